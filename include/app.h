@@ -31,11 +31,13 @@
 
 
 #define INITPEERS_MAX 256
+#define ANNOUNCEPREFIX_MAX 32
 
 struct s_initconfig {
         char sourceip[CONFPARSER_NAMEBUF_SIZE+1];
         char sourceport[CONFPARSER_NAMEBUF_SIZE+1];
         char tapname[CONFPARSER_NAMEBUF_SIZE+1];
+        char xdpinterface[CONFPARSER_NAMEBUF_SIZE+1];
         char userstr[CONFPARSER_NAMEBUF_SIZE+1];
         char groupstr[CONFPARSER_NAMEBUF_SIZE+1];
         char chrootstr[CONFPARSER_NAMEBUF_SIZE+1];
@@ -49,6 +51,10 @@ struct s_initconfig {
         // counter of initial peers
         int initpeerscount;
 
+        // prefixes announced to the peers in TUN mode
+        char announceprefix[ANNOUNCEPREFIX_MAX][CONFPARSER_NAMEBUF_SIZE+1];
+        int announceprefixcount;
+
         char engines[CONFPARSER_NAMEBUF_SIZE+1];
         char password[CONFPARSER_NAMEBUF_SIZE+1];
         char pidfile[CONFPARSER_NAMEBUF_SIZE+1];
@@ -58,8 +64,17 @@ struct s_initconfig {
         int enablepidfile;
         int enableindirect;
         int enablerelay;
+        int enablebroadcasttree;
         int enableeth;
+        int enabletun;
+        int enableoffload;
+        int enableiouring;
+        int enableudpoffload;
+        int enabledscp;
+        int enablepacketring;
         int enablendpcache;
+        int enablearpcache;
+        int enablemcastsnooping;
         int enablevirtserv;
         int enableipv4;
         int enableipv6;
@@ -71,6 +86,10 @@ struct s_initconfig {
         int daemonize;
         int enableconsole;
         int sockmark;
+        int xdpqueue;
+        int connectrate;
+        int probeinterval;
+        int cryptothreads;
 };
 
 // handle termination signals
@@ -68,13 +68,17 @@
 #define auth_CNEGIVSIZE 16
 
 
+// Message number of cookie challenges.
+#define auth_MSGNUM_COOKIE 0x7FFF
+
+
 // Size of nonces.
 #define auth_NONCESIZE 32
 #define AUTH_NONCESIZE 32
 
 
 // Maximum size of auth messages in bytes.
-#define auth_MAXMSGSIZE_S0 (4 + 2 + 8 + 4 + 4 + netid_SIZE)
+#define auth_MAXMSGSIZE_S0 (4 + 2 + 8 + 4 + 4 + netid_SIZE + auth_COOKIESIZE)
 #define auth_MAXMSGSIZE_S1 (4 + 2 + 8 + 4 + auth_NONCESIZE + 2 + dh_MAXSIZE)
 #define auth_MAXMSGSIZE_S2 (4 + 2 + 2 + nodekey_MAXSIZE + 2 + nodekey_MAXSIZE + auth_HMACSIZE + auth_IDPIVSIZE + auth_IDPHMACSIZE + crypto_MAXIVSIZE)
 #define auth_MAXMSGSIZE_S3 (4 + 2 + auth_NONCESIZE + seq_SIZE + 4 + 8 + auth_CNEGIVSIZE + auth_CNEGHMACSIZE + crypto_MAXIVSIZE)
@@ -127,6 +131,8 @@ struct s_auth_state {
         int remote_dhkey_size;
         int nextmsg_size;
         int local_cneg_set;
+        int cookie_size;
+        unsigned char cookie[auth_COOKIESIZE];
         unsigned char local_authid[4];
         unsigned char remote_authid[4];
         unsigned char local_flags[8];
@@ -162,6 +168,9 @@ int authGenSigIn(struct s_auth_state *authstate, unsigned char *siginbuf, const
 // Generate auth message S0
 void authGenS0(struct s_auth_state *authstate);
 
+// Verify length, checksum and NetID of auth message S0. Returns 1 if the message is valid.
+int authVerifyS0(const struct s_netid *netid, const unsigned char *msg, const int msg_len);
+
 // Decode auth message S0
 int authDecodeS0(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len);
 
@@ -189,6 +198,9 @@ void authGenS4(struct s_auth_state *authstate);
 // Decode auth message S4
 int authDecodeS4(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len);
 
+// Decode cookie challenge. Returns 1 if the cookie has been accepted.
+int authDecodeCookie(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len);
+
 // Generate auth message
 void authGenMsg(struct s_auth_state *authstate);
 
@@ -137,6 +137,9 @@ void printMacTable();
 // print table of ndp cache
 void printNDPTable();
 
+// print table of arp cache
+void printARPTable();
+
 // parse command
 void decodeConsole(char *cmd, int cmdlen);
 
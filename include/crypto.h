@@ -44,6 +44,9 @@
 #define crypto_MAXIVSIZE EVP_MAX_IV_LENGTH
 #define crypto_MAXHMACSIZE EVP_MAX_MD_SIZE
 
+// maximum number of buffers that share one IV generation
+#define crypto_BATCHMAX 64
+
 
 // cipher context storage
 struct s_crypto {
@@ -53,6 +56,19 @@ struct s_crypto {
 };
 
 
+// batch item, pre_buf is encrypted in front of in_buf (encryption only)
+struct s_crypto_batch {
+        struct s_crypto *ctx;
+        unsigned char *out_buf;
+        int out_len;
+        const unsigned char *pre_buf;
+        int pre_len;
+        const unsigned char *in_buf;
+        int in_len;
+        int result;
+};
+
+
 // cipher pointer storage
 struct s_crypto_cipher {
         const EVP_CIPHER *cipher;
@@ -92,6 +108,9 @@ int cryptoSetKeysRandom(struct s_crypto *ctxs, const int count);
 // destroy cipher contexts
 void cryptoDestroy(struct s_crypto *ctxs, const int count);
 
+// copy cipher contexts, the copy can be used by another thread than the original
+int cryptoCopy(struct s_crypto *dst_ctx, struct s_crypto *src_ctx);
+
 // create cipher contexts
 int cryptoCreate(struct s_crypto *ctxs, const int count);
 
@@ -107,6 +126,12 @@ int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, c
 // decrypt buffer
 int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len);
 
+// encrypt multiple buffers of one or several sessions. Sets the result of each item to the encrypted length, or 0 on error. Returns the number of encrypted buffers.
+int cryptoEncBatch(struct s_crypto_batch *batch, const int count, const int hmac_len, const int iv_len);
+
+// decrypt multiple buffers of one or several sessions. Sets the result of each item to the decrypted length, or 0 on error. Returns the number of decrypted buffers.
+int cryptoDecBatch(struct s_crypto_batch *batch, const int count, const int hmac_len, const int iv_len);
+
 // calculate hash
 int cryptoCalculateHash(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len, const EVP_MD *hash_func);
 
@@ -116,6 +141,9 @@ int cryptoCalculateSHA256(unsigned char *hash_buf, const int hash_len, const uns
 // calculate SHA-512 hash
 int cryptoCalculateSHA512(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len);
 
+// allow the use of separate cipher contexts from several threads
+int cryptoEnableThreads();
+
 // generate session keys from password
 int cryptoSetSessionKeysFromPassword(struct s_crypto *session_ctx, const unsigned char *password, const int password_len, const int cipher_algorithm, const int hmac_algorithm);
 
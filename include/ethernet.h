@@ -31,6 +31,60 @@ struct s_checksum {
 };
 
 
+
+// Constants.
+#define gso_VNETHDR_SIZE 10
+#define gso_FLAG_NEEDS_CSUM 0x01
+#define gso_TYPE_NONE 0
+#define gso_TYPE_TCPV4 1
+#define gso_TYPE_TCPV6 4
+#define gso_TYPE_ECN 0x80
+#define gso_SEGBUF_SIZE 9216
+
+
+// GSO structures.
+struct s_gso_state {
+        unsigned char *frame;
+        int frame_len;
+        int type;
+        int mss;
+        int l3off;
+        int l4off;
+        int hdrlen;
+        int pos;
+        int segno;
+        int done;
+};
+
+
+
+// Constants.
+#define gro_BUF_SIZE (65536 + 64)
+
+
+// GRO structures.
+struct s_gro_state {
+        unsigned char *buf;
+        unsigned char vnethdr[gso_VNETHDR_SIZE];
+        int len;
+        int count;
+        int closed;
+        int peerid;
+        int peerct;
+        int l3off;
+        int l4off;
+        int hdrlen;
+        int v6;
+        int mss;
+        uint32_t nextseq;
+};
+
+
+// Constants.
+#define qos_DSCP_MASK 0xfc
+
+
+
 // Constants.
 #define virtserv_LISTENADDR_COUNT 8
 #define virtserv_ADDR_SIZE 16
@@ -59,10 +113,18 @@ struct s_virtserv_state {
 #define switch_FRAME_TYPE_INVALID 0
 #define switch_FRAME_TYPE_BROADCAST 1
 #define switch_FRAME_TYPE_UNICAST 2
+#define switch_FRAME_TYPE_MULTICAST 3
 #define switch_FRAME_MINSIZE 14
 #define switch_MACADDR_SIZE 6
 #define switch_MACMAP_SIZE 8192
 #define switch_TIMEOUT 86400
+#define switch_MCASTMAP_SIZE 256
+#define switch_MCAST_MAXMEMBERS 16
+#define switch_MCAST_MAXROUTERS 4
+#define switch_MCAST_TIMEOUT 260
+#define switch_MCAST_LEAVETIMEOUT 2
+#define switch_LOCALMAP_SIZE 256
+#define switch_LOCAL_TIMEOUT 300
 
 
 // Constraints.
@@ -79,9 +141,29 @@ struct s_switch_mactable_entry {
         int portid;
         int portts;
         int ents;
+        int dataents;
+};
+struct s_switch_local_entry {
+        int ents;
+};
+struct s_switch_mcast_member {
+        int portid;
+        int portts;
+        int ents;
+};
+struct s_switch_mcast_entry {
+        struct s_switch_mcast_member member[switch_MCAST_MAXMEMBERS];
+        int count;
+        int floodents;
 };
 struct s_switch_state {
         struct s_map mactable;
+        struct s_map mcasttable;
+        struct s_map localtable;
+        struct s_switch_mcast_member mcastrouter[switch_MCAST_MAXROUTERS];
+        int mcastroutercount;
+        int mcastlocalqueryents;
+        int mcastsnoop;
 };
 
 
@@ -114,15 +196,110 @@ struct s_ndp6_state {
         struct s_map ndptable;
 };
 
+
+
+// Constants.
+#define arp4_TABLE_SIZE 1024
+#define arp4_ADDR_SIZE 4
+#define arp4_MAC_SIZE 6
+#define arp4_TIMEOUT 600
+
+
+// Constraints.
+#if arp4_ADDR_SIZE != 4
+#error arp4_ADDR_SIZE != 4
+#endif
+#if arp4_MAC_SIZE != 6
+#error arp4_MAC_SIZE != 6
+#endif
+
+
+// ARP4 structures.
+struct s_arp4_arptable_entry {
+        unsigned char mac[arp4_MAC_SIZE];
+        int portid;
+        int portts;
+        int ents;
+};
+
+struct s_arp4_state {
+        struct s_map arptable;
+};
+
+
+
+// Constants.
+#define route_ADDR_SIZE 16
+#define route_IPV4_OFFSET 96
+#define route_NODE_MAX 4096
+#define route_LOCAL_MAX 32
+#define route_TIMEOUT 180
+#define route_ADVERT_ENTRYSIZE (1 + route_ADDR_SIZE)
+
+
+// Route structures.
+struct s_route_node {
+        unsigned char prefix[route_ADDR_SIZE];
+        int plen;
+        int child[2];
+        int hasroute;
+        int portid;
+        int portts;
+        int ents;
+};
+
+struct s_route_local {
+        unsigned char prefix[route_ADDR_SIZE];
+        int plen;
+};
+
+struct s_route_state {
+        struct s_route_node *node;
+        int nodecount;
+        int root;
+        struct s_route_local local[route_LOCAL_MAX];
+        int localcount;
+};
+
 // Zeroes the checksum.
 void checksumZero(struct s_checksum *cs);
 
 // Adds 16 bit to the checksum.
 void checksumAdd(struct s_checksum *cs, const uint16_t x);
 
+// Adds a buffer to the checksum. An odd trailing byte is padded with zero.
+void checksumAddBuf(struct s_checksum *cs, const unsigned char *buf, const int len);
+
 // Get checksum
 uint16_t checksumGet(struct s_checksum *cs);
 
+// Prepare segmentation of a frame read from the TAP device. If vnethdr is set, the frame is prefixed with a virtio-net header. Returns 1 if the frame can be sent.
+int gsoInit(struct s_gso_state *gso, unsigned char *buf, const int buf_len, const int vnethdr, const int l2);
+
+// Get next segment of the frame. Returns length of the segment, or 0 if there are no more segments.
+int gsoNext(struct s_gso_state *gso, unsigned char *segbuf, const int segbuf_len, unsigned char **seg);
+
+// Append frame to the pending superframe. Returns 1 if the frame has been coalesced.
+int groAppend(struct s_gro_state *gro, const unsigned char *frame, const int frame_len, const int peerid, const int peerct, const int l2);
+
+// Start a new pending superframe with frame. The previous superframe has to be taken with groGet first. Returns 1 if the frame has been stored.
+int groStart(struct s_gro_state *gro, const unsigned char *frame, const int frame_len, const int peerid, const int peerct, const int l2);
+
+// Take the pending superframe and its virtio-net header. Returns length of the frame, or 0 if there is none.
+int groGet(struct s_gro_state *gro, unsigned char **vnethdr, unsigned char **frame);
+
+// Returns 1 if a superframe is pending.
+int groPending(struct s_gro_state *gro);
+
+// Create GRO structure.
+int groCreate(struct s_gro_state *gro);
+
+// Destroy GRO structure.
+void groDestroy(struct s_gro_state *gro);
+
+// Get the DSCP of an IPv4 or IPv6 frame read from the TAP device. If l2 is set, the frame starts with an ethernet header. Returns the IPv4 TOS or IPv6 traffic class with cleared ECN bits, or 0 if the frame is not an IP packet.
+int qosGetTOS(const unsigned char *frame, const int frame_len, const int l2);
+
 
 // Learn MAC+PortID+PortTS of incoming IPv6 packet.
 void ndp6PacketIn(struct s_ndp6_state *ndpstate, const unsigned char *frame, const int frame_len, const int portid, const int portts);
@@ -142,12 +319,69 @@ int ndp6Create(struct s_ndp6_state *ndpstate);
 // Destroy NDP6 structure.
 void ndp6Destroy(struct s_ndp6_state *ndpstate);
 
+// Learn MAC+PortID+PortTS of incoming ARP or IPv4 packet.
+void arp4PacketIn(struct s_arp4_state *arpstate, const unsigned char *frame, const int frame_len, const int portid, const int portts);
+
+// Generate ARP reply. Returns length of generated answer.
+int arp4GenReplyFrame(unsigned char *outbuf, const int outbuf_len, const unsigned char *src_addr, const unsigned char *dest_addr, const unsigned char *src_mac, const unsigned char *dest_mac);
+
+// Scan Ethernet frame for ARP request and generate answer ARP reply. Returns length of generated answer.
+int arp4GenReply(struct s_arp4_state *arpstate, const unsigned char *frame, const int frame_len, unsigned char *replybuf, const int replybuf_len, int *portid, int *portts);
+
+// Generate ARP table status report.
+void arp4Status(struct s_arp4_state *arpstate, char *report, const int report_len);
+
+// Create ARP4 structure.
+int arp4Create(struct s_arp4_state *arpstate);
+
+// Destroy ARP4 structure.
+void arp4Destroy(struct s_arp4_state *arpstate);
+
+// Parse IPv4 or IPv6 prefix in "address/length" notation. IPv4 prefixes are mapped to ::ffff:0:0/96. If host is set, the length is ignored.
+int routeParsePrefix(unsigned char *prefix, int *plen, const char *str, const int str_len, const int host);
+
+// Add local prefix that is announced to the peers.
+int routeAddLocal(struct s_route_state *routestate, const char *str, const int str_len, const int host);
+
+// Generate advertisement of local prefixes. Returns length of generated advertisement.
+int routeGenAdvert(struct s_route_state *routestate, unsigned char *advbuf, const int advbuf_len);
+
+// Replace the routes of a peer with the prefixes it advertised.
+void routeAdvertIn(struct s_route_state *routestate, const unsigned char *advert, const int advert_len, const int portid, const int portts);
+
+// Get PortID and PortTS of the longest matching prefix for the destination of outgoing IP packet. Returns 1 if a route is found.
+int routePacketOut(struct s_route_state *routestate, const unsigned char *packet, const int packet_len, int *portid, int *portts);
+
+// Create route structure.
+int routeCreate(struct s_route_state *routestate);
+
+// Destroy route structure.
+void routeDestroy(struct s_route_state *routestate);
+
 // Get type of outgoing frame. If it is an unicast frame, also returns PortID and PortTS.
 int switchFrameOut(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, int *portid, int *portts);
 
 // Learn PortID+PortTS of incoming frame.
 void switchFrameIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, const int portid, const int portts);
 
+// Check whether incoming frame should be written to the local TAP device. IGMPv1/v2 and MLDv1 reports of remote listeners are only delivered if a local querier exists, otherwise they would suppress the reports of local listeners.
+int switchMcastDeliverIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len);
+
+// Get PortIDs and PortTSs of the members of the multicast group of outgoing frame, including multicast router ports. Returns number of members.
+int switchMcastMembers(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, int *portid, int *portts, const int max);
+
+// Enable or disable IGMP/MLD snooping.
+void switchSetMcastSnooping(struct s_switch_state *switchstate, const int enable);
+
+// Learn source MAC of frame read from the local TAP device.
+void switchLocalFrameIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len);
+
+// Generate advertisement of recently seen local MAC addresses. Returns length of generated advertisement.
+int switchGenMacAdvert(struct s_switch_state *switchstate, unsigned char *advbuf, const int advbuf_len);
+
+// Learn PortID+PortTS of MAC addresses advertised by a peer.
+void switchMacAdvertIn(struct s_switch_state *switchstate, const unsigned char *advert, const int advert_len, const int portid, const int portts);
+
 // Generate MAC table status report.
 void switchStatus(struct s_switch_state *switchstate, char *report, const int report_len);
 
@@ -54,12 +54,19 @@ int g_mainloop;
 
 struct s_switch_state g_switchstate;
 struct s_ndp6_state g_ndpstate;
+struct s_arp4_state g_arpstate;
+struct s_route_state g_routestate;
+struct s_gro_state g_grostate;
 struct s_virtserv_state g_virtserv;
 
 int g_enableconsole;
 int g_enableeth;
+int g_enabletun;
+int g_enablegro;
 int g_enablendpcache;
+int g_enablearpcache;
 int g_enablevirtserv;
+int g_enabledscp;
 int g_enableengines;
 
 #endif
@@ -80,6 +80,43 @@
 #define IO_TYPE_SOCKET_V6 1
 #define IO_TYPE_SOCKET_V4 2
 #define IO_TYPE_FILE 3
+#define IO_TYPE_PACKET 4
+#define IO_TYPE_XDP 5
+
+#define IO_VNETHDR_SIZE 10
+#define IO_VNETHDR_BUFSIZE (65536 + 64)
+
+#define IO_UDPGSO_BUFSIZE 65000
+#define IO_UDPGSO_MAXSEGS 64
+#define IO_UDPGRO_BUFSIZE 65536
+
+#define IO_PACKET_BLOCKSIZE (1 << 18)
+#define IO_PACKET_BLOCKNR 16
+#define IO_PACKET_TXBLOCKNR 16
+#define IO_PACKET_FRAMESIZE 16384
+#define IO_PACKET_TIMEOUT 2
+#define IO_PACKET_TXBATCH 64
+
+#define IO_XDP_FRAMESIZE 4096
+#define IO_XDP_FRAMES 4096
+#define IO_XDP_RINGSIZE 2048
+#define IO_XDP_NEIGHBORS 256
+#define IO_XDP_MAXQUEUE 64
+#define IO_XDP_RXBATCH 64
+#define IO_XDP_TXBATCH 64
+
+#define IO_URING_ENTRIES 256
+#define IO_URING_BUFCOUNT 256
+#define IO_URING_BUFMEM (4 * 1024 * 1024)
+#define IO_URING_BUFHDR 256
+#define IO_URING_BGID 0
+#define IO_URING_WSLOTS 128
+#define IO_URING_BATCH 64
+#define IO_URING_OP_RECV 1
+#define IO_URING_OP_WRITE 2
+
+#define IO_RECVERR_BATCH 16
+#define IO_UNREACH_MAX 16
 
 #define IO_ADDRTYPE_NULL "\x00\x00\x00\x00"
 #define IO_ADDRTYPE_UDP6 "\x01\x06\x01\x00"
@@ -110,6 +147,24 @@ struct s_io_handle {
         int content_len;
         int type;
         int open;
+        int vnethdr;
+        unsigned char *content;
+        int uringbuf;
+        int uringarmed;
+        int uringsingle;
+        unsigned char *udpgsobuf;
+        int udpgsolen;
+        int udpgsosize;
+        int udpgsocount;
+        struct sockaddr_storage udpgsoaddr;
+        socklen_t udpgsoaddr_len;
+        int udpgsotos;
+        unsigned char *udpgrobuf;
+        int udpgrolen;
+        int udpgropos;
+        int udpgrosize;
+        void *packetring;
+        void *xdp;
 #if defined(IO_WINDOWS)
         HANDLE fd_h;
         int open_h;
@@ -131,8 +186,15 @@ struct s_io_state {
         int timeout;
         int sockmark;
         int nat64clat;
+        int offload;
+        int udpoffload;
+        int tos;
+        int recverr;
+        struct s_io_addr unreach[IO_UNREACH_MAX];
+        int unreachcount;
         unsigned char nat64_prefix[12];
         int debug;
+        void *uring;
 };
 
 
@@ -174,8 +236,14 @@ HANDLE ioOpenTAPWINHandle(char *tapname, const char *reqname, const int reqname_
 #endif
 
 
-// Opens a TAP device. Returns handle ID if succesful, or -1 on error.
-int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname);
+// Opens a TAP device, or a TUN device if tun is set. Returns handle ID if succesful, or -1 on error.
+int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname, const int tun);
+
+// Attaches to the existing network interface reqname with memory-mapped AF_PACKET rings, frames are read and written like on a TAP device. Returns handle ID if succesful, or -1 on error.
+int ioOpenPacketRing(struct s_io_state *iostate, char *ifname, const char *reqname);
+
+// Attaches an AF_XDP socket in copy mode to queue of network interface ifname and steers UDP packets to port into it. Returns handle ID if succesful, or -1 on error.
+int ioOpenXDP(struct s_io_state *iostate, const char *ifname, const int queue, const char *port);
 
 // Opens STDIN. Returns handle ID if succesful, or -1 on error.
 int ioOpenSTDIN(struct s_io_state *iostate);
@@ -189,8 +257,16 @@ int ioHelperFinishRecvFrom(struct s_io_handle *handle);
 #endif
 
 
-// Sends an UDP packet. Returns length of sent message.
-int ioHelperSendTo(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len);
+// Sends an UDP packet. If tos is set, it is used as IPv4 TOS or IPv6 traffic class of the packet. Returns length of sent message.
+int ioHelperSendTo(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos);
+
+#if defined(IO_LINUX)
+// Receives UDP packets that the kernel may have coalesced, the size of the coalesced packets is stored in segment_size. Returns length of received data.
+int ioHelperRecvFromGRO(struct s_io_handle *handle, unsigned char *recv_buf, const int recv_buf_size, struct sockaddr *source_sockaddr, socklen_t *source_sockaddr_len, int *segment_size);
+
+// Sends UDP packets of segment_size bytes each (the last one may be shorter) with a single system call. If tos is set, it is used for all packets. Returns length of sent data.
+int ioHelperSendSegments(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const int segment_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos);
+#endif
 
 // Reads from file. Returns amount of bytes read, or 0 if nothing is read.
 int ioHelperReadFile(struct s_io_handle *handle, unsigned char *read_buf, const int read_buf_size);
@@ -200,8 +276,8 @@ int ioHelperReadFile(struct s_io_handle *handle, unsigned char *read_buf, const
 int ioHelperFinishReadFile(struct s_io_handle *handle);
 #endif
 
-// Writes to file. Returns amount of bytes written.
-int ioHelperWriteFile(struct s_io_handle *handle, const unsigned char *write_buf, const int write_buf_size);
+// Writes to file. If the handle expects a virtio-net header, vnethdr is prepended, or an empty header if vnethdr is NULL. Returns amount of bytes written.
+int ioHelperWriteFile(struct s_io_handle *handle, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size);
 
 // Prepares read operation on specified handle ID.
 void ioPreRead(struct s_io_state *iostate, const int id);
@@ -209,6 +285,9 @@ void ioPreRead(struct s_io_state *iostate, const int id);
 // Reads data on specified handle ID. Returns amount of bytes read, or 0 if nothing is read.
 int ioRead(struct s_io_state *iostate, const int id);
 
+// Sends the queued UDP packets and packet ring frames of all handles.
+void ioFlush(struct s_io_state *iostate);
+
 // Waits for data on any handle and read it. Returns the amount of handles where data have been read.
 int ioReadAll(struct s_io_state *iostate);
 
@@ -218,6 +297,9 @@ int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write
 // Writes data on one handle ID of the specified group. Returns amount of bytes written.
 int ioWriteGroup(struct s_io_state *iostate, const int group, const unsigned char *write_buf, const int write_buf_size, const struct s_io_addr *destination_addr);
 
+// Writes an offloaded frame with the specified virtio-net header on one handle ID of the specified group. Only handles that expect a virtio-net header are used. Returns amount of bytes written.
+int ioWriteVnetHdrGroup(struct s_io_state *iostate, const int group, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size);
+
 // Returns the first handle of the specified group that has data, or -1 if there is none.
 int ioGetGroup(struct s_io_state *iostate, const int group);
 
@@ -230,6 +312,9 @@ int ioGetDataLen(struct s_io_state *iostate, const int id);
 // Returns a pointer to the current source address of the specified handle ID.
 struct s_io_addr * ioGetAddr(struct s_io_state *iostate, const int id);
 
+// Pops a destination address that has been reported unreachable by ICMP. Returns 1 if an address has been returned.
+int ioGetUnreachable(struct s_io_state *iostate, struct s_io_addr *addr);
+
 // Clear data of the specified handle ID.
 void ioGetClear(struct s_io_state *iostate, const int id);
 
@@ -242,7 +327,25 @@ void ioSetSockmark(struct s_io_state *iostate, const int io_sockmark);
 // Enable/Disable NAT64 CLAT support.
 void ioSetNat64Clat(struct s_io_state *iostate, const int enable);
 
-// Set IO read timeout (in seconds).
+// Enable/Disable segmentation and checksum offload for new TAP devices.
+void ioSetOffload(struct s_io_state *iostate, const int enable);
+
+// Enable/Disable UDP segmentation and receive coalescing for new sockets.
+void ioSetUdpOffload(struct s_io_state *iostate, const int enable);
+
+// Set the IPv4 TOS or IPv6 traffic class of the UDP packets that are written next.
+void ioSetTOS(struct s_io_state *iostate, const int tos);
+
+// Enable/Disable the reception of ICMP errors on new sockets.
+void ioSetRecvErr(struct s_io_state *iostate, const int enable);
+
+// Returns 1 if data of handle ID is prefixed with a virtio-net header.
+int ioGetVnetHdr(struct s_io_state *iostate, const int id);
+
+// Switch to the io_uring backend. Has to be called after all handles have been opened. Returns 1 on success.
+int ioEnableUring(struct s_io_state *iostate);
+
+// Set IO read timeout (in milliseconds).
 void ioSetTimeout(struct s_io_state *iostate, const int io_timeout);
 
 // Closes all handles and resets defaults.
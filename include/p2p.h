@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "nodeid.h"
 #include "dh.h"
@@ -69,9 +70,18 @@ struct s_nodedb_addrdata {
         int lastconnect_t;
         int lastconntry;
         int lastconntry_t;
+        int failcount;
+        int rtt;
+        int jitter;
 };
 
 
+// NodeDB connection backoff settings.
+#define nodedb_BACKOFF_MIN 1
+#define nodedb_BACKOFF_MAX 600
+#define nodedb_BACKOFF_MAXSHIFT 10
+
+
 // The NodeDB structure.
 struct s_nodedb {
         struct s_map *addrdb;
@@ -120,17 +130,127 @@ struct s_nodedb {
 #define peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN 300
 
 
+// Delta peerinfo settings. The full refresh has to reach the peer before its RelayDB entries expire (peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN).
+#define peermgt_PEERINFO_DELTA 1
+#define peermgt_PEERINFO_DELTA_HDRSIZE 12
+#define peermgt_PEERINFO_DELTA_INTERVAL 1
+#define peermgt_PEERINFO_FULL_INTERVAL 240
+#define peermgt_KEEPALIVE_SIZE 8
+
+
+// Group key settings.
+#define peermgt_GROUPKEY_SECRETSIZE 32
+#define peermgt_GROUPKEY_MSGSIZE (4 + seq_SIZE + peermgt_GROUPKEY_SECRETSIZE)
+#define peermgt_GROUPKEY_INTERVAL 600
+#define peermgt_GROUPKEY_RESEND 3
+#define peermgt_GROUPKEY_KEY 0
+#define peermgt_GROUPKEY_ACK 1
+#define peermgt_GROUPBUF_SIZE (peermgt_MSGSIZE_MAX + 128)
+
+
+// Broadcast tree settings.
+#define peermgt_BCAST_FANOUT 4
+#define peermgt_BCAST_HDRSIZE (nodeid_SIZE + seq_SIZE + 2)
+#define peermgt_BCAST_DEDUP_SIZE 1024
+#define peermgt_BCAST_FWDQ_SIZE 8
+#define peermgt_BCAST_DIRECT -1
+#define peermgt_BCAST_COVERED -2
+
+
+// MAC advertisement settings.
+#define peermgt_MACADV_SIZE 1020
+#define peermgt_MACADV_INTERVAL 60
+
+
+// Route advertisement settings.
+#define peermgt_ROUTEADV_SIZE 1020
+#define peermgt_ROUTEADV_INTERVAL 60
+
+
+// Userdata bundle settings.
+#define peermgt_BUNDLE_SIZE peermgt_MSGSIZE_MIN
+#define peermgt_BUNDLE_FRAMEMAX 256
+#define peermgt_BUNDLE_HDRSIZE 2
+
+
+// Connection scheduler settings.
+#define peermgt_CONNECT_RATE_DEFAULT 16
+#define peermgt_CONNECT_RATE_MAX 256
+
+
+// Transmit scheduler settings. Control packets have strict priority, user data is served by deficit round robin.
+#define peermgt_CTRLQ_SIZE 16
+#define peermgt_RELAYQ_SIZE 32
+#define peermgt_RELAYQ_PEERMAX 8
+#define peermgt_TXQ_QUANTUM peermgt_MSGSIZE_MIN
+
+
+// User data with a DSCP of at least this class (CS5, VA, EF, CS6, CS7) is latency sensitive. It is not bundled and bypasses the round robin.
+#define peermgt_DSCP_HIGH 40
+
+
+// Path probing settings (in milliseconds). A peer that carries user data is probed every probe interval when nothing has been received from it for that long, its path is considered down after peermgt_PROBE_MULTIPLIER intervals without any received packet. Peers without user data for peermgt_PROBE_IDLE_TIME are probed at the keepalive interval.
+#define peermgt_PROBE_INTERVAL_DEFAULT 500
+#define peermgt_PROBE_INTERVAL_MIN 50
+#define peermgt_PROBE_INTERVAL_MAX 10000
+#define peermgt_PROBE_MULTIPLIER 3
+#define peermgt_PROBE_RECOVER_INTERVAL 1000
+#define peermgt_PROBE_IDLE_TIME (peermgt_KEEPALIVE_INTERVAL * 1000)
+#define peermgt_PROBE_IDLE_INTERVAL (peermgt_KEEPALIVE_INTERVAL * 1000)
+
+
+// Ping payload layout. A ping carries its send time in milliseconds and its type, the pong echoes the payload.
+#define peermgt_PING_TIMEPOS 0
+#define peermgt_PING_TYPEPOS 8
+#define peermgt_PING_PATH 0
+#define peermgt_PING_MEASURE 1
+
+
+// RTT measurement settings. The RTT of every peer is measured every peermgt_RTT_INTERVAL seconds, relayed peers also measure their other relays and switch if another relay is faster by at least peermgt_RELAY_SWITCH_PERCENT. Paths are compared by SRTT plus jitter.
+#define peermgt_RTT_MAX 10000
+#define peermgt_RTT_INTERVAL 10
+#define peermgt_RELAY_SWITCH_PERCENT 20
+
+
+// Session resumption settings.
+#define peermgt_TICKET_SECRETSIZE 32
+#define peermgt_TICKET_NONCESIZE 32
+#define peermgt_TICKET_HMACSIZE 32
+#define peermgt_TICKET_IVSIZE 16
+#define peermgt_TICKET_PLAINSIZE (nodeid_SIZE + peermgt_TICKET_SECRETSIZE + 4)
+#define peermgt_TICKET_MAXSIZE 160
+#define peermgt_TICKET_INTERVAL 1800
+#define peermgt_TICKET_LIFETIME 3600
+#define peermgt_TICKET_KEY_INTERVAL 1800
+#define peermgt_RESUME_TIMEOUT 5
+#define peermgt_RESUME_HDRSIZE (nodeid_SIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE + 8)
+#define peermgt_RESUME_REPLAY_SIZE 4096
+#define peermgt_RESUME_MSGSIZE (peermgt_RESUME_HDRSIZE + 2 + peermgt_TICKET_MAXSIZE + peermgt_TICKET_HMACSIZE)
+#define peermgt_RESUMEQ_SIZE 16
+
+
+// Resume message types.
+#define peermgt_RESUME_REQUEST 0
+#define peermgt_RESUME_ACK 1
+
+
+// Resume states.
+#define peermgt_RESUME_NONE 0
+#define peermgt_RESUME_PENDING 1
+#define peermgt_RESUME_UNCONFIRMED 2
+
+
 // Flags.
 #define peermgt_FLAG_USERDATA 0x0001
 #define peermgt_FLAG_RELAY 0x0002
-#define peermgt_FLAG_F03 0x0004
-#define peermgt_FLAG_F04 0x0008
-#define peermgt_FLAG_F05 0x0010
-#define peermgt_FLAG_F06 0x0020
-#define peermgt_FLAG_F07 0x0040
-#define peermgt_FLAG_F08 0x0080
-#define peermgt_FLAG_F09 0x0100
-#define peermgt_FLAG_F10 0x0200
+#define peermgt_FLAG_TICKET 0x0004
+#define peermgt_FLAG_DELTA 0x0008
+#define peermgt_FLAG_GROUPKEY 0x0010
+#define peermgt_FLAG_BCAST 0x0020
+#define peermgt_FLAG_MACADV 0x0040
+#define peermgt_FLAG_ROUTEADV 0x0080
+#define peermgt_FLAG_BUNDLE 0x0100
+#define peermgt_FLAG_PINGTYPE 0x0200
 #define peermgt_FLAG_F11 0x0400
 #define peermgt_FLAG_F12 0x0800
 #define peermgt_FLAG_F13 0x1000
@@ -146,6 +266,18 @@ struct s_nodedb {
 #if peermgt_PINGBUF_SIZE > peermgt_MSGSIZE_MIN
 #error peermgt_PINGBUF_SIZE too big
 #endif
+#if peermgt_PEERINFO_FULL_INTERVAL >= peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN
+#error peermgt_PEERINFO_FULL_INTERVAL too big
+#endif
+#if peermgt_RESUME_MSGSIZE > peermgt_MSGSIZE_MIN
+#error peermgt_TICKET_MAXSIZE too big
+#endif
+#if peermgt_MACADV_SIZE > peermgt_MSGSIZE_MIN
+#error peermgt_MACADV_SIZE too big
+#endif
+#if peermgt_ROUTEADV_SIZE > peermgt_MSGSIZE_MIN
+#error peermgt_ROUTEADV_SIZE too big
+#endif
 
 // NetID size in bytes.
 #define netid_SIZE 32
@@ -182,12 +314,94 @@ struct s_peermgt_data {
         int lastsend;
         int lastpeerinfo;
         int lastpeerinfosendpeerid;
+        int lastinfodelta;
+        int infoversion;
+        int infoacked;
+        int infoackdue;
+        int remoteinfoversion;
+        int groupkeyid;
+        int groupkeysent;
+        int groupkeyacked;
+        int groupkeyackdue;
+        int lastgroupkey;
+        struct s_seq_state groupseq;
+        int macadvsent;
+        int lastmacadv;
+        int routeadvsent;
+        int lastrouteadv;
         struct s_peeraddr remoteaddr;
         int remoteflags;
         int remoteid;
         int64_t remoteseq;
         struct s_seq_state seq;
         int state;
+        int lastticket;
+        int resumestate;
+        unsigned char resumenonce[peermgt_TICKET_NONCESIZE];
+        int ctxgen;
+        int relayqhead;
+        int relayqtail;
+        int relayqlen;
+        int txdeficit;
+        int txactive;
+        int64_t lastrecvms;
+        int64_t lastdatams;
+        int64_t activems;
+        int64_t lastprobe;
+        int64_t lastrecover;
+        int failover;
+        struct s_peeraddr directaddr;
+        int srtt;
+        int jitter;
+        int lastrtt;
+};
+
+
+// A queued ping, pong or other request-response message.
+struct s_peermgt_ctrlmsg {
+        int peerid;
+        int type;
+        int usetargetaddr;
+        struct s_peeraddr targetaddr;
+        int len;
+        unsigned char msg[peermgt_PINGBUF_SIZE];
+};
+
+
+// A queued resume request or acknowledgement. Resume messages are sent without a session.
+struct s_peermgt_resumemsg {
+        int type;
+        struct s_peeraddr targetaddr;
+        int len;
+        unsigned char msg[peermgt_RESUME_MSGSIZE];
+};
+
+
+// A queued broadcast message that is forwarded to the peers of our partition.
+struct s_peermgt_bcastfwd {
+        int from;
+        int next;
+        int len;
+        unsigned char msg[peermgt_MSGSIZE_MAX];
+};
+
+
+// A queued relay-out message. Entries are linked to the queue of the peer that sent them.
+struct s_peermgt_relaymsg {
+        int next;
+        int targetpeerid;
+        int len;
+        unsigned char msg[peermgt_MSGSIZE_MAX];
+};
+
+
+// The session resumption ticket structure (cached per NodeID).
+struct s_peermgt_ticket {
+        int recvtime;
+        int resumetime;
+        int len;
+        unsigned char secret[peermgt_TICKET_SECRETSIZE];
+        unsigned char ticket[peermgt_TICKET_MAXSIZE];
 };
 
 
@@ -198,16 +412,143 @@ struct s_peermgt_data {
 #define AUTHMGT_RECV_TIMEOUT 30
 #define AUTHMGT_RESEND_TIMEOUT 3
 
+
+// Cookie settings. Cookies are required once more than half of the auth slots are in use or the rate of new sessions exceeds the limit.
+// Peers that don't support cookies are still admitted under load as long as less than authmgt_COOKIE_LEGACY_PERCENT of the auth slots are in use.
+#define authmgt_COOKIE_INTERVAL 30
+#define authmgt_COOKIE_MAXRATE 16
+#define authmgt_COOKIE_LEGACY_PERCENT 75
+
+
+// Size of stateless cookies and of cookie challenges (remote auth ID, msgnum, cookie).
+#define auth_COOKIESIZE 16
+#define auth_MSGSIZE_COOKIE (4 + 2 + auth_COOKIESIZE)
+
+
+// Number of cookie challenges that can wait to be sent.
+#define authmgt_COOKIEQ_SIZE 16
+
+
+// A queued cookie challenge.
+struct s_authmgt_cookiemsg {
+        struct s_peeraddr targetaddr;
+        int len;
+        unsigned char msg[auth_MSGSIZE_COOKIE];
+};
+
 // The auth manager structure.
 struct s_authmgt {
         struct s_idsp idsp;
         struct s_auth_state *authstate;
         struct s_peeraddr *peeraddr;
+        struct s_map addrmap;
+        int *freelist;
+        int *freepos;
+        int freecount;
+        int nextdue;
+        int *raceid;
+        int *racenext;
+        int racecount;
+        int racelast;
         int *lastrecv;
         int *lastsend;
         int fastauth;
         int current_authed_id;
         int current_completed_id;
+        struct s_netid *netid;
+        struct s_crypto cookiectx;
+        int newcount;
+        int newcount_t;
+        struct s_authmgt_cookiemsg cookieq[authmgt_COOKIEQ_SIZE];
+        int cookieqhead;
+        int cookieqcount;
+};
+
+
+// packet data structure
+struct s_packet_data {
+        int peerid;
+        int64_t seq;
+        int pl_length;
+        int pl_type;
+        int pl_options;
+        unsigned char *pl_buf;
+        int pl_buf_size;
+};
+
+
+// Crypto worker pool queues.
+#define cryptpool_QUEUE_ENCODE 0
+#define cryptpool_QUEUE_DECODE 1
+#define cryptpool_QUEUE_COUNT 2
+
+
+// Crypto worker pool settings. Finished packets are collected in the order they were queued, so the number of packets in flight is kept below the width of the replay window.
+#define cryptpool_THREADS_MAX 16
+#define cryptpool_QUEUESIZE 64
+#define cryptpool_INFLIGHT 48
+#define cryptpool_BATCH 16
+#define cryptpool_SPIN 256
+#define cryptpool_BUFSIZE 4096
+#define cryptpool_PLSIZE_MAX (cryptpool_BUFSIZE - packet_PEERID_SIZE - packet_HMAC_SIZE - (2 * packet_IV_SIZE) - packet_CRHDR_SIZE)
+
+
+// Constraints.
+#if (cryptpool_QUEUESIZE & (cryptpool_QUEUESIZE - 1)) != 0
+#error cryptpool_QUEUESIZE is not a power of two
+#endif
+#if (cryptpool_INFLIGHT >= cryptpool_QUEUESIZE) || (cryptpool_INFLIGHT >= 64)
+#error cryptpool_INFLIGHT too big
+#endif
+
+
+// A packet that is encoded or decoded by a crypto worker.
+struct s_cryptpool_job {
+        struct s_packet_data data;
+        struct s_peeraddr addr;
+        struct s_crypto *ctx;
+        int ctxid;
+        int ctxgen;
+        int tos;
+        int len;
+        int result;
+        int done;
+        unsigned char inbuf[cryptpool_BUFSIZE];
+        unsigned char outbuf[cryptpool_BUFSIZE];
+};
+
+
+// A job ring. Job N is processed by worker (N % worker_count), the main thread is the only one that queues and collects jobs.
+struct s_cryptpool_queue {
+        struct s_cryptpool_job *job;
+        unsigned int head;
+        unsigned int tail;
+        int nextworker;
+};
+
+
+// A crypto worker thread.
+struct s_cryptpool_worker {
+        struct s_cryptpool *pool;
+        pthread_t thread;
+        pthread_cond_t wake;
+        unsigned int next[cryptpool_QUEUE_COUNT];
+        int sleeping;
+        int started;
+};
+
+
+// The crypto worker pool structure. Every worker has its own copy of the cipher contexts.
+struct s_cryptpool {
+        struct s_cryptpool_queue queue[cryptpool_QUEUE_COUNT];
+        struct s_cryptpool_worker *worker;
+        struct s_crypto *ctx;
+        int *ctxgen;
+        int *ctxbusy;
+        int ctx_count;
+        int worker_count;
+        int stop;
+        pthread_mutex_t lock;
 };
 
 
@@ -217,34 +558,100 @@ struct s_peermgt {
         struct s_map map;
         struct s_nodedb nodedb;
         struct s_nodedb relaydb;
+        struct s_map ticketdb;
+        struct s_map resumereplay;
         struct s_authmgt authmgt;
         struct s_dfrag dfrag;
         struct s_nodekey *nodekey;
         struct s_peermgt_data *data;
         struct s_crypto *ctx;
+        struct s_crypto ticketctx[2];
+        struct s_crypto resumectx;
+        struct s_crypto *groupctx;
+        struct s_crypto localgroupctx;
+        struct s_map groupmap;
+        unsigned char groupsecret[peermgt_GROUPKEY_SECRETSIZE];
+        int groupkeyid;
+        int groupkeytime;
+        int64_t groupseq;
+        unsigned char groupbuf[peermgt_GROUPBUF_SIZE];
+        int grouplen;
+        struct s_map bcastdedup;
+        int bcasttree;
+        int64_t bcastseq;
+        unsigned char bcastbuf[peermgt_MSGSIZE_MAX];
+        int bcastlen;
+        int bcastparts;
+        int bcastfwdpeer[peermgt_BCAST_FANOUT];
+        struct s_peermgt_bcastfwd bcastfwdq[peermgt_BCAST_FWDQ_SIZE];
+        int bcastfwdqhead;
+        int bcastfwdqcount;
+        unsigned char macadvbuf[peermgt_MACADV_SIZE];
+        int macadvlen;
+        int macadvversion;
+        int macadvsize;
+        int macadvpeerid;
+        unsigned char routeadvbuf[peermgt_ROUTEADV_SIZE];
+        int routeadvlen;
+        int routeadvversion;
+        int routeadvsize;
+        int routeadvpeerid;
+        int ticketkeygen;
+        int ticketkeytime;
+        int infoversion;
         int localflags;
         unsigned char msgbuf[peermgt_MSGSIZE_MAX];
         unsigned char relaymsgbuf[peermgt_MSGSIZE_MAX];
-        unsigned char rrmsgbuf[peermgt_MSGSIZE_MAX];
+        unsigned char resumemsgbuf[peermgt_RESUME_MSGSIZE];
         int msgsize;
         int msgpeerid;
+        int msgbundle;
+        int msgbundlepos;
         struct s_msg outmsg;
         int outmsgpeerid;
         int outmsgbroadcast;
         int outmsgbroadcastcount;
-        struct s_msg rrmsg;
-        int rrmsgpeerid;
-        int rrmsgtype;
-        int rrmsgusetargetaddr;
-        struct s_peeraddr rrmsgtargetaddr;
+        int outmsgtos;
+        int usertos;
+        int txtos;
+        struct s_peermgt_ctrlmsg ctrlq[peermgt_CTRLQ_SIZE];
+        int ctrlqhead;
+        int ctrlqcount;
+        struct s_peermgt_relaymsg *relayq;
+        int relayqfree;
+        int *txflow;
+        int txflowhead;
+        int txflowcount;
+        int txflowsize;
+        int txcredited;
+        int txctrltime;
+        int txctrlscan;
+        int probeinterval;
+        int64_t probetime;
+        int rtttime;
+        struct s_peermgt_resumemsg resumeq[peermgt_RESUMEQ_SIZE];
+        int resumeqhead;
+        int resumeqcount;
         int loopback;
         int fragmentation;
         int fragoutpeerid;
         int fragoutcount;
         int fragoutsize;
         int fragoutpos;
+        unsigned char bundlebuf[peermgt_BUNDLE_SIZE];
+        int bundlelen;
+        int bundlecount;
+        int bundlepeerid;
+        int bundleready;
+        int bundletos;
         int lastconntry;
+        int conntrycount;
+        int connectrate;
         int tinit;
+        struct s_cryptpool cryptpool;
+        int cryptthreads;
+        int cryptqueued;
+        int ctxgen;
 };
 
 
@@ -260,6 +667,10 @@ struct s_p2psec {
         int loopback_enable;
         int fastauth_enable;
         int fragmentation_enable;
+        int broadcasttree_enable;
+        int connect_rate;
+        int probe_interval;
+        int cryptthreads;
         int flags;
         char password[1024];
         int password_len;
@@ -294,12 +705,27 @@ void nodedbInit(struct s_nodedb *db);
 // Update NodeDB entry.
 void nodedbUpdate(struct s_nodedb *db, struct s_nodeid *nodeid, struct s_peeraddr *addr, const int update_lastseen, const int update_lastconnect, const int update_lastconntry);
 
+// Returns the retry delay of a NodeDB entry after failed connection attempts.
+int nodedbBackoff(const struct s_nodedb_addrdata *addrdata);
+
 // Returns a NodeDB ID that matches the specified criteria, with explicit nid/tnow.
 int nodedbGetDBIDByID(struct s_nodedb *db, const int nid, const int tnow, const int max_lastseen, const int max_lastconnect, const int min_lastconntry);
 
 // Returns a NodeDB ID that matches the specified criteria.
 int nodedbGetDBID(struct s_nodedb *db, struct s_nodeid *nodeid, const int max_lastseen, const int max_lastconnect, const int min_lastconntry);
 
+// Stores all NodeDB IDs of a NodeID that match the specified criteria in db_ids. Returns the number of stored IDs.
+int nodedbGetDBIDs(struct s_nodedb *db, struct s_nodeid *nodeid, const int max_lastseen, const int max_lastconnect, const int min_lastconntry, int *db_ids, const int db_ids_size);
+
+// Update the smoothed round trip time and jitter of an existing NodeDB entry (in milliseconds).
+void nodedbUpdateRTT(struct s_nodedb *db, const struct s_nodeid *nodeid, const struct s_peeraddr *addr, const int rtt);
+
+// Returns the smoothed round trip time of specified NodeDB ID (in milliseconds), or -1 if it has not been measured.
+int nodedbGetRTT(struct s_nodedb *db, const int db_id);
+
+// Returns the jitter of the round trip time of specified NodeDB ID (in milliseconds), or 0 if it has not been measured.
+int nodedbGetJitter(struct s_nodedb *db, const int db_id);
+
 // Returns node ID of specified NodeDB ID.
 struct s_nodeid *nodedbGetNodeID(struct s_nodedb *db, const int db_id);
 
@@ -312,6 +738,9 @@ int nodedbCreate(struct s_nodedb *db, const int size, const int num_peeraddrs);
 // Destroy NodeDB.
 void nodedbDestroy(struct s_nodedb *db);
 
+// Returns the number of NodeIDs stored in NodeDB.
+int nodedbNodeCount(struct s_nodedb *db);
+
 // Generate NodeDB status report.
 void nodedbStatus(struct s_nodedb *db, char *report, const int report_len);
 
@@ -333,6 +762,10 @@ void nodedbStatus(struct s_nodedb *db, char *report, const int report_len);
 #define packet_CRHDR_PLOPT_START (packet_CRHDR_PLTYPE_START + packet_PLTYPE_SIZE)
 
 
+// maximum amount of decrypted data that is buffered on the stack by one decode batch
+#define packet_DECBATCH_BUFSIZE 65536
+
+
 // @deprecated
 #define packet_PLTYPE_USERDATA 0
 #define packet_PLTYPE_USERDATA_FRAGMENT 1
@@ -342,6 +775,14 @@ void nodedbStatus(struct s_nodedb *db, char *report, const int report_len);
 #define packet_PLTYPE_PONG 5
 #define packet_PLTYPE_RELAY_IN 6
 #define packet_PLTYPE_RELAY_OUT 7
+#define packet_PLTYPE_TICKET 8
+#define packet_PLTYPE_RESUME 9
+#define packet_PLTYPE_KEEPALIVE 10
+#define packet_PLTYPE_GROUPKEY 11
+#define packet_PLTYPE_BCAST 12
+#define packet_PLTYPE_MACADV 13
+#define packet_PLTYPE_ROUTEADV 14
+#define packet_PLTYPE_USERDATA_BUNDLE 15
 
 
 // payload types
@@ -353,6 +794,14 @@ void nodedbStatus(struct s_nodedb *db, char *report, const int report_len);
 #define PACKET_PLTYPE_PONG 5
 #define PACKET_PLTYPE_RELAY_IN 6
 #define PACKET_PLTYPE_RELAY_OUT 7
+#define PACKET_PLTYPE_TICKET 8
+#define PACKET_PLTYPE_RESUME 9
+#define PACKET_PLTYPE_KEEPALIVE 10
+#define PACKET_PLTYPE_GROUPKEY 11
+#define PACKET_PLTYPE_BCAST 12
+#define PACKET_PLTYPE_MACADV 13
+#define PACKET_PLTYPE_ROUTEADV 14
+#define PACKET_PLTYPE_USERDATA_BUNDLE 15
 
 // constraints
 #if packet_PEERID_SIZE != 4
@@ -369,24 +818,29 @@ void nodedbStatus(struct s_nodedb *db, char *report, const int report_len);
 #endif
 
 
-// packet data structure
-struct s_packet_data {
-        int peerid;
-        int64_t seq;
-        int pl_length;
-        int pl_type;
-        int pl_options;
-        unsigned char *pl_buf;
-        int pl_buf_size;
+// packet batch item, seqstate is only used for decoding and may be NULL
+struct s_packet_batch {
+        unsigned char *pbuf;
+        int pbuf_size;
+        struct s_packet_data *data;
+        struct s_crypto *ctx;
+        struct s_seq_state *seqstate;
+        int result;
 };
 
 
 // return the peer ID
 int packetGetPeerID(const unsigned char *pbuf);
 
+// encode multiple packets of one or several sessions. Sets the result of each item to the length of the encoded packet, or 0 on error. Returns the number of encoded packets.
+int packetEncodeBatch(struct s_packet_batch *batch, const int count);
+
 // encode packet
 int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s_packet_data *data, struct s_crypto *ctx);
 
+// decode multiple packets of one or several sessions in order. Sets the result of each item to the length of the decoded payload, or 0 on error. Returns the number of decoded packets.
+int packetDecodeBatch(struct s_packet_batch *batch, const int count);
+
 // decode packet
 int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const int pbuf_size, struct s_crypto *ctx, struct s_seq_state *seqstate);
 
@@ -435,6 +889,36 @@ int seqVerify(struct s_seq_state *state, const int64_t seq);
 // Returns the amount of received sequence numbers out of the last 64.
 int seqRQ(struct s_seq_state *state);
 
+// Returns 1 if the workers have the current cipher contexts of the specified context ID. Copies them if no job uses the old ones.
+int cryptpoolPrepare(struct s_cryptpool *pool, const int ctxid, const int ctxgen, struct s_crypto *ctx);
+
+// Returns 1 if no further job can be queued.
+int cryptpoolIsFull(struct s_cryptpool *pool, const int queue_id);
+
+// Returns the next free job for the specified context ID, or NULL if the queue is full. The job has to be filled and submitted.
+struct s_cryptpool_job *cryptpoolGetJob(struct s_cryptpool *pool, const int queue_id, const int ctxid);
+
+// Submit the job returned by cryptpoolGetJob to the workers.
+void cryptpoolSubmit(struct s_cryptpool *pool, const int queue_id);
+
+// Returns the oldest job if it is finished, else NULL.
+struct s_cryptpool_job *cryptpoolGetDone(struct s_cryptpool *pool, const int queue_id);
+
+// Waits until the oldest job is finished and returns it. Returns NULL if the queue is empty.
+struct s_cryptpool_job *cryptpoolWaitDone(struct s_cryptpool *pool, const int queue_id);
+
+// Release the oldest job.
+void cryptpoolRelease(struct s_cryptpool *pool, const int queue_id);
+
+// Returns the number of queued jobs.
+int cryptpoolPending(struct s_cryptpool *pool);
+
+// Create crypto worker pool and start the worker threads.
+int cryptpoolCreate(struct s_cryptpool *pool, const int worker_count, const int ctx_count);
+
+// Stop the worker threads and destroy crypto worker pool.
+void cryptpoolDestroy(struct s_cryptpool *pool);
+
 int p2psecStart(struct s_p2psec *p2psec);
 
 void p2psecStop(struct s_p2psec *p2psec);
@@ -467,6 +951,12 @@ void p2psecSetMaxConnectedPeers(struct s_p2psec *p2psec, const int peer_count);
 
 void p2psecSetAuthSlotCount(struct s_p2psec *p2psec, const int auth_slot_count);
 
+void p2psecSetConnectRate(struct s_p2psec *p2psec, const int connect_rate);
+
+void p2psecSetProbeInterval(struct s_p2psec *p2psec, const int probe_interval);
+
+void p2psecSetCryptThreads(struct s_p2psec *p2psec, const int threads);
+
 void p2psecSetNetname(struct s_p2psec *p2psec, const char *netname, const int netname_len);
 
 void p2psecSetPassword(struct s_p2psec *p2psec, const char *password, const int password_len);
@@ -483,6 +973,10 @@ void p2psecEnableFragmentation(struct s_p2psec *p2psec);
 
 void p2psecDisableFragmentation(struct s_p2psec *p2psec);
 
+void p2psecEnableBroadcastTree(struct s_p2psec *p2psec);
+
+void p2psecDisableBroadcastTree(struct s_p2psec *p2psec);
+
 void p2psecSetFlag(struct s_p2psec *p2psec, const int flag, const int enable);
 
 void p2psecEnableUserdata(struct s_p2psec *p2psec);
@@ -493,6 +987,38 @@ void p2psecEnableRelay(struct s_p2psec *p2psec);
 
 void p2psecDisableRelay(struct s_p2psec *p2psec);
 
+void p2psecEnableTickets(struct s_p2psec *p2psec);
+
+void p2psecDisableTickets(struct s_p2psec *p2psec);
+
+void p2psecEnableDeltaPeerinfo(struct s_p2psec *p2psec);
+
+void p2psecDisableDeltaPeerinfo(struct s_p2psec *p2psec);
+
+void p2psecEnableGroupKey(struct s_p2psec *p2psec);
+
+void p2psecDisableGroupKey(struct s_p2psec *p2psec);
+
+void p2psecEnableBroadcastRelay(struct s_p2psec *p2psec);
+
+void p2psecDisableBroadcastRelay(struct s_p2psec *p2psec);
+
+void p2psecEnableMacAdvert(struct s_p2psec *p2psec);
+
+void p2psecDisableMacAdvert(struct s_p2psec *p2psec);
+
+void p2psecSetMacAdvert(struct s_p2psec *p2psec, const unsigned char *advert, const int advert_len);
+
+void p2psecEnableRouteAdvert(struct s_p2psec *p2psec);
+
+void p2psecDisableRouteAdvert(struct s_p2psec *p2psec);
+
+void p2psecSetRouteAdvert(struct s_p2psec *p2psec, const unsigned char *advert, const int advert_len);
+
+void p2psecEnableBundling(struct s_p2psec *p2psec);
+
+void p2psecDisableBundling(struct s_p2psec *p2psec);
+
 int p2psecLoadDefaults(struct s_p2psec *p2psec);
 
 struct s_p2psec *p2psecCreate();
@@ -507,25 +1033,52 @@ int p2psecConnect(struct s_p2psec *p2psec, const unsigned char *destination_addr
 
 int p2psecInputPacket(struct s_p2psec *p2psec, const unsigned char *packet_input, const int packet_input_len, const unsigned char *packet_source_addr);
 
+void p2psecInputUnreachable(struct s_p2psec *p2psec, const unsigned char *unreachable_addr);
+
 unsigned char *p2psecRecvMSG(struct s_p2psec *p2psec, unsigned char *source_nodeid, int *message_len);
 
 unsigned char *p2psecRecvMSGFromPeerID(struct s_p2psec *p2psec, int *source_peerid, int *source_peerct, int *message_len);
 
+unsigned char *p2psecRecvMacAdvertFromPeerID(struct s_p2psec *p2psec, int *source_peerid, int *source_peerct, int *advert_len);
+
+unsigned char *p2psecRecvRouteAdvertFromPeerID(struct s_p2psec *p2psec, int *source_peerid, int *source_peerct, int *advert_len);
+
 int p2psecSendMSG(struct s_p2psec *p2psec, const unsigned char *destination_nodeid, unsigned char *message, int message_len);
 
 int p2psecSendBroadcastMSG(struct s_p2psec *p2psec, unsigned char *message, int message_len);
 
 int p2psecSendMSGToPeerID(struct s_p2psec *p2psec, const int destination_peerid, const int destination_peerct, unsigned char *message, int message_len);
 
+int p2psecBundleMSGToPeerID(struct s_p2psec *p2psec, const int destination_peerid, const int destination_peerct, unsigned char *message, int message_len);
+
+void p2psecFlushBundle(struct s_p2psec *p2psec);
+
+int p2psecBundlePending(struct s_p2psec *p2psec);
+
+void p2psecSetMSGTOS(struct s_p2psec *p2psec, const int tos);
+
+int p2psecInputPending(struct s_p2psec *p2psec);
+
+int p2psecCryptPending(struct s_p2psec *p2psec);
+
 int p2psecOutputPacket(struct s_p2psec *p2psec, unsigned char *packet_output, const int packet_output_len, unsigned char *packet_destination_addr);
 
+int p2psecGetOutputTOS(struct s_p2psec *p2psec);
+
+int p2psecGetTimeout(struct s_p2psec *p2psec);
+
 int p2psecPeerCount(struct s_p2psec *p2psec);
 
+int p2psecNodeCount(struct s_p2psec *p2psec);
+
 int p2psecUptime(struct s_p2psec *p2psec);
 
 // Return number of connected peers.
 int peermgtPeerCount(struct s_peermgt *mgt);
 
+// Return number of known nodes.
+int peermgtNodeCount(struct s_peermgt *mgt);
+
 // Check if PeerID is valid.
 int peermgtIsValidID(struct s_peermgt *mgt, const int peerid);
 
@@ -574,6 +1127,12 @@ void peermgtDeleteID(struct s_peermgt *mgt, const int peerid);
 // Connect to a new peer.
 int peermgtConnect(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr);
 
+// Connect to a new peer as part of an address race.
+int peermgtConnectRace(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr, const int raceid);
+
+// Race connection attempts to all eligible addresses of a node. Returns the number of attempts started.
+int peermgtConnectNode(struct s_peermgt *mgt, struct s_nodeid *nodeid, const struct s_peeraddr *first_addr);
+
 // Enable/Disable loopback messages.
 void peermgtSetLoopback(struct s_peermgt *mgt, const int enable);
 
@@ -583,6 +1142,27 @@ void peermgtSetFastauth(struct s_peermgt *mgt, const int enable);
 // Enable/disable packet fragmentation.
 void peermgtSetFragmentation(struct s_peermgt *mgt, const int enable);
 
+// Set maximum number of new connection attempts per second.
+void peermgtSetConnectRate(struct s_peermgt *mgt, const int rate);
+
+// Enable/disable distribution of local broadcast messages over forwarding peers.
+void peermgtSetBroadcastTree(struct s_peermgt *mgt, const int enable);
+
+// Set the list of local MAC addresses that is advertised to all peers.
+void peermgtSetMacAdvert(struct s_peermgt *mgt, const unsigned char *advert, const int advert_len);
+
+// Set the list of local prefixes that is advertised to all peers.
+void peermgtSetRouteAdvert(struct s_peermgt *mgt, const unsigned char *advert, const int advert_len);
+
+// Returns the number of connection attempts allowed in the current second.
+int peermgtConnectBudget(struct s_peermgt *mgt);
+
+// Set the path probing interval in milliseconds, 0 disables probing.
+void peermgtSetProbeInterval(struct s_peermgt *mgt, const int interval);
+
+// Returns the maximum time in milliseconds the main loop may wait for input before probes are due.
+int peermgtGetTimeout(struct s_peermgt *mgt);
+
 // Set flags.
 void peermgtSetFlags(struct s_peermgt *mgt, const int flags);
 
@@ -595,6 +1175,66 @@ int peermgtGetRemoteFlag(struct s_peermgt *mgt, const int peerid, const int flag
 // Generate peerinfo packet.
 void peermgtGenPacketPeerinfo(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid);
 
+// Mark the peerinfo entry of a peer as changed.
+void peermgtUpdatePeerinfoVersion(struct s_peermgt *mgt, const int peerid);
+
+// Set the remote PeerAddr of a peer. The RTT of a new path is measured from scratch.
+void peermgtSetRemoteAddr(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr);
+
+// Generate delta peerinfo packet containing the entries the peer has not acknowledged yet.
+void peermgtGenPacketPeerinfoDelta(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid);
+
+// Generate keepalive packet.
+void peermgtGenPacketKeepalive(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid);
+
+// Generate MAC advertisement packet.
+void peermgtGenPacketMacAdvert(struct s_packet_data *data, struct s_peermgt *mgt);
+
+// Generate route advertisement packet.
+void peermgtGenPacketRouteAdvert(struct s_packet_data *data, struct s_peermgt *mgt);
+
+// Rotate the local group key if it is due.
+void peermgtRotateGroupKey(struct s_peermgt *mgt, const int tnow);
+
+// Check if broadcast messages to the specified peer can use the local group key.
+int peermgtIsGroupKeyReady(struct s_peermgt *mgt, const int peerid);
+
+// Generate group key packet.
+void peermgtGenPacketGroupKey(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid);
+
+// Forget the group key received from a peer.
+void peermgtClearGroupKey(struct s_peermgt *mgt, const int peerid);
+
+// Returns the broadcast tree partition a peer belongs to.
+int peermgtGetBroadcastPart(struct s_peermgt *mgt, const int peerid, const int parts);
+
+// Check if a peer has announced a session to another peer in its peerinfo.
+int peermgtIsAnnouncedBy(struct s_peermgt *mgt, const int relayid, const int peerid);
+
+// Returns the role of a peer for the current broadcast message: a partition index to forward, peermgt_BCAST_DIRECT or peermgt_BCAST_COVERED.
+int peermgtGetBroadcastRole(struct s_peermgt *mgt, const int peerid);
+
+// Prepare the current broadcast message for distribution over forwarding peers.
+void peermgtPrepareBroadcastTree(struct s_peermgt *mgt);
+
+// Check if the (origin, seq) pair of a broadcast message has been seen before and remember it.
+int peermgtIsBroadcastDuplicate(struct s_peermgt *mgt, const unsigned char *origin_seq);
+
+// Rotate the local ticket key if it is due.
+void peermgtRotateTicketKey(struct s_peermgt *mgt, const int tnow);
+
+// Derive resumption keys from a ticket secret and nonces.
+int peermgtSetResumeKeys(struct s_crypto *ctx, const unsigned char *secret, const unsigned char *nonce_a, const unsigned char *nonce_b);
+
+// Generate ticket packet. Returns 1 if successful.
+int peermgtGenPacketTicket(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid);
+
+// Open a ticket issued by this node. Returns 1 if the ticket is valid for the specified NodeID.
+int peermgtOpenTicket(struct s_peermgt *mgt, unsigned char *secret, const unsigned char *ticket, const int ticket_len, const struct s_nodeid *nodeid, const int tnow);
+
+// Resume a session using a cached ticket. Returns 1 if a resume request has been queued.
+int peermgtResume(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struct s_peeraddr *remote_addr);
+
 // Send ping to PeerAddr. Return 1 if successful.
 int peermgtSendPingToAddr(struct s_peermgt *mgt, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct, const struct s_peeraddr *peeraddr);
 
@@ -610,18 +1250,57 @@ int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_data *d
 // Decode peerinfo packet
 int peermgtDecodePacketPeerinfo(struct s_peermgt *mgt, const struct s_packet_data *data);
 
-// Decode ping packet
-int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data);
+// Decode peerinfo entries.
+void peermgtDecodePeerinfoEntries(struct s_peermgt *mgt, const int peerid, const unsigned char *buf, const int peerinfo_count);
+
+// Decode keepalive packet
+int peermgtDecodePacketKeepalive(struct s_peermgt *mgt, const struct s_packet_data *data);
 
-// Decode pong packet
-int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data);
+// Decode MAC advertisement packet
+int peermgtDecodePacketMacAdvert(struct s_peermgt *mgt, const struct s_packet_data *data);
+
+// Decode route advertisement packet
+int peermgtDecodePacketRouteAdvert(struct s_peermgt *mgt, const struct s_packet_data *data);
+
+// Decode group key packet
+int peermgtDecodePacketGroupKey(struct s_peermgt *mgt, const struct s_packet_data *data);
+
+// Decode broadcast tree packet
+int peermgtDecodePacketBcast(struct s_peermgt *mgt, const struct s_packet_data *data);
+
+// Decode packet encrypted with the group key of a peer.
+int peermgtDecodePacketGroup(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const int tnow);
+
+// Decode ping packet, the pong is sent back to the source address of the ping
+int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr);
+
+// Decode pong packet and measure the RTT of its ping. The pong of a path ping moves the peer to the path it has been received on.
+int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr);
 
 // Decode relay-in packet
 int peermgtDecodePacketRelayIn(struct s_peermgt *mgt, const struct s_packet_data *data);
 
+// Decode ticket packet
+int peermgtDecodePacketTicket(struct s_peermgt *mgt, const struct s_packet_data *data);
+
+// Record the nonce of a resume request. Returns 1 if the nonce has not been seen before.
+int peermgtCheckResumeReplay(struct s_peermgt *mgt, const unsigned char *nonce, const int tnow);
+
+// Decode resume request
+int peermgtDecodeResumeRequest(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr);
+
+// Decode resume acknowledgement
+int peermgtDecodeResumeAck(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr);
+
+// Decode resume packet
+int peermgtDecodePacketResume(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr);
+
 // Decode fragmented packet
 int peermgtDecodeUserdataFragment(struct s_peermgt *mgt, struct s_packet_data *data);
 
+// Decode bundled user data. The frames are returned one by one by peermgtRecvUserdata.
+int peermgtDecodeUserdataBundle(struct s_peermgt *mgt, const struct s_packet_data *data);
+
 // Decode input packet recursively. Decapsulates relayed packets if necessary.
 int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr, const int tnow, const int depth);
 
@@ -629,15 +1308,48 @@ int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *pac
 // Decode input packet. Returns 1 on success.
 int peermgtDecodePacket(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr);
 
+// Mark the paths of the peers that are reached via PeerAddr as down, after an ICMP error has been received for it.
+void peermgtDecodeUnreachable(struct s_peermgt *mgt, const struct s_peeraddr *addr);
+
 // Return received user data. Return 1 if successful.
 int peermgtRecvUserdata(struct s_peermgt *mgt, struct s_msg *recvmsg, struct s_nodeid *fromnodeid, int *frompeerid, int *frompeerct);
 
+// Return received MAC advertisement. Return 1 if successful.
+int peermgtRecvMacAdvert(struct s_peermgt *mgt, struct s_msg *recvmsg, int *frompeerid, int *frompeerct);
+
+// Return received route advertisement. Return 1 if successful.
+int peermgtRecvRouteAdvert(struct s_peermgt *mgt, struct s_msg *recvmsg, int *frompeerid, int *frompeerct);
+
 // Send user data. Return 1 if successful.
 int peermgtSendUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct);
 
 // Send user data to all connected peers. Return 1 if successful.
 int peermgtSendBroadcastUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg);
 
+// Add small user data to the bundle of the peer. The bundle is sent when it gets flushed or before other user data. Return 1 if successful.
+int peermgtBundleUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, const int topeerid, const int topeerct);
+
+// Mark the bundle as ready to be sent.
+void peermgtFlushBundle(struct s_peermgt *mgt);
+
+// Returns 1 if a bundle is waiting to be sent.
+int peermgtIsBundlePending(struct s_peermgt *mgt);
+
+// Set the IPv4 TOS or IPv6 traffic class of the user data that is sent or bundled next.
+void peermgtSetUserdataTOS(struct s_peermgt *mgt, const int tos);
+
+// Returns the IPv4 TOS or IPv6 traffic class of the last packet returned by peermgtGetNextPacket.
+int peermgtGetOutputTOS(struct s_peermgt *mgt);
+
+// Start crypto worker threads that encode and decode the user data of directly connected peers. Returns 1 if successful.
+int peermgtEnableCryptPool(struct s_peermgt *mgt, const int threads);
+
+// Returns the number of packets the crypto workers are busy with.
+int peermgtCryptPending(struct s_peermgt *mgt);
+
+// Decode the next packet finished by the crypto workers. Returns 1 if a packet has been accepted.
+int peermgtDecodePending(struct s_peermgt *mgt);
+
 // Set NetID from network name.
 int peermgtSetNetID(struct s_peermgt *mgt, const char *netname, const int netname_len);
 
@@ -674,6 +1386,18 @@ void authmgtDelete(struct s_authmgt *mgt, const int authstateid);
 // Start new auth session. Returns 1 on success.
 int authmgtStart(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr);
 
+// Returns a new race ID. Auth sessions started with the same race ID are cancelled when one of them completes.
+int authmgtNewRace(struct s_authmgt *mgt);
+
+// Start new auth session as part of a race. Returns 1 on success.
+int authmgtStartRace(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr, const int raceid);
+
+// Remove an auth session from the ring of its race.
+void authmgtLeaveRace(struct s_authmgt *mgt, const int authstateid);
+
+// Cancel all other auth sessions of the race the specified session belongs to.
+void authmgtFinishRace(struct s_authmgt *mgt, const int authstateid);
+
 // Check if auth manager has an authed peer.
 int authmgtHasAuthedPeer(struct s_authmgt *mgt);
 
@@ -710,12 +1434,36 @@ void authmgtFinishCompletedPeer(struct s_authmgt *mgt);
 // Get next auth manager message.
 int authmgtGetNextMsg(struct s_authmgt *mgt, struct s_msg *out_msg, struct s_peeraddr *target);
 
+// Set the PeerAddr of an auth session and update the address index.
+void authmgtSetAddr(struct s_authmgt *mgt, const int authstateid, const struct s_peeraddr *peeraddr);
+
+// Add or remove an auth session from the list of replaceable sessions.
+void authmgtUpdateFree(struct s_authmgt *mgt, const int authstateid);
+
 // Find auth session with specified PeerAddr.
 int authmgtFindAddr(struct s_authmgt *mgt, const struct s_peeraddr *addr);
 
 // Find unused auth session.
 int authmgtFindUnused(struct s_authmgt *mgt);
 
+// Check if the auth manager is under load and requires cookies for new sessions.
+int authmgtIsUnderLoad(struct s_authmgt *mgt, const int tnow);
+
+// Admit a resumed session. Resumes skip the cookie exchange, so they are refused under load and the peer falls back to a full handshake. Returns 1 if admitted.
+int authmgtAdmitResume(struct s_authmgt *mgt, const int tnow);
+
+// Calculate the cookie for a new session request.
+int authmgtGenCookie(struct s_authmgt *mgt, unsigned char *cookie, const unsigned char *msg, const struct s_peeraddr *peeraddr, const int interval);
+
+// Check if a new session request comes from a peer that supports cookies.
+int authmgtHasCookieField(const int msg_len);
+
+// Verify the cookie echoed in a new session request. Returns 1 if the cookie is valid.
+int authmgtVerifyCookie(struct s_authmgt *mgt, const unsigned char *msg, const int msg_len, const struct s_peeraddr *peeraddr, const int tnow);
+
+// Queue a cookie challenge as answer to a new session request.
+void authmgtSendCookie(struct s_authmgt *mgt, const unsigned char *msg, const struct s_peeraddr *peeraddr, const int tnow);
+
 // Decode auth message. Returns 1 if message is accepted.
 int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, const int msg_len, const struct s_peeraddr *peeraddr);
 
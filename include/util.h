@@ -60,6 +60,9 @@ void utilWriteInt64(unsigned char *buf, int64_t i);
 // Get clock value in seconds
 int utilGetClock();
 
+// Get monotonic clock value in milliseconds
+int64_t utilGetClockMs();
+
 int isWhitespaceChar(char c);
 
 #endif // H_UTIL
@@ -146,6 +146,19 @@ int parseConfigLine(char *line, int len, struct s_initconfig *cs) {
 		strncpy(cs->tapname,&line[vpos],CONFPARSER_NAMEBUF_SIZE);
 		return 1;
 	}
+	else if(parseConfigLineCheckCommand(line,len,"xdpinterface",&vpos)) {
+		strncpy(cs->xdpinterface,&line[vpos],CONFPARSER_NAMEBUF_SIZE);
+		return 1;
+	}
+	else if(parseConfigLineCheckCommand(line,len,"xdpqueue",&vpos)) {
+		if((a = parseConfigInt(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->xdpqueue = a;
+			return 1;
+		}
+	}
 	else if(parseConfigLineCheckCommand(line,len,"ifconfig4",&vpos)) {
 		strncpy(cs->ifconfig4,&line[vpos],CONFPARSER_NAMEBUF_SIZE);
 		return 1;
@@ -220,6 +233,69 @@ int parseConfigLine(char *line, int len, struct s_initconfig *cs) {
 			return 1;
 		}
 	}
+	else if(parseConfigLineCheckCommand(line,len,"enabletun",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enabletun = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enableoffload",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enableoffload = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enablepacketring",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enablepacketring = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enableudpoffload",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enableudpoffload = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enabledscp",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enabledscp = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enableiouring",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enableiouring = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"announceprefix",&vpos)) {
+		if(cs->announceprefixcount >= ANNOUNCEPREFIX_MAX) {
+			return -1;
+		}
+		strncpy(cs->announceprefix[cs->announceprefixcount],&line[vpos],CONFPARSER_NAMEBUF_SIZE);
+		cs->announceprefix[cs->announceprefixcount][CONFPARSER_NAMEBUF_SIZE] = '\0';
+		cs->announceprefixcount++;
+		return 1;
+	}
 	else if(parseConfigLineCheckCommand(line,len,"enablendpcache",&vpos)) {
 		if((a = parseConfigBoolean(&line[vpos])) < 0) {
 			return -1;
@@ -229,6 +305,24 @@ int parseConfigLine(char *line, int len, struct s_initconfig *cs) {
 			return 1;
 		}
 	}
+	else if(parseConfigLineCheckCommand(line,len,"enablearpcache",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enablearpcache = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"enablemcastsnooping",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enablemcastsnooping = a;
+			return 1;
+		}
+	}
 	else if(parseConfigLineCheckCommand(line,len,"enablevirtserv",&vpos)) {
 		if((a = parseConfigBoolean(&line[vpos])) < 0) {
 			return -1;
@@ -247,6 +341,15 @@ int parseConfigLine(char *line, int len, struct s_initconfig *cs) {
 			return 1;
 		}
 	}
+	else if(parseConfigLineCheckCommand(line,len,"enablebroadcasttree",&vpos)) {
+		if((a = parseConfigBoolean(&line[vpos])) < 0) {
+			return -1;
+		}
+		else {
+			cs->enablebroadcasttree = a;
+			return 1;
+		}
+	}
 	else if(parseConfigLineCheckCommand(line,len,"enableipv4",&vpos)) {
 		if((a = parseConfigBoolean(&line[vpos])) < 0) {
 			return -1;
@@ -299,6 +402,33 @@ int parseConfigLine(char *line, int len, struct s_initconfig *cs) {
 			return 1;
 		}
 	}
+	else if(parseConfigLineCheckCommand(line,len,"connectrate",&vpos)) {
+		if((a = parseConfigInt(&line[vpos])) < 1) {
+			return -1;
+		}
+		else {
+			cs->connectrate = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"probeinterval",&vpos)) {
+		if(((a = parseConfigInt(&line[vpos])) < 0) || (a > 10000)) {
+			return -1;
+		}
+		else {
+			cs->probeinterval = a;
+			return 1;
+		}
+	}
+	else if(parseConfigLineCheckCommand(line,len,"cryptothreads",&vpos)) {
+		if(((a = parseConfigInt(&line[vpos])) < 0) || (a > 16)) {
+			return -1;
+		}
+		else {
+			cs->cryptothreads = a;
+			return 1;
+		}
+	}
 	else if(parseConfigLineCheckCommand(line,len,"endconfig",&vpos)) {
 		return 0;
 	}
@@ -317,6 +447,7 @@ void parseConfigFile(int fd, struct s_initconfig *cs) {
 	int readlen;
 
     strcpy(cs->tapname,"");
+    strcpy(cs->xdpinterface,"");
     strcpy(cs->ifconfig4,"");
     strcpy(cs->ifconfig6,"");
     strcpy(cs->upcmd,"");
@@ -333,9 +464,18 @@ void parseConfigFile(int fd, struct s_initconfig *cs) {
     cs->password_len = 0;
     cs->enablepidfile = 0;
     cs->enableeth = 1;
+    cs->enabletun = 0;
+    cs->enableoffload = 0;
+    cs->enableiouring = 0;
+    cs->enableudpoffload = 0;
+    cs->enabledscp = 0;
+    cs->enablepacketring = 0;
     cs->enablendpcache = 0;
+    cs->enablearpcache = 0;
+    cs->enablemcastsnooping = 0;
     cs->enablevirtserv = 0;
     cs->enablerelay = 0;
+    cs->enablebroadcasttree = 0;
     cs->enableindirect = 0;
     cs->enableconsole = 0;
     cs->enableseccomp = 0;
@@ -347,8 +487,13 @@ void parseConfigFile(int fd, struct s_initconfig *cs) {
     cs->enablenat64clat = 0;
     cs->enablesyslog = 0;
     cs->sockmark = 0;
+    cs->xdpqueue = 0;
+    cs->connectrate = 0;
+    cs->probeinterval = -1;
+    cs->cryptothreads = 0;
     cs->enablepidfile = 0;
     cs->initpeerscount = 0;
+    cs->announceprefixcount = 0;
 
 	do {
 		readlen = read(fd,&c,1);
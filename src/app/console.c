@@ -441,6 +441,14 @@ void printNDPTable() {
 }
 
 
+// print table of arp cache
+void printARPTable() {
+    char str[32768];
+    arp4Status(&g_arpstate, str, 32768);
+    printf("%s\n", str);
+}
+
+
 // parse command
 void decodeConsole(char *cmd, int cmdlen) {
     char text[4096];
@@ -459,6 +467,10 @@ void decodeConsole(char *cmd, int cmdlen) {
         // ACTIVEPEERTABLE
         printActivePeerTable();
     }
+    if(pa[0] == 'C' || pa[0] == 'c') {
+        // CACHEARPTABLE
+        printARPTable();
+    }
     if(pa[0] == 'D' || pa[0] == 'd') {
         // DB
         printNodeDB();
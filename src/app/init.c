@@ -152,10 +152,13 @@ void init(struct s_initconfig *initconfig) {
     }
 
 	// create data structures
-	if(!ioCreate(&iostate, 4096, 4)) {
+	if(!ioCreate(&iostate, ((initconfig->enableoffload) ? IO_VNETHDR_BUFSIZE : 4096), 5)) {
 		throwError("Could not initialize I/O backend!\n");
 	}
-	ioSetTimeout(&iostate, 1);
+	ioSetOffload(&iostate, initconfig->enableoffload);
+	ioSetUdpOffload(&iostate, initconfig->enableudpoffload);
+	ioSetTimeout(&iostate, 1000);
+	ioSetRecvErr(&iostate, (initconfig->probeinterval != 0));
 
 	// enable console
 	if(initconfig->enableconsole) {
@@ -176,6 +179,16 @@ void init(struct s_initconfig *initconfig) {
 	i = 0;
 	ioSetNat64Clat(&iostate, initconfig->enablenat64clat);
 	ioSetSockmark(&iostate, initconfig->sockmark);
+	if(strlen(initconfig->xdpinterface) > 0) {
+		// opened before the sockets, so that it is preferred for sending
+		if(!((j = (ioOpenXDP(&iostate, initconfig->xdpinterface, initconfig->xdpqueue, initconfig->sourceport))) < 0)) {
+			ioSetGroup(&iostate, j, IOGRP_SOCKET);
+			msgf("AF_XDP socket attached to %s queue %d", initconfig->xdpinterface, initconfig->xdpqueue);
+		}
+		else {
+			printf("   AF_XDP: failed.\n");
+		}
+	}
 	if(initconfig->enableipv4) {
 		if(!((j = (ioOpenSocketV4(&iostate, initconfig->sourceip, initconfig->sourceport))) < 0)) {
 			ioSetGroup(&iostate, j, IOGRP_SOCKET);
@@ -202,14 +215,25 @@ void init(struct s_initconfig *initconfig) {
 
     // open tap device
     if(initconfig->enableeth) {
-        msg("Trying to open TAP device");
-        if((j = (ioOpenTAP(&iostate, tapname, initconfig->tapname))) < 0) {
+        if(initconfig->enablepacketring) {
+            if(initconfig->enabletun) {
+                throwError("The packet ring carries ethernet frames and can not be used in TUN mode!");
+            }
+            msgf("Trying to attach to interface %s", initconfig->tapname);
+            j = ioOpenPacketRing(&iostate, tapname, initconfig->tapname);
+        } else {
+            msg("Trying to open TAP device");
+            j = ioOpenTAP(&iostate, tapname, initconfig->tapname, initconfig->enabletun);
+        }
+        if(j < 0) {
             g_enableeth = 0;
             printf("   failed.\n");
             throwError("The TAP device could not be opened! This might be caused by:\n- a missing TAP device driver,\n- a blocked TAP device (try a different name),\n- insufficient privileges (try running as the root/administrator user).");
         } else {
             ioSetGroup(&iostate, j, IOGRP_TAP);
             g_enableeth = 1;
+            g_enabletun = (initconfig->enabletun) ? 1 : 0;
+            g_enablegro = ioGetVnetHdr(&iostate, j);
             msgf("TAP device successfully opened: %s", tapname);
 
             if(strlen(initconfig->ifconfig4) > 0) {
@@ -241,6 +265,8 @@ void init(struct s_initconfig *initconfig) {
     }
     else {
         g_enableeth = 0;
+        g_enabletun = 0;
+        g_enablegro = 0;
     }
 
 	// enable ndp cache
@@ -251,6 +277,14 @@ void init(struct s_initconfig *initconfig) {
 		g_enablendpcache = 0;
 	}
 
+	// enable arp cache
+	if(initconfig->enablearpcache) {
+		g_enablearpcache = 1;
+	}
+	else {
+		g_enablearpcache = 0;
+	}
+
 	// enable virtual service
 	if(initconfig->enablevirtserv) {
 		g_enablevirtserv = 1;
@@ -259,6 +293,14 @@ void init(struct s_initconfig *initconfig) {
 		g_enablevirtserv = 0;
 	}
 
+	// copy the DSCP of user data to the outer header
+	if(initconfig->enabledscp) {
+		g_enabledscp = 1;
+	}
+	else {
+		g_enabledscp = 0;
+	}
+
 	// load OpenSSL engines
 	ENGINE_load_builtin_engines();
 	ENGINE_register_all_complete();
@@ -316,14 +358,49 @@ void init(struct s_initconfig *initconfig) {
 	else {
 		p2psecDisableRelay(g_p2psec);
 	}
+	if(initconfig->enablebroadcasttree) {
+		p2psecEnableBroadcastTree(g_p2psec);
+	}
+	else {
+		p2psecDisableBroadcastTree(g_p2psec);
+	}
+	if(initconfig->connectrate > 0) {
+		p2psecSetConnectRate(g_p2psec, initconfig->connectrate);
+	}
+	if(initconfig->probeinterval >= 0) {
+		p2psecSetProbeInterval(g_p2psec, initconfig->probeinterval);
+	}
+	if(initconfig->cryptothreads > 0) {
+		p2psecSetCryptThreads(g_p2psec, initconfig->cryptothreads);
+		msgf("Using %d crypto worker threads", initconfig->cryptothreads);
+	}
 	if(!p2psecStart(g_p2psec)) throwError("Failed to start p2p core!");
         msg("P2P core successfully initialized");
 	// initialize mac table
 	if(!switchCreate(&g_switchstate)) throwError("Failed to setup mactable!\n");
+	switchSetMcastSnooping(&g_switchstate, initconfig->enablemcastsnooping);
 
 	// initialize ndp table
 	if(!ndp6Create(&g_ndpstate)) throwError("Failed to setup ndptable!\n");
 
+	// initialize arp table
+	if(!arp4Create(&g_arpstate)) throwError("Failed to setup arptable!\n");
+
+	// initialize receive coalescing buffer
+	if(!groCreate(&g_grostate)) throwError("Failed to setup coalescing buffer!\n");
+
+	// initialize route table and local prefixes
+	if(!routeCreate(&g_routestate)) throwError("Failed to setup routetable!\n");
+	if(g_enabletun) {
+		if(strlen(initconfig->ifconfig4) > 0) routeAddLocal(&g_routestate, initconfig->ifconfig4, strlen(initconfig->ifconfig4), 1);
+		if(strlen(initconfig->ifconfig6) > 0) routeAddLocal(&g_routestate, initconfig->ifconfig6, strlen(initconfig->ifconfig6), 1);
+		for(i=0; i<initconfig->announceprefixcount; i++) {
+			if(!routeAddLocal(&g_routestate, initconfig->announceprefix[i], strlen(initconfig->announceprefix[i]), 0)) {
+				msgf("Invalid or too many announceprefix entries: %s", initconfig->announceprefix[i]);
+			}
+		}
+	}
+
 	// initialize virtual service
 	if(!virtservCreate(&g_virtserv)) throwError("Failed to setup virtserv!\n");
 
@@ -339,6 +416,16 @@ void init(struct s_initconfig *initconfig) {
 	utilByteArrayToHexstring(str, 256, g_p2psec->mgt.netid.id, netid_SIZE);
 	msgf("Network ID: %s", str);
 
+	// switch to the io_uring backend, the ring has to be set up before privileges are dropped
+	if(initconfig->enableiouring) {
+		if(ioEnableUring(&iostate)) {
+			msg("io_uring backend enabled");
+		}
+		else {
+			msg("io_uring backend is not available, using select.");
+		}
+	}
+
 	// drop privileges
 	dropPrivileges(initconfig->userstr, initconfig->groupstr, initconfig->chrootstr);
 	if(initconfig->enableprivdrop) {
@@ -362,6 +449,9 @@ void init(struct s_initconfig *initconfig) {
 
 	// shut down
 	virtservDestroy(&g_virtserv);
+	routeDestroy(&g_routestate);
+	groDestroy(&g_grostate);
+	arp4Destroy(&g_arpstate);
 	ndp6Destroy(&g_ndpstate);
 	switchDestroy(&g_switchstate);
 	p2psecStop(g_p2psec);
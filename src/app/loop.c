@@ -47,116 +47,262 @@ void connectInitpeers(struct s_initpeers * peers) {
 }
 
 
+// Write pending coalesced frame to the tap device.
+void flushCoalescedFrame() {
+	unsigned char *vnethdr;
+	unsigned char *frame;
+	int frame_len;
+
+	if((frame_len = (groGet(&g_grostate, &vnethdr, &frame))) > 0) {
+		if(!(ioWriteVnetHdrGroup(&iostate, IOGRP_TAP, vnethdr, frame, frame_len) > 0)) {
+			debug("could not write to tap device!");
+		}
+	}
+}
+
+
+// Send out the packets generated by the peer manager.
+void outputPackets(unsigned char *sockdata_buf, int *sockdata_lastlen) {
+	int sockdata_len;
+	struct s_io_addr new_peeraddr;
+
+	while((sockdata_len = (p2psecOutputPacket(g_p2psec, sockdata_buf, 4096, new_peeraddr.addr))) > 0) {
+		*sockdata_lastlen = sockdata_len;
+		if(g_enabledscp) {
+			ioSetTOS(&iostate, p2psecGetOutputTOS(g_p2psec));
+		}
+		if(!(ioWriteGroup(&iostate, IOGRP_SOCKET, sockdata_buf, sockdata_len, &new_peeraddr) > 0)) {
+			debug("could not send packet!");
+		}
+	}
+}
+
+
+// Write received frames to the tap device and send out the resulting packets.
+void outputReceived(unsigned char *sockdata_buf, int *sockdata_lastlen) {
+	unsigned char *msg;
+	int msg_len;
+	int source_peerid;
+	int source_peerct;
+
+	// output frames to tap device
+	while((msg = p2psecRecvMSGFromPeerID(g_p2psec, &source_peerid, &source_peerct, &msg_len)) != NULL) {
+		if(msg_len > 12 && g_enableeth > 0) {
+			if(!g_enabletun) {
+				switchFrameIn(&g_switchstate, msg, msg_len, source_peerid, source_peerct);
+				ndp6PacketIn(&g_ndpstate, msg, msg_len, source_peerid, source_peerct);
+				arp4PacketIn(&g_arpstate, msg, msg_len, source_peerid, source_peerct);
+				if(!switchMcastDeliverIn(&g_switchstate, msg, msg_len)) continue;
+			}
+			if(g_enablegro) {
+				// coalesce consecutive segments of a TCP flow into one superframe
+				if(!groAppend(&g_grostate, msg, msg_len, source_peerid, source_peerct, !g_enabletun)) {
+					flushCoalescedFrame();
+					if(!groStart(&g_grostate, msg, msg_len, source_peerid, source_peerct, !g_enabletun)) {
+						if(!(ioWriteGroup(&iostate, IOGRP_TAP, msg, msg_len, NULL) > 0)) {
+							debug("could not write to tap device!");
+						}
+					}
+				}
+			}
+			else if(!(ioWriteGroup(&iostate, IOGRP_TAP, msg, msg_len, NULL) > 0)) {
+				debug("could not write to tap device!");
+			}
+		}
+	}
+
+	// learn advertised MAC addresses
+	msg = p2psecRecvMacAdvertFromPeerID(g_p2psec, &source_peerid, &source_peerct, &msg_len);
+	if(msg != NULL && g_enableeth > 0 && !g_enabletun) {
+		switchMacAdvertIn(&g_switchstate, msg, msg_len, source_peerid, source_peerct);
+	}
+
+	// learn advertised prefixes
+	msg = p2psecRecvRouteAdvertFromPeerID(g_p2psec, &source_peerid, &source_peerct, &msg_len);
+	if(msg != NULL && g_enabletun > 0) {
+		routeAdvertIn(&g_routestate, msg, msg_len, source_peerid, source_peerct);
+	}
+
+	// output packets
+	outputPackets(sockdata_buf, sockdata_lastlen);
+}
+
+
 // the mainloop
 void mainLoop(struct s_initpeers * peers) {
 	int fd;
 	int tnow;
 	unsigned char sockdata_buf[4096];
-	int sockdata_len;
 	int sockdata_lastlen;
+	int sockdata_rx;
+	int tapdata_rx;
 	unsigned char tapmsg_buf[1024];
+	unsigned char advert_buf[peermgt_MSGSIZE_MIN];
+	unsigned char gso_buf[gso_SEGBUF_SIZE];
+	struct s_gso_state gso;
+	int lastadvert = 0;
 	int tapmsg_len;
-	unsigned char *msg;
 	unsigned char *msg_buf;
 	int msg_len;
 	int msg_offset;
 	int msg_ok;
 	int lastinit = 0;
+	int initinterval = 1;
 	int laststatus = 0;
 	int lastconnectcount = -1;
 	int connectcount = 0;
+	int lastnodecount = -1;
+	int nodecount = 0;
 	int do_broadcast = 0;
 	int ndp_peerid = 0;
 	int ndp_peerct = 0;
+	int mcast_peerid[switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS];
+	int mcast_peerct[switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS];
+	int mcast_count;
+	int mcast_active;
+	int i;
 	int frametype;
 	int source_peerid;
 	int source_peerct;
-	struct s_io_addr new_peeraddr;
+	struct s_io_addr unreach_addr;
 
 	msg_len = 0;
-	sockdata_len = 0;
 	sockdata_lastlen = 0;
 	tapmsg_len = 0;
 
 	while(g_mainloop) {
 		tnow = utilGetClock();
 
-		// read all fds
+		// read all fds, don't wait while a coalesced frame, a bundle or packets on the crypto workers are pending
+		ioSetTimeout(&iostate, (groPending(&g_grostate) || p2psecBundlePending(g_p2psec) || p2psecCryptPending(g_p2psec)) ? 0 : p2psecGetTimeout(g_p2psec));
 		ioReadAll(&iostate);
 
+		// report destinations that are unreachable according to ICMP errors
+		while(ioGetUnreachable(&iostate, &unreach_addr)) {
+			p2psecInputUnreachable(g_p2psec, unreach_addr.addr);
+		}
+
 		// check udp sockets
+		sockdata_rx = 0;
 		while(!((fd = (ioGetGroup(&iostate, IOGRP_SOCKET))) < 0)) {
+			sockdata_rx = 1;
 			if(p2psecInputPacket(g_p2psec, ioGetData(&iostate, fd), ioGetDataLen(&iostate, fd), ioGetAddr(&iostate, fd)->addr)) {
-				// output frames to tap device
-				msg = p2psecRecvMSGFromPeerID(g_p2psec, &source_peerid, &source_peerct, &msg_len);
-				if(msg != NULL && msg_len > 12 && g_enableeth > 0) {
-					switchFrameIn(&g_switchstate, msg, msg_len, source_peerid, source_peerct);
-					ndp6PacketIn(&g_ndpstate, msg, msg_len, source_peerid, source_peerct);
-					if(!(ioWriteGroup(&iostate, IOGRP_TAP, msg, msg_len, NULL) > 0)) {
-						debug("could not write to tap device!");
-					}
-				}
-
-				// output packets
-				while((sockdata_len = (p2psecOutputPacket(g_p2psec, sockdata_buf, 4096, new_peeraddr.addr))) > 0) {
-					sockdata_lastlen = sockdata_len;
-					if(!(ioWriteGroup(&iostate, IOGRP_SOCKET, sockdata_buf, sockdata_len, &new_peeraddr) > 0)) {
-						debug("could not send packet!");
-					}
-				}
+				outputReceived(sockdata_buf, &sockdata_lastlen);
 			}
 			ioGetClear(&iostate, fd);
 		}
 
+		// process packets decoded by the crypto workers, they are returned in the order they have been received
+		while(p2psecInputPending(g_p2psec)) {
+			sockdata_rx = 1;
+			outputReceived(sockdata_buf, &sockdata_lastlen);
+		}
+
+		// sockets are drained, write coalesced frame
+		if(!sockdata_rx) {
+			flushCoalescedFrame();
+		}
+
 		// check for ethernet frames on tap device
+		tapdata_rx = 0;
 		if(g_enableeth > 0) {
 			while(!((fd = (ioGetGroup(&iostate, IOGRP_TAP))) < 0)) {
-				msg_buf = ioGetData(&iostate, fd);
-				msg_len = ioGetDataLen(&iostate, fd);
-				msg_ok = 1;
-
-				// check frame
-				if((sockdata_lastlen > 0) && (msg_len > sockdata_lastlen)) {
-					msg_offset = msg_len - sockdata_lastlen;
-					if(memcmp(&msg_buf[msg_offset], sockdata_buf, sockdata_lastlen) == 0) {
-						// drop packets which have been sent out via MeshVPN's socket before to avoid loops
-						debug("recursive packet filtered!");
-						msg_ok = 0;
+				tapdata_rx = 1;
+				// split offloaded superframes into segments, complete pending checksums
+				gsoInit(&gso, ioGetData(&iostate, fd), ioGetDataLen(&iostate, fd), ioGetVnetHdr(&iostate, fd), !g_enabletun);
+				while((msg_len = (gsoNext(&gso, gso_buf, gso_SEGBUF_SIZE, &msg_buf))) > 0) {
+					msg_ok = 1;
+
+					// check frame
+					if((sockdata_lastlen > 0) && (msg_len > sockdata_lastlen)) {
+						msg_offset = msg_len - sockdata_lastlen;
+						if(memcmp(&msg_buf[msg_offset], sockdata_buf, sockdata_lastlen) == 0) {
+							// drop packets which have been sent out via MeshVPN's socket before to avoid loops
+							debug("recursive packet filtered!");
+							msg_ok = 0;
+						}
 					}
-				}
 
-				// process frame
-				if(msg_ok) {
-					if((g_enablevirtserv) && ((tapmsg_len = (virtservFrame(&g_virtserv, tapmsg_buf, 1024, msg_buf, msg_len))) > 0)) {
-						// virtual service frame
-						if(!(ioWriteGroup(&iostate, IOGRP_TAP, tapmsg_buf, tapmsg_len, NULL) > 0)) {
-							debug("could not write to tap device!");
+					// classify frame, latency sensitive frames are sent first
+					if(msg_ok) {
+						p2psecSetMSGTOS(g_p2psec, qosGetTOS(msg_buf, msg_len, !g_enabletun));
+					}
+
+					// process frame
+					if(msg_ok && g_enabletun) {
+						// routed packet, there is no broadcast path in TUN mode
+						if(routePacketOut(&g_routestate, msg_buf, msg_len, &source_peerid, &source_peerct) && peermgtIsActiveIDCT(&g_p2psec->mgt, source_peerid, source_peerct)) {
+							if(!p2psecBundleMSGToPeerID(g_p2psec, source_peerid, source_peerct, msg_buf, msg_len)) {
+								p2psecSendMSGToPeerID(g_p2psec, source_peerid, source_peerct, msg_buf, msg_len);
+							}
+
+							// output packets
+							outputPackets(sockdata_buf, &sockdata_lastlen);
+						}
+						else {
+							debug("no route for packet, dropped!");
 						}
 					}
-					else {
-						// regular frame
-						frametype = switchFrameOut(&g_switchstate, msg_buf, msg_len, &source_peerid, &source_peerct);
-						switch(frametype) {
-							case switch_FRAME_TYPE_UNICAST:
-								if(peermgtIsActiveIDCT(&g_p2psec->mgt, source_peerid, source_peerct)) {
+					else if(msg_ok) {
+						switchLocalFrameIn(&g_switchstate, msg_buf, msg_len);
+						if((g_enablevirtserv) && ((tapmsg_len = (virtservFrame(&g_virtserv, tapmsg_buf, 1024, msg_buf, msg_len))) > 0)) {
+							// virtual service frame
+							if(!(ioWriteGroup(&iostate, IOGRP_TAP, tapmsg_buf, tapmsg_len, NULL) > 0)) {
+								debug("could not write to tap device!");
+							}
+						}
+						else {
+							// regular frame
+							frametype = switchFrameOut(&g_switchstate, msg_buf, msg_len, &source_peerid, &source_peerct);
+							switch(frametype) {
+								case switch_FRAME_TYPE_UNICAST:
+									if(peermgtIsActiveIDCT(&g_p2psec->mgt, source_peerid, source_peerct)) {
+										do_broadcast = 0;
+										if(!p2psecBundleMSGToPeerID(g_p2psec, source_peerid, source_peerct, msg_buf, msg_len)) {
+											p2psecSendMSGToPeerID(g_p2psec, source_peerid, source_peerct, msg_buf, msg_len);
+										}
+									}
+									else {
+										do_broadcast = 1;
+									}
+									break;
+								case switch_FRAME_TYPE_MULTICAST:
+									// snooped multicast group, send to subscribed peers only
+									mcast_count = switchMcastMembers(&g_switchstate, msg_buf, msg_len, mcast_peerid, mcast_peerct, (switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS));
+									mcast_active = 0;
+									for(i=0; i<mcast_count; i++) {
+										if(peermgtIsActiveIDCT(&g_p2psec->mgt, mcast_peerid[i], mcast_peerct[i])) mcast_active++;
+									}
+									if((mcast_active > 0) && (mcast_active == mcast_count)) {
+										do_broadcast = 0;
+										for(i=0; i<mcast_count; i++) {
+											// the peer manager holds one outgoing frame, send it before queueing the next copy
+											p2psecSendMSGToPeerID(g_p2psec, mcast_peerid[i], mcast_peerct[i], msg_buf, msg_len);
+											outputPackets(sockdata_buf, &sockdata_lastlen);
+										}
+									}
+									else {
+										// a member has disconnected or no member is left, fall back to flooding
+										do_broadcast = 1;
+									}
+									break;
+								case(switch_FRAME_TYPE_BROADCAST):
+									do_broadcast = 1;
+									break;
+								default:
 									do_broadcast = 0;
-									p2psecSendMSGToPeerID(g_p2psec, source_peerid, source_peerct, msg_buf, msg_len);
+									break;
+							}
+							if(do_broadcast) {
+								tapmsg_len = 0;
+								if(g_enablendpcache) {
+									// ndp cache enabled, check whether we can answer a neighbour solicitation from the cache
+									tapmsg_len = ndp6GenAdv(&g_ndpstate, msg_buf, msg_len, tapmsg_buf, 128, &ndp_peerid, &ndp_peerct);
 								}
-								else {
-									do_broadcast = 1;
+								if((tapmsg_len <= 0) && (g_enablearpcache)) {
+									// arp cache enabled, check whether we can answer an arp request from the cache
+									tapmsg_len = arp4GenReply(&g_arpstate, msg_buf, msg_len, tapmsg_buf, 128, &ndp_peerid, &ndp_peerct);
 								}
-								break;
-							case(switch_FRAME_TYPE_BROADCAST):
-								do_broadcast = 1;
-								break;
-							default:
-								do_broadcast = 0;
-								break;
-						}
-						if(do_broadcast) {
-							if(g_enablendpcache) {
-								// ndp cache enabled, check whether we can avoid the broadcast and answer from the cache instead
-								tapmsg_len = ndp6GenAdv(&g_ndpstate, msg_buf, msg_len, tapmsg_buf, 128, &ndp_peerid, &ndp_peerct);
 								if(tapmsg_len > 0) {
 									if(peermgtIsActiveIDCT(&g_p2psec->mgt, ndp_peerid, ndp_peerct)) {
 										// answer from cache
@@ -170,22 +316,13 @@ void mainLoop(struct s_initpeers * peers) {
 									}
 								}
 								else {
-									// no cache entry or message not a neighbour solicitation, send broadcast
+									// caches disabled, no cache entry or message not a solicitation/request, send broadcast
 									p2psecSendBroadcastMSG(g_p2psec, msg_buf, msg_len);
 								}
 							}
-							else {
-								// ndp cache disabled, send broadcast
-								p2psecSendBroadcastMSG(g_p2psec, msg_buf, msg_len);
-							}
-						}
 
-						// output packets
-						while((sockdata_len = (p2psecOutputPacket(g_p2psec, sockdata_buf, 4096, new_peeraddr.addr))) > 0) {
-							sockdata_lastlen = sockdata_len;
-							if(!(ioWriteGroup(&iostate, IOGRP_SOCKET, sockdata_buf, sockdata_len, &new_peeraddr) > 0)) {
-								debug("could not send packet!");
-							}
+							// output packets
+							outputPackets(sockdata_buf, &sockdata_lastlen);
 						}
 					}
 				}
@@ -195,27 +332,44 @@ void mainLoop(struct s_initpeers * peers) {
 			}
 		}
 
-		// output packets
-		while((sockdata_len = (p2psecOutputPacket(g_p2psec, sockdata_buf, 4096, new_peeraddr.addr))) > 0) {
-			sockdata_lastlen = sockdata_len;
-			if(!(ioWriteGroup(&iostate, IOGRP_SOCKET, sockdata_buf, sockdata_len, &new_peeraddr) > 0)) {
-				debug("could not send packet!");
+		// tap device is drained, send bundled frames
+		if(!tapdata_rx) {
+			p2psecFlushBundle(g_p2psec);
+		}
+
+		// update advertised local MAC addresses or prefixes
+		if((g_enableeth > 0) && (tnow != lastadvert)) {
+			lastadvert = tnow;
+			if(g_enabletun) {
+				p2psecSetRouteAdvert(g_p2psec, advert_buf, routeGenAdvert(&g_routestate, advert_buf, peermgt_ROUTEADV_SIZE));
+			}
+			else {
+				p2psecSetMacAdvert(g_p2psec, advert_buf, switchGenMacAdvert(&g_switchstate, advert_buf, peermgt_MACADV_SIZE));
 			}
 		}
 
+		// output packets
+		outputPackets(sockdata_buf, &sockdata_lastlen);
+
 		// show status
 		if((tnow - laststatus) > 10) {
 			laststatus = tnow;
 			connectcount = p2psecPeerCount(g_p2psec);
-			if(lastconnectcount != connectcount) {
-				msgf("Uptime, %d secs, %d peers connected", p2psecUptime(g_p2psec), connectcount);
+			nodecount = p2psecNodeCount(g_p2psec);
+			if((lastconnectcount != connectcount) || (lastnodecount != nodecount)) {
+				msgf("Uptime, %d secs, %d peers connected, %d nodes known", p2psecUptime(g_p2psec), connectcount, nodecount);
 				lastconnectcount = connectcount;
+				lastnodecount = nodecount;
 			}
 		}
 
         // connect initpeers
-		if(((tnow - lastinit) > 30) && (!(mapGetKeyCount(&g_p2psec->mgt.map) > 1))) {
+		if(mapGetKeyCount(&g_p2psec->mgt.map) > 1) {
+			initinterval = 1;
+		}
+		else if((tnow - lastinit) >= initinterval) { // retry with exponential backoff until the first peer is connected
 			lastinit = tnow;
+			initinterval = ((initinterval * 2) > 30) ? 30 : (initinterval * 2);
 			connectInitpeers(peers);
 		}
 
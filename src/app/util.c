@@ -26,6 +26,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#if defined(WIN32)
+#include <windows.h>
+#endif
 #include "util.h"
 
 // Convert a 4 bit number to a hexchar.
@@ -188,6 +191,18 @@ int utilGetClock() {
 	return time(NULL);
 }
 
+
+// Get monotonic clock value in milliseconds
+int64_t utilGetClockMs() {
+#if defined(WIN32)
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000));
+#endif
+}
+
 int isWhitespaceChar(char c) {
     switch(c) {
         case ' ':
@@ -33,9 +33,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 int cryptoRandFD = -1;
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+pthread_mutex_t *cryptoLocks = NULL;
+#endif
+
 // return EVP cipher key size
 int cryptoGetEVPCipherSize(struct s_crypto_cipher *st_cipher) {
 	return EVP_CIPHER_key_length(st_cipher->cipher);
@@ -216,6 +222,17 @@ void cryptoDestroy(struct s_crypto *ctxs, const int count) {
 }
 
 
+// copy cipher contexts, the copy can be used by another thread than the original
+int cryptoCopy(struct s_crypto *dst_ctx, struct s_crypto *src_ctx) {
+	HMAC_CTX_cleanup(&dst_ctx->hmac_ctx);
+	HMAC_CTX_init(&dst_ctx->hmac_ctx);
+	if(!EVP_CIPHER_CTX_copy(&dst_ctx->enc_ctx, &src_ctx->enc_ctx)) return 0;
+	if(!EVP_CIPHER_CTX_copy(&dst_ctx->dec_ctx, &src_ctx->dec_ctx)) return 0;
+	if(!HMAC_CTX_copy(&dst_ctx->hmac_ctx, &src_ctx->hmac_ctx)) return 0;
+	return 1;
+}
+
+
 // create cipher contexts
 int cryptoCreate(struct s_crypto *ctxs, const int count) {
 	int i;
@@ -278,9 +295,9 @@ int cryptoSetSessionKeys(struct s_crypto *session_ctx, struct s_crypto *cipher_k
 }
 
 
-// encrypt buffer
-int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len) {
-	if(!((enc_len > 0) && (dec_len > 0) && (dec_len < enc_len) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+// encrypt prefix and buffer with the specified IV
+static int cryptoEncIV(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *pre_buf, const int pre_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len, const unsigned char *iv_buf) {
+	if(!((enc_len > 0) && (dec_len >= 0) && (pre_len >= 0) && ((pre_len + dec_len) > 0) && ((pre_len + dec_len) < enc_len) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
 
 	unsigned char iv[crypto_MAXIVSIZE];
 	unsigned char hmac[hmac_len];
@@ -288,15 +305,20 @@ int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, c
 	int cr_len;
 	int len;
 
-	if(enc_len < (hdr_len + crypto_MAXIVSIZE + dec_len)) { return 0; }
+	if(enc_len < (hdr_len + crypto_MAXIVSIZE + pre_len + dec_len)) { return 0; }
 
 	memset(iv, 0, crypto_MAXIVSIZE);
-	cryptoRand(iv, iv_len);
+	memcpy(iv, iv_buf, iv_len);
 	memcpy(&enc_buf[hmac_len], iv, iv_len);
 
 	if(!EVP_EncryptInit_ex(&ctx->enc_ctx, NULL, NULL, NULL, iv)) { return 0; }
-	if(!EVP_EncryptUpdate(&ctx->enc_ctx, &enc_buf[(hdr_len)], &len, dec_buf, dec_len)) { return 0; }
-	cr_len = len;
+	cr_len = 0;
+	if(pre_len > 0) {
+		if(!EVP_EncryptUpdate(&ctx->enc_ctx, &enc_buf[(hdr_len)], &len, pre_buf, pre_len)) { return 0; }
+		cr_len = len;
+	}
+	if(!EVP_EncryptUpdate(&ctx->enc_ctx, &enc_buf[(hdr_len + cr_len)], &len, dec_buf, dec_len)) { return 0; }
+	cr_len += len;
 	if(!EVP_EncryptFinal(&ctx->enc_ctx, &enc_buf[(hdr_len + cr_len)], &len)) { return 0; }
 	cr_len += len;
 
@@ -307,21 +329,41 @@ int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, c
 }
 
 
-// decrypt buffer
-int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
+// encrypt buffer
+int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len) {
+	unsigned char iv[crypto_MAXIVSIZE];
+	if(!((iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+	cryptoRand(iv, iv_len);
+	return cryptoEncIV(ctx, enc_buf, enc_len, NULL, 0, dec_buf, dec_len, hmac_len, iv_len, iv);
+}
+
+
+// verify HMAC tag of encrypted buffer
+static int cryptoDecAuth(struct s_crypto *ctx, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
+	if(!((enc_len > 0) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+
+	unsigned char hmac[hmac_len];
+
+	if(enc_len < (hmac_len + iv_len)) { return 0; }
+
+	if(!cryptoHMAC(ctx, hmac, hmac_len, &enc_buf[hmac_len], (enc_len - hmac_len))) { return 0; }
+	if(memcmp(hmac, enc_buf, hmac_len) != 0) { return 0; }
+
+	return 1;
+}
+
+
+// decrypt authenticated buffer
+static int cryptoDecData(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
 	if(!((enc_len > 0) && (dec_len > 0) && (enc_len < dec_len) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
 
 	unsigned char iv[crypto_MAXIVSIZE];
-	unsigned char hmac[hmac_len];
 	const int hdr_len = (hmac_len + iv_len);
 	int cr_len;
 	int len;
 
 	if(enc_len < hdr_len) { return 0; }
 
-	if(!cryptoHMAC(ctx, hmac, hmac_len, &enc_buf[hmac_len], (enc_len - hmac_len))) { return 0; }
-	if(memcmp(hmac, enc_buf, hmac_len) != 0) { return 0; }
-
 	memset(iv, 0, crypto_MAXIVSIZE);
 	memcpy(iv, &enc_buf[hmac_len], iv_len);
 
@@ -335,6 +377,70 @@ int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, c
 }
 
 
+// decrypt buffer
+int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
+	if(!((enc_len > 0) && (dec_len > 0) && (enc_len < dec_len))) { return 0; }
+	if(!cryptoDecAuth(ctx, enc_buf, enc_len, hmac_len, iv_len)) { return 0; }
+	return cryptoDecData(ctx, dec_buf, dec_len, enc_buf, enc_len, hmac_len, iv_len);
+}
+
+
+// encrypt multiple buffers of one or several sessions. Sets the result of each item to the encrypted length, or 0 on error. Returns the number of encrypted buffers.
+int cryptoEncBatch(struct s_crypto_batch *batch, const int count, const int hmac_len, const int iv_len) {
+	unsigned char iv[crypto_BATCHMAX * crypto_MAXIVSIZE];
+	struct s_crypto_batch *item;
+	int done;
+	int pos;
+	int n;
+	int i;
+
+	if(!((iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+
+	done = 0;
+	pos = 0;
+	while(pos < count) {
+		n = (count - pos);
+		if(n > crypto_BATCHMAX) n = crypto_BATCHMAX;
+
+		// one RNG call for the IVs of the whole chunk
+		cryptoRand(iv, (n * iv_len));
+		for(i=0; i<n; i++) {
+			item = &batch[pos + i];
+			item->result = cryptoEncIV(item->ctx, item->out_buf, item->out_len, item->pre_buf, item->pre_len, item->in_buf, item->in_len, hmac_len, iv_len, &iv[i * iv_len]);
+			if(item->result > 0) done++;
+		}
+		pos += n;
+	}
+
+	return done;
+}
+
+
+// decrypt multiple buffers of one or several sessions. Sets the result of each item to the decrypted length, or 0 on error. Returns the number of decrypted buffers.
+int cryptoDecBatch(struct s_crypto_batch *batch, const int count, const int hmac_len, const int iv_len) {
+	struct s_crypto_batch *item;
+	int done;
+	int i;
+
+	// authenticate all buffers first, only authentic buffers are decrypted
+	for(i=0; i<count; i++) {
+		item = &batch[i];
+		item->result = ((item->out_len > item->in_len) && cryptoDecAuth(item->ctx, item->in_buf, item->in_len, hmac_len, iv_len));
+	}
+
+	done = 0;
+	for(i=0; i<count; i++) {
+		item = &batch[i];
+		if(item->result) {
+			item->result = cryptoDecData(item->ctx, item->out_buf, item->out_len, item->in_buf, item->in_len, hmac_len, iv_len);
+			if(item->result > 0) done++;
+		}
+	}
+
+	return done;
+}
+
+
 // calculate hash
 int cryptoCalculateHash(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len, const EVP_MD *hash_func) {
 	unsigned char hash[EVP_MAX_MD_SIZE];
@@ -363,6 +469,43 @@ int cryptoCalculateSHA512(unsigned char *hash_buf, const int hash_len, const uns
 }
 
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// OpenSSL lock callback
+static void cryptoLockCallback(int mode, int n, const char *file, int line) {
+	if(mode & CRYPTO_LOCK) {
+		pthread_mutex_lock(&cryptoLocks[n]);
+	}
+	else {
+		pthread_mutex_unlock(&cryptoLocks[n]);
+	}
+}
+
+
+// OpenSSL thread ID callback
+static void cryptoThreadIDCallback(CRYPTO_THREADID *id) {
+	CRYPTO_THREADID_set_numeric(id, (unsigned long)pthread_self());
+}
+#endif
+
+
+// allow the use of separate cipher contexts from several threads
+int cryptoEnableThreads() {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	int count;
+	int i;
+	if(cryptoLocks != NULL) return 1;
+	count = CRYPTO_num_locks();
+	if((cryptoLocks = malloc(sizeof(pthread_mutex_t) * count)) == NULL) return 0;
+	for(i=0; i<count; i++) {
+		pthread_mutex_init(&cryptoLocks[i], NULL);
+	}
+	CRYPTO_THREADID_set_callback(cryptoThreadIDCallback);
+	CRYPTO_set_locking_callback(cryptoLockCallback);
+#endif
+	return 1;
+}
+
+
 // generate session keys from password
 int cryptoSetSessionKeysFromPassword(struct s_crypto *session_ctx, const unsigned char *password, const int password_len, const int cipher_algorithm, const int hmac_algorithm) {
 	unsigned char key_a[64];
@@ -0,0 +1,218 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_ARP4_C
+#define F_ARP4_C
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ethernet.h"
+#include "p2p.h"
+#include "util.h"
+#include "map.h"
+
+// Check if Ethernet frame contains an IPv4 over Ethernet ARP packet.
+static int arp4IsARP(const unsigned char *frame, const int frame_len) {
+	return (
+	(frame_len >= 42) &&
+	(frame[12] == 0x08) && (frame[13] == 0x06) &&	// ethertype ARP
+	(memcmp(&frame[14], "\x00\x01\x08\x00\x06\x04", 6) == 0)	// hardware type Ethernet, protocol type IPv4, address sizes 6/4
+	);
+}
+
+
+// Learn MAC+PortID+PortTS of incoming ARP or IPv4 packet.
+void arp4PacketIn(struct s_arp4_state *arpstate, const unsigned char *frame, const int frame_len, const int portid, const int portts) {
+	struct s_arp4_arptable_entry mapentry;
+	struct s_arp4_arptable_entry *oldentry;
+	const unsigned char *ipv4addr;
+	const unsigned char *macaddr;
+	if(arp4IsARP(frame, frame_len)) {
+		ipv4addr = &frame[28];
+		macaddr = &frame[22];
+		if(
+		((macaddr[0] & 0x01) == 0) &&	// unicast sender MAC
+		(memcmp(macaddr, &frame[6], arp4_MAC_SIZE) == 0) &&	// sender MAC matches source MAC
+		(memcmp(ipv4addr, "\x00\x00\x00\x00", arp4_ADDR_SIZE) != 0)	// not an ARP probe
+		) {
+			memcpy(mapentry.mac, macaddr, arp4_MAC_SIZE);
+			mapentry.portid = portid;
+			mapentry.portts = portts;
+			mapentry.ents = utilGetClock();
+			mapSet(&arpstate->arptable, ipv4addr, &mapentry);
+		}
+	}
+	else if(frame_len > 33) {
+		ipv4addr = &frame[26];
+		macaddr = &frame[6];
+		if(
+		(frame[12] == 0x08) && (frame[13] == 0x00) &&	// ethertype IPv4
+		((frame[14] >> 4) == 4)				// packet is IPv4
+		) {
+			oldentry = mapGet(&arpstate->arptable, ipv4addr);
+			if((oldentry != NULL) && (memcmp(oldentry->mac, macaddr, arp4_MAC_SIZE) == 0)) { // existing entry with same MAC can be refreshed
+				memcpy(mapentry.mac, macaddr, arp4_MAC_SIZE);
+				mapentry.portid = portid;
+				mapentry.portts = portts;
+				mapentry.ents = utilGetClock();
+				mapSet(&arpstate->arptable, ipv4addr, &mapentry);
+			}
+		}
+	}
+}
+
+
+// Generate ARP reply. Returns length of generated answer.
+int arp4GenReplyFrame(unsigned char *outbuf, const int outbuf_len, const unsigned char *src_addr, const unsigned char *dest_addr, const unsigned char *src_mac, const unsigned char *dest_mac) {
+	if(outbuf_len >= 42) {
+		memcpy(&outbuf[0], dest_mac, arp4_MAC_SIZE); // destination MAC
+		memcpy(&outbuf[6], src_mac, arp4_MAC_SIZE); // source MAC
+		memcpy(&outbuf[12], "\x08\x06\x00\x01\x08\x00\x06\x04\x00\x02", 10); // ARP header (Ethernet/IPv4, opcode reply)
+		memcpy(&outbuf[22], src_mac, arp4_MAC_SIZE); // sender MAC address
+		memcpy(&outbuf[28], src_addr, arp4_ADDR_SIZE); // sender IPv4 address
+		memcpy(&outbuf[32], dest_mac, arp4_MAC_SIZE); // target MAC address
+		memcpy(&outbuf[38], dest_addr, arp4_ADDR_SIZE); // target IPv4 address
+		return 42;
+	}
+	return 0;
+}
+
+
+// Scan Ethernet frame for ARP request and generate answer ARP reply. Returns length of generated answer.
+int arp4GenReply(struct s_arp4_state *arpstate, const unsigned char *frame, const int frame_len, unsigned char *replybuf, const int replybuf_len, int *portid, int *portts) {
+	struct s_arp4_arptable_entry *mapentry;
+	const unsigned char *ipv4addr;
+	const unsigned char *macaddr;
+	const unsigned char *reqipv4addr;
+	if(arp4IsARP(frame, frame_len)) {
+		ipv4addr = &frame[28];
+		macaddr = &frame[22];
+		reqipv4addr = &frame[38];
+		if(
+		((macaddr[0] & 0x01) == 0) &&	// unicast sender MAC
+		(memcmp(macaddr, &frame[6], arp4_MAC_SIZE) == 0) &&	// sender MAC matches source MAC
+		(frame[20] == 0x00) && (frame[21] == 0x01) &&	// packet is ARP request
+		(memcmp(ipv4addr, "\x00\x00\x00\x00", arp4_ADDR_SIZE) != 0) &&	// not an ARP probe
+		(memcmp(ipv4addr, reqipv4addr, arp4_ADDR_SIZE) != 0)	// not a gratuitous ARP
+		) {
+			// resolve requested ipv4 address
+			mapentry = mapGet(&arpstate->arptable, reqipv4addr);
+			if(mapentry != NULL) {
+				if(((utilGetClock() - mapentry->ents) < arp4_TIMEOUT) && (memcmp(mapentry->mac, macaddr, arp4_MAC_SIZE) != 0)) {
+					// valid entry found
+					*portid = mapentry->portid;
+					*portts = mapentry->portts;
+
+					// generate answer
+					return arp4GenReplyFrame(replybuf, replybuf_len, reqipv4addr, ipv4addr, mapentry->mac, macaddr);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Generate ARP table status report.
+void arp4Status(struct s_arp4_state *arpstate, char *report, const int report_len) {
+	int tnow = utilGetClock();
+	struct s_map *map = &arpstate->arptable;
+	struct s_arp4_arptable_entry *mapentry;
+	int pos = 0;
+	int size = mapGetMapSize(map);
+	int maxpos = (((size + 2) * (65)) + 1);
+	unsigned char infoipv4addr[arp4_ADDR_SIZE];
+	char infoipv4str[16];
+	unsigned char infomacaddr[arp4_MAC_SIZE];
+	unsigned char infoportid[4];
+	unsigned char infoportts[4];
+	unsigned char infoents[4];
+	int i;
+	int j;
+
+	if(maxpos > report_len) { maxpos = report_len; }
+
+	memcpy(&report[pos], "IPv4             MAC                PortID    PortTS    LastPkt ", 64);
+	pos = pos + 64;
+	report[pos++] = '\n';
+
+	i = 0;
+	while(i < size && (pos + 65) < maxpos) {
+		if(mapIsValidID(map, i)) {
+			mapentry = (struct s_arp4_arptable_entry *)mapGetValueByID(&arpstate->arptable, i);
+			memcpy(infoipv4addr, mapGetKeyByID(map, i), arp4_ADDR_SIZE);
+			memcpy(infomacaddr, mapentry->mac, arp4_MAC_SIZE);
+			j = snprintf(infoipv4str, 16, "%d.%d.%d.%d", infoipv4addr[0], infoipv4addr[1], infoipv4addr[2], infoipv4addr[3]);
+			memset(&report[pos], ' ', 15);
+			memcpy(&report[pos], infoipv4str, j);
+			pos = pos + 15;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			j = 0;
+			while(j < arp4_MAC_SIZE) {
+				utilByteArrayToHexstring(&report[pos + (j * 3)], (2 + 2), &infomacaddr[j], 1);
+				report[pos + (j * 3) + 2] = ':';
+				j++;
+			}
+			pos = pos + ((arp4_MAC_SIZE * 2) + (arp4_MAC_SIZE) - 1);
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infoportid, mapentry->portid);
+			utilByteArrayToHexstring(&report[pos], ((4 * 2) + 2), infoportid, 4);
+			pos = pos + (4 * 2);
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infoportts, mapentry->portts);
+			utilByteArrayToHexstring(&report[pos], ((4 * 2) + 2), infoportts, 4);
+			pos = pos + (4 * 2);
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infoents, (tnow - mapentry->ents));
+			utilByteArrayToHexstring(&report[pos], ((4 * 2) + 2), infoents, 4);
+			pos = pos + (4 * 2);
+			report[pos++] = '\n';
+		}
+		i++;
+	}
+	report[pos++] = '\0';
+}
+
+
+// Create ARP4 structure.
+int arp4Create(struct s_arp4_state *arpstate) {
+	if(mapCreate(&arpstate->arptable, arp4_TABLE_SIZE, arp4_ADDR_SIZE, sizeof(struct s_arp4_arptable_entry))) {
+		mapEnableReplaceOld(&arpstate->arptable);
+		mapInit(&arpstate->arptable);
+		return 1;
+	}
+	return 0;
+}
+
+
+// Destroy ARP4 structure.
+void arp4Destroy(struct s_arp4_state *arpstate) {
+	mapDestroy(&arpstate->arptable);
+}
+
+
+#endif // F_ARP4_C
@@ -22,6 +22,8 @@
 #ifndef F_CHECKSUM_C
 #define F_CHECKSUM_C
 
+#include <string.h>
+
 #include "ethernet.h"
 
 // Zeroes the checksum.
@@ -36,6 +38,22 @@ void checksumAdd(struct s_checksum *cs, const uint16_t x) {
 }
 
 
+// Adds a buffer to the checksum. An odd trailing byte is padded with zero.
+void checksumAddBuf(struct s_checksum *cs, const unsigned char *buf, const int len) {
+	uint16_t x;
+	int i;
+	for(i=0; (i + 1) < len; i = i + 2) {
+		memcpy(&x, &buf[i], 2);
+		cs->checksum += x;
+	}
+	if(i < len) {
+		x = 0;
+		memcpy(&x, &buf[i], 1);
+		cs->checksum += x;
+	}
+}
+
+
 // Get checksum
 uint16_t checksumGet(struct s_checksum *cs) {
 	uint16_t ret;
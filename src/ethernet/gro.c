@@ -0,0 +1,254 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_GRO_C
+#define F_GRO_C
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ethernet.h"
+#include "util.h"
+
+
+// Parsed TCP segment.
+struct s_gro_segment {
+	int len;
+	int l3off;
+	int l4off;
+	int hdrlen;
+	int v6;
+};
+
+
+// Add the TCP pseudo header of a segment to the checksum.
+static void groChecksumAddPseudo(struct s_checksum *cs, const unsigned char *l3, const int v6, const int l4len) {
+	unsigned char pseudo[8];
+	if(v6) {
+		checksumAddBuf(cs, &l3[8], 32);
+		utilWriteInt32(&pseudo[0], l4len);
+		memcpy(&pseudo[4], "\x00\x00\x00\x06", 4);
+		checksumAddBuf(cs, pseudo, 8);
+	}
+	else {
+		checksumAddBuf(cs, &l3[12], 8);
+		pseudo[0] = 0;
+		pseudo[1] = 6;
+		utilWriteInt16(&pseudo[2], l4len);
+		checksumAddBuf(cs, pseudo, 4);
+	}
+}
+
+
+// Check if frame is a TCP segment with payload that may be coalesced. Returns 1 if so.
+static int groParse(struct s_gro_segment *seg, const unsigned char *frame, const int frame_len, const int l2) {
+	struct s_checksum checksum;
+	const unsigned char *l3;
+	const unsigned char *l4;
+	int ethertype;
+
+	seg->l3off = 0;
+	if(l2) {
+		if(frame_len < 14) return 0;
+		ethertype = ((frame[12] << 8) | frame[13]);
+		if((ethertype != 0x0800) && (ethertype != 0x86dd)) return 0;
+		seg->l3off = 14;
+	}
+	if((frame_len - seg->l3off) < 40) return 0;
+	l3 = &frame[seg->l3off];
+	if((l3[0] >> 4) == 4) {
+		// IPv4 without options and fragmentation
+		if((l3[0] != 0x45) || (l3[9] != 6) || ((utilReadInt16(&l3[6]) & 0x3fff) != 0)) return 0;
+		seg->v6 = 0;
+		seg->l4off = seg->l3off + 20;
+		seg->len = seg->l3off + (utilReadInt16(&l3[2]) & 0xffff);
+	}
+	else if((l3[0] >> 4) == 6) {
+		// IPv6 without extension headers
+		if(((frame_len - seg->l3off) < 60) || (l3[6] != 6)) return 0;
+		seg->v6 = 1;
+		seg->l4off = seg->l3off + 40;
+		seg->len = seg->l4off + (utilReadInt16(&l3[4]) & 0xffff);
+	}
+	else {
+		return 0;
+	}
+	if((seg->len > frame_len) || ((seg->l4off + 20) > seg->len)) return 0;
+
+	// only ACK and PSH may be set
+	l4 = &frame[seg->l4off];
+	if((l4[13] & ~(0x08)) != 0x10) return 0;
+	seg->hdrlen = seg->l4off + ((l4[12] >> 4) * 4);
+	if((seg->hdrlen < (seg->l4off + 20)) || (seg->hdrlen >= seg->len)) return 0;
+
+	// never merge a segment with a bad checksum, the stack has to drop it
+	checksumZero(&checksum);
+	groChecksumAddPseudo(&checksum, l3, seg->v6, (seg->len - seg->l4off));
+	checksumAddBuf(&checksum, l4, (seg->len - seg->l4off));
+	if(checksumGet(&checksum) != 0) return 0;
+
+	return 1;
+}
+
+
+// Append frame to the pending superframe. Returns 1 if the frame has been coalesced.
+int groAppend(struct s_gro_state *gro, const unsigned char *frame, const int frame_len, const int peerid, const int peerct, const int l2) {
+	struct s_gro_segment seg;
+	unsigned char *l3;
+	unsigned char *l4;
+	const unsigned char *fl3;
+	const unsigned char *fl4;
+	int payload_len;
+
+	if((gro->count < 1) || (gro->closed) || (gro->peerid != peerid) || (gro->peerct != peerct)) return 0;
+	if(!groParse(&seg, frame, frame_len, l2)) return 0;
+	if((seg.l3off != gro->l3off) || (seg.l4off != gro->l4off) || (seg.hdrlen != gro->hdrlen) || (seg.v6 != gro->v6)) return 0;
+	payload_len = seg.len - seg.hdrlen;
+	if((payload_len > gro->mss) || ((gro->len + payload_len) > gro_BUF_SIZE) || ((gro->len + payload_len - gro->l3off - (gro->v6 ? 40 : 0)) > 65535)) return 0;
+
+	// compare headers, except lengths, IP id, sequence number, PSH flag and checksums
+	l3 = &gro->buf[gro->l3off];
+	l4 = &gro->buf[gro->l4off];
+	fl3 = &frame[seg.l3off];
+	fl4 = &frame[seg.l4off];
+	if(memcmp(gro->buf, frame, gro->l3off) != 0) return 0;
+	if(gro->v6) {
+		if((memcmp(l3, fl3, 4) != 0) || (memcmp(&l3[6], &fl3[6], 34) != 0)) return 0;
+	}
+	else {
+		if((memcmp(l3, fl3, 2) != 0) || (memcmp(&l3[6], &fl3[6], 4) != 0) || (memcmp(&l3[12], &fl3[12], 8) != 0)) return 0;
+	}
+	if((memcmp(l4, fl4, 4) != 0) || (memcmp(&l4[8], &fl4[8], 4) != 0) || (memcmp(&l4[14], &fl4[14], 2) != 0) || (memcmp(&l4[18], &fl4[18], (gro->hdrlen - gro->l4off - 18)) != 0)) return 0;
+	if((uint32_t)utilReadInt32(&fl4[4]) != gro->nextseq) return 0;
+
+	// append payload
+	memcpy(&gro->buf[gro->len], &frame[seg.hdrlen], payload_len);
+	gro->len = gro->len + payload_len;
+	gro->nextseq = gro->nextseq + payload_len;
+	gro->count++;
+	if((payload_len < gro->mss) || (fl4[13] & 0x08)) {
+		// short segment or PSH ends the superframe
+		l4[13] |= (fl4[13] & 0x08);
+		gro->closed = 1;
+	}
+	return 1;
+}
+
+
+// Start a new pending superframe with frame. The previous superframe has to be taken with groGet first. Returns 1 if the frame has been stored.
+int groStart(struct s_gro_state *gro, const unsigned char *frame, const int frame_len, const int peerid, const int peerct, const int l2) {
+	struct s_gro_segment seg;
+
+	if(gro->count > 0) return 0;
+	if(!groParse(&seg, frame, frame_len, l2)) return 0;
+	if(seg.len > gro_BUF_SIZE) return 0;
+	memcpy(gro->buf, frame, seg.len);
+	gro->len = seg.len;
+	gro->l3off = seg.l3off;
+	gro->l4off = seg.l4off;
+	gro->hdrlen = seg.hdrlen;
+	gro->v6 = seg.v6;
+	gro->mss = seg.len - seg.hdrlen;
+	gro->nextseq = (uint32_t)utilReadInt32(&frame[seg.l4off + 4]) + gro->mss;
+	gro->peerid = peerid;
+	gro->peerct = peerct;
+	gro->count = 1;
+	gro->closed = ((frame[seg.l4off + 13] & 0x08) != 0);
+	return 1;
+}
+
+
+// Take the pending superframe and its virtio-net header. Returns length of the frame, or 0 if there is none.
+int groGet(struct s_gro_state *gro, unsigned char **vnethdr, unsigned char **frame) {
+	struct s_checksum checksum;
+	unsigned char *l3;
+	uint16_t u;
+	int len;
+
+	if(gro->count < 1) return 0;
+	memset(gro->vnethdr, 0, gso_VNETHDR_SIZE);
+	if(gro->count > 1) {
+		// fix lengths, leave the TCP checksum to the kernel
+		l3 = &gro->buf[gro->l3off];
+		if(gro->v6) {
+			utilWriteInt16(&l3[4], (gro->len - gro->l4off));
+		}
+		else {
+			utilWriteInt16(&l3[2], (gro->len - gro->l3off));
+			memset(&l3[10], 0, 2);
+			checksumZero(&checksum);
+			checksumAddBuf(&checksum, l3, 20);
+			u = checksumGet(&checksum);
+			memcpy(&l3[10], &u, 2);
+		}
+		checksumZero(&checksum);
+		groChecksumAddPseudo(&checksum, l3, gro->v6, (gro->len - gro->l4off));
+		u = ~checksumGet(&checksum);
+		memcpy(&gro->buf[gro->l4off + 16], &u, 2);
+
+		// native byte order virtio-net header
+		gro->vnethdr[0] = gso_FLAG_NEEDS_CSUM;
+		gro->vnethdr[1] = (gro->v6) ? gso_TYPE_TCPV6 : gso_TYPE_TCPV4;
+		u = gro->hdrlen;
+		memcpy(&gro->vnethdr[2], &u, 2);
+		u = gro->mss;
+		memcpy(&gro->vnethdr[4], &u, 2);
+		u = gro->l4off;
+		memcpy(&gro->vnethdr[6], &u, 2);
+		u = 16;
+		memcpy(&gro->vnethdr[8], &u, 2);
+	}
+	len = gro->len;
+	*vnethdr = gro->vnethdr;
+	*frame = gro->buf;
+	gro->count = 0;
+	gro->closed = 0;
+	gro->len = 0;
+	return len;
+}
+
+
+// Returns 1 if a superframe is pending.
+int groPending(struct s_gro_state *gro) {
+	return (gro->count > 0);
+}
+
+
+// Create GRO structure.
+int groCreate(struct s_gro_state *gro) {
+	if((gro->buf = (malloc(gro_BUF_SIZE))) != NULL) {
+		gro->len = 0;
+		gro->count = 0;
+		gro->closed = 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+// Destroy GRO structure.
+void groDestroy(struct s_gro_state *gro) {
+	free(gro->buf);
+}
+
+
+#endif // F_GRO_C
@@ -0,0 +1,186 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_GSO_C
+#define F_GSO_C
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "ethernet.h"
+#include "util.h"
+
+
+// Read native 16 bit integer of the virtio-net header.
+static int gsoReadHdr16(const unsigned char *buf) {
+	uint16_t u;
+	memcpy(&u, buf, 2);
+	return u;
+}
+
+
+// Prepare segmentation of a frame read from the TAP device. If vnethdr is set, the frame is prefixed with a virtio-net header. Returns 1 if the frame can be sent.
+int gsoInit(struct s_gso_state *gso, unsigned char *buf, const int buf_len, const int vnethdr, const int l2) {
+	struct s_checksum checksum;
+	uint16_t u;
+	int flags;
+	int csum_start;
+	int csum_offset;
+	int ethertype;
+
+	gso->frame = buf;
+	gso->frame_len = buf_len;
+	gso->type = gso_TYPE_NONE;
+	gso->pos = 0;
+	gso->segno = 0;
+	gso->done = 0;
+	if(!vnethdr) return 1;
+
+	gso->done = 1;
+	if(buf_len <= gso_VNETHDR_SIZE) return 0;
+	flags = buf[0];
+	gso->type = (buf[1] & (~gso_TYPE_ECN));
+	gso->mss = gsoReadHdr16(&buf[4]);
+	csum_start = gsoReadHdr16(&buf[6]);
+	csum_offset = gsoReadHdr16(&buf[8]);
+	gso->frame = &buf[gso_VNETHDR_SIZE];
+	gso->frame_len = buf_len - gso_VNETHDR_SIZE;
+
+	if(gso->type == gso_TYPE_NONE) {
+		if(flags & gso_FLAG_NEEDS_CSUM) {
+			// complete the partial checksum, the checksum field already contains the pseudo header sum
+			if((csum_start + csum_offset + 2) > gso->frame_len) return 0;
+			checksumZero(&checksum);
+			checksumAddBuf(&checksum, &gso->frame[csum_start], (gso->frame_len - csum_start));
+			u = checksumGet(&checksum);
+			memcpy(&gso->frame[csum_start + csum_offset], &u, 2);
+		}
+		gso->done = 0;
+		return 1;
+	}
+	if((gso->type != gso_TYPE_TCPV4) && (gso->type != gso_TYPE_TCPV6)) return 0;
+
+	// locate network and transport header
+	gso->l3off = 0;
+	if(l2) {
+		gso->l3off = 14;
+		if(gso->frame_len < gso->l3off) return 0;
+		ethertype = ((gso->frame[12] << 8) | gso->frame[13]);
+		while(((ethertype == 0x8100) || (ethertype == 0x88a8)) && ((gso->l3off + 4) <= gso->frame_len)) {
+			ethertype = ((gso->frame[gso->l3off + 2] << 8) | gso->frame[gso->l3off + 3]);
+			gso->l3off = gso->l3off + 4;
+		}
+	}
+	gso->l4off = csum_start;
+	if((gso->mss <= 0) || ((gso->l4off + 20) > gso->frame_len)) return 0;
+	if(gso->type == gso_TYPE_TCPV4) {
+		if(((gso->l3off + 20) > gso->l4off) || ((gso->frame[gso->l3off] >> 4) != 4)) return 0;
+	}
+	else {
+		if(((gso->l3off + 40) > gso->l4off) || ((gso->frame[gso->l3off] >> 4) != 6)) return 0;
+	}
+	gso->hdrlen = gso->l4off + ((gso->frame[gso->l4off + 12] >> 4) * 4);
+	if((gso->hdrlen > gso->frame_len) || (gso->hdrlen < (gso->l4off + 20))) return 0;
+
+	gso->done = 0;
+	return 1;
+}
+
+
+// Get next segment of the frame. Returns length of the segment, or 0 if there are no more segments.
+int gsoNext(struct s_gso_state *gso, unsigned char *segbuf, const int segbuf_len, unsigned char **seg) {
+	struct s_checksum checksum;
+	unsigned char pseudo[40];
+	unsigned char *l3;
+	unsigned char *l4;
+	uint16_t u;
+	int chunk;
+	int seglen;
+	int last;
+
+	if(gso->done) return 0;
+	if(gso->type == gso_TYPE_NONE) {
+		gso->done = 1;
+		*seg = gso->frame;
+		return gso->frame_len;
+	}
+
+	// copy headers and the next chunk of payload
+	chunk = gso->frame_len - gso->hdrlen - gso->pos;
+	if(chunk > gso->mss) chunk = gso->mss;
+	last = ((gso->hdrlen + gso->pos + chunk) >= gso->frame_len);
+	seglen = gso->hdrlen + chunk;
+	if(seglen > segbuf_len) {
+		gso->done = 1;
+		return 0;
+	}
+	memcpy(segbuf, gso->frame, gso->hdrlen);
+	memcpy(&segbuf[gso->hdrlen], &gso->frame[gso->hdrlen + gso->pos], chunk);
+	l3 = &segbuf[gso->l3off];
+	l4 = &segbuf[gso->l4off];
+
+	// fix network header
+	if(gso->type == gso_TYPE_TCPV4) {
+		utilWriteInt16(&l3[2], (seglen - gso->l3off));
+		utilWriteInt16(&l3[4], (utilReadInt16(&l3[4]) + gso->segno));
+		memset(&l3[10], 0, 2);
+		checksumZero(&checksum);
+		checksumAddBuf(&checksum, l3, ((l3[0] & 0x0f) * 4));
+		u = checksumGet(&checksum);
+		memcpy(&l3[10], &u, 2);
+	}
+	else {
+		utilWriteInt16(&l3[4], (seglen - gso->l3off - 40));
+	}
+
+	// fix transport header
+	utilWriteInt32(&l4[4], (utilReadInt32(&l4[4]) + gso->pos));
+	if(!last) l4[13] &= ~(0x01 | 0x08); // FIN and PSH only on the last segment
+	if(gso->segno > 0) l4[13] &= ~(0x80); // CWR only on the first segment
+	memset(&l4[16], 0, 2);
+	checksumZero(&checksum);
+	if(gso->type == gso_TYPE_TCPV4) {
+		memcpy(&pseudo[0], &l3[12], 8);
+		pseudo[8] = 0;
+		pseudo[9] = 6;
+		utilWriteInt16(&pseudo[10], (seglen - gso->l4off));
+		checksumAddBuf(&checksum, pseudo, 12);
+	}
+	else {
+		memcpy(&pseudo[0], &l3[8], 32);
+		utilWriteInt32(&pseudo[32], (seglen - gso->l4off));
+		memcpy(&pseudo[36], "\x00\x00\x00\x06", 4);
+		checksumAddBuf(&checksum, pseudo, 40);
+	}
+	checksumAddBuf(&checksum, l4, (seglen - gso->l4off));
+	u = checksumGet(&checksum);
+	memcpy(&l4[16], &u, 2);
+
+	gso->pos = gso->pos + chunk;
+	gso->segno++;
+	if(last) gso->done = 1;
+	*seg = segbuf;
+	return seglen;
+}
+
+
+#endif // F_GSO_C
@@ -0,0 +1,57 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_QOS_C
+#define F_QOS_C
+
+#include "ethernet.h"
+
+
+// Get the DSCP of an IPv4 or IPv6 frame read from the TAP device. If l2 is set, the frame starts with an ethernet header. Returns the IPv4 TOS or IPv6 traffic class with cleared ECN bits, or 0 if the frame is not an IP packet.
+int qosGetTOS(const unsigned char *frame, const int frame_len, const int l2) {
+	int l3off;
+	int ethertype;
+
+	l3off = 0;
+	if(l2) {
+		l3off = 14;
+		if(frame_len < l3off) return 0;
+		ethertype = ((frame[12] << 8) | frame[13]);
+		while(((ethertype == 0x8100) || (ethertype == 0x88a8)) && ((l3off + 4) <= frame_len)) {
+			ethertype = ((frame[l3off + 2] << 8) | frame[l3off + 3]);
+			l3off = l3off + 4;
+		}
+		if((ethertype != 0x0800) && (ethertype != 0x86dd)) return 0;
+	}
+	if((l3off + 2) > frame_len) return 0;
+
+	switch(frame[l3off] >> 4) {
+		case 4:
+			return (frame[l3off + 1] & qos_DSCP_MASK);
+		case 6:
+			return ((((frame[l3off] & 0x0f) << 4) | (frame[l3off + 1] >> 4)) & qos_DSCP_MASK);
+		default:
+			return 0;
+	}
+}
+
+
+#endif // F_QOS_C
@@ -0,0 +1,306 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_ROUTE_C
+#define F_ROUTE_C
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(WIN32)
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "ethernet.h"
+#include "p2p.h"
+#include "util.h"
+#include "logging.h"
+
+
+// Get bit of address.
+static int routeBit(const unsigned char *addr, const int bit) {
+	return ((addr[bit / 8] >> (7 - (bit % 8))) & 0x01);
+}
+
+
+// Get length of common prefix of two addresses, limited to maxlen.
+static int routeCommonLen(const unsigned char *a, const unsigned char *b, const int maxlen) {
+	int i = 0;
+	while(((i + 8) <= maxlen) && (a[i / 8] == b[i / 8])) i = i + 8;
+	while((i < maxlen) && (routeBit(a, i) == routeBit(b, i))) i++;
+	return i;
+}
+
+
+// Clear all bits of address that are not part of the prefix.
+static void routeNormalize(unsigned char *addr, const int plen) {
+	int i;
+	for(i=plen; i<(route_ADDR_SIZE * 8); i++) {
+		addr[i / 8] &= ~(0x80 >> (i % 8));
+	}
+}
+
+
+// Allocate a trie node. Returns node ID or -1 if the node pool is exhausted.
+static int routeNewNode(struct s_route_state *routestate, const unsigned char *prefix, const int plen) {
+	struct s_route_node *node;
+	int id;
+	if(routestate->nodecount >= route_NODE_MAX) return -1;
+	id = routestate->nodecount++;
+	node = &routestate->node[id];
+	memcpy(node->prefix, prefix, route_ADDR_SIZE);
+	routeNormalize(node->prefix, plen);
+	node->plen = plen;
+	node->child[0] = -1;
+	node->child[1] = -1;
+	node->hasroute = 0;
+	return id;
+}
+
+
+// Insert prefix into the path compressed trie and return its node ID, or -1 if the node pool is exhausted.
+static int routeInsertNode(struct s_route_state *routestate, const unsigned char *prefix, const int plen) {
+	struct s_route_node *node;
+	int *link = &routestate->root;
+	int split;
+	int leaf;
+	int cl;
+
+	if((routestate->nodecount + 2) > route_NODE_MAX) return -1;
+	while(!(*link < 0)) {
+		node = &routestate->node[*link];
+		cl = routeCommonLen(prefix, node->prefix, ((plen < node->plen) ? plen : node->plen));
+		if(cl < node->plen) {
+			// prefix diverges inside the compressed path of this node, split it
+			split = routeNewNode(routestate, prefix, cl);
+			routestate->node[split].child[routeBit(node->prefix, cl)] = *link;
+			*link = split;
+			if(cl == plen) return split;
+			leaf = routeNewNode(routestate, prefix, plen);
+			routestate->node[split].child[routeBit(prefix, cl)] = leaf;
+			return leaf;
+		}
+		if(plen == node->plen) return *link;
+		link = &node->child[routeBit(prefix, node->plen)];
+	}
+	leaf = routeNewNode(routestate, prefix, plen);
+	*link = leaf;
+	return leaf;
+}
+
+
+// Rebuild the trie from all valid routes to free unused nodes.
+static void routeCompact(struct s_route_state *routestate) {
+	struct s_route_node *old;
+	int tnow = utilGetClock();
+	int count = routestate->nodecount;
+	int id;
+	int i;
+
+	old = malloc(sizeof(struct s_route_node) * count);
+	if(old == NULL) return;
+	memcpy(old, routestate->node, sizeof(struct s_route_node) * count);
+	routestate->nodecount = 0;
+	routestate->root = -1;
+	for(i=0; i<count; i++) {
+		if((old[i].hasroute) && ((tnow - old[i].ents) < route_TIMEOUT)) {
+			id = routeInsertNode(routestate, old[i].prefix, old[i].plen);
+			if(id < 0) break;
+			routestate->node[id].hasroute = 1;
+			routestate->node[id].portid = old[i].portid;
+			routestate->node[id].portts = old[i].portts;
+			routestate->node[id].ents = old[i].ents;
+		}
+	}
+	free(old);
+}
+
+
+// Parse IPv4 or IPv6 prefix in "address/length" notation. IPv4 prefixes are mapped to ::ffff:0:0/96. If host is set, the length is ignored.
+int routeParsePrefix(unsigned char *prefix, int *plen, const char *str, const int str_len, const int host) {
+	char addr_s[64];
+	const char *slash;
+	int addr_len;
+	int len;
+
+	if(!(str_len > 0 && str_len < 64)) return 0;
+	slash = memchr(str, '/', str_len);
+	addr_len = (slash != NULL) ? (slash - str) : str_len;
+	memcpy(addr_s, str, addr_len);
+	addr_s[addr_len] = '\0';
+	len = -1;
+	if((slash != NULL) && (!host)) {
+		// the length has to be a decimal number
+		slash++;
+		if(!(slash < (str + str_len))) return 0;
+		len = 0;
+		while(slash < (str + str_len)) {
+			if(!((*slash >= '0') && (*slash <= '9') && (len <= 128))) return 0;
+			len = (len * 10) + (*slash - '0');
+			slash++;
+		}
+	}
+
+	memset(prefix, 0, route_ADDR_SIZE);
+	if(inet_pton(AF_INET, addr_s, &prefix[route_ADDR_SIZE - 4]) == 1) {
+		prefix[10] = 0xff;
+		prefix[11] = 0xff;
+		if(len < 0) len = 32;
+		if(len > 32) return 0;
+		len = len + route_IPV4_OFFSET;
+	}
+	else if(inet_pton(AF_INET6, addr_s, prefix) == 1) {
+		if(len < 0) len = 128;
+		if(len > 128) return 0;
+	}
+	else {
+		return 0;
+	}
+	routeNormalize(prefix, len);
+	*plen = len;
+	return 1;
+}
+
+
+// Add local prefix that is announced to the peers.
+int routeAddLocal(struct s_route_state *routestate, const char *str, const int str_len, const int host) {
+	struct s_route_local *local;
+	if(routestate->localcount >= route_LOCAL_MAX) return 0;
+	local = &routestate->local[routestate->localcount];
+	if(!routeParsePrefix(local->prefix, &local->plen, str, str_len, host)) return 0;
+	routestate->localcount++;
+	return 1;
+}
+
+
+// Generate advertisement of local prefixes. Returns length of generated advertisement.
+int routeGenAdvert(struct s_route_state *routestate, unsigned char *advbuf, const int advbuf_len) {
+	int pos = 0;
+	int i;
+	for(i=0; i<routestate->localcount && (pos + route_ADVERT_ENTRYSIZE) <= advbuf_len; i++) {
+		advbuf[pos] = routestate->local[i].plen;
+		memcpy(&advbuf[pos + 1], routestate->local[i].prefix, route_ADDR_SIZE);
+		pos = pos + route_ADVERT_ENTRYSIZE;
+	}
+	return pos;
+}
+
+
+// Replace the routes of a peer with the prefixes it advertised.
+void routeAdvertIn(struct s_route_state *routestate, const unsigned char *advert, const int advert_len, const int portid, const int portts) {
+	unsigned char prefix[route_ADDR_SIZE];
+	struct s_route_node *node;
+	int tnow = utilGetClock();
+	int plen;
+	int pos;
+	int id;
+	int i;
+
+	// withdraw previously advertised routes of this peer
+	for(i=0; i<routestate->nodecount; i++) {
+		if(routestate->node[i].hasroute && routestate->node[i].portid == portid) routestate->node[i].hasroute = 0;
+	}
+
+	for(pos=0; (pos + route_ADVERT_ENTRYSIZE) <= advert_len; pos = pos + route_ADVERT_ENTRYSIZE) {
+		plen = advert[pos];
+		if(plen > (route_ADDR_SIZE * 8)) continue;
+		memcpy(prefix, &advert[pos + 1], route_ADDR_SIZE);
+		id = routeInsertNode(routestate, prefix, plen);
+		if(id < 0) {
+			routeCompact(routestate);
+			id = routeInsertNode(routestate, prefix, plen);
+			if(id < 0) {
+				debug("route table full!");
+				return;
+			}
+		}
+		node = &routestate->node[id];
+		node->hasroute = 1;
+		node->portid = portid;
+		node->portts = portts;
+		node->ents = tnow;
+	}
+}
+
+
+// Get PortID and PortTS of the longest matching prefix for the destination of outgoing IP packet. Returns 1 if a route is found.
+int routePacketOut(struct s_route_state *routestate, const unsigned char *packet, const int packet_len, int *portid, int *portts) {
+	unsigned char addr[route_ADDR_SIZE];
+	struct s_route_node *node;
+	int tnow = utilGetClock();
+	int best = -1;
+	int id;
+
+	if(packet_len >= 20 && (packet[0] >> 4) == 4) {
+		memset(addr, 0, 10);
+		addr[10] = 0xff;
+		addr[11] = 0xff;
+		memcpy(&addr[12], &packet[16], 4);
+	}
+	else if(packet_len >= 40 && (packet[0] >> 4) == 6) {
+		memcpy(addr, &packet[24], route_ADDR_SIZE);
+	}
+	else {
+		return 0;
+	}
+
+	id = routestate->root;
+	while(!(id < 0)) {
+		node = &routestate->node[id];
+		if(routeCommonLen(addr, node->prefix, node->plen) < node->plen) break;
+		if((node->hasroute) && ((tnow - node->ents) < route_TIMEOUT)) best = id;
+		if(node->plen >= (route_ADDR_SIZE * 8)) break;
+		id = node->child[routeBit(addr, node->plen)];
+	}
+
+	if(best < 0) return 0;
+	*portid = routestate->node[best].portid;
+	*portts = routestate->node[best].portts;
+	return 1;
+}
+
+
+// Create route structure.
+int routeCreate(struct s_route_state *routestate) {
+	routestate->node = malloc(sizeof(struct s_route_node) * route_NODE_MAX);
+	if(routestate->node != NULL) {
+		routestate->nodecount = 0;
+		routestate->root = -1;
+		routestate->localcount = 0;
+		return 1;
+	}
+	return 0;
+}
+
+
+// Destroy route structure.
+void routeDestroy(struct s_route_state *routestate) {
+	free(routestate->node);
+	routestate->node = NULL;
+	routestate->nodecount = 0;
+	routestate->root = -1;
+}
+
+
+#endif // F_ROUTE_C
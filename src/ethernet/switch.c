@@ -31,13 +31,276 @@
 #include "map.h"
 
 
+// Check if multicast MAC address belongs to a group that can be snooped. Link-local control groups (224.0.0.x, ff02::x) and solicited-node groups (33:33:ff:xx:xx:xx) are always flooded.
+static int switchMcastIsSnoopable(const unsigned char *macaddr) {
+	if(memcmp(macaddr, "\x01\x00\x5e", 3) == 0) {
+		return ((macaddr[3] != 0) || (macaddr[4] != 0));
+	}
+	if(memcmp(macaddr, "\x33\x33", 2) == 0) {
+		if(macaddr[2] == 0xff) return 0; // solicited-node groups are joined without reports on some stacks, NDP must keep working
+		return ((macaddr[2] != 0) || (macaddr[3] != 0) || (macaddr[4] != 0));
+	}
+	return 0;
+}
+
+
+// Add or refresh multicast router port. Routers receive all snooped multicast traffic.
+static void switchMcastRouterUpdate(struct s_switch_state *switchstate, const int portid, const int portts) {
+	int tnow = utilGetClock();
+	int i;
+	int j;
+
+	// search router port, drop expired router ports
+	j = -1;
+	i = 0;
+	while(i < switchstate->mcastroutercount) {
+		if((tnow - switchstate->mcastrouter[i].ents) >= switch_MCAST_TIMEOUT) {
+			switchstate->mcastroutercount--;
+			switchstate->mcastrouter[i] = switchstate->mcastrouter[switchstate->mcastroutercount];
+		}
+		else {
+			if(switchstate->mcastrouter[i].portid == portid) j = i;
+			i++;
+		}
+	}
+
+	if(j < 0) {
+		if(switchstate->mcastroutercount < switch_MCAST_MAXROUTERS) {
+			j = switchstate->mcastroutercount++;
+		}
+		else {
+			// replace the router port that has been quiet the longest
+			j = 0;
+			for(i=1; i<switchstate->mcastroutercount; i++) {
+				if(switchstate->mcastrouter[i].ents < switchstate->mcastrouter[j].ents) j = i;
+			}
+		}
+	}
+	switchstate->mcastrouter[j].portid = portid;
+	switchstate->mcastrouter[j].portts = portts;
+	switchstate->mcastrouter[j].ents = tnow;
+}
+
+
+// Add, refresh or remove multicast group member.
+static void switchMcastUpdate(struct s_switch_state *switchstate, const unsigned char *macaddr, const int portid, const int portts, const int join) {
+	struct s_switch_mcast_entry newentry;
+	struct s_switch_mcast_entry *mapentry;
+	int tnow = utilGetClock();
+	int i;
+	int j;
+
+	if(!switchMcastIsSnoopable(macaddr)) return;
+	mapentry = mapGet(&switchstate->mcasttable, macaddr);
+	if(mapentry == NULL) {
+		if(!join) return;
+		memset(&newentry, 0, sizeof(struct s_switch_mcast_entry));
+		newentry.floodents = tnow - switch_MCAST_TIMEOUT;
+		if(!mapSet(&switchstate->mcasttable, macaddr, &newentry)) return;
+		mapentry = mapGet(&switchstate->mcasttable, macaddr);
+		if(mapentry == NULL) return;
+	}
+
+	// search member, drop expired members
+	j = -1;
+	i = 0;
+	while(i < mapentry->count) {
+		if((tnow - mapentry->member[i].ents) >= switch_MCAST_TIMEOUT) {
+			mapentry->count--;
+			mapentry->member[i] = mapentry->member[mapentry->count];
+		}
+		else {
+			if(mapentry->member[i].portid == portid) j = i;
+			i++;
+		}
+	}
+
+	if(join) {
+		if(j < 0) {
+			if(mapentry->count < switch_MCAST_MAXMEMBERS) {
+				j = mapentry->count++;
+			}
+			else {
+				// too many members, flood this group
+				mapentry->floodents = tnow;
+				return;
+			}
+		}
+		mapentry->member[j].portid = portid;
+		mapentry->member[j].portts = portts;
+		mapentry->member[j].ents = tnow;
+	}
+	else {
+		if(!(j < 0)) {
+			// other listeners behind the same peer may still answer the querier, so only shorten the membership
+			if((tnow - mapentry->member[j].ents) < (switch_MCAST_TIMEOUT - switch_MCAST_LEAVETIMEOUT)) {
+				mapentry->member[j].ents = tnow - (switch_MCAST_TIMEOUT - switch_MCAST_LEAVETIMEOUT);
+			}
+		}
+	}
+}
+
+
+// Convert IPv4 multicast group address to MAC address.
+static int switchMcastIPv4ToMac(unsigned char *macaddr, const unsigned char *group) {
+	if((group[0] & 0xf0) != 0xe0) return 0;
+	macaddr[0] = 0x01;
+	macaddr[1] = 0x00;
+	macaddr[2] = 0x5e;
+	macaddr[3] = (group[1] & 0x7f);
+	macaddr[4] = group[2];
+	macaddr[5] = group[3];
+	return 1;
+}
+
+
+// Convert IPv6 multicast group address to MAC address.
+static int switchMcastIPv6ToMac(unsigned char *macaddr, const unsigned char *group) {
+	if(group[0] != 0xff) return 0;
+	macaddr[0] = 0x33;
+	macaddr[1] = 0x33;
+	memcpy(&macaddr[2], &group[12], 4);
+	return 1;
+}
+
+
+// Locate IGMP or MLD message in frame. Returns 4 for IGMP, 6 for MLD or 0 if the frame carries neither.
+static int switchMcastLocate(const unsigned char *frame, const int frame_len, int *msgpos) {
+	int nexthdr;
+	int pos;
+
+	if((frame[12] == 0x08) && (frame[13] == 0x00) && (frame_len >= 34) && ((frame[14] >> 4) == 4) && (frame[23] == 0x02)) {
+		// IGMP packet
+		pos = 14 + ((frame[14] & 0x0f) * 4);
+		if(frame_len < (pos + 8)) return 0;
+		*msgpos = pos;
+		return 4;
+	}
+	if((frame[12] == 0x86) && (frame[13] == 0xdd) && (frame_len >= 54) && ((frame[14] >> 4) == 6)) {
+		// IPv6 packet, may be MLD
+		nexthdr = frame[20];
+		pos = 54;
+		if(nexthdr == 0) { // hop-by-hop options header carrying the router alert
+			if(frame_len < (pos + 8)) return 0;
+			nexthdr = frame[pos];
+			pos = pos + ((frame[pos + 1] + 1) * 8);
+		}
+		if(nexthdr != 0x3a) return 0; // not ICMPv6
+		if(frame_len < (pos + 24)) return 0;
+		if(!((frame[pos] >= 130 && frame[pos] <= 132) || (frame[pos] == 143))) return 0;
+		*msgpos = pos;
+		return 6;
+	}
+	return 0;
+}
+
+
+// Learn multicast group memberships and router ports from IGMP message.
+static void switchMcastIGMPIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, const int msgpos, const int portid, const int portts) {
+	unsigned char macaddr[switch_MACADDR_SIZE];
+	int pos = msgpos;
+	int rtype;
+	int records;
+	int sources;
+
+	switch(frame[pos]) {
+		case 0x11: // IGMP query
+			switchMcastRouterUpdate(switchstate, portid, portts);
+			break;
+		case 0x12: // IGMPv1 report
+		case 0x16: // IGMPv2 report
+			if(switchMcastIPv4ToMac(macaddr, &frame[pos + 4])) switchMcastUpdate(switchstate, macaddr, portid, portts, 1);
+			break;
+		case 0x17: // IGMPv2 leave
+			if(switchMcastIPv4ToMac(macaddr, &frame[pos + 4])) switchMcastUpdate(switchstate, macaddr, portid, portts, 0);
+			break;
+		case 0x22: // IGMPv3 report
+			records = (utilReadInt16(&frame[pos + 6]) & 0xffff);
+			pos = pos + 8;
+			while((records > 0) && (frame_len >= (pos + 8))) {
+				rtype = frame[pos];
+				sources = (utilReadInt16(&frame[pos + 2]) & 0xffff);
+				if(switchMcastIPv4ToMac(macaddr, &frame[pos + 4])) {
+					if((rtype == 2) || (rtype == 4) || ((rtype == 1 || rtype == 3 || rtype == 5) && (sources > 0))) {
+						switchMcastUpdate(switchstate, macaddr, portid, portts, 1);
+					}
+					else if((rtype == 1 || rtype == 3) && (sources == 0)) {
+						switchMcastUpdate(switchstate, macaddr, portid, portts, 0);
+					}
+				}
+				pos = pos + 8 + (sources * 4) + (frame[pos + 1] * 4);
+				records--;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+
+// Learn multicast group memberships and router ports from MLD message.
+static void switchMcastMLDIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, const int msgpos, const int portid, const int portts) {
+	unsigned char macaddr[switch_MACADDR_SIZE];
+	int pos = msgpos;
+	int rtype;
+	int records;
+	int sources;
+
+	switch(frame[pos]) {
+		case 130: // MLD query
+			switchMcastRouterUpdate(switchstate, portid, portts);
+			break;
+		case 131: // MLDv1 report
+			if(switchMcastIPv6ToMac(macaddr, &frame[pos + 8])) switchMcastUpdate(switchstate, macaddr, portid, portts, 1);
+			break;
+		case 132: // MLDv1 done
+			if(switchMcastIPv6ToMac(macaddr, &frame[pos + 8])) switchMcastUpdate(switchstate, macaddr, portid, portts, 0);
+			break;
+		case 143: // MLDv2 report
+			records = (utilReadInt16(&frame[pos + 6]) & 0xffff);
+			pos = pos + 8;
+			while((records > 0) && (frame_len >= (pos + 20))) {
+				rtype = frame[pos];
+				sources = (utilReadInt16(&frame[pos + 2]) & 0xffff);
+				if(switchMcastIPv6ToMac(macaddr, &frame[pos + 4])) {
+					if((rtype == 2) || (rtype == 4) || ((rtype == 1 || rtype == 3 || rtype == 5) && (sources > 0))) {
+						switchMcastUpdate(switchstate, macaddr, portid, portts, 1);
+					}
+					else if((rtype == 1 || rtype == 3) && (sources == 0)) {
+						switchMcastUpdate(switchstate, macaddr, portid, portts, 0);
+					}
+				}
+				pos = pos + 20 + (sources * 16) + (frame[pos + 1] * 4);
+				records--;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+
 // Get type of outgoing frame. If it is an unicast frame, also returns PortID and PortTS.
 int switchFrameOut(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, int *portid, int *portts) {
 	struct s_switch_mactable_entry *mapentry;
+	struct s_switch_mcast_entry *mcastentry;
 	const unsigned char *macaddr;
 	int pos;
 	if(frame_len > switch_FRAME_MINSIZE) {
 		macaddr = &frame[0];
+		if(((macaddr[0] & 0x01) != 0) && (switchstate->mcastsnoop)) {
+			// IGMP/MLD messages are flooded, every node has to see the reports of all listeners
+			if(switchMcastLocate(frame, frame_len, &pos)) return switch_FRAME_TYPE_BROADCAST;
+			// multicast frame, check whether group members are known
+			pos = mapGetKeyID(&switchstate->mcasttable, macaddr);
+			if(!(pos < 0)) {
+				mcastentry = (struct s_switch_mcast_entry *)mapGetValueByID(&switchstate->mcasttable, pos);
+				if((utilGetClock() - mcastentry->floodents) >= switch_MCAST_TIMEOUT) {
+					return switch_FRAME_TYPE_MULTICAST;
+				}
+			}
+			return switch_FRAME_TYPE_BROADCAST;
+		}
 		pos = mapGetKeyID(&switchstate->mactable, macaddr);
 		if(!(pos < 0)) {
 			mapentry = (struct s_switch_mactable_entry *)mapGetValueByID(&switchstate->mactable, pos);
@@ -68,14 +331,178 @@ int switchFrameOut(struct s_switch_state *switchstate, const unsigned char *fram
 void switchFrameIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, const int portid, const int portts) {
 	struct s_switch_mactable_entry mapentry;
 	const unsigned char *macaddr;
+	int msgpos;
 	if(frame_len > switch_FRAME_MINSIZE) {
 		macaddr = &frame[6];
 		if((macaddr[0] & 0x01) == 0) { // only insert unicast address into mactable
 			mapentry.portid = portid;
 			mapentry.portts = portts;
 			mapentry.ents = utilGetClock();
+			mapentry.dataents = mapentry.ents;
 			mapSet(&switchstate->mactable, macaddr, &mapentry);
+			mapRemove(&switchstate->localtable, macaddr); // address has moved behind a peer, stop advertising it
+		}
+		if(switchstate->mcastsnoop) {
+			switch(switchMcastLocate(frame, frame_len, &msgpos)) {
+				case 4:
+					switchMcastIGMPIn(switchstate, frame, frame_len, msgpos, portid, portts);
+					break;
+				case 6:
+					switchMcastMLDIn(switchstate, frame, frame_len, msgpos, portid, portts);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+
+// Check whether incoming frame should be written to the local TAP device. IGMPv1/v2 and MLDv1 reports of remote listeners are only delivered if a local querier exists, otherwise they would suppress the reports of local listeners.
+int switchMcastDeliverIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len) {
+	int msgpos;
+	if(!switchstate->mcastsnoop) return 1;
+	if(frame_len <= switch_FRAME_MINSIZE) return 1;
+	if((frame[0] & 0x01) == 0) return 1;
+	switch(switchMcastLocate(frame, frame_len, &msgpos)) {
+		case 4:
+			if((frame[msgpos] != 0x12) && (frame[msgpos] != 0x16)) return 1;
+			break;
+		case 6:
+			if(frame[msgpos] != 131) return 1;
+			break;
+		default:
+			return 1;
+	}
+	return ((utilGetClock() - switchstate->mcastlocalqueryents) < switch_MCAST_TIMEOUT);
+}
+
+
+// Get PortIDs and PortTSs of the members of the multicast group of outgoing frame, including multicast router ports. Returns number of members.
+int switchMcastMembers(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len, int *portid, int *portts, const int max) {
+	struct s_switch_mcast_entry *mapentry;
+	int tnow = utilGetClock();
+	int count = 0;
+	int i;
+	int j;
+	if(frame_len > switch_FRAME_MINSIZE) {
+		mapentry = mapGet(&switchstate->mcasttable, &frame[0]);
+		if(mapentry != NULL) {
+			for(i=0; i<mapentry->count && count<max; i++) {
+				if((tnow - mapentry->member[i].ents) < switch_MCAST_TIMEOUT) {
+					portid[count] = mapentry->member[i].portid;
+					portts[count] = mapentry->member[i].portts;
+					count++;
+				}
+			}
+		}
+		for(i=0; i<switchstate->mcastroutercount && count<max; i++) {
+			if((tnow - switchstate->mcastrouter[i].ents) < switch_MCAST_TIMEOUT) {
+				for(j=0; j<count; j++) {
+					if(portid[j] == switchstate->mcastrouter[i].portid) break;
+				}
+				if(j == count) {
+					portid[count] = switchstate->mcastrouter[i].portid;
+					portts[count] = switchstate->mcastrouter[i].portts;
+					count++;
+				}
+			}
+		}
+	}
+	return count;
+}
+
+
+// Enable or disable IGMP/MLD snooping.
+void switchSetMcastSnooping(struct s_switch_state *switchstate, const int enable) {
+	switchstate->mcastsnoop = (enable != 0);
+}
+
+
+// Learn source MAC of frame read from the local TAP device.
+void switchLocalFrameIn(struct s_switch_state *switchstate, const unsigned char *frame, const int frame_len) {
+	struct s_switch_local_entry mapentry;
+	struct s_switch_local_entry *oldentry;
+	const unsigned char *macaddr;
+	int msgpos;
+	if(frame_len > switch_FRAME_MINSIZE) {
+		if(switchstate->mcastsnoop && ((frame[0] & 0x01) != 0)) {
+			// remember local querier, it needs the reports of remote listeners
+			switch(switchMcastLocate(frame, frame_len, &msgpos)) {
+				case 4:
+					if(frame[msgpos] == 0x11) switchstate->mcastlocalqueryents = utilGetClock();
+					break;
+				case 6:
+					if(frame[msgpos] == 130) switchstate->mcastlocalqueryents = utilGetClock();
+					break;
+				default:
+					break;
+			}
+		}
+		macaddr = &frame[6];
+		if((macaddr[0] & 0x01) == 0) { // only advertise unicast addresses
+			mapentry.ents = utilGetClock();
+			oldentry = mapGet(&switchstate->localtable, macaddr);
+			if(oldentry != NULL) {
+				*oldentry = mapentry;
+			}
+			else {
+				mapSet(&switchstate->localtable, macaddr, &mapentry);
+			}
+		}
+	}
+}
+
+
+// Generate advertisement of recently seen local MAC addresses. Returns length of generated advertisement.
+int switchGenMacAdvert(struct s_switch_state *switchstate, unsigned char *advbuf, const int advbuf_len) {
+	int tnow = utilGetClock();
+	struct s_map *map = &switchstate->localtable;
+	struct s_switch_local_entry *mapentry;
+	int size = mapGetMapSize(map);
+	int pos = 0;
+	int i;
+	for(i=0; i<size && (pos + switch_MACADDR_SIZE) <= advbuf_len; i++) {
+		if(mapIsValidID(map, i)) {
+			mapentry = (struct s_switch_local_entry *)mapGetValueByID(map, i);
+			if((tnow - mapentry->ents) < switch_LOCAL_TIMEOUT) {
+				memcpy(&advbuf[pos], mapGetKeyByID(map, i), switch_MACADDR_SIZE);
+				pos = pos + switch_MACADDR_SIZE;
+			}
+		}
+	}
+	return pos;
+}
+
+
+// Learn PortID+PortTS of MAC addresses advertised by a peer.
+void switchMacAdvertIn(struct s_switch_state *switchstate, const unsigned char *advert, const int advert_len, const int portid, const int portts) {
+	struct s_switch_mactable_entry mapentry;
+	struct s_switch_mactable_entry *oldentry;
+	struct s_switch_local_entry *localentry;
+	const unsigned char *macaddr;
+	int tnow = utilGetClock();
+	int pos;
+	mapentry.portid = portid;
+	mapentry.portts = portts;
+	mapentry.ents = tnow;
+	mapentry.dataents = tnow - switch_LOCAL_TIMEOUT;
+	for(pos=0; (pos + switch_MACADDR_SIZE) <= advert_len; pos = pos + switch_MACADDR_SIZE) {
+		macaddr = &advert[pos];
+		if((macaddr[0] & 0x01) != 0) continue; // only unicast addresses can be advertised
+		localentry = mapGet(&switchstate->localtable, macaddr);
+		if((localentry != NULL) && ((tnow - localentry->ents) < switch_LOCAL_TIMEOUT)) continue; // address is active on the local TAP device
+		oldentry = mapGet(&switchstate->mactable, macaddr);
+		if(oldentry != NULL) {
+			if((oldentry->portid == portid) && (oldentry->portts == portts)) {
+				// refresh entry, keep the time the address was last seen in a frame
+				oldentry->ents = tnow;
+				continue;
+			}
+			// the previous node keeps advertising a moved address until its local entry expires, frames seen since then take precedence
+			if((tnow - oldentry->dataents) < switch_LOCAL_TIMEOUT) continue;
 		}
+		mapSet(&switchstate->mactable, macaddr, &mapentry);
 	}
 }
 
@@ -138,9 +565,22 @@ void switchStatus(struct s_switch_state *switchstate, char *report, const int re
 // Create switchstate structure.
 int switchCreate(struct s_switch_state *switchstate) {
 	if(mapCreate(&switchstate->mactable, switch_MACMAP_SIZE, switch_MACADDR_SIZE, sizeof(struct s_switch_mactable_entry))) {
-		mapEnableReplaceOld(&switchstate->mactable);
-		mapInit(&switchstate->mactable);
-		return 1;
+		if(mapCreate(&switchstate->mcasttable, switch_MCASTMAP_SIZE, switch_MACADDR_SIZE, sizeof(struct s_switch_mcast_entry))) {
+			if(mapCreate(&switchstate->localtable, switch_LOCALMAP_SIZE, switch_MACADDR_SIZE, sizeof(struct s_switch_local_entry))) {
+				mapEnableReplaceOld(&switchstate->mactable);
+				mapInit(&switchstate->mactable);
+				mapEnableReplaceOld(&switchstate->mcasttable);
+				mapInit(&switchstate->mcasttable);
+				mapEnableReplaceOld(&switchstate->localtable);
+				mapInit(&switchstate->localtable);
+				switchstate->mcastroutercount = 0;
+				switchstate->mcastlocalqueryents = utilGetClock() - switch_MCAST_TIMEOUT;
+				switchstate->mcastsnoop = 0;
+				return 1;
+			}
+			mapDestroy(&switchstate->mcasttable);
+		}
+		mapDestroy(&switchstate->mactable);
 	}
 	return 0;
 }
@@ -148,6 +588,8 @@ int switchCreate(struct s_switch_state *switchstate) {
 
 // Destroy switchstate structure.
 void switchDestroy(struct s_switch_state *switchstate) {
+	mapDestroy(&switchstate->localtable);
+	mapDestroy(&switchstate->mcasttable);
 	mapDestroy(&switchstate->mactable);
 }
 
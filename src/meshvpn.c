@@ -121,6 +121,9 @@ int show_usage(void) {
 #endif
 #ifdef HAVE_LIBZ
                 " [ZLIB]"
+#endif
+#ifdef HAVE_LIBURING
+                " [IOURING]"
 #endif
                 " built on " __DATE__
         ;
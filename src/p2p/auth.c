@@ -74,6 +74,7 @@ int authGenSigIn(struct s_auth_state *authstate, unsigned char *siginbuf, const
  * 4 bytes  - local auth ID
  * 4 bytes  - session token
  * 32 bytes - network ID
+ * 16 bytes - cookie (sent by initiators that support cookies, zero until a cookie challenge has been received)
  *
  */
 void authGenS0(struct s_auth_state *authstate) {
@@ -95,27 +96,32 @@ void authGenS0(struct s_auth_state *authstate) {
     }
 
     authstate->nextmsg_size = (4 + 2 + 8 + 4 + 4 + NETID_SIZE);
+
+    // echo the cookie of the last challenge (not covered by the checksum, it is a MAC on its own)
+    // an initiator always sends the field, so the responder knows that it can answer with a challenge
+    if(authstate->state == auth_S0a) {
+        if(authstate->cookie_size > 0) {
+            memcpy(&authstate->nextmsg[authstate->nextmsg_size], authstate->cookie, auth_COOKIESIZE);
+        }
+        else {
+            memset(&authstate->nextmsg[authstate->nextmsg_size], 0, auth_COOKIESIZE);
+        }
+        authstate->nextmsg_size += auth_COOKIESIZE;
+    }
+
     debugf("Generated S0 message, size %d bytes, RemoteID: %d", authstate->nextmsg_size, authstate->remote_authid);
 }
 
 
 
-// Decode auth message S0
-int authDecodeS0(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
-    int msgnum;
+// Verify length, checksum and NetID of auth message S0. Returns 1 if the message is valid.
+int authVerifyS0(const struct s_netid *netid, const unsigned char *msg, const int msg_len) {
     unsigned char checksum[8];
     if(msg_len < (4 + 2 + 8 + 4 + 4 + NETID_SIZE)) {
         debugf("wrong S0 message size: %d", msg_len);
         return 0;
     }
 
-    msgnum = utilReadInt16(&msg[4]);
-    int expected_state = authstate->state + 1;
-    if(msgnum != expected_state) {
-        debugf("wrong S0 msgnum: %d, waiting for %d", msgnum, expected_state);
-        return 0;
-    }
-
     if(!cryptoCalculateSHA256(checksum, 8, &msg[(4 + 2 + 8)], (4 + 4 + NETID_SIZE))) {
         debug("unable to create SHA256 sum for S0 message");
         return 0;
@@ -126,11 +132,29 @@ int authDecodeS0(struct s_auth_state *authstate, const unsigned char *msg, const
         return 0;
     }
 
-    if(memcmp(authstate->netid->id, &msg[(4 + 2 + 8 + 4 + 4)], NETID_SIZE) != 0) {
+    if(memcmp(netid->id, &msg[(4 + 2 + 8 + 4 + 4)], NETID_SIZE) != 0) {
         debug("NetID verification failed for S0 message");
         return 0;
     }
 
+    return 1;
+}
+
+
+// Decode auth message S0
+int authDecodeS0(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+    int msgnum;
+    if(!authVerifyS0(authstate->netid, msg, msg_len)) {
+        return 0;
+    }
+
+    msgnum = utilReadInt16(&msg[4]);
+    int expected_state = authstate->state + 1;
+    if(msgnum != expected_state) {
+        debugf("wrong S0 msgnum: %d, waiting for %d", msgnum, expected_state);
+        return 0;
+    }
+
     memcpy(authstate->remote_authid, &msg[(4 + 2 + 8)], 4);
     memcpy(authstate->remote_sesstoken, &msg[(4 + 2 + 8 + 4)], 4);
 
@@ -525,6 +549,29 @@ int authGenS5(struct s_auth_state *authstate) {
     return 0;
 }
 
+// Decode cookie challenge. Returns 1 if the cookie has been accepted.
+int authDecodeCookie(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+    if(authstate->state != auth_S0a) {
+        return 0;
+    }
+
+    if(msg_len < auth_MSGSIZE_COOKIE) {
+        debugf("wrong cookie challenge size: %d", msg_len);
+        return 0;
+    }
+
+    if(utilReadInt16(&msg[4]) != auth_MSGNUM_COOKIE) {
+        return 0;
+    }
+
+    memcpy(authstate->cookie, &msg[(4 + 2)], auth_COOKIESIZE);
+    authstate->cookie_size = auth_COOKIESIZE;
+    debugf("Cookie challenge received for Local %d", authstate->local_authid);
+
+    return 1;
+}
+
+
 // Generate auth message
 void authGenMsg(struct s_auth_state *authstate) {
 	int state = authstate->state;
@@ -573,6 +620,12 @@ int authDecodeMsg(struct s_auth_state *authstate, const unsigned char *msg, cons
 	int state = authstate->state;
 	int newstate = state;
 
+	// the responder is under load and wants its cookie echoed before it allocates an auth slot
+	if(authDecodeCookie(authstate, msg, msg_len)) {
+		authGenMsg(authstate);
+		return 1;
+	}
+
 	switch(state) {
 		case auth_IDLE: if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S0b; break;
 		case auth_S0a:  if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S1a; break;
@@ -623,6 +676,7 @@ void authReset(struct s_auth_state *authstate) {
 	memset(authstate->remote_sesstoken, 0, 4);
 	authstate->nextmsg_size = 0;
 	authstate->local_cneg_set = 0;
+	authstate->cookie_size = 0;
 	cryptoSetKeysRandom(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT);
 }
 
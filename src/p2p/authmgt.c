@@ -52,7 +52,11 @@ int authmgtNew(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr) {
 
 	mgt->lastsend[authstateid] = (mgt->fastauth) ? (tnow - authmgt_RESEND_TIMEOUT - 3) : tnow;
 	mgt->lastrecv[authstateid] = tnow;
-	mgt->peeraddr[authstateid] = *peeraddr;
+	mgt->raceid[authstateid] = 0;
+	mgt->racenext[authstateid] = authstateid;
+	authmgtSetAddr(mgt, authstateid, peeraddr);
+	authmgtUpdateFree(mgt, authstateid);
+	mgt->nextdue = 0;
 
     CREATE_HUMAN_IP(peeraddr);
     debugf("Starting new auth session for %s, ID: %d", humanIp, authstateid);
@@ -63,25 +67,87 @@ int authmgtNew(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr) {
 
 // Delete auth session.
 void authmgtDelete(struct s_authmgt *mgt, const int authstateid) {
+	int *indexed;
 	if(mgt->current_authed_id == authstateid) mgt->current_authed_id = -1;
 	if(mgt->current_completed_id == authstateid) mgt->current_completed_id = -1;
+	indexed = mapGet(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+	if((indexed != NULL) && (*indexed == authstateid)) mapRemove(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+	authmgtLeaveRace(mgt, authstateid);
 	authReset(&mgt->authstate[authstateid]);
 	idspDelete(&mgt->idsp, authstateid);
+	authmgtUpdateFree(mgt, authstateid);
 }
 
 
 // Start new auth session. Returns 1 on success.
 int authmgtStart(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr) {
+	return authmgtStartRace(mgt, peeraddr, 0);
+}
+
+
+// Returns a new race ID. Auth sessions started with the same race ID are cancelled when one of them completes.
+int authmgtNewRace(struct s_authmgt *mgt) {
+	mgt->racecount++;
+	if(!(mgt->racecount > 0)) mgt->racecount = 1;
+	return mgt->racecount;
+}
+
+
+// Start new auth session as part of a race. Returns 1 on success.
+int authmgtStartRace(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr, const int raceid) {
 	int authstateid = authmgtNew(mgt, peeraddr);
 	if(authstateid < 0) {
 		return 0;
 	}
 
+	// sessions of a race are started back to back, so the new session joins the ring of the last one
+	mgt->raceid[authstateid] = raceid;
+	if((raceid > 0) && (!(mgt->racelast < 0)) && idspIsValid(&mgt->idsp, mgt->racelast) && (mgt->raceid[mgt->racelast] == raceid)) {
+		mgt->racenext[authstateid] = mgt->racenext[mgt->racelast];
+		mgt->racenext[mgt->racelast] = authstateid;
+	}
+	mgt->racelast = authstateid;
 	authStart(&mgt->authstate[authstateid]);
+	authmgtUpdateFree(mgt, authstateid);
 	return 1;
 }
 
 
+// Remove an auth session from the ring of its race.
+void authmgtLeaveRace(struct s_authmgt *mgt, const int authstateid) {
+	int i = authstateid;
+	while(mgt->racenext[i] != authstateid) {
+		i = mgt->racenext[i];
+	}
+	mgt->racenext[i] = mgt->racenext[authstateid];
+	mgt->racenext[authstateid] = authstateid;
+	mgt->raceid[authstateid] = 0;
+	if(mgt->racelast == authstateid) mgt->racelast = -1;
+}
+
+
+// Cancel all other auth sessions of the race the specified session belongs to.
+void authmgtFinishRace(struct s_authmgt *mgt, const int authstateid) {
+	int i;
+
+	if(!(mgt->raceid[authstateid] > 0)) {
+		return;
+	}
+
+	// every step removes one session from the ring
+	while((i = mgt->racenext[authstateid]) != authstateid) {
+		if(authIsCompleted(&mgt->authstate[i])) {
+			authmgtLeaveRace(mgt, i);
+		}
+		else {
+			debugf("[%d] cancelling auth session, race won by %d", i, authstateid);
+			authmgtDelete(mgt, i);
+		}
+	}
+	authmgtLeaveRace(mgt, authstateid);
+}
+
+
 // Check if auth manager has an authed peer.
 int authmgtHasAuthedPeer(struct s_authmgt *mgt) {
 	return (!(mgt->current_authed_id < 0));
@@ -104,6 +170,7 @@ void authmgtAcceptAuthedPeer(struct s_authmgt *mgt, const int local_peerid, cons
 	if(authmgtHasAuthedPeer(mgt)) {
 		authSetLocalData(&mgt->authstate[mgt->current_authed_id], local_peerid, seq, flags);
 		mgt->current_authed_id = -1;
+		mgt->nextdue = 0;
 	}
 }
 
@@ -186,17 +253,38 @@ void authmgtFinishCompletedPeer(struct s_authmgt *mgt) {
 int authmgtGetNextMsg(struct s_authmgt *mgt, struct s_msg *out_msg, struct s_peeraddr *target) {
 	int used = idspUsedCount(&mgt->idsp);
 	int tnow = utilGetClock();
+	int nextdue;
 	int authstateid;
 	int i;
+	struct s_authmgt_cookiemsg *cookiemsg;
+
+	// cookie challenges are stateless and go out first
+	if(mgt->cookieqcount > 0) {
+		cookiemsg = &mgt->cookieq[mgt->cookieqhead];
+		mgt->cookieqhead = ((mgt->cookieqhead + 1) % authmgt_COOKIEQ_SIZE);
+		mgt->cookieqcount--;
+		out_msg->msg = cookiemsg->msg;
+		out_msg->len = cookiemsg->len;
+		*target = cookiemsg->targetaddr;
+		return 1;
+	}
+
+	// skip the scan if no session can be due yet
+	if(tnow < mgt->nextdue) {
+		return 0;
+	}
 
+	nextdue = (tnow + AUTHMGT_RESEND_TIMEOUT + 1);
 	for(i=0; i<used; i++) {
 		authstateid = idspNext(&mgt->idsp);
 		if((tnow - mgt->lastrecv[authstateid]) >= AUTHMGT_RECV_TIMEOUT) { // check if auth session has expired
             authmgtDelete(mgt, authstateid);
             continue;
         }
+        if((mgt->lastrecv[authstateid] + AUTHMGT_RECV_TIMEOUT) < nextdue) nextdue = (mgt->lastrecv[authstateid] + AUTHMGT_RECV_TIMEOUT);
 
         if((tnow - mgt->lastsend[authstateid]) <= AUTHMGT_RESEND_TIMEOUT) { // only send one auth message per specified time interval and session
+            if((mgt->lastsend[authstateid] + AUTHMGT_RESEND_TIMEOUT + 1) < nextdue) nextdue = (mgt->lastsend[authstateid] + AUTHMGT_RESEND_TIMEOUT + 1);
             continue;
         }
 
@@ -211,38 +299,145 @@ int authmgtGetNextMsg(struct s_authmgt *mgt, struct s_msg *out_msg, struct s_pee
         }
     }
 
+	mgt->nextdue = nextdue;
 	return 0;
 }
 
 
+// Set the PeerAddr of an auth session and update the address index.
+void authmgtSetAddr(struct s_authmgt *mgt, const int authstateid, const struct s_peeraddr *peeraddr) {
+	int *indexed;
+	if(!idspIsValid(&mgt->idsp, authstateid)) {
+		mgt->peeraddr[authstateid] = *peeraddr;
+		return;
+	}
+	if(memcmp(mgt->peeraddr[authstateid].addr, peeraddr->addr, peeraddr_SIZE) != 0) {
+		indexed = mapGet(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+		if((indexed != NULL) && (*indexed == authstateid)) mapRemove(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+		mgt->peeraddr[authstateid] = *peeraddr;
+	}
+	mapSet(&mgt->addrmap, peeraddr->addr, &authstateid);
+}
+
+
+// Add or remove an auth session from the list of replaceable sessions.
+void authmgtUpdateFree(struct s_authmgt *mgt, const int authstateid) {
+	struct s_auth_state *authstate = &mgt->authstate[authstateid];
+	int pos = mgt->freepos[authstateid];
+	int lastid;
+	int replaceable = ((idspIsValid(&mgt->idsp, authstateid)) && ((!authIsPreauth(authstate)) || (authIsPeerCompleted(authstate))));
+
+	if(replaceable && (pos < 0)) {
+		mgt->freepos[authstateid] = mgt->freecount;
+		mgt->freelist[mgt->freecount++] = authstateid;
+	}
+	else if((!replaceable) && (!(pos < 0))) {
+		lastid = mgt->freelist[--mgt->freecount];
+		mgt->freelist[pos] = lastid;
+		mgt->freepos[lastid] = pos;
+		mgt->freepos[authstateid] = -1;
+	}
+}
+
+
 // Find auth session with specified PeerAddr.
 int authmgtFindAddr(struct s_authmgt *mgt, const struct s_peeraddr *addr) {
-	int count = idspUsedCount(&mgt->idsp);
-	int i;
-	int j;
-	for(i=0; i<count; i++) {
-		j = idspNext(&mgt->idsp);
-		if(memcmp(mgt->peeraddr[j].addr, addr->addr, peeraddr_SIZE) == 0) return j;
-	}
-	return -1;
+	int *authstateid = mapGet(&mgt->addrmap, addr->addr);
+	if(authstateid == NULL) return -1;
+	return *authstateid;
 }
 
 
 // Find unused auth session.
 int authmgtFindUnused(struct s_authmgt *mgt) {
-	int count = idspUsedCount(&mgt->idsp);
-	int i;
-	int j;
-	struct s_auth_state *authstate;
-	for(i=0; i<count; i++) {
-		j = idspNext(&mgt->idsp);
-		authstate = &mgt->authstate[j];
-		if((!authIsPreauth(authstate)) || (authIsPeerCompleted(authstate))) return j;
-	}
+	if(mgt->freecount > 0) return mgt->freelist[0];
 	return -1;
 }
 
 
+// Check if the auth manager is under load and requires cookies for new sessions.
+int authmgtIsUnderLoad(struct s_authmgt *mgt, const int tnow) {
+	if(mgt->newcount_t != tnow) {
+		mgt->newcount_t = tnow;
+		mgt->newcount = 0;
+	}
+	return ((authmgtUsedSlotCount(mgt) > (authmgtSlotCount(mgt) / 2)) || (mgt->newcount >= authmgt_COOKIE_MAXRATE));
+}
+
+
+// Admit a resumed session. Resumes skip the cookie exchange, so they are refused under load and the peer falls back to a full handshake. Returns 1 if admitted.
+int authmgtAdmitResume(struct s_authmgt *mgt, const int tnow) {
+	if(authmgtIsUnderLoad(mgt, tnow)) {
+		return 0;
+	}
+	if(!(authmgtUsedSlotCount(mgt) < authmgtSlotCount(mgt))) {
+		return 0;
+	}
+	mgt->newcount++;
+	return 1;
+}
+
+
+// Calculate the cookie for a new session request.
+int authmgtGenCookie(struct s_authmgt *mgt, unsigned char *cookie, const unsigned char *msg, const struct s_peeraddr *peeraddr, const int interval) {
+	// cookie = hmac(peeraddr, remote_authid, remote_sesstoken, interval)
+	unsigned char cookiein[(peeraddr_SIZE + 4 + 4 + 4)];
+	memcpy(cookiein, peeraddr->addr, peeraddr_SIZE);
+	memcpy(&cookiein[peeraddr_SIZE], &msg[(4 + 2 + 8)], (4 + 4));
+	utilWriteInt32(&cookiein[(peeraddr_SIZE + 4 + 4)], interval);
+	return cryptoHMAC(&mgt->cookiectx, cookie, auth_COOKIESIZE, cookiein, (peeraddr_SIZE + 4 + 4 + 4));
+}
+
+
+// Check if a new session request comes from a peer that supports cookies.
+int authmgtHasCookieField(const int msg_len) {
+	return (msg_len >= (4 + 2 + 8 + 4 + 4 + netid_SIZE + auth_COOKIESIZE));
+}
+
+
+// Verify the cookie echoed in a new session request. Returns 1 if the cookie is valid.
+int authmgtVerifyCookie(struct s_authmgt *mgt, const unsigned char *msg, const int msg_len, const struct s_peeraddr *peeraddr, const int tnow) {
+	const int pos = (4 + 2 + 8 + 4 + 4 + netid_SIZE);
+	unsigned char cookie[auth_COOKIESIZE];
+	int interval = (tnow / authmgt_COOKIE_INTERVAL);
+
+	if(!authmgtHasCookieField(msg_len)) {
+		return 0;
+	}
+
+	// accept cookies of the current and the previous interval
+	if(authmgtGenCookie(mgt, cookie, msg, peeraddr, interval) && (memcmp(cookie, &msg[pos], auth_COOKIESIZE) == 0)) {
+		return 1;
+	}
+	if(authmgtGenCookie(mgt, cookie, msg, peeraddr, (interval - 1)) && (memcmp(cookie, &msg[pos], auth_COOKIESIZE) == 0)) {
+		return 1;
+	}
+
+	return 0;
+}
+
+
+// Queue a cookie challenge as answer to a new session request.
+void authmgtSendCookie(struct s_authmgt *mgt, const unsigned char *msg, const struct s_peeraddr *peeraddr, const int tnow) {
+	struct s_authmgt_cookiemsg *cookiemsg;
+
+	if(!(mgt->cookieqcount < authmgt_COOKIEQ_SIZE)) {
+		debug("cookie queue is full, challenge dropped");
+		return;
+	}
+
+	// generate msg(remote_authid, msgnum, cookie)
+	cookiemsg = &mgt->cookieq[((mgt->cookieqhead + mgt->cookieqcount) % authmgt_COOKIEQ_SIZE)];
+	memcpy(cookiemsg->msg, &msg[(4 + 2 + 8)], 4);
+	utilWriteInt16(&cookiemsg->msg[4], auth_MSGNUM_COOKIE);
+	if(authmgtGenCookie(mgt, &cookiemsg->msg[(4 + 2)], msg, peeraddr, (tnow / authmgt_COOKIE_INTERVAL))) {
+		cookiemsg->len = auth_MSGSIZE_COOKIE;
+		cookiemsg->targetaddr = *peeraddr;
+		mgt->cookieqcount++;
+	}
+}
+
+
 // Decode auth message. Returns 1 if message is accepted.
 int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, const int msg_len, const struct s_peeraddr *peeraddr) {
 	int authid;
@@ -277,8 +472,10 @@ int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, const int
         }
 
         mgt->lastrecv[authstateid] = tnow;
-        mgt->peeraddr[authstateid] = *peeraddr;
-        if(mgt->fastauth) {
+        authmgtSetAddr(mgt, authstateid, peeraddr);
+        authmgtUpdateFree(mgt, authstateid);
+        mgt->nextdue = 0;
+        if((mgt->fastauth) || (utilReadInt16(&msg[4]) == auth_MSGNUM_COOKIE)) { // echo cookies right away, the responder is waiting for them
             mgt->lastsend[authstateid] = (tnow - authmgt_RESEND_TIMEOUT - 3);
         }
 
@@ -287,11 +484,32 @@ int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, const int
         if((authIsCompleted(&mgt->authstate[authstateid])) && (!authIsPeerCompleted(&mgt->authstate[authstateid]))) {
             msgf("Host %s authorized", humanIp);
             mgt->current_completed_id = authstateid;
+            authmgtFinishRace(mgt, authstateid);
         }
 
         return 1;
     } else if(authid == 0) {
         debugf("starting new session for %s, authid: %d", humanIp, authid);
+
+        // under load, only allocate auth state for requests that echo a valid cookie
+        if(authmgtIsUnderLoad(mgt, tnow)) {
+            if(!authVerifyS0(mgt->netid, msg, msg_len)) {
+                return 0;
+            }
+            if(!authmgtHasCookieField(msg_len)) {
+                // older peers can't echo cookies, they only get slots up to a limit that leaves room for peers that can
+                if(!(((authmgtUsedSlotCount(mgt) * 100) < (authmgtSlotCount(mgt) * authmgt_COOKIE_LEGACY_PERCENT)) && (mgt->newcount < authmgt_COOKIE_MAXRATE))) {
+                    debugf("[%s] auth manager under load, peer without cookie support refused", humanIp);
+                    return 0;
+                }
+            }
+            else if(!authmgtVerifyCookie(mgt, msg, msg_len, peeraddr, tnow)) {
+                debugf("[%s] auth manager under load, sending cookie challenge", humanIp);
+                authmgtSendCookie(mgt, msg, peeraddr, tnow);
+                return 0;
+            }
+        }
+
         // message requests new auth session
         dupid = authmgtFindAddr(mgt, peeraddr);
 
@@ -317,9 +535,10 @@ int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, const int
         }
 
         if(!(authstateid < 0)) {
+            mgt->newcount++;
             if(authDecodeMsg(&mgt->authstate[authstateid], msg, msg_len)) {
                 mgt->lastrecv[authstateid] = tnow;
-                mgt->peeraddr[authstateid] = *peeraddr;
+                authmgtUpdateFree(mgt, authstateid);
                 if(mgt->fastauth) {
                     mgt->lastsend[authstateid] = (tnow - authmgt_RESEND_TIMEOUT - 3);
                 }
@@ -348,12 +567,25 @@ void authmgtReset(struct s_authmgt *mgt) {
 	int count = idspSize(&mgt->idsp);
 	for(i=0; i<count; i++) {
 		authReset(&mgt->authstate[i]);
+		mgt->freepos[i] = -1;
+		mgt->raceid[i] = 0;
+		mgt->racenext[i] = i;
 	}
 
 	idspReset(&mgt->idsp);
+	mapInit(&mgt->addrmap);
+	mgt->freecount = 0;
+	mgt->nextdue = 0;
+	mgt->racecount = 0;
+	mgt->racelast = -1;
 	mgt->fastauth = 0;
 	mgt->current_authed_id = -1;
 	mgt->current_completed_id = -1;
+	mgt->newcount = 0;
+	mgt->newcount_t = 0;
+	mgt->cookieqhead = 0;
+	mgt->cookieqcount = 0;
+	cryptoSetKeysRandom(&mgt->cookiectx, 1);
 
     debug("auth manager RESET completed");
 }
@@ -368,6 +600,10 @@ int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int auth_s
 	struct s_peeraddr *peeraddr_mem;
 	int *lastsend_mem;
 	int *lastrecv_mem;
+	int *freelist_mem;
+	int *freepos_mem;
+	int *raceid_mem;
+	int *racenext_mem;
 
 	if(auth_slots <= 0) {
         debug("No auth slots available");
@@ -386,6 +622,27 @@ int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int auth_s
         return 0;
     }
 
+    freelist_mem = malloc(sizeof(int) * auth_slots);
+    freepos_mem = malloc(sizeof(int) * auth_slots);
+    if(freelist_mem == NULL || freepos_mem == NULL) {
+        free(freelist_mem); free(freepos_mem);
+        debug("failed to allocate memory for free list / auth_slots");
+        return 0;
+    }
+
+    raceid_mem = malloc(sizeof(int) * auth_slots);
+    racenext_mem = malloc(sizeof(int) * auth_slots);
+    if(raceid_mem == NULL || racenext_mem == NULL) {
+        free(raceid_mem); free(racenext_mem);
+        debug("failed to allocate memory for race IDs / auth_slots");
+        return 0;
+    }
+
+    if(!mapCreate(&mgt->addrmap, auth_slots, peeraddr_SIZE, sizeof(int))) {
+        debug("failed to create auth address index");
+        return 0;
+    }
+
     authstate_mem = malloc(sizeof(struct s_auth_state) * auth_slots);
 
     if(authstate_mem == NULL) {
@@ -408,11 +665,16 @@ int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int auth_s
     }
 
     if(!(ac < auth_slots)) {
-        if(idspCreate(&mgt->idsp, auth_slots)) {
+        if(idspCreate(&mgt->idsp, auth_slots) && cryptoCreate(&mgt->cookiectx, 1)) {
+            mgt->netid = netid;
             mgt->lastsend = lastsend_mem;
             mgt->lastrecv = lastrecv_mem;
             mgt->authstate = authstate_mem;
             mgt->peeraddr = peeraddr_mem;
+            mgt->freelist = freelist_mem;
+            mgt->freepos = freepos_mem;
+            mgt->raceid = raceid_mem;
+            mgt->racenext = racenext_mem;
             authmgtReset(mgt);
             return 1;
         }
@@ -432,7 +694,13 @@ void authmgtDestroy(struct s_authmgt *mgt) {
 	int i;
 	int count = idspSize(&mgt->idsp);
 	idspDestroy(&mgt->idsp);
+	cryptoDestroy(&mgt->cookiectx, 1);
+	mapDestroy(&mgt->addrmap);
 	for(i=0; i<count; i++) authDestroy(&mgt->authstate[i]);
+	free(mgt->racenext);
+	free(mgt->raceid);
+	free(mgt->freepos);
+	free(mgt->freelist);
 	free(mgt->peeraddr);
 	free(mgt->authstate);
 	free(mgt->lastrecv);
@@ -0,0 +1,317 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_CRYPTPOOL_C
+#define F_CRYPTPOOL_C
+
+
+#include "crypto.h"
+#include "p2p.h"
+#include "logging.h"
+#include <pthread.h>
+#include <sched.h>
+
+
+// Returns the job of the specified ticket.
+static struct s_cryptpool_job *cryptpoolJob(struct s_cryptpool_queue *queue, const unsigned int ticket) {
+	return &queue->job[(ticket & (cryptpool_QUEUESIZE - 1))];
+}
+
+
+// Returns 1 if jobs are waiting for the worker.
+static int cryptpoolHasWork(struct s_cryptpool_worker *worker) {
+	struct s_cryptpool *pool = worker->pool;
+	int i;
+	for(i=0; i<cryptpool_QUEUE_COUNT; i++) {
+		if(((int)(__atomic_load_n(&pool->queue[i].head, __ATOMIC_SEQ_CST) - worker->next[i])) > 0) return 1;
+	}
+	return 0;
+}
+
+
+// Process the waiting jobs of a worker in one batch. Returns the number of processed jobs.
+static int cryptpoolWork(struct s_cryptpool_worker *worker, const int queue_id) {
+	struct s_cryptpool *pool = worker->pool;
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	struct s_cryptpool_job *job[cryptpool_BATCH];
+	struct s_packet_batch batch[cryptpool_BATCH];
+	unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	unsigned int ticket = worker->next[queue_id];
+	int n;
+	int i;
+
+	n = 0;
+	while((n < cryptpool_BATCH) && (((int)(head - ticket)) > 0)) {
+		job[n] = cryptpoolJob(queue, ticket);
+		batch[n].data = &job[n]->data;
+		batch[n].ctx = job[n]->ctx;
+		batch[n].seqstate = NULL; // sequence numbers are verified in order by the main thread
+		batch[n].result = 0;
+		if(queue_id == cryptpool_QUEUE_ENCODE) {
+			batch[n].pbuf = job[n]->outbuf;
+			batch[n].pbuf_size = cryptpool_BUFSIZE;
+		}
+		else {
+			job[n]->data.pl_buf = job[n]->outbuf;
+			job[n]->data.pl_buf_size = cryptpool_BUFSIZE;
+			batch[n].pbuf = job[n]->inbuf;
+			batch[n].pbuf_size = job[n]->len;
+		}
+		ticket += pool->worker_count;
+		n++;
+	}
+	if(!(n > 0)) return 0;
+
+	if(queue_id == cryptpool_QUEUE_ENCODE) {
+		packetEncodeBatch(batch, n);
+	}
+	else {
+		packetDecodeBatch(batch, n);
+	}
+
+	for(i=0; i<n; i++) {
+		job[i]->result = batch[i].result;
+		__atomic_store_n(&job[i]->done, 1, __ATOMIC_RELEASE);
+	}
+	worker->next[queue_id] = ticket;
+	return n;
+}
+
+
+// Worker thread main function.
+static void *cryptpoolThread(void *arg) {
+	struct s_cryptpool_worker *worker = arg;
+	struct s_cryptpool *pool = worker->pool;
+	int idle;
+	int n;
+	int i;
+
+	idle = 0;
+	while(!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+		n = 0;
+		for(i=0; i<cryptpool_QUEUE_COUNT; i++) {
+			n += cryptpoolWork(worker, i);
+		}
+		if(n > 0) {
+			idle = 0;
+		}
+		else if(idle < cryptpool_SPIN) {
+			idle++;
+			sched_yield();
+		}
+		else {
+			// nothing to do for a while, sleep until a job is queued for this worker
+			pthread_mutex_lock(&pool->lock);
+			__atomic_store_n(&worker->sleeping, 1, __ATOMIC_SEQ_CST);
+			while((!cryptpoolHasWork(worker)) && (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE))) {
+				pthread_cond_wait(&worker->wake, &pool->lock);
+			}
+			__atomic_store_n(&worker->sleeping, 0, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&pool->lock);
+			idle = 0;
+		}
+	}
+	return NULL;
+}
+
+
+// Returns 1 if the workers have the current cipher contexts of the specified context ID. Copies them if no job uses the old ones.
+int cryptpoolPrepare(struct s_cryptpool *pool, const int ctxid, const int ctxgen, struct s_crypto *ctx) {
+	int i;
+	if(!((ctxid >= 0) && (ctxid < pool->ctx_count))) return 0;
+	if(pool->ctxgen[ctxid] == ctxgen) return 1;
+	if(pool->ctxbusy[ctxid] > 0) return 0;
+	for(i=0; i<pool->worker_count; i++) {
+		if(!cryptoCopy(&pool->ctx[((i * pool->ctx_count) + ctxid)], ctx)) return 0;
+	}
+	pool->ctxgen[ctxid] = ctxgen;
+	return 1;
+}
+
+
+// Returns 1 if no further job can be queued.
+int cryptpoolIsFull(struct s_cryptpool *pool, const int queue_id) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	return ((queue->head - queue->tail) >= cryptpool_INFLIGHT);
+}
+
+
+// Returns the next free job for the specified context ID, or NULL if the queue is full. The job has to be filled and submitted.
+struct s_cryptpool_job *cryptpoolGetJob(struct s_cryptpool *pool, const int queue_id, const int ctxid) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	struct s_cryptpool_job *job;
+	if(cryptpoolIsFull(pool, queue_id)) return NULL;
+	job = cryptpoolJob(queue, queue->head);
+	job->ctx = &pool->ctx[((queue->nextworker * pool->ctx_count) + ctxid)];
+	job->ctxid = ctxid;
+	job->ctxgen = pool->ctxgen[ctxid];
+	job->len = 0;
+	job->result = 0;
+	job->done = 0;
+	return job;
+}
+
+
+// Submit the job returned by cryptpoolGetJob to the workers.
+void cryptpoolSubmit(struct s_cryptpool *pool, const int queue_id) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	struct s_cryptpool_worker *worker = &pool->worker[queue->nextworker];
+	pool->ctxbusy[cryptpoolJob(queue, queue->head)->ctxid]++;
+	__atomic_store_n(&queue->head, (queue->head + 1), __ATOMIC_SEQ_CST);
+	queue->nextworker = ((queue->nextworker + 1) % pool->worker_count);
+	if(__atomic_load_n(&worker->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&worker->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+
+// Returns the oldest job if it is finished, else NULL.
+struct s_cryptpool_job *cryptpoolGetDone(struct s_cryptpool *pool, const int queue_id) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	struct s_cryptpool_job *job;
+	if(queue->head == queue->tail) return NULL;
+	job = cryptpoolJob(queue, queue->tail);
+	if(!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE)) return NULL;
+	return job;
+}
+
+
+// Waits until the oldest job is finished and returns it. Returns NULL if the queue is empty.
+struct s_cryptpool_job *cryptpoolWaitDone(struct s_cryptpool *pool, const int queue_id) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	struct s_cryptpool_job *job;
+	if(queue->head == queue->tail) return NULL;
+	while((job = cryptpoolGetDone(pool, queue_id)) == NULL) {
+		sched_yield();
+	}
+	return job;
+}
+
+
+// Release the oldest job.
+void cryptpoolRelease(struct s_cryptpool *pool, const int queue_id) {
+	struct s_cryptpool_queue *queue = &pool->queue[queue_id];
+	if(queue->head == queue->tail) return;
+	pool->ctxbusy[cryptpoolJob(queue, queue->tail)->ctxid]--;
+	queue->tail++;
+}
+
+
+// Returns the number of queued jobs.
+int cryptpoolPending(struct s_cryptpool *pool) {
+	int n;
+	int i;
+	n = 0;
+	for(i=0; i<cryptpool_QUEUE_COUNT; i++) {
+		n += (pool->queue[i].head - pool->queue[i].tail);
+	}
+	return n;
+}
+
+
+// Create crypto worker pool and start the worker threads.
+int cryptpoolCreate(struct s_cryptpool *pool, const int worker_count, const int ctx_count) {
+	int i;
+
+	if(!((worker_count > 0) && (worker_count <= cryptpool_THREADS_MAX) && (ctx_count > 0))) return 0;
+	if(!cryptoEnableThreads()) return 0;
+
+	memset(pool, 0, sizeof(struct s_cryptpool));
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->worker_count = worker_count;
+	pool->ctx_count = ctx_count;
+	for(i=0; i<cryptpool_QUEUE_COUNT; i++) {
+		pool->queue[i].job = malloc(sizeof(struct s_cryptpool_job) * cryptpool_QUEUESIZE);
+	}
+	pool->worker = calloc(worker_count, sizeof(struct s_cryptpool_worker));
+	pool->ctx = malloc(sizeof(struct s_crypto) * worker_count * ctx_count);
+	pool->ctxgen = calloc(ctx_count, sizeof(int));
+	pool->ctxbusy = calloc(ctx_count, sizeof(int));
+	if((pool->queue[cryptpool_QUEUE_ENCODE].job == NULL) || (pool->queue[cryptpool_QUEUE_DECODE].job == NULL) || (pool->worker == NULL) || (pool->ctx == NULL) || (pool->ctxgen == NULL) || (pool->ctxbusy == NULL)) {
+		debug("failed to allocate memory for crypto worker pool");
+		free(pool->ctx);
+		pool->ctx = NULL;
+		cryptpoolDestroy(pool);
+		return 0;
+	}
+	if(!cryptoCreate(pool->ctx, (worker_count * ctx_count))) {
+		debug("failed to create crypto worker contexts");
+		free(pool->ctx);
+		pool->ctx = NULL;
+		cryptpoolDestroy(pool);
+		return 0;
+	}
+
+	// start worker threads, worker i processes the jobs i, i + worker_count, ...
+	for(i=0; i<worker_count; i++) {
+		pool->worker[i].pool = pool;
+		pool->worker[i].next[cryptpool_QUEUE_ENCODE] = i;
+		pool->worker[i].next[cryptpool_QUEUE_DECODE] = i;
+		pthread_cond_init(&pool->worker[i].wake, NULL);
+		if(pthread_create(&pool->worker[i].thread, NULL, cryptpoolThread, &pool->worker[i]) != 0) {
+			debugf("failed to start crypto worker %d", i);
+			pthread_cond_destroy(&pool->worker[i].wake);
+			cryptpoolDestroy(pool);
+			return 0;
+		}
+		pool->worker[i].started = 1;
+	}
+
+	return 1;
+}
+
+
+// Stop the worker threads and destroy crypto worker pool.
+void cryptpoolDestroy(struct s_cryptpool *pool) {
+	int i;
+
+	if(pool->worker != NULL) {
+		__atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_lock(&pool->lock);
+		for(i=0; i<pool->worker_count; i++) {
+			if(pool->worker[i].started) pthread_cond_signal(&pool->worker[i].wake);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		for(i=0; i<pool->worker_count; i++) {
+			if(pool->worker[i].started) {
+				pthread_join(pool->worker[i].thread, NULL);
+				pthread_cond_destroy(&pool->worker[i].wake);
+			}
+		}
+	}
+	if(pool->ctx != NULL) {
+		cryptoDestroy(pool->ctx, (pool->worker_count * pool->ctx_count));
+	}
+	for(i=0; i<cryptpool_QUEUE_COUNT; i++) {
+		free(pool->queue[i].job);
+	}
+	free(pool->worker);
+	free(pool->ctx);
+	free(pool->ctxgen);
+	free(pool->ctxbusy);
+	pthread_mutex_destroy(&pool->lock);
+	memset(pool, 0, sizeof(struct s_cryptpool));
+}
+
+
+#endif // F_CRYPTPOOL_C
@@ -62,6 +62,9 @@ void nodedbUpdate(struct s_nodedb *db, struct s_nodeid *nodeid, struct s_peeradd
 			addrdata_new.lastseen_t = 0;
 			addrdata_new.lastconnect_t = 0;
 			addrdata_new.lastconntry_t = 0;
+			addrdata_new.failcount = 0;
+			addrdata_new.rtt = -1;
+			addrdata_new.jitter = 0;
 			if((addrdata = mapGet(addrset, addr->addr)) != NULL) {
 				addrdata_new = *addrdata;
 			}
@@ -72,8 +75,13 @@ void nodedbUpdate(struct s_nodedb *db, struct s_nodeid *nodeid, struct s_peeradd
 			if(update_lastconnect > 0) {
 				addrdata_new.lastconnect = 1;
 				addrdata_new.lastconnect_t = tnow;
+				addrdata_new.failcount = 0;
 			}
 			if(update_lastconntry > 0) {
+				if((addrdata_new.lastconntry > 0) && (!((addrdata_new.lastconnect > 0) && (addrdata_new.lastconnect_t >= addrdata_new.lastconntry_t)))) {
+					// previous attempt did not lead to a connection
+					if(addrdata_new.failcount < nodedb_BACKOFF_MAXSHIFT) addrdata_new.failcount++;
+				}
 				addrdata_new.lastconntry = 1;
 				addrdata_new.lastconntry_t = tnow;
 			}
@@ -83,6 +91,36 @@ void nodedbUpdate(struct s_nodedb *db, struct s_nodeid *nodeid, struct s_peeradd
 }
 
 
+// Returns the retry delay of a NodeDB entry after failed connection attempts.
+int nodedbBackoff(const struct s_nodedb_addrdata *addrdata) {
+	int backoff;
+	backoff = (nodedb_BACKOFF_MIN << addrdata->failcount);
+	if(backoff > nodedb_BACKOFF_MAX) backoff = nodedb_BACKOFF_MAX;
+	return backoff;
+}
+
+
+// Check if a NodeDB entry matches the specified criteria.
+static int nodedbIsMatch(const struct s_nodedb_addrdata *dbdata, const int tnow, const int max_lastseen, const int max_lastconnect, const int min_lastconntry) {
+	return (
+		( (max_lastseen < 0) || (
+			(dbdata->lastseen > 0) &&
+			((tnow - dbdata->lastseen_t) < max_lastseen) &&
+		1)) &&
+		( (max_lastconnect < 0) || (
+			(dbdata->lastconnect > 0) &&
+			((tnow - dbdata->lastconnect_t) < max_lastconnect) &&
+		1)) &&
+		( (min_lastconntry < 0) || (!(dbdata->lastconntry > 0)) || (
+			(dbdata->lastseen > 0) &&
+			((tnow - dbdata->lastconntry_t) >= min_lastconntry) &&
+			((tnow - dbdata->lastconntry_t) >= ((tnow - dbdata->lastseen_t) / 2)) &&
+		1)) &&
+		( (!(dbdata->lastconntry > 0)) || ((tnow - dbdata->lastconntry_t) >= nodedbBackoff(dbdata)) ) &&
+	1);
+}
+
+
 // Returns a NodeDB ID that matches the specified criteria, with explicit nid/tnow.
 int nodedbGetDBIDByID(struct s_nodedb *db, const int nid, const int tnow, const int max_lastseen, const int max_lastconnect, const int min_lastconntry) {
 	int j, j_max, aid, ret;
@@ -94,21 +132,7 @@ int nodedbGetDBIDByID(struct s_nodedb *db, const int nid, const int tnow, const
 		aid = mapGetNextKeyID(addrset);
 		dbdata = mapGetValueByID(addrset, aid);
 		if(dbdata != NULL) {
-			if(
-				( (max_lastseen < 0) || (
-					(dbdata->lastseen > 0) &&
-					((tnow - dbdata->lastseen_t) < max_lastseen) &&
-				1)) &&
-				( (max_lastconnect < 0) || (
-					(dbdata->lastconnect > 0) &&
-					((tnow - dbdata->lastconnect_t) < max_lastconnect) &&
-				1)) &&
-				( (min_lastconntry < 0) || (!(dbdata->lastconntry > 0)) || (
-					(dbdata->lastseen > 0) &&
-					((tnow - dbdata->lastconntry_t) >= min_lastconntry) &&
-					((tnow - dbdata->lastconntry_t) >= ((tnow - dbdata->lastseen_t) / 2)) &&
-				1)) &&
-			1) {
+			if(nodedbIsMatch(dbdata, tnow, max_lastseen, max_lastconnect, min_lastconntry)) {
 				ret = (nid * db->num_peeraddrs) + aid;
 				return ret;
 			}
@@ -118,6 +142,28 @@ int nodedbGetDBIDByID(struct s_nodedb *db, const int nid, const int tnow, const
 }
 
 
+// Stores all NodeDB IDs of a NodeID that match the specified criteria in db_ids. Returns the number of stored IDs.
+int nodedbGetDBIDs(struct s_nodedb *db, struct s_nodeid *nodeid, const int max_lastseen, const int max_lastconnect, const int min_lastconntry, int *db_ids, const int db_ids_size) {
+	int aid, nid, tnow, count;
+	struct s_nodedb_addrdata *dbdata;
+	struct s_map *addrset;
+	tnow = utilGetClock();
+	count = 0;
+	nid = mapGetKeyID(db->addrdb, nodeid->id);
+	if(nid < 0) return 0;
+	addrset = mapGetValueByID(db->addrdb, nid);
+	for(aid=0; ((aid < db->num_peeraddrs) && (count < db_ids_size)); aid++) {
+		if(mapIsValidID(addrset, aid)) {
+			dbdata = mapGetValueByID(addrset, aid);
+			if(nodedbIsMatch(dbdata, tnow, max_lastseen, max_lastconnect, min_lastconntry)) {
+				db_ids[count++] = (nid * db->num_peeraddrs) + aid;
+			}
+		}
+	}
+	return count;
+}
+
+
 // Returns a NodeDB ID that matches the specified criteria.
 int nodedbGetDBID(struct s_nodedb *db, struct s_nodeid *nodeid, const int max_lastseen, const int max_lastconnect, const int min_lastconntry) {
 	int i, i_max, nid, tnow, ret;
@@ -142,6 +188,60 @@ int nodedbGetDBID(struct s_nodedb *db, struct s_nodeid *nodeid, const int max_la
 }
 
 
+// Update the smoothed round trip time and jitter of an existing NodeDB entry (in milliseconds).
+void nodedbUpdateRTT(struct s_nodedb *db, const struct s_nodeid *nodeid, const struct s_peeraddr *addr, const int rtt) {
+	struct s_map *addrset;
+	struct s_nodedb_addrdata *addrdata;
+
+	if((addrset = mapGet(db->addrdb, nodeid->id)) == NULL) return;
+	if((addrdata = mapGet(addrset, addr->addr)) == NULL) return;
+	if(addrdata->rtt < 0) {
+		addrdata->rtt = rtt;
+		addrdata->jitter = (rtt / 2);
+	}
+	else {
+		addrdata->jitter = (((addrdata->jitter * 3) + abs(addrdata->rtt - rtt)) / 4);
+		addrdata->rtt = (((addrdata->rtt * 7) + rtt) / 8);
+	}
+}
+
+
+// Returns the smoothed round trip time of specified NodeDB ID (in milliseconds), or -1 if it has not been measured.
+int nodedbGetRTT(struct s_nodedb *db, const int db_id) {
+	struct s_map *addrset;
+	struct s_nodedb_addrdata *addrdata;
+	int nid, aid;
+
+	nid = (db_id / db->num_peeraddrs);
+	aid = (db_id % db->num_peeraddrs);
+	addrset = mapGetValueByID(db->addrdb, nid);
+	if((addrset != NULL) && (mapIsValidID(addrset, aid))) {
+		addrdata = mapGetValueByID(addrset, aid);
+		return addrdata->rtt;
+	}
+
+	return -1;
+}
+
+
+// Returns the jitter of the round trip time of specified NodeDB ID (in milliseconds), or 0 if it has not been measured.
+int nodedbGetJitter(struct s_nodedb *db, const int db_id) {
+	struct s_map *addrset;
+	struct s_nodedb_addrdata *addrdata;
+	int nid, aid;
+
+	nid = (db_id / db->num_peeraddrs);
+	aid = (db_id % db->num_peeraddrs);
+	addrset = mapGetValueByID(db->addrdb, nid);
+	if((addrset != NULL) && (mapIsValidID(addrset, aid))) {
+		addrdata = mapGetValueByID(addrset, aid);
+		return addrdata->jitter;
+	}
+
+	return 0;
+}
+
+
 // Returns node ID of specified NodeDB ID.
 struct s_nodeid *nodedbGetNodeID(struct s_nodedb *db, const int db_id) {
 	int nid;
@@ -192,6 +292,12 @@ void nodedbDestroy(struct s_nodedb *db) {
 }
 
 
+// Returns the number of NodeIDs stored in NodeDB.
+int nodedbNodeCount(struct s_nodedb *db) {
+	return mapGetKeyCount(db->addrdb);
+}
+
+
 // Generate NodeDB status report.
 void nodedbStatus(struct s_nodedb *db, char *report, const int report_len) {
 	int i;
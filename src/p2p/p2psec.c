@@ -46,9 +46,17 @@ int p2psecStart(struct s_p2psec *p2psec) {
 	peermgtSetLoopback(&p2psec->mgt, p2psec->loopback_enable);
 	peermgtSetFastauth(&p2psec->mgt, p2psec->fastauth_enable);
 	peermgtSetFragmentation(&p2psec->mgt, p2psec->fragmentation_enable);
+	peermgtSetBroadcastTree(&p2psec->mgt, p2psec->broadcasttree_enable);
+	peermgtSetConnectRate(&p2psec->mgt, p2psec->connect_rate);
+	peermgtSetProbeInterval(&p2psec->mgt, p2psec->probe_interval);
 	peermgtSetNetID(&p2psec->mgt, p2psec->netname, p2psec->netname_len);
 	peermgtSetPassword(&p2psec->mgt, p2psec->password, p2psec->password_len);
 	peermgtSetFlags(&p2psec->mgt, p2psec->flags);
+	if(p2psec->cryptthreads > 0) {
+		if(!peermgtEnableCryptPool(&p2psec->mgt, p2psec->cryptthreads)) {
+			return 0;
+		}
+	}
 	p2psec->started = 1;
 
 	return 1;
@@ -178,6 +186,21 @@ void p2psecSetAuthSlotCount(struct s_p2psec *p2psec, const int auth_slot_count)
 }
 
 
+void p2psecSetConnectRate(struct s_p2psec *p2psec, const int connect_rate) {
+	if(connect_rate > 0) p2psec->connect_rate = connect_rate;
+}
+
+
+void p2psecSetProbeInterval(struct s_p2psec *p2psec, const int probe_interval) {
+	if(probe_interval >= 0) p2psec->probe_interval = probe_interval;
+}
+
+
+void p2psecSetCryptThreads(struct s_p2psec *p2psec, const int threads) {
+	if((threads >= 0) && (threads <= cryptpool_THREADS_MAX)) p2psec->cryptthreads = threads;
+}
+
+
 void p2psecSetNetname(struct s_p2psec *p2psec, const char *netname, const int netname_len) {
 	int len;
 	if(netname_len < 1024) {
@@ -253,6 +276,18 @@ void p2psecDisableFragmentation(struct s_p2psec *p2psec) {
 }
 
 
+void p2psecEnableBroadcastTree(struct s_p2psec *p2psec) {
+	p2psec->broadcasttree_enable = 1;
+	if(p2psec->started) peermgtSetBroadcastTree(&p2psec->mgt, 1);
+}
+
+
+void p2psecDisableBroadcastTree(struct s_p2psec *p2psec) {
+	p2psec->broadcasttree_enable = 0;
+	if(p2psec->started) peermgtSetBroadcastTree(&p2psec->mgt, 0);
+}
+
+
 void p2psecSetFlag(struct s_p2psec *p2psec, const int flag, const int enable) {
 	int f;
 	if(enable) {
@@ -286,16 +321,108 @@ void p2psecDisableRelay(struct s_p2psec *p2psec) {
 }
 
 
+void p2psecEnableTickets(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_TICKET, 1);
+}
+
+
+void p2psecDisableTickets(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_TICKET, 0);
+}
+
+
+void p2psecEnableDeltaPeerinfo(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_DELTA, 1);
+}
+
+
+void p2psecDisableDeltaPeerinfo(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_DELTA, 0);
+}
+
+
+void p2psecEnableGroupKey(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_GROUPKEY, 1);
+}
+
+
+void p2psecDisableGroupKey(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_GROUPKEY, 0);
+}
+
+
+void p2psecEnableBroadcastRelay(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BCAST, 1);
+}
+
+
+void p2psecDisableBroadcastRelay(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BCAST, 0);
+}
+
+
+void p2psecEnableMacAdvert(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_MACADV, 1);
+}
+
+
+void p2psecDisableMacAdvert(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_MACADV, 0);
+}
+
+
+void p2psecSetMacAdvert(struct s_p2psec *p2psec, const unsigned char *advert, const int advert_len) {
+	peermgtSetMacAdvert(&p2psec->mgt, advert, advert_len);
+}
+
+
+void p2psecEnableRouteAdvert(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_ROUTEADV, 1);
+}
+
+
+void p2psecDisableRouteAdvert(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_ROUTEADV, 0);
+}
+
+
+void p2psecSetRouteAdvert(struct s_p2psec *p2psec, const unsigned char *advert, const int advert_len) {
+	peermgtSetRouteAdvert(&p2psec->mgt, advert, advert_len);
+}
+
+
+void p2psecEnableBundling(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BUNDLE, 1);
+}
+
+
+void p2psecDisableBundling(struct s_p2psec *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BUNDLE, 0);
+}
+
+
 int p2psecLoadDefaults(struct s_p2psec *p2psec) {
 	if(!p2psecLoadDH(p2psec)) return 0;
 	p2psecSetFlag(p2psec, (~(0)), 0);
 	p2psecSetMaxConnectedPeers(p2psec, 256);
 	p2psecSetAuthSlotCount(p2psec, 32);
+	p2psecSetConnectRate(p2psec, peermgt_CONNECT_RATE_DEFAULT);
+	p2psecSetProbeInterval(p2psec, peermgt_PROBE_INTERVAL_DEFAULT);
+	p2psecSetCryptThreads(p2psec, 0);
 	p2psecDisableLoopback(p2psec);
 	p2psecEnableFastauth(p2psec);
 	p2psecDisableFragmentation(p2psec);
+	p2psecDisableBroadcastTree(p2psec);
 	p2psecEnableUserdata(p2psec);
 	p2psecDisableRelay(p2psec);
+	p2psecEnableTickets(p2psec);
+	p2psecEnableDeltaPeerinfo(p2psec);
+	p2psecEnableGroupKey(p2psec);
+	p2psecEnableBroadcastRelay(p2psec);
+	p2psecEnableMacAdvert(p2psec);
+	p2psecEnableRouteAdvert(p2psec);
+	p2psecEnableBundling(p2psec);
+	p2psecSetFlag(p2psec, peermgt_FLAG_PINGTYPE, 1);
 	p2psecSetNetname(p2psec, NULL, 0);
 	p2psecSetPassword(p2psec, NULL, 0);
 	return 1;
@@ -357,6 +484,13 @@ int p2psecInputPacket(struct s_p2psec *p2psec, const unsigned char *packet_input
 }
 
 
+void p2psecInputUnreachable(struct s_p2psec *p2psec, const unsigned char *unreachable_addr) {
+	struct s_peeraddr addr;
+	memcpy(addr.addr, unreachable_addr, peeraddr_SIZE);
+	peermgtDecodeUnreachable(&p2psec->mgt, &addr);
+}
+
+
 unsigned char *p2psecRecvMSG(struct s_p2psec *p2psec, unsigned char *source_nodeid, int *message_len) {
 	struct s_msg msg;
 	struct s_nodeid nodeid;
@@ -389,6 +523,30 @@ unsigned char *p2psecRecvMSGFromPeerID(struct s_p2psec *p2psec, int *source_peer
 }
 
 
+unsigned char *p2psecRecvMacAdvertFromPeerID(struct s_p2psec *p2psec, int *source_peerid, int *source_peerct, int *advert_len) {
+	struct s_msg msg;
+	if(peermgtRecvMacAdvert(&p2psec->mgt, &msg, source_peerid, source_peerct)) {
+		*advert_len = msg.len;
+		return msg.msg;
+	}
+	else {
+		return NULL;
+	}
+}
+
+
+unsigned char *p2psecRecvRouteAdvertFromPeerID(struct s_p2psec *p2psec, int *source_peerid, int *source_peerct, int *advert_len) {
+	struct s_msg msg;
+	if(peermgtRecvRouteAdvert(&p2psec->mgt, &msg, source_peerid, source_peerct)) {
+		*advert_len = msg.len;
+		return msg.msg;
+	}
+	else {
+		return NULL;
+	}
+}
+
+
 int p2psecSendMSG(struct s_p2psec *p2psec, const unsigned char *destination_nodeid, unsigned char *message, int message_len) {
 	struct s_msg msg = { .msg = message, .len = message_len };
 	struct s_nodeid nodeid;
@@ -409,6 +567,37 @@ int p2psecSendMSGToPeerID(struct s_p2psec *p2psec, const int destination_peerid,
 }
 
 
+int p2psecBundleMSGToPeerID(struct s_p2psec *p2psec, const int destination_peerid, const int destination_peerct, unsigned char *message, int message_len) {
+	struct s_msg msg = { .msg = message, .len = message_len };
+	return peermgtBundleUserdata(&p2psec->mgt, &msg, destination_peerid, destination_peerct);
+}
+
+
+void p2psecFlushBundle(struct s_p2psec *p2psec) {
+	peermgtFlushBundle(&p2psec->mgt);
+}
+
+
+int p2psecBundlePending(struct s_p2psec *p2psec) {
+	return peermgtIsBundlePending(&p2psec->mgt);
+}
+
+
+void p2psecSetMSGTOS(struct s_p2psec *p2psec, const int tos) {
+	peermgtSetUserdataTOS(&p2psec->mgt, tos);
+}
+
+
+int p2psecInputPending(struct s_p2psec *p2psec) {
+	return peermgtDecodePending(&p2psec->mgt);
+}
+
+
+int p2psecCryptPending(struct s_p2psec *p2psec) {
+	return peermgtCryptPending(&p2psec->mgt);
+}
+
+
 int p2psecOutputPacket(struct s_p2psec *p2psec, unsigned char *packet_output, const int packet_output_len, unsigned char *packet_destination_addr) {
 	struct s_peeraddr addr;
 	int len = peermgtGetNextPacket(&p2psec->mgt, packet_output, packet_output_len, &addr);
@@ -422,12 +611,28 @@ int p2psecOutputPacket(struct s_p2psec *p2psec, unsigned char *packet_output, co
 }
 
 
+int p2psecGetOutputTOS(struct s_p2psec *p2psec) {
+	return peermgtGetOutputTOS(&p2psec->mgt);
+}
+
+
+int p2psecGetTimeout(struct s_p2psec *p2psec) {
+	return peermgtGetTimeout(&p2psec->mgt);
+}
+
+
 int p2psecPeerCount(struct s_p2psec *p2psec) {
 	int n = peermgtPeerCount(&p2psec->mgt);
 	return n;
 }
 
 
+int p2psecNodeCount(struct s_p2psec *p2psec) {
+	int n = peermgtNodeCount(&p2psec->mgt);
+	return n;
+}
+
+
 int p2psecUptime(struct s_p2psec *p2psec) {
 	if(p2psec == NULL) { return 0; }
 	int uptime = peermgtUptime(&p2psec->mgt);
@@ -35,44 +35,75 @@ int packetGetPeerID(const unsigned char *pbuf) {
 }
 
 
-// encode packet
-int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s_packet_data *data, struct s_crypto *ctx) {
-	unsigned char dec_buf[packet_CRHDR_SIZE + data->pl_buf_size];
-	int32_t *scr_peerid = ((int32_t *)pbuf);
+// encode multiple packets of one or several sessions. Sets the result of each item to the length of the encoded packet, or 0 on error. Returns the number of encoded packets.
+int packetEncodeBatch(struct s_packet_batch *batch, const int count) {
+	unsigned char hdr_buf[crypto_BATCHMAX][packet_CRHDR_SIZE];
+	struct s_crypto_batch crbatch[crypto_BATCHMAX];
+	const struct s_packet_data *data;
+	int32_t *scr_peerid;
 	int32_t ne_peerid;
-	int len;
-
-	// check if enough space is available for the operation
-	if(data->pl_length > data->pl_buf_size) { return 0; }
-
-	// prepare buffer
-	utilWriteInt64(&dec_buf[packet_CRHDR_SEQ_START], data->seq);
-	utilWriteInt16(&dec_buf[packet_CRHDR_PLLEN_START], data->pl_length);
-	dec_buf[packet_CRHDR_PLTYPE_START] = data->pl_type;
-	dec_buf[packet_CRHDR_PLOPT_START] = data->pl_options;
-	memcpy(&dec_buf[packet_CRHDR_SIZE], data->pl_buf, data->pl_length);
+	int done;
+	int pos;
+	int n;
+	int i;
+
+	done = 0;
+	pos = 0;
+	while(pos < count) {
+		n = (count - pos);
+		if(n > crypto_BATCHMAX) n = crypto_BATCHMAX;
+
+		// prepare the headers, the payload is encrypted in place behind them
+		for(i=0; i<n; i++) {
+			data = batch[pos + i].data;
+			utilWriteInt64(&hdr_buf[i][packet_CRHDR_SEQ_START], data->seq);
+			utilWriteInt16(&hdr_buf[i][packet_CRHDR_PLLEN_START], data->pl_length);
+			hdr_buf[i][packet_CRHDR_PLTYPE_START] = data->pl_type;
+			hdr_buf[i][packet_CRHDR_PLOPT_START] = data->pl_options;
+			crbatch[i].ctx = batch[pos + i].ctx;
+			crbatch[i].out_buf = &batch[pos + i].pbuf[packet_PEERID_SIZE];
+			crbatch[i].out_len = (batch[pos + i].pbuf_size - packet_PEERID_SIZE);
+			crbatch[i].pre_buf = hdr_buf[i];
+			crbatch[i].pre_len = packet_CRHDR_SIZE;
+			crbatch[i].in_buf = data->pl_buf;
+			crbatch[i].in_len = data->pl_length;
+			if(!((data->pl_length >= 0) && (data->pl_length <= data->pl_buf_size))) {
+				// not enough space available for the operation
+				crbatch[i].in_len = -1;
+			}
+		}
+
+		// encrypt buffers
+		cryptoEncBatch(crbatch, n, packet_HMAC_SIZE, packet_IV_SIZE);
+
+		// write the scrambled peer IDs
+		for(i=0; i<n; i++) {
+			batch[pos + i].result = 0;
+			if(crbatch[i].result >= (packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE)) {
+				scr_peerid = ((int32_t *)batch[pos + i].pbuf);
+				utilWriteInt32((unsigned char *)&ne_peerid, batch[pos + i].data->peerid);
+				scr_peerid[0] = (ne_peerid ^ (scr_peerid[1] ^ scr_peerid[2]));
+				batch[pos + i].result = (packet_PEERID_SIZE + crbatch[i].result);
+				done++;
+			}
+		}
+		pos += n;
+	}
 
-	// encrypt buffer
-	len = cryptoEnc(ctx, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), dec_buf, (packet_CRHDR_SIZE + data->pl_length), packet_HMAC_SIZE, packet_IV_SIZE);
-	if(len < (packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE)) { return 0; }
+	return done;
+}
 
-	// write the scrambled peer ID
-	utilWriteInt32((unsigned char *)&ne_peerid, data->peerid);
-	scr_peerid[0] = (ne_peerid ^ (scr_peerid[1] ^ scr_peerid[2]));
 
-	// return length of encoded packet
-	return (packet_PEERID_SIZE + len);
+// encode packet
+int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s_packet_data *data, struct s_crypto *ctx) {
+	struct s_packet_batch item = { .pbuf = pbuf, .pbuf_size = pbuf_size, .data = (struct s_packet_data *)data, .ctx = ctx, .seqstate = NULL, .result = 0 };
+	packetEncodeBatch(&item, 1);
+	return item.result;
 }
 
 
-// decode packet
-int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const int pbuf_size, struct s_crypto *ctx, struct s_seq_state *seqstate) {
-	unsigned char dec_buf[pbuf_size];
-	int len;
-
-	// decrypt packet
-	if(pbuf_size < (packet_PEERID_SIZE + packet_HMAC_SIZE + packet_IV_SIZE)) { return 0; }
-	len = cryptoDec(ctx, dec_buf, pbuf_size, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), packet_HMAC_SIZE, packet_IV_SIZE);
+// parse decrypted packet
+static int packetDecodeData(struct s_packet_data *data, const unsigned char *pbuf, const unsigned char *dec_buf, const int len, struct s_seq_state *seqstate) {
 	if(len < packet_CRHDR_SIZE) { return 0; };
 
 	// get packet data
@@ -95,4 +126,63 @@ int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const in
 }
 
 
+// decode multiple packets of one or several sessions in order. Sets the result of each item to the length of the decoded payload, or 0 on error. Returns the number of decoded packets.
+int packetDecodeBatch(struct s_packet_batch *batch, const int count) {
+	struct s_crypto_batch crbatch[crypto_BATCHMAX];
+	int done;
+	int pos;
+	int size;
+	int n;
+	int i;
+
+	done = 0;
+	pos = 0;
+	while(pos < count) {
+		// take as many packets as fit into the decryption buffer, but at least one
+		n = 0;
+		size = 0;
+		while(((pos + n) < count) && (n < crypto_BATCHMAX) && ((n == 0) || ((size + batch[pos + n].pbuf_size) <= packet_DECBATCH_BUFSIZE))) {
+			size += ((batch[pos + n].pbuf_size > 0) ? batch[pos + n].pbuf_size : 0);
+			n++;
+		}
+
+		unsigned char dec_buf[size + 1];
+
+		// decrypt packets
+		size = 0;
+		for(i=0; i<n; i++) {
+			crbatch[i].ctx = batch[pos + i].ctx;
+			crbatch[i].out_buf = &dec_buf[size];
+			crbatch[i].out_len = batch[pos + i].pbuf_size;
+			crbatch[i].pre_buf = NULL;
+			crbatch[i].pre_len = 0;
+			crbatch[i].in_buf = &batch[pos + i].pbuf[packet_PEERID_SIZE];
+			crbatch[i].in_len = (batch[pos + i].pbuf_size - packet_PEERID_SIZE);
+			if(batch[pos + i].pbuf_size < (packet_PEERID_SIZE + packet_HMAC_SIZE + packet_IV_SIZE)) {
+				crbatch[i].in_len = 0;
+			}
+			size += ((batch[pos + i].pbuf_size > 0) ? batch[pos + i].pbuf_size : 0);
+		}
+		cryptoDecBatch(crbatch, n, packet_HMAC_SIZE, packet_IV_SIZE);
+
+		// parse packets in order, so that the sequence numbers are verified in order
+		for(i=0; i<n; i++) {
+			batch[pos + i].result = packetDecodeData(batch[pos + i].data, batch[pos + i].pbuf, crbatch[i].out_buf, crbatch[i].result, batch[pos + i].seqstate);
+			if(batch[pos + i].result > 0) done++;
+		}
+		pos += n;
+	}
+
+	return done;
+}
+
+
+// decode packet
+int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const int pbuf_size, struct s_crypto *ctx, struct s_seq_state *seqstate) {
+	struct s_packet_batch item = { .pbuf = (unsigned char *)pbuf, .pbuf_size = pbuf_size, .data = data, .ctx = ctx, .seqstate = seqstate, .result = 0 };
+	packetDecodeBatch(&item, 1);
+	return item.result;
+}
+
+
 #endif // F_PACKET_C
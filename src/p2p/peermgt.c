@@ -34,6 +34,12 @@ int peermgtPeerCount(struct s_peermgt *mgt) {
 }
 
 
+// Return number of known nodes.
+int peermgtNodeCount(struct s_peermgt *mgt) {
+	return nodedbNodeCount(&mgt->nodedb);
+}
+
+
 // Check if PeerID is valid.
 int peermgtIsValidID(struct s_peermgt *mgt, const int peerid) {
 	if(!(peerid < 0)) {
@@ -164,9 +170,24 @@ int peermgtGetNodeID(struct s_peermgt *mgt, struct s_nodeid *nodeid, const int p
 
 // Reset the data for an ID.
 void peermgtResetID(struct s_peermgt *mgt, const int peerid) {
+	int entry;
+	peermgtClearGroupKey(mgt, peerid);
+
+	// return the relay queue of the peer, its packets must not go out under the PeerID of the next peer. The flow drops out of the round robin once it is found empty.
+	while((entry = mgt->data[peerid].relayqhead) >= 0) {
+		mgt->data[peerid].relayqhead = mgt->relayq[entry].next;
+		mgt->relayq[entry].next = mgt->relayqfree;
+		mgt->relayqfree = entry;
+	}
+	mgt->data[peerid].relayqtail = -1;
+	mgt->data[peerid].relayqlen = 0;
+	mgt->data[peerid].txdeficit = 0;
+
 	mgt->data[peerid].state = peermgt_STATE_INVALID;
+	mgt->data[peerid].resumestate = peermgt_RESUME_NONE;
 	memset(mgt->data[peerid].remoteaddr.addr, 0, peeraddr_SIZE);
 	cryptoSetKeysRandom(&mgt->ctx[peerid], 1);
+	mgt->data[peerid].ctxgen = ++mgt->ctxgen;
 }
 
 
@@ -182,8 +203,34 @@ int peermgtNew(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struc
 		mgt->data[peerid].lastsend = tnow;
 		mgt->data[peerid].lastpeerinfo = tnow;
 		mgt->data[peerid].lastpeerinfosendpeerid = peermgtGetNextID(mgt);
+		mgt->data[peerid].lastinfodelta = 0;
+		mgt->data[peerid].infoversion = 0;
+		mgt->data[peerid].infoacked = 0;
+		mgt->data[peerid].infoackdue = 0;
+		mgt->data[peerid].remoteinfoversion = 0;
+		mgt->data[peerid].groupkeyid = 0;
+		mgt->data[peerid].groupkeysent = 0;
+		mgt->data[peerid].groupkeyacked = 0;
+		mgt->data[peerid].groupkeyackdue = 0;
+		mgt->data[peerid].lastgroupkey = 0;
+		mgt->data[peerid].macadvsent = 0;
+		mgt->data[peerid].lastmacadv = 0;
+		mgt->data[peerid].routeadvsent = 0;
+		mgt->data[peerid].lastrouteadv = 0;
+		mgt->data[peerid].lastticket = (tnow - peermgt_TICKET_INTERVAL - 1);
+		mgt->data[peerid].resumestate = peermgt_RESUME_NONE;
 		seqInit(&mgt->data[peerid].seq, cryptoRand64());
 		mgt->data[peerid].remoteflags = 0;
+		mgt->data[peerid].ctxgen = ++mgt->ctxgen;
+		mgt->data[peerid].lastrecvms = utilGetClockMs();
+		mgt->data[peerid].lastdatams = (mgt->data[peerid].lastrecvms - peermgt_PROBE_IDLE_TIME);
+		mgt->data[peerid].activems = 0;
+		mgt->data[peerid].lastprobe = 0;
+		mgt->data[peerid].lastrecover = 0;
+		mgt->data[peerid].failover = 0;
+		mgt->data[peerid].srtt = -1;
+		mgt->data[peerid].jitter = 0;
+		mgt->data[peerid].lastrtt = tnow;
 		return peerid;
 	}
 	return -1;
@@ -211,6 +258,12 @@ void peermgtDeleteID(struct s_peermgt *mgt, const int peerid) {
 
 // Connect to a new peer.
 int peermgtConnect(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr) {
+	return peermgtConnectRace(mgt, remote_addr, 0);
+}
+
+
+// Connect to a new peer as part of an address race.
+int peermgtConnectRace(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr, const int raceid) {
 	if(remote_addr == NULL) {
         debug("failed to connect tot peer, remote_addr is NULL");
         return 0;
@@ -222,7 +275,7 @@ int peermgtConnect(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr)
     }
 
 
-    if(!authmgtStart(&mgt->authmgt, remote_addr)) {
+    if(!authmgtStartRace(&mgt->authmgt, remote_addr, raceid)) {
         debug("failed to start AUTH connection");
         return 0;
     }
@@ -234,6 +287,32 @@ int peermgtConnect(struct s_peermgt *mgt, const struct s_peeraddr *remote_addr)
 }
 
 
+// Race connection attempts to all eligible addresses of a node. Returns the number of attempts started.
+int peermgtConnectNode(struct s_peermgt *mgt, struct s_nodeid *nodeid, const struct s_peeraddr *first_addr) {
+	int raceid = authmgtNewRace(&mgt->authmgt);
+	int started = 0;
+	int i;
+	struct s_peeraddr *peeraddr;
+
+	if(!peermgtConnectRace(mgt, first_addr, raceid)) {
+		return 0;
+	}
+	started++;
+
+	// the remaining candidates are queued back to back, the first session that completes cancels the others
+	while(started < peermgt_NODEDB_NUM_PEERADDRS) {
+		i = nodedbGetDBID(&mgt->nodedb, nodeid, peermgt_NEWCONNECT_MAX_LASTSEEN, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY);
+		if(i < 0) break;
+		peeraddr = nodedbGetNodeAddress(&mgt->nodedb, i);
+		nodedbUpdate(&mgt->nodedb, nodeid, peeraddr, 0, 0, 1);
+		if(!peermgtConnectRace(mgt, peeraddr, raceid)) break;
+		started++;
+	}
+
+	return started;
+}
+
+
 // Enable/Disable loopback messages.
 void peermgtSetLoopback(struct s_peermgt *mgt, const int enable) {
 	if(enable) {
@@ -257,6 +336,92 @@ void peermgtSetFragmentation(struct s_peermgt *mgt, const int enable) {
 }
 
 
+// Enable/disable distribution of local broadcast messages over forwarding peers.
+void peermgtSetBroadcastTree(struct s_peermgt *mgt, const int enable) {
+	mgt->bcasttree = (enable) ? 1 : 0;
+}
+
+
+// Set the list of local MAC addresses that is advertised to all peers.
+void peermgtSetMacAdvert(struct s_peermgt *mgt, const unsigned char *advert, const int advert_len) {
+	int len = advert_len;
+	if(len > peermgt_MACADV_SIZE) len = peermgt_MACADV_SIZE;
+	if(len < 0) len = 0;
+	if((len == mgt->macadvlen) && (memcmp(mgt->macadvbuf, advert, len) == 0)) {
+		return;
+	}
+	memcpy(mgt->macadvbuf, advert, len);
+	mgt->macadvlen = len;
+	mgt->macadvversion++;
+}
+
+
+// Set the list of local prefixes that is advertised to all peers.
+void peermgtSetRouteAdvert(struct s_peermgt *mgt, const unsigned char *advert, const int advert_len) {
+	int len = advert_len;
+	if(len > peermgt_ROUTEADV_SIZE) len = peermgt_ROUTEADV_SIZE;
+	if(len < 0) len = 0;
+	if((len == mgt->routeadvlen) && (memcmp(mgt->routeadvbuf, advert, len) == 0)) {
+		return;
+	}
+	memcpy(mgt->routeadvbuf, advert, len);
+	mgt->routeadvlen = len;
+	mgt->routeadvversion++;
+}
+
+
+// Set maximum number of new connection attempts per second.
+void peermgtSetConnectRate(struct s_peermgt *mgt, const int rate) {
+	if(rate < 1) {
+		mgt->connectrate = 1;
+	}
+	else if(rate > peermgt_CONNECT_RATE_MAX) {
+		mgt->connectrate = peermgt_CONNECT_RATE_MAX;
+	}
+	else {
+		mgt->connectrate = rate;
+	}
+}
+
+
+// Returns the number of connection attempts allowed in the current second.
+int peermgtConnectBudget(struct s_peermgt *mgt) {
+	int slots = authmgtSlotCount(&mgt->authmgt);
+	int free_slots = (slots - authmgtUsedSlotCount(&mgt->authmgt));
+	int budget;
+	if(!(free_slots > 0)) return 0;
+	budget = ((mgt->connectrate * free_slots) / slots);
+	if(budget < 1) budget = 1;
+	return budget;
+}
+
+
+// Set the path probing interval in milliseconds, 0 disables probing.
+void peermgtSetProbeInterval(struct s_peermgt *mgt, const int interval) {
+	if(!(interval > 0)) {
+		mgt->probeinterval = 0;
+	}
+	else if(interval < peermgt_PROBE_INTERVAL_MIN) {
+		mgt->probeinterval = peermgt_PROBE_INTERVAL_MIN;
+	}
+	else if(interval > peermgt_PROBE_INTERVAL_MAX) {
+		mgt->probeinterval = peermgt_PROBE_INTERVAL_MAX;
+	}
+	else {
+		mgt->probeinterval = interval;
+	}
+}
+
+
+// Returns the maximum time in milliseconds the main loop may wait for input before probes are due.
+int peermgtGetTimeout(struct s_peermgt *mgt) {
+	if((mgt->probeinterval > 0) && (peermgtPeerCount(mgt) > 0) && ((mgt->probeinterval / 2) < 1000)) {
+		return (mgt->probeinterval / 2);
+	}
+	return 1000;
+}
+
+
 // Set flags.
 void peermgtSetFlags(struct s_peermgt *mgt, const int flags) {
 	mgt->localflags = flags;
@@ -321,262 +486,1379 @@ void peermgtGenPacketPeerinfo(struct s_packet_data *data, struct s_peermgt *mgt,
 }
 
 
-// Send ping to PeerAddr. Return 1 if successful.
-int peermgtSendPingToAddr(struct s_peermgt *mgt, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct, const struct s_peeraddr *peeraddr) {
-	int outpeerid;
-	unsigned char pingbuf[peermgt_PINGBUF_SIZE];
+// Mark the peerinfo entry of a peer as changed.
+void peermgtUpdatePeerinfoVersion(struct s_peermgt *mgt, const int peerid) {
+	mgt->infoversion++;
+	mgt->data[peerid].infoversion = mgt->infoversion;
+}
 
-	outpeerid = peermgtGetActiveID(mgt, tonodeid, topeerid, topeerct);
 
-	if(!(outpeerid > 0)) {
-		return 0;
+// Set the remote PeerAddr of a peer. The RTT of a new path is measured from scratch.
+void peermgtSetRemoteAddr(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr) {
+	if(memcmp(mgt->data[peerid].remoteaddr.addr, addr->addr, peeraddr_SIZE) != 0) {
+		mgt->data[peerid].remoteaddr = *addr;
+		mgt->data[peerid].srtt = -1;
+		mgt->data[peerid].jitter = 0;
+		if(mgt->data[peerid].state == peermgt_STATE_COMPLETE) peermgtUpdatePeerinfoVersion(mgt, peerid);
 	}
-
-	cryptoRand(pingbuf, 64); // generate ping message
-	memcpy(mgt->rrmsg.msg, pingbuf, peermgt_PINGBUF_SIZE);
-	mgt->rrmsgpeerid = outpeerid;
-	mgt->rrmsgtype = packet_PLTYPE_PING;
-	mgt->rrmsg.len = peermgt_PINGBUF_SIZE;
-	mgt->rrmsgusetargetaddr = 1;
-	mgt->rrmsgtargetaddr = *peeraddr;
-
-	return 1;
 }
 
 
-// Generate next peer manager packet. Returns length if successful.
-int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
-	int used = mapGetKeyCount(&mgt->map);
-	int len;
-	int outlen;
-	int fragoutlen;
-	int peerid;
-	int usetargetaddr;
+// Generate delta peerinfo packet containing the entries the peer has not acknowledged yet.
+void peermgtGenPacketPeerinfoDelta(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	const int peerinfo_size = (packet_PEERID_SIZE + nodeid_SIZE + peeraddr_SIZE);
+	int size = mapGetMapSize(&mgt->map);
+	int pos = peermgt_PEERINFO_DELTA_HDRSIZE;
+	int peerinfo_count = 0;
+	int version = mgt->data[peerid].infoacked;
+	int minversion;
+	int infoid;
 	int i;
-	int j;
-	int fragcount;
-	int fragpos;
-	const int plbuf_size = peermgt_MSGSIZE_MIN;
-	unsigned char plbuf[plbuf_size];
-	struct s_msg authmsg;
-	struct s_packet_data data;
-	struct s_nodeid *nodeid;
-	struct s_peeraddr *peeraddr;
-
-    CREATE_HUMAN_IP(target);
+	struct s_nodeid infonid;
 
-	// send out user data
-	outlen = mgt->outmsg.len;
-	fragoutlen = mgt->fragoutsize;
-	if(outlen > 0 && (!(fragoutlen > 0))) {
-		if(mgt->outmsgbroadcast) { // get PeerID for broadcast message
-			do {
-				peerid = peermgtGetNextID(mgt);
-				mgt->outmsgbroadcastcount++;
-			}
-			while((!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA))) && (mgt->outmsgbroadcastcount < used));
-			if(mgt->outmsgbroadcastcount >= used) {
-				mgt->outmsgbroadcast = 0;
-				mgt->outmsg.len = 0;
+	// add changed entries in version order, so the version sent is the highest one fully covered
+	while(pos + peerinfo_size < data->pl_buf_size) {
+		infoid = -1;
+		minversion = 0;
+		for(i=1; i<size; i++) {
+			if((mgt->data[i].infoversion > version) && ((infoid < 0) || (mgt->data[i].infoversion < minversion)) && peermgtIsValidID(mgt, i)) {
+				infoid = i;
+				minversion = mgt->data[i].infoversion;
 			}
 		}
-		else { // get PeerID for unicast message
-			peerid = mgt->outmsgpeerid;
-			mgt->outmsg.len = 0;
-		}
-		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
-			if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA)) {
-				if((mgt->fragmentation > 0) && (outlen > peermgt_MSGSIZE_MIN)) {
-					// start generating fragmented userdata packets
-					mgt->fragoutpeerid = peerid;
-					mgt->fragoutcount = (((outlen - 1) / peermgt_MSGSIZE_MIN) + 1); // calculate number of fragments
-					mgt->fragoutsize = outlen;
-					fragoutlen = outlen;
-					mgt->fragoutpos = 0;
-				}
-				else {
-					// generate userdata packet
-					data.pl_buf = mgt->outmsg.msg;
-					data.pl_buf_size = outlen;
-					data.peerid = mgt->data[peerid].remoteid;
-					data.seq = ++mgt->data[peerid].remoteseq;
-					data.pl_length = outlen;
-					data.pl_type = packet_PLTYPE_USERDATA;
-					data.pl_options = 0;
-					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-					if(len > 0) {
-						mgt->data[peerid].lastsend = tnow;
-						*target = mgt->data[peerid].remoteaddr;
-						return len;
-					}
-				}
-			}
-		}
-	}
-
-	// send out fragments
-	if(fragoutlen > 0) {
-		fragcount = mgt->fragoutcount;
-		fragpos = mgt->fragoutpos;
-		peerid = mgt->fragoutpeerid;
-		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
-			// generate fragmented packet
-			data.pl_buf = &mgt->outmsg.msg[(fragpos * peermgt_MSGSIZE_MIN)];
-			if(fragoutlen > peermgt_MSGSIZE_MIN) {
-				// start or middle fragment
-				data.pl_buf_size = peermgt_MSGSIZE_MIN;
-				data.pl_length = peermgt_MSGSIZE_MIN;
-				mgt->fragoutsize = (fragoutlen - peermgt_MSGSIZE_MIN);
-			}
-			else {
-				// end fragment
-				data.pl_buf_size = fragoutlen;
-				data.pl_length = fragoutlen;
-				mgt->fragoutsize = 0;
-			}
-			data.peerid = mgt->data[peerid].remoteid;
-			data.seq = ++mgt->data[peerid].remoteseq;
-			data.pl_type = packet_PLTYPE_USERDATA_FRAGMENT;
-			data.pl_options = (fragcount << 4) | (fragpos);
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-			mgt->fragoutpos = (fragpos + 1);
-			if(len > 0) {
-				mgt->data[peerid].lastsend = tnow;
-				*target = mgt->data[peerid].remoteaddr;
-				return len;
-			}
+		if(infoid < 0) {
+			version = mgt->infoversion;
+			break;
 		}
-		else {
-			// session not active anymore, abort sending fragments
-			mgt->fragoutsize = 0;
+		version = minversion;
+		if((infoid != peerid) && (mgt->data[infoid].state == peermgt_STATE_COMPLETE) && (!peeraddrIsInternal(&mgt->data[infoid].remoteaddr))) {
+			utilWriteInt32(&data->pl_buf[pos], infoid);
+			peermgtGetNodeID(mgt, &infonid, infoid);
+			memcpy(&data->pl_buf[(pos + packet_PEERID_SIZE)], infonid.id, nodeid_SIZE);
+			memcpy(&data->pl_buf[(pos + packet_PEERID_SIZE + nodeid_SIZE)], &mgt->data[infoid].remoteaddr.addr, peeraddr_SIZE);
+			pos = pos + peerinfo_size;
+			peerinfo_count++;
 		}
 	}
 
-	// send out request-response packet
-	outlen = mgt->rrmsg.len;
-	if(outlen > 0) {
-		peerid = mgt->rrmsgpeerid;
-		usetargetaddr = mgt->rrmsgusetargetaddr;
-		mgt->rrmsg.len = 0;
-		mgt->rrmsgusetargetaddr = 0;
-		if((outlen < peermgt_MSGSIZE_MAX) && (peermgtIsActiveRemoteID(mgt, peerid))) {  // check if session is active
-			data.pl_buf = mgt->rrmsg.msg;
-			data.pl_buf_size = peermgt_MSGSIZE_MAX;
-			data.pl_length = outlen;
-			data.pl_type = mgt->rrmsgtype;
-			data.pl_options = 0;
-			data.peerid = mgt->data[peerid].remoteid;
-			data.seq = ++mgt->data[peerid].remoteseq;
+	// write header: entry count, covered version, acknowledged remote version
+	utilWriteInt32(data->pl_buf, peerinfo_count);
+	utilWriteInt32(&data->pl_buf[4], version);
+	utilWriteInt32(&data->pl_buf[8], mgt->data[peerid].remoteinfoversion);
 
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-			if(len > 0) {
-				if(usetargetaddr > 0) {
-					*target = mgt->rrmsgtargetaddr;
-				}
-				else {
-					mgt->data[peerid].lastsend = tnow;
-					*target = mgt->data[peerid].remoteaddr;
-				}
-				return len;
-			}
-		}
-	}
+	// set packet metadata
+	data->pl_length = (peermgt_PEERINFO_DELTA_HDRSIZE + (peerinfo_count * peerinfo_size));
+	data->pl_type = packet_PLTYPE_PEERINFO;
+	data->pl_options = peermgt_PEERINFO_DELTA;
+}
 
-	// send peerinfo to peers
-	for(i=0; i<used; i++) {
-		peerid = peermgtGetNextID(mgt);
-		if(peerid > 0) {
-			if((tnow - mgt->data[peerid].lastrecv) < peermgt_RECV_TIMEOUT) { // check if session has expired
-				if(mgt->data[peerid].state == peermgt_STATE_COMPLETE) {  // check if session is active
-					if(((tnow - mgt->data[peerid].lastsend) > peermgt_KEEPALIVE_INTERVAL) || ((tnow - mgt->data[peerid].lastpeerinfo) > peermgt_PEERINFO_INTERVAL)) { // check if we should send peerinfo packet
-						data.pl_buf = plbuf;
-						data.pl_buf_size = plbuf_size;
-						data.peerid = mgt->data[peerid].remoteid;
-						data.seq = ++mgt->data[peerid].remoteseq;
-						peermgtGenPacketPeerinfo(&data, mgt, peerid);
-						len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-						if(len > 0) {
-							mgt->data[peerid].lastsend = tnow;
-							mgt->data[peerid].lastpeerinfo = tnow;
-							*target = mgt->data[peerid].remoteaddr;
-							return len;
-						}
-					}
-				}
-			}
-			else {
-				peermgtDeleteID(mgt, peerid);
-			}
-		}
-	}
 
-	// send auth manager message
-	if(authmgtGetNextMsg(&mgt->authmgt, &authmsg, target)) {
-		data.pl_buf = authmsg.msg;
-		data.pl_buf_size = authmsg.len;
-		data.peerid = 0;
-		data.seq = 0;
-		data.pl_length = authmsg.len;
-		if(data.pl_length > 0) {
-			data.pl_type = packet_PLTYPE_AUTH;
-			data.pl_options = 0;
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[0]);
-			if(len > 0) {
-				mgt->data[0].lastsend = tnow;
-				return len;
-			}
-		}
-	}
+// Generate keepalive packet.
+void peermgtGenPacketKeepalive(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	utilWriteInt32(data->pl_buf, mgt->infoversion);
+	utilWriteInt32(&data->pl_buf[4], mgt->data[peerid].remoteinfoversion);
+	data->pl_length = peermgt_KEEPALIVE_SIZE;
+	data->pl_type = packet_PLTYPE_KEEPALIVE;
+	data->pl_options = 0;
+}
 
-	// connect new peer
-	if((tnow - mgt->lastconntry) > 0) { // limit to one per second
-		mgt->lastconntry = tnow;
-		i = -1;
 
-		// find a NodeID and PeerAddr pair in NodeDB
-		if(authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 2)) {
-			i = nodedbGetDBID(&mgt->nodedb, NULL, peermgt_NEWCONNECT_MAX_LASTSEEN, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY);
-			if((i < 0) && (authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 8))) {
-				i = nodedbGetDBID(&mgt->nodedb, NULL, peermgt_NEWCONNECT_MAX_LASTSEEN, -1, -1);
-				if((i < 0) && (authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 16))) {
-					i = nodedbGetDBID(&mgt->nodedb, NULL, -1, -1, -1);
-				}
-			}
-		}
+// Generate MAC advertisement packet.
+void peermgtGenPacketMacAdvert(struct s_packet_data *data, struct s_peermgt *mgt) {
+	memcpy(data->pl_buf, mgt->macadvbuf, mgt->macadvlen);
+	data->pl_length = mgt->macadvlen;
+	if(data->pl_length < 1) {
+		// packets without payload are dropped by the decoder, send a padding byte that contains no complete entry
+		data->pl_buf[0] = 0;
+		data->pl_length = 1;
+	}
+	data->pl_type = packet_PLTYPE_MACADV;
+	data->pl_options = 0;
+}
 
-		// start connection attempt if a node is found
-		if(!(i < 0)) {
-			nodeid = nodedbGetNodeID(&mgt->nodedb, i);
-			peerid = peermgtGetID(mgt, nodeid);
-			peeraddr = nodedbGetNodeAddress(&mgt->nodedb, i);
-			nodedbUpdate(&mgt->nodedb, nodeid, peeraddr, 0, 0, 1);
-			if(peerid < 0) { // node is not connected yet
-				if(peermgtConnect(mgt, peeraddr)) { // try to connect
-                    debugf("Trying to connect with %s", humanIp);
-
-					j = nodedbGetDBID(&mgt->relaydb, nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY);
-					if(!(j < 0)) {
-						peermgtConnect(mgt, nodedbGetNodeAddress(&mgt->relaydb, j)); // try to connect via relay
-						nodedbUpdate(&mgt->relaydb, nodeid, nodedbGetNodeAddress(&mgt->relaydb, j), 0, 0, 1);
-					}
-				}
-			}
-			else { // node is already connected
-				if(peermgtIsActiveRemoteID(mgt, peerid)) {
-					if(peeraddrIsInternal(&mgt->data[peerid].remoteaddr)) { // node connection is indirect
-						peermgtSendPingToAddr(mgt, NULL, peerid, mgt->data[peerid].conntime, peeraddr); // try to switch peer to a direct connection
-					}
-				}
-			}
-		}
 
+// Generate route advertisement packet.
+void peermgtGenPacketRouteAdvert(struct s_packet_data *data, struct s_peermgt *mgt) {
+	memcpy(data->pl_buf, mgt->routeadvbuf, mgt->routeadvlen);
+	data->pl_length = mgt->routeadvlen;
+	if(data->pl_length < 1) {
+		// packets without payload are dropped by the decoder, send a padding byte that contains no complete entry
+		data->pl_buf[0] = 0;
+		data->pl_length = 1;
 	}
-
-	return 0;
+	data->pl_type = packet_PLTYPE_ROUTEADV;
+	data->pl_options = 0;
 }
 
 
-// Get next peer manager packet. Also encapsulates packets for relaying if necessary. Returns length if successful.
+// Rotate the local group key if it is due.
+void peermgtRotateGroupKey(struct s_peermgt *mgt, const int tnow) {
+	unsigned char nonce[4];
+	int keyid;
+
+	if((mgt->groupkeyid > 0) && ((tnow - mgt->groupkeytime) <= peermgt_GROUPKEY_INTERVAL)) {
+		return;
+	}
+
+	// peers fall back to per-peer encryption until they acknowledge the new key
+	keyid = (cryptoRandInt() & 0x7FFFFFFF);
+	if(keyid == 0 || keyid == mgt->groupkeyid) keyid = ((mgt->groupkeyid & 0x7FFFFFFE) + 1);
+	utilWriteInt32(nonce, keyid);
+	if(cryptoRand(mgt->groupsecret, peermgt_GROUPKEY_SECRETSIZE) && cryptoSetKeys(&mgt->localgroupctx, 1, mgt->groupsecret, peermgt_GROUPKEY_SECRETSIZE, nonce, 4)) {
+		mgt->groupkeyid = keyid;
+		mgt->groupseq = 0;
+		debugf("group key rotated, key ID %d", keyid);
+	}
+	else {
+		mgt->groupkeyid = 0;
+	}
+	mgt->groupkeytime = tnow;
+	mgt->grouplen = 0;
+}
+
+
+// Check if broadcast messages to the specified peer can use the local group key.
+int peermgtIsGroupKeyReady(struct s_peermgt *mgt, const int peerid) {
+	return ((mgt->groupkeyid > 0) && (mgt->data[peerid].groupkeyacked == mgt->groupkeyid) && (peermgtGetFlag(mgt, peermgt_FLAG_GROUPKEY)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_GROUPKEY)));
+}
+
+
+// Generate group key packet.
+void peermgtGenPacketGroupKey(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	if(mgt->data[peerid].groupkeyackdue) { // acknowledge the key received from the peer
+		utilWriteInt32(data->pl_buf, mgt->data[peerid].groupkeyid);
+		data->pl_length = 4;
+		data->pl_options = peermgt_GROUPKEY_ACK;
+	}
+	else { // send msg(keyid, seq, secret)
+		utilWriteInt32(data->pl_buf, mgt->groupkeyid);
+		utilWriteInt64(&data->pl_buf[4], mgt->groupseq);
+		memcpy(&data->pl_buf[(4 + seq_SIZE)], mgt->groupsecret, peermgt_GROUPKEY_SECRETSIZE);
+		data->pl_length = peermgt_GROUPKEY_MSGSIZE;
+		data->pl_options = peermgt_GROUPKEY_KEY;
+	}
+	data->pl_type = packet_PLTYPE_GROUPKEY;
+}
+
+
+// Forget the group key received from a peer.
+void peermgtClearGroupKey(struct s_peermgt *mgt, const int peerid) {
+	unsigned char keyid[4];
+	int *indexed;
+	if(mgt->data[peerid].groupkeyid > 0) {
+		utilWriteInt32(keyid, mgt->data[peerid].groupkeyid);
+		indexed = mapGet(&mgt->groupmap, keyid);
+		if((indexed != NULL) && (*indexed == peerid)) mapRemove(&mgt->groupmap, keyid);
+		mgt->data[peerid].groupkeyid = 0;
+	}
+}
+
+
+// Returns the broadcast tree partition a peer belongs to.
+int peermgtGetBroadcastPart(struct s_peermgt *mgt, const int peerid, const int parts) {
+	struct s_nodeid nodeid;
+	if(!((parts > 0) && peermgtGetNodeID(mgt, &nodeid, peerid))) {
+		return -1;
+	}
+	return ((utilReadInt32(nodeid.id) & 0x7FFFFFFF) % parts);
+}
+
+
+// Check if a peer has announced a session to another peer in its peerinfo.
+int peermgtIsAnnouncedBy(struct s_peermgt *mgt, const int relayid, const int peerid) {
+	int db_ids[peermgt_RELAYDB_NUM_PEERADDRS];
+	struct s_peeraddr *addr;
+	struct s_nodeid nodeid;
+	int count;
+	int viaid;
+	int i;
+
+	if(!peermgtGetNodeID(mgt, &nodeid, peerid)) {
+		return 0;
+	}
+	count = nodedbGetDBIDs(&mgt->relaydb, &nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, -1, db_ids, peermgt_RELAYDB_NUM_PEERADDRS);
+	for(i=0; i<count; i++) {
+		addr = nodedbGetNodeAddress(&mgt->relaydb, db_ids[i]);
+		if(peermgtIsValidIndirectPeerAddr(mgt, addr) && peeraddrGetIndirect(addr, &viaid, NULL, NULL) && (viaid == relayid)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Returns the role of a peer for the current broadcast message: a partition index to forward, peermgt_BCAST_DIRECT or peermgt_BCAST_COVERED.
+int peermgtGetBroadcastRole(struct s_peermgt *mgt, const int peerid) {
+	int part;
+	if(!((mgt->bcastlen > 0) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_BCAST))) {
+		return peermgt_BCAST_DIRECT;
+	}
+	for(part=0; part<mgt->bcastparts; part++) {
+		if(mgt->bcastfwdpeer[part] == peerid) return part;
+	}
+
+	// only leave a peer to its forwarder if the forwarder has announced a session to it
+	part = peermgtGetBroadcastPart(mgt, peerid, mgt->bcastparts);
+	if((part < 0) || (!peermgtIsAnnouncedBy(mgt, mgt->bcastfwdpeer[part], peerid))) {
+		return peermgt_BCAST_DIRECT;
+	}
+	return peermgt_BCAST_COVERED;
+}
+
+
+// Prepare the current broadcast message for distribution over forwarding peers.
+void peermgtPrepareBroadcastTree(struct s_peermgt *mgt) {
+	int size = mapGetMapSize(&mgt->map);
+	int len = (peermgt_BCAST_HDRSIZE + mgt->outmsg.len);
+	int forwarders = 0;
+	int i;
+
+	mgt->bcastlen = 0;
+	if(!(mgt->bcasttree && peermgtGetFlag(mgt, peermgt_FLAG_BCAST))) return;
+	if((len > peermgt_MSGSIZE_MAX) || ((mgt->fragmentation > 0) && (len > peermgt_MSGSIZE_MIN))) return;
+
+	// the first peers that forward broadcasts serve one partition each
+	for(i=1; (i<size) && (forwarders < peermgt_BCAST_FANOUT); i++) {
+		if(peermgtIsActiveRemoteID(mgt, i) && peermgtGetRemoteFlag(mgt, i, peermgt_FLAG_USERDATA) && peermgtGetRemoteFlag(mgt, i, peermgt_FLAG_BCAST) && peermgtGetRemoteFlag(mgt, i, peermgt_FLAG_RELAY)) {
+			mgt->bcastfwdpeer[forwarders++] = i;
+		}
+	}
+	if(!(forwarders > 0)) return;
+
+	// generate msg(origin, seq, parts, part, frame)
+	mgt->bcastparts = forwarders;
+	memcpy(mgt->bcastbuf, mgt->nodekey->nodeid.id, nodeid_SIZE);
+	utilWriteInt64(&mgt->bcastbuf[nodeid_SIZE], ++mgt->bcastseq);
+	mgt->bcastbuf[(nodeid_SIZE + seq_SIZE)] = mgt->bcastparts;
+	mgt->bcastbuf[(nodeid_SIZE + seq_SIZE + 1)] = 0;
+	memcpy(&mgt->bcastbuf[peermgt_BCAST_HDRSIZE], mgt->outmsg.msg, mgt->outmsg.len);
+	peermgtIsBroadcastDuplicate(mgt, mgt->bcastbuf);
+	mgt->bcastlen = len;
+}
+
+
+// Check if the (origin, seq) pair of a broadcast message has been seen before and remember it.
+int peermgtIsBroadcastDuplicate(struct s_peermgt *mgt, const unsigned char *origin_seq) {
+	unsigned char seen = 1;
+	if(mapGet(&mgt->bcastdedup, origin_seq) != NULL) {
+		return 1;
+	}
+	mapSet(&mgt->bcastdedup, origin_seq, &seen);
+	return 0;
+}
+
+
+// Rotate the local ticket key if it is due.
+void peermgtRotateTicketKey(struct s_peermgt *mgt, const int tnow) {
+	if((tnow - mgt->ticketkeytime) > peermgt_TICKET_KEY_INTERVAL) {
+		// tickets sealed with the previous key stay valid until the next rotation
+		mgt->ticketkeygen = ((mgt->ticketkeygen + 1) & 0xFF);
+		cryptoSetKeysRandom(&mgt->ticketctx[(mgt->ticketkeygen % 2)], 1);
+		mgt->ticketkeytime = tnow;
+		debugf("ticket key rotated, generation %d", mgt->ticketkeygen);
+	}
+}
+
+
+// Derive resumption keys from a ticket secret and nonces.
+int peermgtSetResumeKeys(struct s_crypto *ctx, const unsigned char *secret, const unsigned char *nonce_a, const unsigned char *nonce_b) {
+	unsigned char nonce[(peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE)];
+	memcpy(nonce, nonce_a, peermgt_TICKET_NONCESIZE);
+	if(nonce_b != NULL) {
+		memcpy(&nonce[peermgt_TICKET_NONCESIZE], nonce_b, peermgt_TICKET_NONCESIZE);
+	}
+	else {
+		memset(&nonce[peermgt_TICKET_NONCESIZE], 0, peermgt_TICKET_NONCESIZE);
+	}
+	return cryptoSetKeys(ctx, 1, secret, peermgt_TICKET_SECRETSIZE, nonce, (peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE));
+}
+
+
+// Generate ticket packet. Returns 1 if successful.
+int peermgtGenPacketTicket(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	// generate msg(secret, keygen, enc(nodeid, secret, issuetime))
+	unsigned char plain[peermgt_TICKET_PLAINSIZE];
+	struct s_nodeid nodeid;
+	int keygen = mgt->ticketkeygen;
+	int len;
+
+	if(data->pl_buf_size < (peermgt_TICKET_SECRETSIZE + peermgt_TICKET_MAXSIZE)) return 0;
+	if(!peermgtGetNodeID(mgt, &nodeid, peerid)) return 0;
+	if(!cryptoRand(data->pl_buf, peermgt_TICKET_SECRETSIZE)) return 0;
+
+	memcpy(plain, nodeid.id, nodeid_SIZE);
+	memcpy(&plain[nodeid_SIZE], data->pl_buf, peermgt_TICKET_SECRETSIZE);
+	utilWriteInt32(&plain[(nodeid_SIZE + peermgt_TICKET_SECRETSIZE)], utilGetClock());
+	data->pl_buf[peermgt_TICKET_SECRETSIZE] = keygen;
+	len = cryptoEnc(&mgt->ticketctx[(keygen % 2)], &data->pl_buf[(peermgt_TICKET_SECRETSIZE + 1)], (peermgt_TICKET_MAXSIZE - 1), plain, peermgt_TICKET_PLAINSIZE, peermgt_TICKET_HMACSIZE, peermgt_TICKET_IVSIZE);
+	memset(plain, 0, peermgt_TICKET_PLAINSIZE);
+	if(len <= 0) {
+		debug("failed to seal resumption ticket");
+		return 0;
+	}
+
+	data->pl_length = (peermgt_TICKET_SECRETSIZE + 1 + len);
+	data->pl_type = packet_PLTYPE_TICKET;
+	data->pl_options = 0;
+	return 1;
+}
+
+
+// Open a ticket issued by this node. Returns 1 if the ticket is valid for the specified NodeID.
+int peermgtOpenTicket(struct s_peermgt *mgt, unsigned char *secret, const unsigned char *ticket, const int ticket_len, const struct s_nodeid *nodeid, const int tnow) {
+	unsigned char plain[peermgt_TICKET_MAXSIZE];
+	int keygen;
+	int age;
+	int ret = 0;
+
+	if(!((ticket_len > 1) && (ticket_len <= peermgt_TICKET_MAXSIZE))) return 0;
+
+	keygen = ticket[0];
+	if((keygen != mgt->ticketkeygen) && (keygen != ((mgt->ticketkeygen - 1) & 0xFF))) {
+		debugf("ticket key generation %d has been rotated out", keygen);
+		return 0;
+	}
+
+	if(cryptoDec(&mgt->ticketctx[(keygen % 2)], plain, peermgt_TICKET_MAXSIZE, &ticket[1], (ticket_len - 1), peermgt_TICKET_HMACSIZE, peermgt_TICKET_IVSIZE) == peermgt_TICKET_PLAINSIZE) {
+		age = (tnow - utilReadInt32(&plain[(nodeid_SIZE + peermgt_TICKET_SECRETSIZE)]));
+		if((age >= 0) && (age < peermgt_TICKET_LIFETIME) && (memcmp(plain, nodeid->id, nodeid_SIZE) == 0)) {
+			memcpy(secret, &plain[nodeid_SIZE], peermgt_TICKET_SECRETSIZE);
+			ret = 1;
+		}
+	}
+
+	memset(plain, 0, peermgt_TICKET_MAXSIZE);
+	return ret;
+}
+
+
+// Queue a resume request or acknowledgement. Returns 1 if successful.
+static int peermgtQueueResume(struct s_peermgt *mgt, const int type, const unsigned char *msg, const int len, const struct s_peeraddr *targetaddr) {
+	struct s_peermgt_resumemsg *resumemsg;
+
+	if(!(mgt->resumeqcount < peermgt_RESUMEQ_SIZE)) {
+		debug("resume queue is full, packet dropped");
+		return 0;
+	}
+	if(!((len > 0) && (len <= peermgt_RESUME_MSGSIZE))) return 0;
+
+	resumemsg = &mgt->resumeq[((mgt->resumeqhead + mgt->resumeqcount) % peermgt_RESUMEQ_SIZE)];
+	resumemsg->type = type;
+	resumemsg->targetaddr = *targetaddr;
+	resumemsg->len = len;
+	memcpy(resumemsg->msg, msg, len);
+	mgt->resumeqcount++;
+	return 1;
+}
+
+
+// Resume a session using a cached ticket. Returns 1 if a resume request has been queued.
+int peermgtResume(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struct s_peeraddr *remote_addr) {
+	struct s_peermgt_ticket *ticket;
+	struct s_peermgt_data *peer;
+	unsigned char *msg = mgt->resumemsgbuf;
+	int tnow = utilGetClock();
+	int peerid;
+	int pos;
+
+	if((!peermgtGetFlag(mgt, peermgt_FLAG_TICKET)) || (!(mgt->resumeqcount < peermgt_RESUMEQ_SIZE)) || (peeraddrIsInternal(remote_addr))) {
+		return 0;
+	}
+
+	ticket = mapGet(&mgt->ticketdb, nodeid->id);
+	if(ticket == NULL) {
+		return 0;
+	}
+
+	if(((tnow - ticket->recvtime) >= peermgt_TICKET_LIFETIME) || (ticket->resumetime != 0)) {
+		// ticket is expired or has already been used without success, fall back to a full handshake
+		mapRemove(&mgt->ticketdb, nodeid->id);
+		return 0;
+	}
+
+	peerid = peermgtNew(mgt, nodeid, remote_addr);
+	if(peerid < 0) {
+		return 0;
+	}
+
+	peer = &mgt->data[peerid];
+	ticket->resumetime = tnow;
+	cryptoRand(peer->resumenonce, peermgt_TICKET_NONCESIZE);
+	peer->resumestate = peermgt_RESUME_PENDING;
+
+	// generate msg(nodeid, nonce, peerid, seq, flags, ticket_len, ticket, hmac)
+	memcpy(msg, mgt->nodekey->nodeid.id, nodeid_SIZE);
+	memcpy(&msg[nodeid_SIZE], peer->resumenonce, peermgt_TICKET_NONCESIZE);
+	utilWriteInt32(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE)], peerid);
+	utilWriteInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + 4)], seqGet(&peer->seq));
+	utilWriteInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE)], mgt->localflags);
+	utilWriteInt16(&msg[peermgt_RESUME_HDRSIZE], ticket->len);
+	memcpy(&msg[(peermgt_RESUME_HDRSIZE + 2)], ticket->ticket, ticket->len);
+	pos = (peermgt_RESUME_HDRSIZE + 2 + ticket->len);
+
+	if(!(peermgtSetResumeKeys(&mgt->resumectx, ticket->secret, peer->resumenonce, NULL) && cryptoHMAC(&mgt->resumectx, &msg[pos], peermgt_TICKET_HMACSIZE, msg, pos))) {
+		debug("failed to generate resume request");
+		peermgtDeleteID(mgt, peerid);
+		return 0;
+	}
+
+	peermgtQueueResume(mgt, peermgt_RESUME_REQUEST, msg, (pos + peermgt_TICKET_HMACSIZE), remote_addr);
+
+	CREATE_HUMAN_IP(remote_addr);
+	debugf("Resuming session with %s, PeerID: %d", humanIp, peerid);
+
+	return 1;
+}
+
+
+// Record that user data has been sent to or received from a peer. A peer that has been idle gets a full detection time before its path is considered down.
+static void peermgtSetDataTime(struct s_peermgt *mgt, const int peerid) {
+	int64_t tnowms = utilGetClockMs();
+	if((tnowms - mgt->data[peerid].lastdatams) >= peermgt_PROBE_IDLE_TIME) {
+		mgt->data[peerid].activems = tnowms;
+	}
+	mgt->data[peerid].lastdatams = tnowms;
+}
+
+
+// Add a flow to the deficit round robin list if it is not already in it. PeerID 0 is the flow of locally originated user data, other PeerIDs are the relay queues.
+static void peermgtActivateFlow(struct s_peermgt *mgt, const int peerid) {
+	if(mgt->data[peerid].txactive) return;
+	mgt->txflow[((mgt->txflowhead + mgt->txflowcount) % mgt->txflowsize)] = peerid;
+	mgt->txflowcount++;
+	mgt->data[peerid].txactive = 1;
+	mgt->data[peerid].txdeficit = 0;
+}
+
+
+// Queue a request-response packet. If targetaddr is NULL, the packet is sent to the current address of the peer. Returns 1 if successful.
+static int peermgtQueueCtrl(struct s_peermgt *mgt, const int peerid, const int type, const unsigned char *msg, const int len, const struct s_peeraddr *targetaddr) {
+	struct s_peermgt_ctrlmsg *ctrlmsg;
+
+	if(!(mgt->ctrlqcount < peermgt_CTRLQ_SIZE)) {
+		debug("control queue is full, packet dropped");
+		return 0;
+	}
+	if(!((len > 0) && (len <= peermgt_PINGBUF_SIZE))) return 0;
+
+	ctrlmsg = &mgt->ctrlq[((mgt->ctrlqhead + mgt->ctrlqcount) % peermgt_CTRLQ_SIZE)];
+	ctrlmsg->peerid = peerid;
+	ctrlmsg->type = type;
+	ctrlmsg->len = len;
+	memcpy(ctrlmsg->msg, msg, len);
+	if(targetaddr != NULL) {
+		ctrlmsg->usetargetaddr = 1;
+		ctrlmsg->targetaddr = *targetaddr;
+	}
+	else {
+		ctrlmsg->usetargetaddr = 0;
+	}
+	mgt->ctrlqcount++;
+	return 1;
+}
+
+
+// Queue a timestamped ping. Path pings move the peer to the path the pong arrives on, measure pings only record the RTT of their path. Returns 1 if successful.
+static int peermgtQueuePing(struct s_peermgt *mgt, const int peerid, const int type, const struct s_peeraddr *targetaddr) {
+	unsigned char pingbuf[peermgt_PINGBUF_SIZE];
+
+	cryptoRand(pingbuf, peermgt_PINGBUF_SIZE);
+	utilWriteInt64(&pingbuf[peermgt_PING_TIMEPOS], utilGetClockMs());
+	pingbuf[peermgt_PING_TYPEPOS] = type;
+	return peermgtQueueCtrl(mgt, peerid, packet_PLTYPE_PING, pingbuf, peermgt_PINGBUF_SIZE, targetaddr);
+}
+
+
+// Queue a relay-out packet on the relay queue of the sending peer. Returns 1 if successful.
+static int peermgtQueueRelay(struct s_peermgt *mgt, const int peerid, const int targetpeerid, const unsigned char *msg, const int len) {
+	struct s_peermgt_relaymsg *relaymsg;
+	int entry;
+
+	if(!((len > 4) && (len <= peermgt_MSGSIZE_MAX))) return 0;
+	if(!(mgt->data[peerid].relayqlen < peermgt_RELAYQ_PEERMAX) || (mgt->relayqfree < 0)) { // a single peer can't use up the relay queue
+		debugf("relay queue of PeerID %d is full, packet dropped", peerid);
+		return 0;
+	}
+
+	entry = mgt->relayqfree;
+	relaymsg = &mgt->relayq[entry];
+	mgt->relayqfree = relaymsg->next;
+	relaymsg->next = -1;
+	relaymsg->targetpeerid = targetpeerid;
+	relaymsg->len = len;
+	utilWriteInt32(&relaymsg->msg[0], peerid);
+	memcpy(&relaymsg->msg[4], &msg[4], (len - 4));
+
+	if(mgt->data[peerid].relayqlen > 0) {
+		mgt->relayq[mgt->data[peerid].relayqtail].next = entry;
+	}
+	else {
+		mgt->data[peerid].relayqhead = entry;
+	}
+	mgt->data[peerid].relayqtail = entry;
+	mgt->data[peerid].relayqlen++;
+	peermgtActivateFlow(mgt, peerid);
+	peermgtSetDataTime(mgt, peerid);
+	return 1;
+}
+
+
+// Send ping to PeerAddr. Return 1 if successful.
+int peermgtSendPingToAddr(struct s_peermgt *mgt, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct, const struct s_peeraddr *peeraddr) {
+	int outpeerid;
+
+	outpeerid = peermgtGetActiveID(mgt, tonodeid, topeerid, topeerct);
+
+	if(!(outpeerid > 0)) {
+		return 0;
+	}
+
+	return peermgtQueuePing(mgt, outpeerid, peermgt_PING_PATH, peeraddr);
+}
+
+
+// Copy the next packet finished by the crypto workers to pbuf. If wait is set, waits for the oldest packet. Returns length if successful.
+static int peermgtGetEncoded(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, struct s_peeraddr *target, const int wait) {
+	struct s_cryptpool_job *job;
+	int len;
+
+	if(!(mgt->cryptthreads > 0)) return 0;
+	while((job = (wait ? cryptpoolWaitDone(&mgt->cryptpool, cryptpool_QUEUE_ENCODE) : cryptpoolGetDone(&mgt->cryptpool, cryptpool_QUEUE_ENCODE))) != NULL) {
+		len = 0;
+		if((job->result > 0) && (job->result <= pbuf_size) && peermgtIsActiveRemoteID(mgt, job->ctxid) && (mgt->data[job->ctxid].ctxgen == job->ctxgen)) { // drop packets of sessions that have ended meanwhile
+			memcpy(pbuf, job->outbuf, job->result);
+			*target = job->addr;
+			mgt->txtos = job->tos;
+			len = job->result;
+		}
+		cryptpoolRelease(&mgt->cryptpool, cryptpool_QUEUE_ENCODE);
+		if(len > 0) return len;
+	}
+	return 0;
+}
+
+
+// Queue a packet for encoding by the crypto workers. If the queue is full, the oldest packet is written to pbuf to make room. Returns its length, 0 if nothing has been written or -1 if the packet has to be encoded directly.
+static int peermgtEncodeAsync(struct s_peermgt *mgt, const int peerid, const struct s_packet_data *data, unsigned char *pbuf, const int pbuf_size, struct s_peeraddr *target) {
+	struct s_cryptpool_job *job;
+	int tos = mgt->txtos;
+	int len;
+
+	if(!(mgt->cryptthreads > 0)) return -1;
+	if(peeraddrIsInternal(&mgt->data[peerid].remoteaddr)) return -1; // relayed packets get encapsulated right after encoding
+	if(!((data->pl_length > 0) && (data->pl_length <= cryptpool_PLSIZE_MAX))) return -1;
+	if(!cryptpoolPrepare(&mgt->cryptpool, peerid, mgt->data[peerid].ctxgen, &mgt->ctx[peerid])) return -1;
+
+	len = 0;
+	if(cryptpoolIsFull(&mgt->cryptpool, cryptpool_QUEUE_ENCODE)) {
+		len = peermgtGetEncoded(mgt, pbuf, pbuf_size, target, 1);
+	}
+	if((job = cryptpoolGetJob(&mgt->cryptpool, cryptpool_QUEUE_ENCODE, peerid)) == NULL) return ((len > 0) ? len : -1);
+	job->data = *data;
+	job->data.pl_buf = job->inbuf;
+	job->data.pl_buf_size = data->pl_length;
+	memcpy(job->inbuf, data->pl_buf, data->pl_length);
+	job->addr = mgt->data[peerid].remoteaddr;
+	job->tos = tos;
+	cryptpoolSubmit(&mgt->cryptpool, cryptpool_QUEUE_ENCODE);
+	mgt->cryptqueued = data->pl_length;
+	return len;
+}
+
+
+// Encode user data packet, on the crypto workers if possible. Returns the length of the packet written to pbuf, 0 if the packet has been queued or -1 on error.
+static int peermgtEncodeUserdata(struct s_peermgt *mgt, const int peerid, const struct s_packet_data *data, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int len;
+	if((len = peermgtEncodeAsync(mgt, peerid, data, pbuf, pbuf_size, target)) < 0) {
+		if(!((len = packetEncode(pbuf, pbuf_size, data, &mgt->ctx[peerid])) > 0)) return -1;
+		*target = mgt->data[peerid].remoteaddr;
+	}
+	mgt->data[peerid].lastsend = tnow;
+	peermgtSetDataTime(mgt, peerid);
+	return len;
+}
+
+
+// Generate the next locally originated user data packet. Returns length if successful.
+static int peermgtGetNextPacketLocal(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int used = mapGetKeyCount(&mgt->map);
+	int len;
+	int outlen;
+	int fragoutlen;
+	int peerid;
+	int fragcount;
+	int fragpos;
+	int broadcast;
+	int bcastrole;
+	struct s_packet_data data;
+	struct s_peermgt_bcastfwd *bcastfwd;
+
+	// send out bundled user data, it has been queued before any pending user data
+	if((mgt->bundlelen > 0) && (mgt->bundleready || (mgt->outmsg.len > 0)) && (!(mgt->fragoutsize > 0))) {
+		peerid = mgt->bundlepeerid;
+		len = mgt->bundlelen;
+		mgt->bundlelen = 0;
+		mgt->bundleready = 0;
+		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
+			if(mgt->bundlecount > 1) {
+				data.pl_buf = mgt->bundlebuf;
+				data.pl_type = packet_PLTYPE_USERDATA_BUNDLE;
+			}
+			else {
+				// a single frame is sent as regular userdata
+				data.pl_buf = &mgt->bundlebuf[peermgt_BUNDLE_HDRSIZE];
+				len = len - peermgt_BUNDLE_HDRSIZE;
+				data.pl_type = packet_PLTYPE_USERDATA;
+			}
+			data.pl_buf_size = len;
+			data.peerid = mgt->data[peerid].remoteid;
+			data.seq = ++mgt->data[peerid].remoteseq;
+			data.pl_length = len;
+			data.pl_options = 0;
+			mgt->txtos = mgt->bundletos;
+			if(!((len = peermgtEncodeUserdata(mgt, peerid, &data, pbuf, pbuf_size, tnow, target)) < 0)) {
+				return len;
+			}
+		}
+	}
+
+	// send out user data
+	mgt->txtos = mgt->outmsgtos;
+	outlen = mgt->outmsg.len;
+	fragoutlen = mgt->fragoutsize;
+	if(outlen > 0 && (!(fragoutlen > 0))) {
+		broadcast = mgt->outmsgbroadcast;
+		bcastrole = peermgt_BCAST_DIRECT;
+		if(mgt->outmsgbroadcast) { // get PeerID for broadcast message
+			do {
+				peerid = peermgtGetNextID(mgt);
+				mgt->outmsgbroadcastcount++;
+				bcastrole = peermgt_BCAST_DIRECT;
+				if(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA)) {
+					bcastrole = peermgtGetBroadcastRole(mgt, peerid);
+					if(bcastrole != peermgt_BCAST_COVERED) break; // peers covered by the broadcast tree get the message from a forwarding peer
+				}
+			}
+			while(mgt->outmsgbroadcastcount < used);
+			if(mgt->outmsgbroadcastcount >= used) {
+				mgt->outmsgbroadcast = 0;
+				mgt->outmsg.len = 0;
+			}
+		}
+		else { // get PeerID for unicast message
+			peerid = mgt->outmsgpeerid;
+			mgt->outmsg.len = 0;
+		}
+		if((bcastrole != peermgt_BCAST_COVERED) && peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
+			if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA)) {
+				if(bcastrole >= 0) {
+					// send broadcast message to a forwarding peer, tagged with the partition it should serve
+					mgt->bcastbuf[(nodeid_SIZE + seq_SIZE + 1)] = bcastrole;
+					data.pl_buf = mgt->bcastbuf;
+					data.pl_buf_size = mgt->bcastlen;
+					data.peerid = mgt->data[peerid].remoteid;
+					data.seq = ++mgt->data[peerid].remoteseq;
+					data.pl_length = mgt->bcastlen;
+					data.pl_type = packet_PLTYPE_BCAST;
+					data.pl_options = 0;
+					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+					if(len > 0) {
+						mgt->data[peerid].lastsend = tnow;
+						*target = mgt->data[peerid].remoteaddr;
+						return len;
+					}
+				}
+				else if((mgt->fragmentation > 0) && (outlen > peermgt_MSGSIZE_MIN)) {
+					// start generating fragmented userdata packets
+					mgt->fragoutpeerid = peerid;
+					mgt->fragoutcount = (((outlen - 1) / peermgt_MSGSIZE_MIN) + 1); // calculate number of fragments
+					mgt->fragoutsize = outlen;
+					fragoutlen = outlen;
+					mgt->fragoutpos = 0;
+				}
+				else {
+					if(broadcast && peermgtIsGroupKeyReady(mgt, peerid)) {
+						// encrypt broadcast message once with the group key and send the same packet to every peer
+						if(!(mgt->grouplen > 0)) {
+							data.pl_buf = mgt->outmsg.msg;
+							data.pl_buf_size = outlen;
+							data.peerid = -(mgt->groupkeyid);
+							data.seq = ++mgt->groupseq;
+							data.pl_length = outlen;
+							data.pl_type = packet_PLTYPE_USERDATA;
+							data.pl_options = 0;
+							mgt->grouplen = packetEncode(mgt->groupbuf, peermgt_GROUPBUF_SIZE, &data, &mgt->localgroupctx);
+						}
+						if((mgt->grouplen > 0) && (mgt->grouplen <= pbuf_size)) {
+							memcpy(pbuf, mgt->groupbuf, mgt->grouplen);
+							mgt->data[peerid].lastsend = tnow;
+							*target = mgt->data[peerid].remoteaddr;
+							return mgt->grouplen;
+						}
+					}
+
+					// generate userdata packet
+					data.pl_buf = mgt->outmsg.msg;
+					data.pl_buf_size = outlen;
+					data.peerid = mgt->data[peerid].remoteid;
+					data.seq = ++mgt->data[peerid].remoteseq;
+					data.pl_length = outlen;
+					data.pl_type = packet_PLTYPE_USERDATA;
+					data.pl_options = 0;
+					if(!((len = peermgtEncodeUserdata(mgt, peerid, &data, pbuf, pbuf_size, tnow, target)) < 0)) {
+						return len;
+					}
+				}
+			}
+		}
+	}
+
+	// send out fragments
+	if(fragoutlen > 0) {
+		fragcount = mgt->fragoutcount;
+		fragpos = mgt->fragoutpos;
+		peerid = mgt->fragoutpeerid;
+		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
+			// generate fragmented packet
+			data.pl_buf = &mgt->outmsg.msg[(fragpos * peermgt_MSGSIZE_MIN)];
+			if(fragoutlen > peermgt_MSGSIZE_MIN) {
+				// start or middle fragment
+				data.pl_buf_size = peermgt_MSGSIZE_MIN;
+				data.pl_length = peermgt_MSGSIZE_MIN;
+				mgt->fragoutsize = (fragoutlen - peermgt_MSGSIZE_MIN);
+			}
+			else {
+				// end fragment
+				data.pl_buf_size = fragoutlen;
+				data.pl_length = fragoutlen;
+				mgt->fragoutsize = 0;
+			}
+			data.peerid = mgt->data[peerid].remoteid;
+			data.seq = ++mgt->data[peerid].remoteseq;
+			data.pl_type = packet_PLTYPE_USERDATA_FRAGMENT;
+			data.pl_options = (fragcount << 4) | (fragpos);
+			len = peermgtEncodeUserdata(mgt, peerid, &data, pbuf, pbuf_size, tnow, target);
+			mgt->fragoutpos = (fragpos + 1);
+			if(!(len < 0)) {
+				return len;
+			}
+		}
+		else {
+			// session not active anymore, abort sending fragments
+			mgt->fragoutsize = 0;
+		}
+	}
+
+	// forward queued broadcast messages to the peers of our partition
+	mgt->txtos = 0;
+	while(mgt->bcastfwdqcount > 0) {
+		bcastfwd = &mgt->bcastfwdq[mgt->bcastfwdqhead];
+		peerid = bcastfwd->next++;
+		if(!(peerid < mapGetMapSize(&mgt->map))) {
+			mgt->bcastfwdqhead = ((mgt->bcastfwdqhead + 1) % peermgt_BCAST_FWDQ_SIZE);
+			mgt->bcastfwdqcount--;
+			continue;
+		}
+		if((peerid == bcastfwd->from) || (!peermgtIsActiveRemoteID(mgt, peerid))) continue;
+		if(!(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_BCAST))) continue;
+		if(peermgtGetBroadcastPart(mgt, peerid, bcastfwd->msg[(nodeid_SIZE + seq_SIZE)]) != bcastfwd->msg[(nodeid_SIZE + seq_SIZE + 1)]) continue;
+		data.pl_buf = bcastfwd->msg;
+		data.pl_buf_size = bcastfwd->len;
+		data.peerid = mgt->data[peerid].remoteid;
+		data.seq = ++mgt->data[peerid].remoteseq;
+		data.pl_length = bcastfwd->len;
+		data.pl_type = packet_PLTYPE_BCAST;
+		data.pl_options = 0;
+		len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+		if(len > 0) {
+			mgt->data[peerid].lastsend = tnow;
+			*target = mgt->data[peerid].remoteaddr;
+			return len;
+		}
+	}
+
+	return 0;
+}
+
+
+// Generate the next relay-out packet forwarded for a peer. Returns length if successful.
+static int peermgtGetNextPacketRelay(struct s_peermgt *mgt, const int peerid, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	struct s_peermgt_relaymsg *relaymsg;
+	struct s_packet_data data;
+	int targetpeerid;
+	int entry;
+	int len;
+
+	while((entry = mgt->data[peerid].relayqhead) >= 0) {
+		relaymsg = &mgt->relayq[entry];
+		targetpeerid = relaymsg->targetpeerid;
+		len = 0;
+		if(peermgtIsActiveRemoteID(mgt, targetpeerid)) {  // check if session is still active
+			data.pl_buf = relaymsg->msg;
+			data.pl_buf_size = relaymsg->len;
+			data.peerid = mgt->data[targetpeerid].remoteid;
+			data.seq = ++mgt->data[targetpeerid].remoteseq;
+			data.pl_length = relaymsg->len;
+			data.pl_type = packet_PLTYPE_RELAY_OUT;
+			data.pl_options = 0;
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[targetpeerid]);
+		}
+
+		// remove message from the queue
+		mgt->data[peerid].relayqhead = relaymsg->next;
+		mgt->data[peerid].relayqlen--;
+		if(!(mgt->data[peerid].relayqlen > 0)) mgt->data[peerid].relayqtail = -1;
+		relaymsg->next = mgt->relayqfree;
+		mgt->relayqfree = entry;
+
+		if(len > 0) {
+			mgt->data[targetpeerid].lastsend = tnow;
+			peermgtSetDataTime(mgt, targetpeerid);
+			*target = mgt->data[targetpeerid].remoteaddr;
+			return len;
+		}
+	}
+	return 0;
+}
+
+
+// Generate the next user data packet. The active flows are served by deficit round robin, a flow may overdraw its deficit because the size of a local packet is only known after it has been generated. Returns length if successful.
+static int peermgtGetNextPacketData(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int peerid;
+	int len;
+
+	if(((mgt->bundlelen > 0) && mgt->bundleready) || (mgt->outmsg.len > 0) || (mgt->fragoutsize > 0) || (mgt->bcastfwdqcount > 0)) {
+		peermgtActivateFlow(mgt, 0);
+	}
+
+	// latency sensitive user data goes out first
+	if(((mgt->outmsg.len > 0) || (mgt->fragoutsize > 0)) && ((mgt->outmsgtos >> 2) >= peermgt_DSCP_HIGH)) {
+		if(((len = peermgtGetNextPacketLocal(mgt, pbuf, pbuf_size, tnow, target)) > 0) || (mgt->cryptqueued > 0)) {
+			return len;
+		}
+	}
+
+	while(mgt->txflowcount > 0) {
+		peerid = mgt->txflow[mgt->txflowhead];
+		if(!mgt->txcredited) {
+			mgt->data[peerid].txdeficit += peermgt_TXQ_QUANTUM;
+			mgt->txcredited = 1;
+		}
+		if(mgt->data[peerid].txdeficit > 0) {
+			if(peerid == 0) {
+				len = peermgtGetNextPacketLocal(mgt, pbuf, pbuf_size, tnow, target);
+			}
+			else {
+				len = peermgtGetNextPacketRelay(mgt, peerid, pbuf, pbuf_size, tnow, target);
+			}
+			if((len > 0) || (mgt->cryptqueued > 0)) {
+				mgt->data[peerid].txdeficit -= ((mgt->cryptqueued > 0) ? mgt->cryptqueued : len);
+				return len;
+			}
+
+			// flow is empty, remove it from the list
+			mgt->data[peerid].txactive = 0;
+			mgt->data[peerid].txdeficit = 0;
+			mgt->txflowhead = ((mgt->txflowhead + 1) % mgt->txflowsize);
+			mgt->txflowcount--;
+		}
+		else {
+			// deficit is used up, move flow to the end of the list
+			mgt->txflowhead = ((mgt->txflowhead + 1) % mgt->txflowsize);
+			mgt->txflow[((mgt->txflowhead + mgt->txflowcount - 1) % mgt->txflowsize)] = peerid;
+		}
+		mgt->txcredited = 0;
+	}
+	return 0;
+}
+
+
+// Generate the next due control packet for the connected peers. Also removes expired sessions. Returns length if successful.
+static int peermgtGetNextPacketPeer(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int used = mapGetKeyCount(&mgt->map);
+	int len;
+	int peerid;
+	int i;
+	const int plbuf_size = peermgt_MSGSIZE_MIN;
+	unsigned char plbuf[plbuf_size];
+	struct s_packet_data data;
+
+	// send peerinfo to peers
+	for(i=0; i<used; i++) {
+		peerid = peermgtGetNextID(mgt);
+		if(peerid > 0) {
+			if((tnow - mgt->data[peerid].lastrecv) < peermgt_RECV_TIMEOUT) { // check if session has expired
+				if(mgt->data[peerid].state == peermgt_STATE_COMPLETE) {  // check if session is active
+					if(((tnow - mgt->data[peerid].lastticket) > peermgt_TICKET_INTERVAL) && (peermgtGetFlag(mgt, peermgt_FLAG_TICKET)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_TICKET))) { // check if we should issue a new resumption ticket
+						mgt->data[peerid].lastticket = tnow;
+						data.pl_buf = plbuf;
+						data.pl_buf_size = plbuf_size;
+						data.peerid = mgt->data[peerid].remoteid;
+						data.seq = ++mgt->data[peerid].remoteseq;
+						if(peermgtGenPacketTicket(&data, mgt, peerid)) {
+							len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+							if(len > 0) {
+								mgt->data[peerid].lastsend = tnow;
+								*target = mgt->data[peerid].remoteaddr;
+								return len;
+							}
+						}
+					}
+					if((peermgtGetFlag(mgt, peermgt_FLAG_GROUPKEY)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_GROUPKEY))) { // peer supports group keys
+						if((mgt->data[peerid].groupkeyackdue) || ((mgt->groupkeyid > 0) && (mgt->data[peerid].groupkeyacked != mgt->groupkeyid) && ((mgt->data[peerid].groupkeysent != mgt->groupkeyid) || ((tnow - mgt->data[peerid].lastgroupkey) > peermgt_GROUPKEY_RESEND)))) { // check if we should send or acknowledge a group key
+							data.pl_buf = plbuf;
+							data.pl_buf_size = plbuf_size;
+							data.peerid = mgt->data[peerid].remoteid;
+							data.seq = ++mgt->data[peerid].remoteseq;
+							peermgtGenPacketGroupKey(&data, mgt, peerid);
+							len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+							if(len > 0) {
+								if(mgt->data[peerid].groupkeyackdue) {
+									mgt->data[peerid].groupkeyackdue = 0;
+								}
+								else {
+									mgt->data[peerid].groupkeysent = mgt->groupkeyid;
+									mgt->data[peerid].lastgroupkey = tnow;
+								}
+								mgt->data[peerid].lastsend = tnow;
+								*target = mgt->data[peerid].remoteaddr;
+								return len;
+							}
+						}
+					}
+					if(((mgt->macadvlen > 0) || (mgt->macadvversion > 0)) && (peermgtGetFlag(mgt, peermgt_FLAG_MACADV)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_MACADV))) { // peer accepts MAC advertisements, once a list has been set an empty list is sent too
+						if(((mgt->data[peerid].macadvsent != mgt->macadvversion) && (mgt->data[peerid].lastmacadv != tnow)) || ((tnow - mgt->data[peerid].lastmacadv) > peermgt_MACADV_INTERVAL)) { // check if we should send the changed or refresh the current list
+							data.pl_buf = plbuf;
+							data.pl_buf_size = plbuf_size;
+							data.peerid = mgt->data[peerid].remoteid;
+							data.seq = ++mgt->data[peerid].remoteseq;
+							peermgtGenPacketMacAdvert(&data, mgt);
+							len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+							if(len > 0) {
+								mgt->data[peerid].macadvsent = mgt->macadvversion;
+								mgt->data[peerid].lastmacadv = tnow;
+								mgt->data[peerid].lastsend = tnow;
+								*target = mgt->data[peerid].remoteaddr;
+								return len;
+							}
+						}
+					}
+					if(((mgt->routeadvlen > 0) || (mgt->routeadvversion > 0)) && (peermgtGetFlag(mgt, peermgt_FLAG_ROUTEADV)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_ROUTEADV))) { // peer accepts route advertisements, once a list has been set an empty list is sent too so that the peer withdraws the routes
+						if(((mgt->data[peerid].routeadvsent != mgt->routeadvversion) && (mgt->data[peerid].lastrouteadv != tnow)) || ((tnow - mgt->data[peerid].lastrouteadv) > peermgt_ROUTEADV_INTERVAL)) { // check if we should send the changed or refresh the current list
+							data.pl_buf = plbuf;
+							data.pl_buf_size = plbuf_size;
+							data.peerid = mgt->data[peerid].remoteid;
+							data.seq = ++mgt->data[peerid].remoteseq;
+							peermgtGenPacketRouteAdvert(&data, mgt);
+							len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+							if(len > 0) {
+								mgt->data[peerid].routeadvsent = mgt->routeadvversion;
+								mgt->data[peerid].lastrouteadv = tnow;
+								mgt->data[peerid].lastsend = tnow;
+								*target = mgt->data[peerid].remoteaddr;
+								return len;
+							}
+						}
+					}
+					if((peermgtGetFlag(mgt, peermgt_FLAG_DELTA)) && (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_DELTA))) { // peer supports delta peerinfo
+						if((tnow - mgt->data[peerid].lastpeerinfo) > peermgt_PEERINFO_FULL_INTERVAL) { // resend all entries from time to time to refresh the remote NodeDB
+							mgt->data[peerid].lastpeerinfo = tnow;
+							mgt->data[peerid].infoacked = 0;
+						}
+						data.pl_buf = plbuf;
+						data.pl_buf_size = plbuf_size;
+						data.peerid = mgt->data[peerid].remoteid;
+						if((mgt->data[peerid].infoacked < mgt->infoversion) && ((tnow - mgt->data[peerid].lastinfodelta) >= peermgt_PEERINFO_DELTA_INTERVAL)) { // check if we should send changed entries
+							mgt->data[peerid].lastinfodelta = tnow;
+							peermgtGenPacketPeerinfoDelta(&data, mgt, peerid);
+						}
+						else if((mgt->data[peerid].infoackdue) || ((tnow - mgt->data[peerid].lastsend) > peermgt_KEEPALIVE_INTERVAL)) { // check if we should send keepalive packet
+							peermgtGenPacketKeepalive(&data, mgt, peerid);
+						}
+						else {
+							continue;
+						}
+						data.seq = ++mgt->data[peerid].remoteseq;
+						len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+						if(len > 0) {
+							mgt->data[peerid].lastsend = tnow;
+							mgt->data[peerid].infoackdue = 0;
+							*target = mgt->data[peerid].remoteaddr;
+							return len;
+						}
+					}
+					else if(((tnow - mgt->data[peerid].lastsend) > peermgt_KEEPALIVE_INTERVAL) || ((tnow - mgt->data[peerid].lastpeerinfo) > peermgt_PEERINFO_INTERVAL)) { // check if we should send peerinfo packet
+						data.pl_buf = plbuf;
+						data.pl_buf_size = plbuf_size;
+						data.peerid = mgt->data[peerid].remoteid;
+						data.seq = ++mgt->data[peerid].remoteseq;
+						peermgtGenPacketPeerinfo(&data, mgt, peerid);
+						len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+						if(len > 0) {
+							mgt->data[peerid].lastsend = tnow;
+							mgt->data[peerid].lastpeerinfo = tnow;
+							*target = mgt->data[peerid].remoteaddr;
+							return len;
+						}
+					}
+				}
+				else if((mgt->data[peerid].resumestate == peermgt_RESUME_PENDING) && ((tnow - mgt->data[peerid].conntime) > peermgt_RESUME_TIMEOUT)) {
+					// resume request was not answered, release the PeerID so a full handshake can take place
+					peermgtDeleteID(mgt, peerid);
+				}
+			}
+			else {
+				peermgtDeleteID(mgt, peerid);
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+// Check if an indirect PeerAddr from RelayDB can be used to reach a peer. The relay has to be reached directly. Returns the relay PeerID, or -1.
+static int peermgtGetRelayCandidate(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr) {
+	int relayid;
+	if((addr == NULL) || (!peermgtIsValidIndirectPeerAddr(mgt, addr)) || (!peeraddrGetIndirect(addr, &relayid, NULL, NULL))) return -1;
+	if((relayid == peerid) || (peeraddrIsInternal(&mgt->data[relayid].remoteaddr))) return -1;
+	return relayid;
+}
+
+
+// Find the fastest relay to a node in RelayDB. Relays without a measured RTT are ranked behind measured ones by the RTT to the relay itself. Returns the RelayDB ID, or -1 if no relay is available.
+static int peermgtGetBestRelay(struct s_peermgt *mgt, struct s_nodeid *nodeid, const int peerid, const int min_lastconntry, const struct s_peeraddr *exclude_addr) {
+	int db_ids[peermgt_RELAYDB_NUM_PEERADDRS];
+	struct s_peeraddr *addr;
+	int count;
+	int relayid;
+	int rtt;
+	int best;
+	int bestrtt;
+	int i;
+
+	best = -1;
+	bestrtt = 0;
+	count = nodedbGetDBIDs(&mgt->relaydb, nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, min_lastconntry, db_ids, peermgt_RELAYDB_NUM_PEERADDRS);
+	for(i=0; i<count; i++) {
+		addr = nodedbGetNodeAddress(&mgt->relaydb, db_ids[i]);
+		if((relayid = peermgtGetRelayCandidate(mgt, peerid, addr)) < 0) continue;
+		if((exclude_addr != NULL) && (memcmp(addr->addr, exclude_addr->addr, peeraddr_SIZE) == 0)) continue;
+		rtt = nodedbGetRTT(&mgt->relaydb, db_ids[i]);
+		if(rtt < 0) {
+			rtt = (mgt->data[relayid].srtt < 0) ? (2 * peermgt_RTT_MAX) : (peermgt_RTT_MAX + mgt->data[relayid].srtt + mgt->data[relayid].jitter);
+		}
+		else {
+			rtt = (rtt + nodedbGetJitter(&mgt->relaydb, db_ids[i])); // prefer stable relays
+		}
+		if((best < 0) || (rtt < bestrtt)) {
+			best = db_ids[i];
+			bestrtt = rtt;
+		}
+	}
+	return best;
+}
+
+
+// Switch a peer whose path is down to the fastest relay from RelayDB. Returns 1 if a relay has been found.
+static int peermgtFailover(struct s_peermgt *mgt, const int peerid) {
+	struct s_nodeid nodeid;
+	struct s_peeraddr *addr;
+	int relayid;
+	int j;
+
+	CREATE_HUMAN_IP(&mgt->data[peerid].remoteaddr);
+
+	if(!peermgtGetNodeID(mgt, &nodeid, peerid)) return 0;
+	j = peermgtGetBestRelay(mgt, &nodeid, peerid, -1, &mgt->data[peerid].remoteaddr); // the current path is down
+	if(j < 0) return 0;
+	addr = nodedbGetNodeAddress(&mgt->relaydb, j);
+	if(!peeraddrGetIndirect(addr, &relayid, NULL, NULL)) return 0;
+
+	if(!peeraddrIsInternal(&mgt->data[peerid].remoteaddr)) { // remember the direct path to probe it for recovery
+		mgt->data[peerid].directaddr = mgt->data[peerid].remoteaddr;
+		mgt->data[peerid].failover = 1;
+	}
+	peermgtSetRemoteAddr(mgt, peerid, addr);
+	msgf("Path to %s is down, switched to relay PeerID %d", humanIp, relayid);
+	return 1;
+}
+
+
+// Measure the RTT of every peer each peermgt_RTT_INTERVAL seconds. Relayed peers also measure their other relays and switch to a relay that is clearly faster.
+static void peermgtMeasurePeers(struct s_peermgt *mgt, const int tnow) {
+	int db_ids[peermgt_RELAYDB_NUM_PEERADDRS];
+	struct s_nodeid nodeid;
+	struct s_peeraddr *addr;
+	struct s_peermgt_data *peer;
+	int size;
+	int peerid;
+	int count;
+	int best;
+	int bestrtt;
+	int i;
+
+	if(mgt->rtttime == tnow) return;
+	mgt->rtttime = tnow;
+
+	size = mapGetMapSize(&mgt->map);
+	for(peerid=1; peerid<size; peerid++) {
+		if(!(mgt->ctrlqcount < peermgt_CTRLQ_SIZE)) break; // the remaining peers are measured on the next call
+		if(!peermgtIsActiveRemoteID(mgt, peerid)) continue;
+		peer = &mgt->data[peerid];
+		if((tnow - peer->lastrtt) < peermgt_RTT_INTERVAL) continue;
+		peer->lastrtt = tnow;
+		if(!peermgtGetNodeID(mgt, &nodeid, peerid)) continue;
+
+		if(peeraddrIsInternal(&peer->remoteaddr) && (peer->srtt >= 0)) { // switch to a relay that has been measured to be faster
+			best = peermgtGetBestRelay(mgt, &nodeid, peerid, -1, &peer->remoteaddr);
+			if(!(best < 0)) {
+				bestrtt = nodedbGetRTT(&mgt->relaydb, best);
+				if(bestrtt >= 0) bestrtt = (bestrtt + nodedbGetJitter(&mgt->relaydb, best));
+				if((bestrtt >= 0) && ((bestrtt * 100) < ((peer->srtt + peer->jitter) * (100 - peermgt_RELAY_SWITCH_PERCENT)))) {
+					debugf("switching PeerID %d to a faster relay (%d ms instead of %d ms)", peerid, bestrtt, (peer->srtt + peer->jitter));
+					peermgtSetRemoteAddr(mgt, peerid, nodedbGetNodeAddress(&mgt->relaydb, best));
+				}
+			}
+		}
+
+		peermgtQueuePing(mgt, peerid, peermgt_PING_PATH, NULL);
+
+		if(peeraddrIsInternal(&peer->remoteaddr) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_PINGTYPE)) { // older peers would switch paths on any ping
+			count = nodedbGetDBIDs(&mgt->relaydb, &nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, -1, db_ids, peermgt_RELAYDB_NUM_PEERADDRS);
+			for(i=0; i<count; i++) {
+				if(!(mgt->ctrlqcount < peermgt_CTRLQ_SIZE)) break;
+				addr = nodedbGetNodeAddress(&mgt->relaydb, db_ids[i]);
+				if(peermgtGetRelayCandidate(mgt, peerid, addr) < 0) continue;
+				if(memcmp(addr->addr, peer->remoteaddr.addr, peeraddr_SIZE) == 0) continue;
+				peermgtQueuePing(mgt, peerid, peermgt_PING_MEASURE, addr);
+			}
+		}
+	}
+}
+
+
+// Probe the paths of quiet peers and switch peers whose path is down to a relay. Peers without recent user data are only probed at the keepalive interval. The direct address of a relayed peer is probed until it answers again.
+static void peermgtProbePeers(struct s_peermgt *mgt) {
+	const int64_t tnowms = utilGetClockMs();
+	const int size = mapGetMapSize(&mgt->map);
+	struct s_peermgt_data *peer;
+	int64_t interval;
+	int64_t since;
+	int peerid;
+
+	if(!(mgt->probeinterval > 0)) return;
+	if((tnowms - mgt->probetime) < (mgt->probeinterval / 2)) return;
+	mgt->probetime = tnowms;
+
+	for(peerid=1; peerid<size; peerid++) {
+		if(!(mgt->ctrlqcount < peermgt_CTRLQ_SIZE)) break; // the remaining peers are probed on the next call
+		if(!peermgtIsActiveRemoteID(mgt, peerid)) continue;
+		peer = &mgt->data[peerid];
+		if((tnowms - peer->lastdatams) < peermgt_PROBE_IDLE_TIME) {
+			// the detection time of a peer that was idle starts when it begins to carry user data
+			interval = mgt->probeinterval;
+			since = (peer->activems > peer->lastrecvms) ? peer->activems : peer->lastrecvms;
+		}
+		else {
+			interval = (mgt->probeinterval > peermgt_PROBE_IDLE_INTERVAL) ? mgt->probeinterval : peermgt_PROBE_IDLE_INTERVAL;
+			since = peer->lastrecvms;
+		}
+		if((tnowms - since) >= (interval * peermgt_PROBE_MULTIPLIER)) {
+			// nothing received for the detection time, the new path gets a full detection time too
+			peermgtFailover(mgt, peerid);
+			peer->lastrecvms = tnowms;
+		}
+		else if(((tnowms - since) >= interval) && ((tnowms - peer->lastprobe) >= interval)) {
+			if(peermgtSendPingToAddr(mgt, NULL, peerid, peer->conntime, NULL)) {
+				peer->lastprobe = tnowms;
+			}
+		}
+		if((peer->failover) && ((tnowms - peer->lastrecover) >= peermgt_PROBE_RECOVER_INTERVAL) && (mgt->ctrlqcount < peermgt_CTRLQ_SIZE)) {
+			if(peermgtSendPingToAddr(mgt, NULL, peerid, peer->conntime, &peer->directaddr)) {
+				peer->lastrecover = tnowms;
+			}
+		}
+	}
+}
+
+
+// Generate next peer manager packet. Control packets have strict priority over user data. Returns length if successful.
+int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int len;
+	int peerid;
+	int i;
+	int j;
+	int k;
+	int scanned;
+	struct s_msg authmsg;
+	struct s_packet_data data;
+	struct s_nodeid *nodeid;
+	struct s_peeraddr *peeraddr;
+	struct s_peermgt_ctrlmsg *ctrlmsg;
+	struct s_peermgt_resumemsg *resumemsg;
+
+    CREATE_HUMAN_IP(target);
+
+	mgt->cryptqueued = 0;
+	mgt->txtos = 0;
+	peermgtRotateTicketKey(mgt, tnow);
+	peermgtRotateGroupKey(mgt, tnow);
+
+	// connect new peers, limited to a per second budget that scales with free auth slots
+	if(mgt->lastconntry != tnow) {
+		mgt->lastconntry = tnow;
+		mgt->conntrycount = 0;
+	}
+	while(mgt->conntrycount < peermgtConnectBudget(mgt)) {
+		mgt->conntrycount++;
+		i = -1;
+
+		// find a NodeID and PeerAddr pair in NodeDB
+		if(authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 2)) {
+			i = nodedbGetDBID(&mgt->nodedb, NULL, peermgt_NEWCONNECT_MAX_LASTSEEN, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY);
+			if((i < 0) && (authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 8))) {
+				i = nodedbGetDBID(&mgt->nodedb, NULL, peermgt_NEWCONNECT_MAX_LASTSEEN, -1, -1);
+				if((i < 0) && (authmgtUsedSlotCount(&mgt->authmgt) <= (authmgtSlotCount(&mgt->authmgt) / 16))) {
+					i = nodedbGetDBID(&mgt->nodedb, NULL, -1, -1, -1);
+				}
+			}
+		}
+
+		// nothing left to try in this second
+		if(i < 0) {
+			mgt->conntrycount = peermgt_CONNECT_RATE_MAX;
+			break;
+		}
+
+		// start connection attempt
+		nodeid = nodedbGetNodeID(&mgt->nodedb, i);
+		peerid = peermgtGetID(mgt, nodeid);
+		peeraddr = nodedbGetNodeAddress(&mgt->nodedb, i);
+		nodedbUpdate(&mgt->nodedb, nodeid, peeraddr, 0, 0, 1);
+		if(peerid < 0) { // node is not connected yet
+			if(peermgtResume(mgt, nodeid, peeraddr)) { // try to resume a previous session
+				debugf("Trying to resume session with %s", humanIp);
+			}
+			else if((k = peermgtConnectNode(mgt, nodeid, peeraddr)) > 0) { // try to connect to all known addresses
+				debugf("Trying to connect with %s using %d addresses", humanIp, k);
+				mgt->conntrycount += (k - 1);
+
+				j = peermgtGetBestRelay(mgt, nodeid, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY, NULL);
+				if(!(j < 0)) {
+					peermgtConnect(mgt, nodedbGetNodeAddress(&mgt->relaydb, j)); // try to connect via relay
+					nodedbUpdate(&mgt->relaydb, nodeid, nodedbGetNodeAddress(&mgt->relaydb, j), 0, 0, 1);
+				}
+			}
+		}
+		else { // node is already connected
+			if(peermgtIsActiveRemoteID(mgt, peerid)) {
+				if(peeraddrIsInternal(&mgt->data[peerid].remoteaddr)) { // node connection is indirect
+					peermgtSendPingToAddr(mgt, NULL, peerid, mgt->data[peerid].conntime, peeraddr); // try to switch peer to a direct connection
+				}
+			}
+		}
+	}
+
+	// queue path probes and RTT measurements
+	peermgtProbePeers(mgt);
+	peermgtMeasurePeers(mgt, tnow);
+
+	// send out queued request-response packets
+	while(mgt->ctrlqcount > 0) {
+		ctrlmsg = &mgt->ctrlq[mgt->ctrlqhead];
+		mgt->ctrlqhead = ((mgt->ctrlqhead + 1) % peermgt_CTRLQ_SIZE);
+		mgt->ctrlqcount--;
+		peerid = ctrlmsg->peerid;
+		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
+			data.pl_buf = ctrlmsg->msg;
+			data.pl_buf_size = peermgt_PINGBUF_SIZE;
+			data.pl_length = ctrlmsg->len;
+			data.pl_type = ctrlmsg->type;
+			data.pl_options = 0;
+			data.peerid = mgt->data[peerid].remoteid;
+			data.seq = ++mgt->data[peerid].remoteseq;
+
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+			if(len > 0) {
+				if(ctrlmsg->usetargetaddr) {
+					*target = ctrlmsg->targetaddr;
+				}
+				else {
+					mgt->data[peerid].lastsend = tnow;
+					*target = mgt->data[peerid].remoteaddr;
+				}
+				return len;
+			}
+		}
+	}
+
+	// send queued resume messages
+	while(mgt->resumeqcount > 0) {
+		resumemsg = &mgt->resumeq[mgt->resumeqhead];
+		mgt->resumeqhead = ((mgt->resumeqhead + 1) % peermgt_RESUMEQ_SIZE);
+		mgt->resumeqcount--;
+		data.pl_buf = resumemsg->msg;
+		data.pl_buf_size = resumemsg->len;
+		data.peerid = 0;
+		data.seq = 0;
+		data.pl_length = resumemsg->len;
+		data.pl_type = packet_PLTYPE_RESUME;
+		data.pl_options = resumemsg->type;
+		len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[0]);
+		if(len > 0) {
+			*target = resumemsg->targetaddr;
+			return len;
+		}
+	}
+
+	// send auth manager message
+	if(authmgtGetNextMsg(&mgt->authmgt, &authmsg, target)) {
+		data.pl_buf = authmsg.msg;
+		data.pl_buf_size = authmsg.len;
+		data.peerid = 0;
+		data.seq = 0;
+		data.pl_length = authmsg.len;
+		if(data.pl_length > 0) {
+			data.pl_type = packet_PLTYPE_AUTH;
+			data.pl_options = 0;
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[0]);
+			if(len > 0) {
+				mgt->data[0].lastsend = tnow;
+				return len;
+			}
+		}
+	}
+
+	// send due peer control packets, the peers are checked at least once per second while user data is pending
+	if(mgt->txctrltime != tnow) {
+		mgt->txctrltime = tnow;
+		mgt->txctrlscan = 1;
+	}
+	scanned = 0;
+	if(mgt->txctrlscan) {
+		if((len = peermgtGetNextPacketPeer(mgt, pbuf, pbuf_size, tnow, target)) > 0) {
+			return len;
+		}
+		mgt->txctrlscan = 0;
+		scanned = 1;
+	}
+
+	// send user data
+	if(((len = peermgtGetNextPacketData(mgt, pbuf, pbuf_size, tnow, target)) > 0) || (mgt->cryptqueued > 0)) {
+		return len;
+	}
+
+	// no user data pending, check the peers on every call
+	if(!scanned) {
+		return peermgtGetNextPacketPeer(mgt, pbuf, pbuf_size, tnow, target);
+	}
+
+	return 0;
+}
+
+
+// Get next peer manager packet. Also encapsulates packets for relaying if necessary. Returns length if successful.
 int peermgtGetNextPacket(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, struct s_peeraddr *target) {
 	int tnow;
 	int outlen;
@@ -586,7 +1868,10 @@ int peermgtGetNextPacket(struct s_peermgt *mgt, unsigned char *pbuf, const int p
 	int depth;
 	struct s_packet_data data;
 	tnow = utilGetClock();
-	while((outlen = (peermgtGetNextPacketGen(mgt, pbuf, pbuf_size, tnow, target))) > 0) {
+	if((outlen = (peermgtGetEncoded(mgt, pbuf, pbuf_size, target, 0))) > 0) { // packets finished by the crypto workers go out first
+		return outlen;
+	}
+	while(((outlen = (peermgtGetNextPacketGen(mgt, pbuf, pbuf_size, tnow, target))) > 0) || (mgt->cryptqueued)) { // continue after a packet has been queued for the crypto workers
 		depth = 0;
 		while(outlen > 0) {
 			if(depth < peermgt_DECODE_RECURSION_MAX_DEPTH) { // limit encapsulation depth
@@ -668,7 +1953,7 @@ int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_data *d
 
             // Upgrade indirect connection to a direct one
             if((peeraddrIsInternal(&mgt->data[dupid].remoteaddr)) && (!peeraddrIsInternal(source_addr))) {
-                mgt->data[dupid].remoteaddr = *source_addr;
+                peermgtSetRemoteAddr(mgt, dupid, source_addr);
                 peermgtSendPingToAddr(mgt, NULL, dupid, mgt->data[dupid].conntime, source_addr); // send a ping using the new peer address
             }
         }
@@ -687,30 +1972,61 @@ int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_data *d
             // Node data gets completed here.
             authmgtGetCompletedPeerAddress(authmgt, &mgt->data[peerid].remoteid, &mgt->data[peerid].remoteaddr);
             authmgtGetCompletedPeerSessionKeys(authmgt, &mgt->ctx[peerid]);
+            mgt->data[peerid].ctxgen = ++mgt->ctxgen;
             authmgtGetCompletedPeerConnectionParams(authmgt, &mgt->data[peerid].remoteseq, &remoteflags);
 
-            mgt->data[peerid].remoteflags = remoteflags;
-            mgt->data[peerid].state = peermgt_STATE_COMPLETE;
-            mgt->data[peerid].lastrecv = tnow;
-        }
-        authmgtFinishCompletedPeer(authmgt);
-    }
-    return 1;
+            mgt->data[peerid].remoteflags = remoteflags;
+            mgt->data[peerid].state = peermgt_STATE_COMPLETE;
+            mgt->data[peerid].lastrecv = tnow;
+            mgt->data[peerid].lastrecvms = utilGetClockMs();
+            peermgtUpdatePeerinfoVersion(mgt, peerid);
+        }
+        authmgtFinishCompletedPeer(authmgt);
+    }
+    return 1;
+}
+
+
+// Decode peerinfo entries.
+void peermgtDecodePeerinfoEntries(struct s_peermgt *mgt, const int peerid, const unsigned char *buf, const int peerinfo_count) {
+	const int peerinfo_size = (packet_PEERID_SIZE + nodeid_SIZE + peeraddr_SIZE);
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr;
+	int pos;
+	int relaypeerid;
+	int i;
+	int64_t r;
+
+	if(!(peerinfo_count > 0)) {
+		return;
+	}
+
+	r = (abs(cryptoRandInt()) % peerinfo_count); // randomly select a peer
+	for(i=0; i<peerinfo_count; i++) {
+		pos = (r * peerinfo_size);
+		relaypeerid = utilReadInt32(&buf[pos]);
+		memcpy(nodeid.id, &buf[(pos + (packet_PEERID_SIZE))], nodeid_SIZE);
+		memcpy(addr.addr, &buf[(pos + (packet_PEERID_SIZE + nodeid_SIZE))], peeraddr_SIZE);
+		if(!peeraddrIsInternal(&addr)) { // only accept external PeerAddr
+			nodedbUpdate(&mgt->nodedb, &nodeid, &addr, 1, 0, 0);
+			if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_RELAY)) { // add relay data
+				peeraddrSetIndirect(&addr, peerid, mgt->data[peerid].conntime, relaypeerid);
+				nodedbUpdate(&mgt->relaydb, &nodeid, &addr, 1, 0, 0);
+			}
+		}
+		r = ((r + 1) % peerinfo_count);
+	}
 }
 
 
 // Decode peerinfo packet
 int peermgtDecodePacketPeerinfo(struct s_peermgt *mgt, const struct s_packet_data *data) {
 	const int peerinfo_size = (packet_PEERID_SIZE + nodeid_SIZE + peeraddr_SIZE);
-	struct s_nodeid nodeid;
-	struct s_peeraddr addr;
 	int peerid;
 	int peerinfo_count;
 	int peerinfo_max;
-	int pos;
-	int relaypeerid;
-	int i;
-	int64_t r;
+	int version;
+	int ack;
 
     debug("PEERINFO packet received");
 	if(data->pl_length <= 4) {
@@ -724,24 +2040,30 @@ int peermgtDecodePacketPeerinfo(struct s_peermgt *mgt, const struct s_packet_dat
         return 0;
     }
 
+    if(data->pl_options == peermgt_PEERINFO_DELTA) {
+        if(data->pl_length < peermgt_PEERINFO_DELTA_HDRSIZE) {
+            debugf("delta PEERINFO packet size is too small: %d bytes", data->pl_length);
+            return 0;
+        }
+        peerinfo_max = ((data->pl_length - peermgt_PEERINFO_DELTA_HDRSIZE) / peerinfo_size);
+        peerinfo_count = utilReadInt32(data->pl_buf);
+        version = utilReadInt32(&data->pl_buf[4]);
+        ack = utilReadInt32(&data->pl_buf[8]);
+        if(peerinfo_count < 0 || peerinfo_count > peerinfo_max) {
+            return 0;
+        }
+        peermgtDecodePeerinfoEntries(mgt, peerid, &data->pl_buf[peermgt_PEERINFO_DELTA_HDRSIZE], peerinfo_count);
+        mgt->data[peerid].remoteinfoversion = version;
+        mgt->data[peerid].infoackdue = 1;
+        mgt->txctrlscan = 1;
+        if((ack > mgt->data[peerid].infoacked) && (!(ack > mgt->infoversion))) mgt->data[peerid].infoacked = ack;
+        return 1;
+    }
+
     peerinfo_max = ((data->pl_length - 4) / peerinfo_size);
     peerinfo_count = utilReadInt32(data->pl_buf);
     if(peerinfo_count > 0 && peerinfo_count <= peerinfo_max) {
-        r = (abs(cryptoRandInt()) % peerinfo_count); // randomly select a peer
-        for(i=0; i<peerinfo_count; i++) {
-            pos = (4 + (r * peerinfo_size));
-            relaypeerid = utilReadInt32(&data->pl_buf[pos]);
-            memcpy(nodeid.id, &data->pl_buf[(pos + (packet_PEERID_SIZE))], nodeid_SIZE);
-            memcpy(addr.addr, &data->pl_buf[(pos + (packet_PEERID_SIZE + nodeid_SIZE))], peeraddr_SIZE);
-            if(!peeraddrIsInternal(&addr)) { // only accept external PeerAddr
-                nodedbUpdate(&mgt->nodedb, &nodeid, &addr, 1, 0, 0);
-                if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_RELAY)) { // add relay data
-                    peeraddrSetIndirect(&addr, peerid, mgt->data[peerid].conntime, relaypeerid);
-                    nodedbUpdate(&mgt->relaydb, &nodeid, &addr, 1, 0, 0);
-                }
-            }
-            r = ((r + 1) % peerinfo_count);
-        }
+        peermgtDecodePeerinfoEntries(mgt, peerid, &data->pl_buf[4], peerinfo_count);
         return 1;
     }
 
@@ -749,33 +2071,285 @@ int peermgtDecodePacketPeerinfo(struct s_peermgt *mgt, const struct s_packet_dat
 }
 
 
-// Decode ping packet
-int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data) {
+// Decode keepalive packet
+int peermgtDecodePacketKeepalive(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int peerid = data->peerid;
+	int ack;
+
+	if(data->pl_length != peermgt_KEEPALIVE_SIZE) {
+		debug("wrong KEEPALIVE packet");
+		return 0;
+	}
+
+	if(!peermgtIsActiveRemoteID(mgt, peerid)) {
+		return 0;
+	}
+
+	// the remote version is only taken from delta peerinfo, it is resent until we acknowledge it
+	ack = utilReadInt32(&data->pl_buf[4]);
+	if((ack > mgt->data[peerid].infoacked) && (!(ack > mgt->infoversion))) mgt->data[peerid].infoacked = ack;
+
+	return 1;
+}
+
+
+// Decode MAC advertisement packet
+int peermgtDecodePacketMacAdvert(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int peerid = data->peerid;
+
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_MACADV)) {
+		return 0;
+	}
+
+	if(!((data->pl_length > 0) && (data->pl_length <= peermgt_MACADV_SIZE))) {
+		debug("wrong MACADV packet");
+		return 0;
+	}
+
+	if(!peermgtIsActiveRemoteID(mgt, peerid)) {
+		return 0;
+	}
+
+	// the list stays in the receive buffer until it is fetched with peermgtRecvMacAdvert
+	mgt->macadvsize = data->pl_length;
+	mgt->macadvpeerid = peerid;
+	return 1;
+}
+
+
+// Decode route advertisement packet
+int peermgtDecodePacketRouteAdvert(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int peerid = data->peerid;
+
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_ROUTEADV)) {
+		return 0;
+	}
+
+	if(!((data->pl_length > 0) && (data->pl_length <= peermgt_ROUTEADV_SIZE))) {
+		debug("wrong ROUTEADV packet");
+		return 0;
+	}
+
+	if(!peermgtIsActiveRemoteID(mgt, peerid)) {
+		return 0;
+	}
+
+	// the list stays in the receive buffer until it is fetched with peermgtRecvRouteAdvert
+	mgt->routeadvsize = data->pl_length;
+	mgt->routeadvpeerid = peerid;
+	return 1;
+}
+
+
+// Decode group key packet
+int peermgtDecodePacketGroupKey(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int peerid = data->peerid;
+	int keyid;
+	unsigned char nonce[4];
+
+	if(!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetFlag(mgt, peermgt_FLAG_GROUPKEY))) {
+		return 0;
+	}
+
+	if(data->pl_options == peermgt_GROUPKEY_ACK) {
+		if(data->pl_length != 4) return 0;
+		keyid = utilReadInt32(data->pl_buf);
+		if(keyid == mgt->groupkeyid) mgt->data[peerid].groupkeyacked = keyid;
+		return 1;
+	}
+
+	if(data->pl_length != peermgt_GROUPKEY_MSGSIZE) {
+		debug("wrong GROUPKEY packet");
+		return 0;
+	}
+	keyid = utilReadInt32(data->pl_buf);
+	if(!(keyid > 0)) return 0;
+
+	if(keyid != mgt->data[peerid].groupkeyid) {
+		memcpy(nonce, data->pl_buf, 4);
+		if(mapGet(&mgt->groupmap, nonce) != NULL) { // the key ID is in use by another peer, don't let this one take it over
+			debugf("group key %d from PeerID %d rejected, key ID already in use", keyid, peerid);
+			return 0;
+		}
+		peermgtClearGroupKey(mgt, peerid);
+		if(!cryptoSetKeys(&mgt->groupctx[peerid], 1, &data->pl_buf[(4 + seq_SIZE)], peermgt_GROUPKEY_SECRETSIZE, nonce, 4)) {
+			return 0;
+		}
+		if(!mapAdd(&mgt->groupmap, nonce, &peerid)) {
+			return 0;
+		}
+		seqInit(&mgt->data[peerid].groupseq, utilReadInt64(&data->pl_buf[4]));
+		mgt->data[peerid].groupkeyid = keyid;
+		debugf("received group key %d from PeerID %d", keyid, peerid);
+	}
+	mgt->data[peerid].groupkeyackdue = 1;
+	mgt->txctrlscan = 1;
+
+	return 1;
+}
+
+
+// Decode broadcast tree packet
+int peermgtDecodePacketBcast(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int peerid = data->peerid;
+	int originid;
+	int parts;
+	int part;
+	int framelen = (data->pl_length - peermgt_BCAST_HDRSIZE);
+	struct s_nodeid origin;
+	struct s_peermgt_bcastfwd *bcastfwd;
+
+	if(!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetFlag(mgt, peermgt_FLAG_BCAST) && peermgtGetFlag(mgt, peermgt_FLAG_USERDATA))) {
+		return 0;
+	}
+	if(!(framelen > 0)) {
+		debug("wrong BCAST packet");
+		return 0;
+	}
+	parts = data->pl_buf[(nodeid_SIZE + seq_SIZE)];
+	part = data->pl_buf[(nodeid_SIZE + seq_SIZE + 1)];
+	if(!((parts > 0) && (part < parts))) {
+		return 0;
+	}
+
+	// only deliver messages of directly connected origins, like plain broadcasts
+	memcpy(origin.id, data->pl_buf, nodeid_SIZE);
+	originid = peermgtGetID(mgt, &origin);
+	if(!((originid > 0) && peermgtIsActiveRemoteID(mgt, originid))) {
+		return 1;
+	}
+	if(peermgtIsBroadcastDuplicate(mgt, data->pl_buf)) {
+		return 1;
+	}
+
+	// forward messages received from the origin if we relay for our peers
+	if((peerid == originid) && (peermgtGetFlag(mgt, peermgt_FLAG_RELAY)) && (data->pl_length <= peermgt_MSGSIZE_MAX)) {
+		if(mgt->bcastfwdqcount < peermgt_BCAST_FWDQ_SIZE) {
+			bcastfwd = &mgt->bcastfwdq[((mgt->bcastfwdqhead + mgt->bcastfwdqcount) % peermgt_BCAST_FWDQ_SIZE)];
+			memcpy(bcastfwd->msg, data->pl_buf, data->pl_length);
+			bcastfwd->len = data->pl_length;
+			bcastfwd->from = originid;
+			bcastfwd->next = 1;
+			mgt->bcastfwdqcount++;
+		}
+		else {
+			debug("broadcast forward queue is full, packet dropped");
+		}
+	}
+
+	memmove(data->pl_buf, &data->pl_buf[peermgt_BCAST_HDRSIZE], framelen);
+	mgt->msgsize = framelen;
+	mgt->msgpeerid = originid;
+	return 1;
+}
+
+
+// Decode packet encrypted with the group key of a peer.
+int peermgtDecodePacketGroup(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const int tnow) {
+	struct s_packet_data data = { .pl_buf_size = peermgt_MSGSIZE_MAX, .pl_buf = mgt->msgbuf };
+	unsigned char keyid[4];
+	int *indexed;
+	int peerid = packetGetPeerID(packet);
+
+	if(peerid < -0x7FFFFFFF) {
+		return 0;
+	}
+	utilWriteInt32(keyid, -(peerid));
+	indexed = mapGet(&mgt->groupmap, keyid);
+	if(indexed == NULL) {
+		debug("group key for packet not found");
+		return 0;
+	}
+	peerid = *indexed;
+	if(!peermgtIsActiveRemoteID(mgt, peerid)) {
+		return 0;
+	}
+
+	// only broadcast user data is sent with the group key
+	mgt->msgsize = 0;
+	mgt->msgbundle = 0;
+	mgt->macadvsize = 0;
+	mgt->routeadvsize = 0;
+	if(packetDecode(&data, packet, packet_len, &mgt->groupctx[peerid], &mgt->data[peerid].groupseq) <= 0) {
+		debugf("failed to decode group packet from PeerID: %d", peerid);
+		return 0;
+	}
+	if(!((data.pl_type == packet_PLTYPE_USERDATA) && peermgtGetFlag(mgt, peermgt_FLAG_USERDATA))) {
+		return 0;
+	}
+
+	mgt->msgsize = data.pl_length;
+	mgt->msgpeerid = peerid;
+	mgt->data[peerid].lastrecv = tnow;
+	mgt->data[peerid].lastrecvms = utilGetClockMs();
+	return 1;
+}
+
+
+// Decode ping packet, the pong is sent back to the source address of the ping
+int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
 	int len = data->pl_length;
 	if(len != peermgt_PINGBUF_SIZE) {
         debug("wrong PEERPING packet");
         return 0;
     }
 
-    memcpy(mgt->rrmsg.msg, data->pl_buf, peermgt_PINGBUF_SIZE);
-    mgt->rrmsgpeerid = data->peerid;
-    mgt->rrmsgtype = packet_PLTYPE_PONG;
-    mgt->rrmsg.len = peermgt_PINGBUF_SIZE;
-    mgt->rrmsgusetargetaddr = 0;
     debugf("PEERPING packet decoded from %d", data->peerid);
-    return 1;
+    return peermgtQueueCtrl(mgt, data->peerid, packet_PLTYPE_PONG, data->pl_buf, peermgt_PINGBUF_SIZE, source_addr);
+}
+
+
+// Update the smoothed RTT and jitter of the current path of a peer.
+static void peermgtUpdateRTT(struct s_peermgt *mgt, const int peerid, const int rtt) {
+	struct s_peermgt_data *peer = &mgt->data[peerid];
+	struct s_nodeid nodeid;
+
+	if(peer->srtt < 0) {
+		peer->srtt = rtt;
+		peer->jitter = (rtt / 2);
+	}
+	else {
+		peer->jitter = (((3 * peer->jitter) + abs(peer->srtt - rtt)) / 4);
+		peer->srtt = (((7 * peer->srtt) + rtt) / 8);
+	}
+	if(peeraddrIsInternal(&peer->remoteaddr)) { // remember the RTT of the relay for relay selection
+		if(peermgtGetNodeID(mgt, &nodeid, peerid)) {
+			nodedbUpdateRTT(&mgt->relaydb, &nodeid, &peer->remoteaddr, rtt);
+		}
+	}
 }
 
 
-// Decode pong packet
-int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data) {
+// Decode pong packet and measure the RTT of its ping. The pong of a path ping moves the peer to the path it has been received on.
+int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
+	struct s_nodeid nodeid;
+	int64_t tnowms;
+	int64_t pingtime;
+	int rtt;
 	int len = data->pl_length;
+	int peerid = data->peerid;
 	if(len != peermgt_PINGBUF_SIZE) {
         debugf("wrong size of PEERPONG packet, got %d bytes", data->pl_length);
         return 0;
     }
 
-    // content is not checked, any response is acceptable
+    // pongs to pings of older versions carry no timestamp, they are accepted without a measurement
+    tnowms = utilGetClockMs();
+    pingtime = utilReadInt64(&data->pl_buf[peermgt_PING_TIMEPOS]);
+    rtt = -1;
+    if((pingtime <= tnowms) && (pingtime >= (tnowms - peermgt_RTT_MAX))) rtt = (tnowms - pingtime);
+
+    if(data->pl_buf[peermgt_PING_TYPEPOS] == peermgt_PING_MEASURE) {
+        if((rtt >= 0) && peeraddrIsInternal(source_addr) && peermgtGetNodeID(mgt, &nodeid, peerid)) {
+            nodedbUpdateRTT(&mgt->relaydb, &nodeid, source_addr, rtt);
+        }
+        return 1;
+    }
+
+    peermgtSetRemoteAddr(mgt, peerid, source_addr);
+    if(rtt >= 0) {
+        peermgtUpdateRTT(mgt, peerid, rtt);
+    }
     return 1;
 }
 
@@ -788,17 +2362,275 @@ int peermgtDecodePacketRelayIn(struct s_peermgt *mgt, const struct s_packet_data
 	if((len > 4) && (len < (peermgt_MSGSIZE_MAX - 4))) {
 		targetpeerid = utilReadInt32(data->pl_buf);
 		if(peermgtIsActiveRemoteID(mgt, targetpeerid)) {
-			utilWriteInt32(&mgt->rrmsg.msg[0], data->peerid);
-			memcpy(&mgt->rrmsg.msg[4], &data->pl_buf[4], (len - 4));
-			mgt->rrmsgpeerid = targetpeerid;
-			mgt->rrmsgtype = packet_PLTYPE_RELAY_OUT;
-			mgt->rrmsg.len = len;
-			mgt->rrmsgusetargetaddr = 0;
-			return 1;
+			return peermgtQueueRelay(mgt, data->peerid, targetpeerid, data->pl_buf, len);
+		}
+	}
+
+	return 0;
+}
+
+
+// Decode ticket packet
+int peermgtDecodePacketTicket(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	struct s_peermgt_ticket ticket;
+	struct s_nodeid nodeid;
+	int len = (data->pl_length - peermgt_TICKET_SECRETSIZE);
+
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_TICKET)) {
+		return 0;
+	}
+
+	if(!((len > 1) && (len <= peermgt_TICKET_MAXSIZE))) {
+		debugf("wrong size of TICKET packet, got %d bytes", data->pl_length);
+		return 0;
+	}
+
+	if(!peermgtGetNodeID(mgt, &nodeid, data->peerid)) {
+		return 0;
+	}
+
+	memcpy(ticket.secret, data->pl_buf, peermgt_TICKET_SECRETSIZE);
+	memcpy(ticket.ticket, &data->pl_buf[peermgt_TICKET_SECRETSIZE], len);
+	ticket.len = len;
+	ticket.recvtime = utilGetClock();
+	ticket.resumetime = 0;
+	mapSet(&mgt->ticketdb, nodeid.id, &ticket);
+	memset(ticket.secret, 0, peermgt_TICKET_SECRETSIZE);
+
+	debugf("TICKET packet decoded from %d", data->peerid);
+	return 1;
+}
+
+
+// Record the nonce of a resume request. Returns 1 if the nonce has not been seen before.
+int peermgtCheckResumeReplay(struct s_peermgt *mgt, const unsigned char *nonce, const int tnow) {
+	int size;
+	int *seen;
+	int i;
+
+	if(mapGet(&mgt->resumereplay, nonce) != NULL) {
+		return 0;
+	}
+
+	if(!(mapGetKeyCount(&mgt->resumereplay) < mapGetMapSize(&mgt->resumereplay))) {
+		// drop nonces of requests whose ticket has expired by now
+		size = mapGetMapSize(&mgt->resumereplay);
+		for(i=0; i<size; i++) {
+			if(!mapIsValidID(&mgt->resumereplay, i)) continue;
+			seen = mapGetValueByID(&mgt->resumereplay, i);
+			if((tnow - *seen) >= peermgt_TICKET_LIFETIME) {
+				mapRemove(&mgt->resumereplay, mapGetKeyByID(&mgt->resumereplay, i));
+			}
+		}
+	}
+
+	// if the cache is still full, the request can't be checked and the peer has to use a full handshake
+	return mapAdd(&mgt->resumereplay, nonce, &tnow);
+}
+
+
+// Decode resume request
+int peermgtDecodeResumeRequest(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
+	const unsigned char *msg = data->pl_buf;
+	unsigned char *ackmsg = mgt->resumemsgbuf;
+	const int ackpos = (nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE + 8);
+	unsigned char secret[peermgt_TICKET_SECRETSIZE];
+	unsigned char hmac[peermgt_TICKET_HMACSIZE];
+	struct s_peermgt_data *peer;
+	struct s_nodeid nodeid;
+	int tnow = utilGetClock();
+	int ticket_len;
+	int peerid;
+	int dupid;
+	int pos;
+
+	CREATE_HUMAN_IP(source_addr);
+
+	if((data->pl_length < (peermgt_RESUME_HDRSIZE + 2)) || (!(mgt->resumeqcount < peermgt_RESUMEQ_SIZE))) {
+		return 0;
+	}
+
+	ticket_len = utilReadInt16(&msg[peermgt_RESUME_HDRSIZE]);
+	pos = (peermgt_RESUME_HDRSIZE + 2 + ticket_len);
+	if(data->pl_length < (pos + peermgt_TICKET_HMACSIZE)) {
+		debugf("[%s] wrong resume request size: %d", humanIp, data->pl_length);
+		return 0;
+	}
+
+	memcpy(nodeid.id, msg, nodeid_SIZE);
+	if(!peermgtOpenTicket(mgt, secret, &msg[(peermgt_RESUME_HDRSIZE + 2)], ticket_len, &nodeid, tnow)) {
+		debugf("[%s] invalid or expired resumption ticket", humanIp);
+		return 0;
+	}
+
+	if(!(peermgtSetResumeKeys(&mgt->resumectx, secret, &msg[nodeid_SIZE], NULL) && cryptoHMAC(&mgt->resumectx, hmac, peermgt_TICKET_HMACSIZE, msg, pos) && (memcmp(hmac, &msg[pos], peermgt_TICKET_HMACSIZE) == 0))) {
+		debugf("[%s] resume request HMAC verification failed", humanIp);
+		memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+		return 0;
+	}
+
+	// every request nonce is accepted only once, a replayed request is dropped
+	if(!peermgtCheckResumeReplay(mgt, &msg[nodeid_SIZE], tnow)) {
+		debugf("[%s] replayed resume request", humanIp);
+		memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+		return 0;
+	}
+
+	// resumes go through the same admission as new auth sessions
+	if(!authmgtAdmitResume(&mgt->authmgt, tnow)) {
+		debugf("[%s] resume request refused under load", humanIp);
+		memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+		return 0;
+	}
+
+	dupid = peermgtGetID(mgt, &nodeid);
+	if(!(dupid < 0)) {
+		if((dupid > 0) && ((mgt->data[dupid].resumestate == peermgt_RESUME_UNCONFIRMED) || ((mgt->data[dupid].resumestate == peermgt_RESUME_PENDING) && (memcmp(mgt->nodekey->nodeid.id, nodeid.id, nodeid_SIZE) < 0)))) {
+			// replace a resumed session that never carried traffic, or our own crossing request if we lose the tie-break
+			peermgtDeleteID(mgt, dupid);
+		}
+		else {
+			// Don't replace active existing session.
+			memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+			return 0;
 		}
 	}
 
-	return 0;
+	peerid = peermgtNew(mgt, &nodeid, source_addr);
+	if(peerid < 0) {
+		memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+		return 0;
+	}
+
+	peer = &mgt->data[peerid];
+	cryptoRand(peer->resumenonce, peermgt_TICKET_NONCESIZE);
+
+	// generate ack(nodeid, remote_nonce, local_nonce, peerid, seq, flags, hmac)
+	memcpy(ackmsg, mgt->nodekey->nodeid.id, nodeid_SIZE);
+	memcpy(&ackmsg[nodeid_SIZE], &msg[nodeid_SIZE], peermgt_TICKET_NONCESIZE);
+	memcpy(&ackmsg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE)], peer->resumenonce, peermgt_TICKET_NONCESIZE);
+	utilWriteInt32(&ackmsg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE)], peerid);
+	utilWriteInt64(&ackmsg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4)], seqGet(&peer->seq));
+	utilWriteInt64(&ackmsg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE)], mgt->localflags);
+
+	if(!(peermgtSetResumeKeys(&mgt->ctx[peerid], secret, &msg[nodeid_SIZE], peer->resumenonce) && peermgtSetResumeKeys(&mgt->resumectx, secret, peer->resumenonce, &msg[nodeid_SIZE]) && cryptoHMAC(&mgt->resumectx, &ackmsg[ackpos], peermgt_TICKET_HMACSIZE, ackmsg, ackpos))) {
+		debug("failed to generate resume acknowledgement");
+		memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+		peermgtDeleteID(mgt, peerid);
+		return 0;
+	}
+	memset(secret, 0, peermgt_TICKET_SECRETSIZE);
+	mgt->data[peerid].ctxgen = ++mgt->ctxgen;
+
+	// Node data gets completed here.
+	peer->remoteid = utilReadInt32(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE)]);
+	peer->remoteseq = utilReadInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + 4)]);
+	peer->remoteflags = utilReadInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE)]);
+	peer->resumestate = peermgt_RESUME_UNCONFIRMED;
+	peer->state = peermgt_STATE_COMPLETE;
+	peermgtUpdatePeerinfoVersion(mgt, peerid);
+
+	peermgtQueueResume(mgt, peermgt_RESUME_ACK, ackmsg, (ackpos + peermgt_TICKET_HMACSIZE), source_addr);
+
+	msgf("Host %s resumed session", humanIp);
+	return 1;
+}
+
+
+// Decode resume acknowledgement
+int peermgtDecodeResumeAck(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
+	const unsigned char *msg = data->pl_buf;
+	const int pos = (nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE + 8);
+	unsigned char hmac[peermgt_TICKET_HMACSIZE];
+	struct s_peermgt_ticket *ticket;
+	struct s_peermgt_data *peer;
+	struct s_nodeid nodeid;
+	int peerid;
+
+	CREATE_HUMAN_IP(source_addr);
+
+	if(data->pl_length < (pos + peermgt_TICKET_HMACSIZE)) {
+		debugf("[%s] wrong resume acknowledgement size: %d", humanIp, data->pl_length);
+		return 0;
+	}
+
+	memcpy(nodeid.id, msg, nodeid_SIZE);
+	peerid = peermgtGetID(mgt, &nodeid);
+	if(!(peerid > 0)) {
+		return 0;
+	}
+
+	peer = &mgt->data[peerid];
+	if((peer->resumestate != peermgt_RESUME_PENDING) || (memcmp(peer->resumenonce, &msg[nodeid_SIZE], peermgt_TICKET_NONCESIZE) != 0)) {
+		return 0;
+	}
+
+	ticket = mapGet(&mgt->ticketdb, nodeid.id);
+	if(ticket == NULL) {
+		return 0;
+	}
+
+	if(!(peermgtSetResumeKeys(&mgt->resumectx, ticket->secret, &msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE)], peer->resumenonce) && cryptoHMAC(&mgt->resumectx, hmac, peermgt_TICKET_HMACSIZE, msg, pos) && (memcmp(hmac, &msg[pos], peermgt_TICKET_HMACSIZE) == 0))) {
+		debugf("[%s] resume acknowledgement HMAC verification failed", humanIp);
+		return 0;
+	}
+
+	if(!peermgtSetResumeKeys(&mgt->ctx[peerid], ticket->secret, peer->resumenonce, &msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE)])) {
+		return 0;
+	}
+	mgt->data[peerid].ctxgen = ++mgt->ctxgen;
+
+	// tickets are single use, the peer issues a new one once the session is up
+	mapRemove(&mgt->ticketdb, nodeid.id);
+
+	// Node data gets completed here.
+	peer->remoteid = utilReadInt32(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE)]);
+	peer->remoteseq = utilReadInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4)]);
+	peer->remoteflags = utilReadInt64(&msg[(nodeid_SIZE + peermgt_TICKET_NONCESIZE + peermgt_TICKET_NONCESIZE + 4 + seq_SIZE)]);
+	peer->remoteaddr = *source_addr;
+	peer->lastrecv = utilGetClock();
+	peer->lastrecvms = utilGetClockMs();
+	peer->resumestate = peermgt_RESUME_NONE;
+	peer->state = peermgt_STATE_COMPLETE;
+	peermgtUpdatePeerinfoVersion(mgt, peerid);
+
+	msgf("Host %s resumed session", humanIp);
+	return 1;
+}
+
+
+// Decode resume packet
+int peermgtDecodePacketResume(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_TICKET)) {
+		return 0;
+	}
+
+	switch(data->pl_options) {
+		case peermgt_RESUME_REQUEST:
+			return peermgtDecodeResumeRequest(mgt, data, source_addr);
+		case peermgt_RESUME_ACK:
+			return peermgtDecodeResumeAck(mgt, data, source_addr);
+		default:
+			return 0;
+	}
+}
+
+
+// Decode bundled user data. The frames are returned one by one by peermgtRecvUserdata.
+int peermgtDecodeUserdataBundle(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	int pos = 0;
+	int len;
+	while(pos < data->pl_length) {
+		if((pos + peermgt_BUNDLE_HDRSIZE) >= data->pl_length) return 0;
+		len = (utilReadInt16(&data->pl_buf[pos]) & 0xFFFF);
+		if((len <= 0) || ((pos + peermgt_BUNDLE_HDRSIZE + len) > data->pl_length)) return 0;
+		pos = pos + peermgt_BUNDLE_HDRSIZE + len;
+	}
+	mgt->msgsize = data->pl_length;
+	mgt->msgpeerid = data->peerid;
+	mgt->msgbundle = 1;
+	mgt->msgbundlepos = 0;
+	return 1;
 }
 
 
@@ -830,11 +2662,9 @@ int peermgtDecodeUserdataFragment(struct s_peermgt *mgt, struct s_packet_data *d
 }
 
 
-// Decode input packet recursively. Decapsulates relayed packets if necessary.
-int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr, const int tnow, const int depth) {
+// Process decoded packet of an active PeerID. Returns 1 on success.
+static int peermgtDecodePacketPayload(struct s_peermgt *mgt, struct s_packet_data *data, const int peerid, const struct s_peeraddr *source_addr, const int tnow, const int depth) {
 	int ret;
-	int peerid;
-	struct s_packet_data data = { .pl_buf_size = peermgt_MSGSIZE_MAX, .pl_buf = mgt->msgbuf };
 	struct s_peeraddr indirect_addr;
 	struct s_nodeid peer_nodeid;
 
@@ -842,93 +2672,80 @@ int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *pac
 
 	ret = 0;
 
-	if(packet_len <= (packet_PEERID_SIZE + packet_HMAC_SIZE) || (depth >= peermgt_DECODE_RECURSION_MAX_DEPTH)) {
-        debugf("Wrong packets size (%d) or recursion depth (%d) from %s", packet_len, depth, humanIp);
-        return 0;
-    }
-
-    peerid = packetGetPeerID(packet);
-
-    // proceed inactive peers
-    if(!peermgtIsActiveID(mgt, peerid)) {
-        debugf("failed to proceed packet for inactive peerid: %d, IP: %s", peerid, humanIp);
-        return 0;
-    }
-
-    if(peerid == 0) {
-        // packet has an anonymous PeerID
-        if(packetDecode(&data, packet, packet_len, &mgt->ctx[0], NULL) <= 0) {
-            debugf("failed to decode packet from anonymous peer, IP: %s", humanIp);
-            return 0;
-        }
-
-        switch(data.pl_type) {
-            case packet_PLTYPE_AUTH:
-                return peermgtDecodePacketAuth(mgt, &data, source_addr);
-            default:
-                return 0;
-        }
-    }
-
-    if(peerid <= 0) {
-        debugf("denied packet from invalid PeerID: %d", peerid);
-        return 0;
-    }
-
-    // packet has an active PeerID
-    mgt->msgsize = 0;
-    if(packetDecode(&data, packet, packet_len, &mgt->ctx[peerid], &mgt->data[peerid].seq) <= 0) {
-        debugf("failed to decode packet from PeerID: %d, size: %d, IP: %s", peerid, packet_len, humanIp);
-        return 0;
-    }
-
-    if(!((data.pl_length > 0) && (data.pl_length < peermgt_MSGSIZE_MAX))) {
+    if(!((data->pl_length > 0) && (data->pl_length < peermgt_MSGSIZE_MAX))) {
         debugf("bad packet from PeerID: %d", peerid);
         return 0;
     }
 
-    switch(data.pl_type) {
+    switch(data->pl_type) {
         case PACKET_PLTYPE_USERDATA:
             if(!peermgtGetFlag(mgt, peermgt_FLAG_USERDATA)) {
                 return 0;
             }
             ret = 1;
-            mgt->msgsize = data.pl_length;
-            mgt->msgpeerid = data.peerid;
+            mgt->msgsize = data->pl_length;
+            mgt->msgpeerid = data->peerid;
+            peermgtSetDataTime(mgt, peerid);
             break;
         case PACKET_PLTYPE_USERDATA_FRAGMENT:
             if(!peermgtGetFlag(mgt, peermgt_FLAG_USERDATA)) {
                 return 0;
             }
-            ret = peermgtDecodeUserdataFragment(mgt, &data);
+            peermgtSetDataTime(mgt, peerid);
+            ret = peermgtDecodeUserdataFragment(mgt, data);
             if(ret > 0) {
-                mgt->msgsize = data.pl_length;
-                mgt->msgpeerid = data.peerid;
+                mgt->msgsize = data->pl_length;
+                mgt->msgpeerid = data->peerid;
             }
 
+            break;
+        case PACKET_PLTYPE_USERDATA_BUNDLE:
+            if(!(peermgtGetFlag(mgt, peermgt_FLAG_USERDATA) && peermgtGetFlag(mgt, peermgt_FLAG_BUNDLE))) {
+                return 0;
+            }
+            ret = peermgtDecodeUserdataBundle(mgt, data);
+            if(ret > 0) peermgtSetDataTime(mgt, peerid);
             break;
         case PACKET_PLTYPE_PEERINFO:
-            ret = peermgtDecodePacketPeerinfo(mgt, &data);
+            ret = peermgtDecodePacketPeerinfo(mgt, data);
+            break;
+        case PACKET_PLTYPE_KEEPALIVE:
+            ret = peermgtDecodePacketKeepalive(mgt, data);
+            break;
+        case PACKET_PLTYPE_MACADV:
+            ret = peermgtDecodePacketMacAdvert(mgt, data);
+            break;
+        case PACKET_PLTYPE_ROUTEADV:
+            ret = peermgtDecodePacketRouteAdvert(mgt, data);
+            break;
+        case PACKET_PLTYPE_GROUPKEY:
+            ret = peermgtDecodePacketGroupKey(mgt, data);
+            break;
+        case PACKET_PLTYPE_BCAST:
+            ret = peermgtDecodePacketBcast(mgt, data);
             break;
         case PACKET_PLTYPE_PING:
             debugf("ping packet from %s", humanIp);
-            ret = peermgtDecodePacketPing(mgt, &data);
+            ret = peermgtDecodePacketPing(mgt, data, source_addr);
             break;
         case PACKET_PLTYPE_PONG:
             debugf("pong packet from %s", humanIp);
-            ret = peermgtDecodePacketPong(mgt, &data);
+            ret = peermgtDecodePacketPong(mgt, data, source_addr);
             break;
         case PACKET_PLTYPE_RELAY_IN:
             if(!peermgtGetFlag(mgt, peermgt_FLAG_RELAY)) {
                 return 0;
             }
-            ret = peermgtDecodePacketRelayIn(mgt, &data);
+            ret = peermgtDecodePacketRelayIn(mgt, data);
+            break;
+        case PACKET_PLTYPE_TICKET:
+            ret = peermgtDecodePacketTicket(mgt, data);
             break;
         case PACKET_PLTYPE_RELAY_OUT:
-            if(data.pl_length > packet_PEERID_SIZE) {
-                memcpy(mgt->relaymsgbuf, &data.pl_buf[4], (data.pl_length - packet_PEERID_SIZE));
-                peeraddrSetIndirect(&indirect_addr, peerid, mgt->data[peerid].conntime, utilReadInt32(&data.pl_buf[0])); // generate indirect PeerAddr
-                ret = peermgtDecodePacketRecursive(mgt, mgt->relaymsgbuf, (data.pl_length - packet_PEERID_SIZE), &indirect_addr, tnow, (depth + 1)); // decode decapsulated packet
+            if(data->pl_length > packet_PEERID_SIZE) {
+                memcpy(mgt->relaymsgbuf, &data->pl_buf[4], (data->pl_length - packet_PEERID_SIZE));
+                peeraddrSetIndirect(&indirect_addr, peerid, mgt->data[peerid].conntime, utilReadInt32(&data->pl_buf[0])); // generate indirect PeerAddr
+                ret = peermgtDecodePacketRecursive(mgt, mgt->relaymsgbuf, (data->pl_length - packet_PEERID_SIZE), &indirect_addr, tnow, (depth + 1)); // decode decapsulated packet
             }
             break;
         default:
@@ -948,11 +2765,150 @@ int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *pac
         }
     }
     mgt->data[peerid].lastrecv = tnow;
-    mgt->data[peerid].remoteaddr = *source_addr;
+    mgt->data[peerid].lastrecvms = utilGetClockMs();
+    if((data->pl_type != packet_PLTYPE_PING) && (data->pl_type != packet_PLTYPE_PONG)) { // a ping only proves one direction of its path, pongs switch paths while decoding
+        if(!((mgt->data[peerid].failover) && (!peeraddrIsInternal(source_addr)))) { // after a failover only a pong to a path probe may switch back to the direct path
+            peermgtSetRemoteAddr(mgt, peerid, source_addr);
+        }
+    }
+    if((mgt->data[peerid].failover) && (!peeraddrIsInternal(&mgt->data[peerid].remoteaddr))) {
+        mgt->data[peerid].failover = 0;
+        msgf("Direct path to %s recovered", humanIp);
+    }
+    if(mgt->data[peerid].resumestate == peermgt_RESUME_UNCONFIRMED) { // the resumed session carries traffic now
+        mgt->data[peerid].resumestate = peermgt_RESUME_NONE;
+    }
     return 1;
 }
 
 
+// Decode the next packet finished by the crypto workers. If wait is set, waits for the oldest packet and processes only this one. Returns 1 if a packet has been accepted.
+static int peermgtDecodeFinished(struct s_peermgt *mgt, const int wait) {
+	struct s_cryptpool_job *job;
+	struct s_packet_data data;
+	struct s_peeraddr source_addr;
+	int peerid;
+	int ret;
+
+	if(!(mgt->cryptthreads > 0)) return 0;
+	while((job = (wait ? cryptpoolWaitDone(&mgt->cryptpool, cryptpool_QUEUE_DECODE) : cryptpoolGetDone(&mgt->cryptpool, cryptpool_QUEUE_DECODE))) != NULL) {
+		ret = 0;
+		peerid = job->ctxid;
+		if((job->result > 0) && peermgtIsActiveID(mgt, peerid) && (mgt->data[peerid].ctxgen == job->ctxgen) && seqVerify(&mgt->data[peerid].seq, job->data.seq)) { // sequence numbers are verified in the order the packets have been received
+			mgt->msgsize = 0;
+			mgt->msgbundle = 0;
+			mgt->macadvsize = 0;
+			mgt->routeadvsize = 0;
+			data = job->data;
+			data.pl_buf = mgt->msgbuf;
+			data.pl_buf_size = peermgt_MSGSIZE_MAX;
+			memcpy(mgt->msgbuf, job->outbuf, data.pl_length);
+			source_addr = job->addr;
+			cryptpoolRelease(&mgt->cryptpool, cryptpool_QUEUE_DECODE);
+			ret = peermgtDecodePacketPayload(mgt, &data, peerid, &source_addr, utilGetClock(), 0);
+		}
+		else {
+			debugf("failed to decode packet from PeerID: %d, size: %d", peerid, job->len);
+			cryptpoolRelease(&mgt->cryptpool, cryptpool_QUEUE_DECODE);
+		}
+		if(ret > 0) return 1;
+		if(wait) return 0;
+	}
+	return 0;
+}
+
+
+// Queue a packet of an active PeerID for decoding by the crypto workers. If the queue is full, the oldest packet is processed to make room. Returns 1 if it has been accepted, 0 if not or -1 if the packet has to be decoded directly.
+static int peermgtDecodeAsync(struct s_peermgt *mgt, const int peerid, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr) {
+	struct s_cryptpool_job *job;
+	int ret;
+
+	if(!(mgt->cryptthreads > 0)) return -1;
+	if(!(packet_len <= cryptpool_BUFSIZE)) return -1;
+	if(!cryptpoolPrepare(&mgt->cryptpool, peerid, mgt->data[peerid].ctxgen, &mgt->ctx[peerid])) return -1;
+
+	ret = 0;
+	if(cryptpoolIsFull(&mgt->cryptpool, cryptpool_QUEUE_DECODE)) {
+		ret = peermgtDecodeFinished(mgt, 1);
+	}
+	if((job = cryptpoolGetJob(&mgt->cryptpool, cryptpool_QUEUE_DECODE, peerid)) == NULL) return ((ret > 0) ? ret : -1);
+	memcpy(job->inbuf, packet, packet_len);
+	job->len = packet_len;
+	job->addr = *source_addr;
+	cryptpoolSubmit(&mgt->cryptpool, cryptpool_QUEUE_DECODE);
+	return ret;
+}
+
+
+// Decode input packet recursively. Decapsulates relayed packets if necessary.
+int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr, const int tnow, const int depth) {
+	int ret;
+	int peerid;
+	struct s_packet_data data = { .pl_buf_size = peermgt_MSGSIZE_MAX, .pl_buf = mgt->msgbuf };
+
+    CREATE_HUMAN_IP(source_addr);
+
+	ret = 0;
+
+	if(packet_len <= (packet_PEERID_SIZE + packet_HMAC_SIZE) || (depth >= peermgt_DECODE_RECURSION_MAX_DEPTH)) {
+        debugf("Wrong packets size (%d) or recursion depth (%d) from %s", packet_len, depth, humanIp);
+        return 0;
+    }
+
+    peerid = packetGetPeerID(packet);
+
+    // packet is encrypted with the group key of a peer
+    if(peerid < 0) {
+        return peermgtDecodePacketGroup(mgt, packet, packet_len, tnow);
+    }
+
+    // proceed inactive peers
+    if(!peermgtIsActiveID(mgt, peerid)) {
+        debugf("failed to proceed packet for inactive peerid: %d, IP: %s", peerid, humanIp);
+        return 0;
+    }
+
+    if(peerid == 0) {
+        // packet has an anonymous PeerID
+        if(packetDecode(&data, packet, packet_len, &mgt->ctx[0], NULL) <= 0) {
+            debugf("failed to decode packet from anonymous peer, IP: %s", humanIp);
+            return 0;
+        }
+
+        switch(data.pl_type) {
+            case packet_PLTYPE_AUTH:
+                return peermgtDecodePacketAuth(mgt, &data, source_addr);
+            case packet_PLTYPE_RESUME:
+                return peermgtDecodePacketResume(mgt, &data, source_addr);
+            default:
+                return 0;
+        }
+    }
+
+    if(peerid <= 0) {
+        debugf("denied packet from invalid PeerID: %d", peerid);
+        return 0;
+    }
+
+    // packet has an active PeerID, decode it on the crypto workers if possible
+    if(depth == 0) {
+        if(!((ret = peermgtDecodeAsync(mgt, peerid, packet, packet_len, source_addr)) < 0)) {
+            return ret;
+        }
+    }
+    mgt->msgsize = 0;
+    mgt->msgbundle = 0;
+    mgt->macadvsize = 0;
+    mgt->routeadvsize = 0;
+    if(packetDecode(&data, packet, packet_len, &mgt->ctx[peerid], &mgt->data[peerid].seq) <= 0) {
+        debugf("failed to decode packet from PeerID: %d, size: %d, IP: %s", peerid, packet_len, humanIp);
+        return 0;
+    }
+
+    return peermgtDecodePacketPayload(mgt, &data, peerid, source_addr, tnow, depth);
+}
+
+
 // Decode input packet. Returns 1 on success.
 int peermgtDecodePacket(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr) {
 	int tnow;
@@ -961,11 +2917,38 @@ int peermgtDecodePacket(struct s_peermgt *mgt, const unsigned char *packet, cons
 }
 
 
+// Mark the paths of the peers that are reached via PeerAddr as down, after an ICMP error has been received for it.
+void peermgtDecodeUnreachable(struct s_peermgt *mgt, const struct s_peeraddr *addr) {
+	const int64_t tnowms = utilGetClockMs();
+	const int size = mapGetMapSize(&mgt->map);
+	int peerid;
+
+	if(!(mgt->probeinterval > 0)) return;
+	for(peerid=1; peerid<size; peerid++) {
+		if(peermgtIsActiveRemoteID(mgt, peerid) && (memcmp(mgt->data[peerid].remoteaddr.addr, addr->addr, peeraddr_SIZE) == 0)) {
+			if((tnowms - mgt->data[peerid].lastrecvms) >= mgt->probeinterval) { // ignore errors for paths that still carry traffic
+				mgt->data[peerid].lastrecvms = (tnowms - ((int64_t)((mgt->probeinterval > peermgt_PROBE_IDLE_INTERVAL) ? mgt->probeinterval : peermgt_PROBE_IDLE_INTERVAL) * peermgt_PROBE_MULTIPLIER));
+				mgt->data[peerid].activems = 0;
+				mgt->probetime = 0;
+			}
+		}
+	}
+}
+
+
 // Return received user data. Return 1 if successful.
 int peermgtRecvUserdata(struct s_peermgt *mgt, struct s_msg *recvmsg, struct s_nodeid *fromnodeid, int *frompeerid, int *frompeerct) {
 	if((mgt->msgsize > 0) && (recvmsg != NULL)) {
-		recvmsg->msg = mgt->msgbuf;
-		recvmsg->len = mgt->msgsize;
+		if(mgt->msgbundle) {
+			// return next frame of the bundle
+			recvmsg->msg = &mgt->msgbuf[(mgt->msgbundlepos + peermgt_BUNDLE_HDRSIZE)];
+			recvmsg->len = (utilReadInt16(&mgt->msgbuf[mgt->msgbundlepos]) & 0xFFFF);
+			mgt->msgbundlepos = mgt->msgbundlepos + peermgt_BUNDLE_HDRSIZE + recvmsg->len;
+		}
+		else {
+			recvmsg->msg = mgt->msgbuf;
+			recvmsg->len = mgt->msgsize;
+		}
 		if(fromnodeid != NULL) peermgtGetNodeID(mgt, fromnodeid, mgt->msgpeerid);
 		if(frompeerid != NULL) *frompeerid = mgt->msgpeerid;
 		if(frompeerct != NULL) {
@@ -976,7 +2959,56 @@ int peermgtRecvUserdata(struct s_peermgt *mgt, struct s_msg *recvmsg, struct s_n
 				*frompeerct = 0;
 			}
 		}
-		mgt->msgsize = 0;
+		if(!(mgt->msgbundle && (mgt->msgbundlepos < mgt->msgsize))) {
+			mgt->msgsize = 0;
+			mgt->msgbundle = 0;
+		}
+		return 1;
+	}
+	else {
+		return 0;
+	}
+}
+
+
+// Return received MAC advertisement. Return 1 if successful.
+int peermgtRecvMacAdvert(struct s_peermgt *mgt, struct s_msg *recvmsg, int *frompeerid, int *frompeerct) {
+	if((mgt->macadvsize > 0) && (recvmsg != NULL)) {
+		recvmsg->msg = mgt->msgbuf;
+		recvmsg->len = mgt->macadvsize;
+		if(frompeerid != NULL) *frompeerid = mgt->macadvpeerid;
+		if(frompeerct != NULL) {
+			if(peermgtIsActiveID(mgt, mgt->macadvpeerid)) {
+				*frompeerct = mgt->data[mgt->macadvpeerid].conntime;
+			}
+			else {
+				*frompeerct = 0;
+			}
+		}
+		mgt->macadvsize = 0;
+		return 1;
+	}
+	else {
+		return 0;
+	}
+}
+
+
+// Return received route advertisement. Return 1 if successful.
+int peermgtRecvRouteAdvert(struct s_peermgt *mgt, struct s_msg *recvmsg, int *frompeerid, int *frompeerct) {
+	if((mgt->routeadvsize > 0) && (recvmsg != NULL)) {
+		recvmsg->msg = mgt->msgbuf;
+		recvmsg->len = mgt->routeadvsize;
+		if(frompeerid != NULL) *frompeerid = mgt->routeadvpeerid;
+		if(frompeerct != NULL) {
+			if(peermgtIsActiveID(mgt, mgt->routeadvpeerid)) {
+				*frompeerct = mgt->data[mgt->routeadvpeerid].conntime;
+			}
+			else {
+				*frompeerct = 0;
+			}
+		}
+		mgt->routeadvsize = 0;
 		return 1;
 	}
 	else {
@@ -1000,6 +3032,7 @@ int peermgtSendUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, cons
 					mgt->outmsg.msg = sendmsg->msg;
 					mgt->outmsg.len = sendmsg->len;
 					mgt->outmsgpeerid = outpeerid;
+					mgt->outmsgtos = mgt->usertos;
 					return 1;
 				}
 				else {
@@ -1007,6 +3040,7 @@ int peermgtSendUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, cons
 					if(mgt->loopback) {
 						memcpy(mgt->msgbuf, sendmsg->msg, sendmsg->len);
 						mgt->msgsize = sendmsg->len;
+						mgt->msgbundle = 0;
 						mgt->msgpeerid = outpeerid;
 						return 1;
 					}
@@ -1027,8 +3061,11 @@ int peermgtSendBroadcastUserdata(struct s_peermgt *mgt, const struct s_msg *send
 			mgt->outmsg.msg = sendmsg->msg;
 			mgt->outmsg.len = sendmsg->len;
 			mgt->outmsgpeerid = -1;
+			mgt->outmsgtos = mgt->usertos;
 			mgt->outmsgbroadcast = 1;
 			mgt->outmsgbroadcastcount = 0;
+			mgt->grouplen = 0;
+			peermgtPrepareBroadcastTree(mgt);
 			return 1;
 		}
 	}
@@ -1036,6 +3073,81 @@ int peermgtSendBroadcastUserdata(struct s_peermgt *mgt, const struct s_msg *send
 }
 
 
+// Add small user data to the bundle of the peer. The bundle is sent when it gets flushed or before other user data. Return 1 if successful.
+int peermgtBundleUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, const int topeerid, const int topeerct) {
+	int outpeerid;
+
+	if(sendmsg == NULL) return 0;
+	if(!((sendmsg->len > 0) && (sendmsg->len <= peermgt_BUNDLE_FRAMEMAX))) return 0;
+	outpeerid = peermgtGetActiveID(mgt, NULL, topeerid, topeerct);
+	if(!(outpeerid > 0)) return 0;
+	if(!(peermgtGetFlag(mgt, peermgt_FLAG_BUNDLE) && peermgtGetRemoteFlag(mgt, outpeerid, peermgt_FLAG_BUNDLE))) return 0;
+	if((mgt->outmsg.len > 0) || (mgt->fragoutsize > 0)) return 0; // bundled frames must not overtake pending user data
+	if((mgt->usertos >> 2) >= peermgt_DSCP_HIGH) return 0; // latency sensitive frames don't wait for a bundle
+	if(mgt->bundlelen > 0) {
+		// only one bundle at a time, all frames of a bundle have the same traffic class
+		if((mgt->bundlepeerid != outpeerid) || (mgt->bundletos != mgt->usertos) || ((mgt->bundlelen + peermgt_BUNDLE_HDRSIZE + sendmsg->len) > peermgt_BUNDLE_SIZE)) return 0;
+	}
+	else {
+		mgt->bundlepeerid = outpeerid;
+		mgt->bundletos = mgt->usertos;
+		mgt->bundlecount = 0;
+		mgt->bundleready = 0;
+	}
+	utilWriteInt16(&mgt->bundlebuf[mgt->bundlelen], sendmsg->len);
+	memcpy(&mgt->bundlebuf[(mgt->bundlelen + peermgt_BUNDLE_HDRSIZE)], sendmsg->msg, sendmsg->len);
+	mgt->bundlelen = mgt->bundlelen + peermgt_BUNDLE_HDRSIZE + sendmsg->len;
+	mgt->bundlecount++;
+	return 1;
+}
+
+
+// Mark the bundle as ready to be sent.
+void peermgtFlushBundle(struct s_peermgt *mgt) {
+	if(mgt->bundlelen > 0) mgt->bundleready = 1;
+}
+
+
+// Returns 1 if a bundle is waiting to be sent.
+int peermgtIsBundlePending(struct s_peermgt *mgt) {
+	return (mgt->bundlelen > 0);
+}
+
+
+// Set the IPv4 TOS or IPv6 traffic class of the user data that is sent or bundled next.
+void peermgtSetUserdataTOS(struct s_peermgt *mgt, const int tos) {
+	mgt->usertos = (tos & 0xff);
+}
+
+
+// Returns the IPv4 TOS or IPv6 traffic class of the last packet returned by peermgtGetNextPacket.
+int peermgtGetOutputTOS(struct s_peermgt *mgt) {
+	return mgt->txtos;
+}
+
+
+// Start crypto worker threads that encode and decode the user data of directly connected peers. Returns 1 if successful.
+int peermgtEnableCryptPool(struct s_peermgt *mgt, const int threads) {
+	if(mgt->cryptthreads > 0) return 0;
+	if(!cryptpoolCreate(&mgt->cryptpool, threads, mapGetMapSize(&mgt->map))) return 0;
+	mgt->cryptthreads = threads;
+	return 1;
+}
+
+
+// Returns the number of packets the crypto workers are busy with.
+int peermgtCryptPending(struct s_peermgt *mgt) {
+	if(!(mgt->cryptthreads > 0)) return 0;
+	return cryptpoolPending(&mgt->cryptpool);
+}
+
+
+// Decode the next packet finished by the crypto workers. Returns 1 if a packet has been accepted.
+int peermgtDecodePending(struct s_peermgt *mgt) {
+	return peermgtDecodeFinished(mgt, 0);
+}
+
+
 // Set NetID from network name.
 int peermgtSetNetID(struct s_peermgt *mgt, const char *netname, const int netname_len) {
 	return netidSet(&mgt->netid, netname, netname_len);
@@ -1058,25 +3170,65 @@ int peermgtInit(struct s_peermgt *mgt) {
 	struct s_nodeid *local_nodeid = &mgt->nodekey->nodeid;
 
 	mgt->msgsize = 0;
+	mgt->msgbundle = 0;
+	mgt->msgbundlepos = 0;
+	mgt->macadvsize = 0;
+	mgt->macadvlen = 0;
+	mgt->macadvversion = 0;
+	mgt->routeadvsize = 0;
+	mgt->routeadvlen = 0;
+	mgt->routeadvversion = 0;
 	mgt->loopback = 0;
 	mgt->outmsg.len = 0;
 	mgt->outmsgbroadcast = 0;
 	mgt->outmsgbroadcastcount = 0;
-	mgt->rrmsg.len = 0;
-	mgt->rrmsgpeerid = 0;
-	mgt->rrmsgusetargetaddr = 0;
+	mgt->ctrlqhead = 0;
+	mgt->ctrlqcount = 0;
+	mgt->txflowhead = 0;
+	mgt->txflowcount = 0;
+	mgt->txcredited = 0;
+	mgt->txctrltime = 0;
+	mgt->txctrlscan = 1;
+	mgt->probetime = 0;
+	mgt->rtttime = 0;
+	mgt->resumeqhead = 0;
+	mgt->resumeqcount = 0;
 	mgt->fragoutpeerid = 0;
 	mgt->fragoutcount = 0;
 	mgt->fragoutsize = 0;
 	mgt->fragoutpos = 0;
+	mgt->bundlelen = 0;
+	mgt->bundlecount = 0;
+	mgt->bundlepeerid = 0;
+	mgt->bundleready = 0;
+	mgt->bundletos = 0;
+	mgt->outmsgtos = 0;
+	mgt->usertos = 0;
+	mgt->txtos = 0;
 	mgt->localflags = 0;
 
 	for(i=0; i<s; i++) {
 		mgt->data[i].state = peermgt_STATE_INVALID;
+		mgt->data[i].relayqhead = -1;
+		mgt->data[i].relayqtail = -1;
+		mgt->data[i].relayqlen = 0;
+		mgt->data[i].txdeficit = 0;
+		mgt->data[i].txactive = 0;
+	}
+
+	mgt->relayqfree = -1;
+	for(i=(peermgt_RELAYQ_SIZE - 1); i>=0; i--) {
+		mgt->relayq[i].next = mgt->relayqfree;
+		mgt->relayqfree = i;
 	}
 
 	memset(empty_addr.addr, 0, peeraddr_SIZE);
 	mapInit(&mgt->map);
+	mapInit(&mgt->ticketdb);
+	mapInit(&mgt->resumereplay);
+	mapInit(&mgt->groupmap);
+	mapInit(&mgt->bcastdedup);
+	mapEnableReplaceOld(&mgt->bcastdedup);
 	authmgtReset(&mgt->authmgt);
 	nodedbInit(&mgt->nodedb);
 	nodedbInit(&mgt->relaydb);
@@ -1088,6 +3240,19 @@ int peermgtInit(struct s_peermgt *mgt) {
 				tnow = utilGetClock();
 				mgt->tinit = tnow;
 				mgt->lastconntry = tnow;
+				mgt->conntrycount = 0;
+				mgt->infoversion = 0;
+				mgt->ticketkeygen = 0;
+				mgt->ticketkeytime = tnow;
+				cryptoSetKeysRandom(mgt->ticketctx, 2);
+				mgt->groupkeyid = 0;
+				mgt->groupkeytime = tnow;
+				mgt->groupseq = 0;
+				mgt->grouplen = 0;
+				mgt->bcastseq = (cryptoRand64() & 0x3FFFFFFFFFFFFFFF);
+				mgt->bcastlen = 0;
+				mgt->bcastfwdqhead = 0;
+				mgt->bcastfwdqcount = 0;
 
 				return 1;
 			}
@@ -1110,7 +3275,7 @@ void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_len) {
 	int tnow = utilGetClock();
 	int pos = 0;
 	int size = mapGetMapSize(&mgt->map);
-	int maxpos = (((size + 2) * (160)) + 1);
+	int maxpos = (((size + 2) * (180)) + 1);
 	unsigned char infoid[packet_PEERID_SIZE];
 	unsigned char infostate[1];
 	unsigned char infoflags[2];
@@ -1121,8 +3286,8 @@ void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_len) {
 
 	if(maxpos > report_len) { maxpos = report_len; }
 
-	memcpy(&report[pos], "PeerID    NodeID                                                            Address                                       Status  LastPkt   SessAge   Flag  RQ", 158);
-	pos = pos + 158;
+	memcpy(&report[pos], "PeerID    NodeID                                                            Address                                       Status  LastPkt   SessAge   Flag  RQ  SRTT      Jitter", 176);
+	pos = pos + 176;
 	report[pos++] = '\n';
 
 	while(i < size && pos < maxpos) {
@@ -1163,6 +3328,16 @@ void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_len) {
 			inforq[0] = seqRQ(&mgt->data[i].seq);
 			utilByteArrayToHexstring(&report[pos], 4, inforq, 1);
 			pos = pos + 2;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(timediff, mgt->data[i].srtt);
+			utilByteArrayToHexstring(&report[pos], 10, timediff, 4);
+			pos = pos + 8;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(timediff, mgt->data[i].jitter);
+			utilByteArrayToHexstring(&report[pos], 10, timediff, 4);
+			pos = pos + 8;
 			report[pos++] = '\n';
 		}
 		i++;
@@ -1177,6 +3352,9 @@ int peermgtCreate(struct s_peermgt *mgt, const int peer_slots, const int auth_sl
 	const char *defaultid = "default";
 	struct s_peermgt_data *data_mem;
 	struct s_crypto *ctx_mem;
+	struct s_crypto *groupctx_mem;
+	struct s_peermgt_relaymsg *relayq_mem;
+	int *txflow_mem;
 
 	if(peer_slots <= 0 || auth_slots <= 0  || !peermgtSetNetID(mgt, defaultid, 7)) {
         debugf("Failed to create PeerMgr, peer_slots: %d, auth_slots: %d", peer_slots, auth_slots);
@@ -1224,11 +3402,69 @@ int peermgtCreate(struct s_peermgt *mgt, const int peer_slots, const int auth_sl
         return 0;
     }
 
+    if(!mapCreate(&mgt->ticketdb, (peer_slots + 1), NODEID_SIZE, sizeof(struct s_peermgt_ticket))) {
+        debug("failed to create ticket cache");
+        return 0;
+    }
+    mapEnableReplaceOld(&mgt->ticketdb);
+
+    if(!mapCreate(&mgt->resumereplay, peermgt_RESUME_REPLAY_SIZE, peermgt_TICKET_NONCESIZE, sizeof(int))) {
+        debug("failed to create resume replay cache");
+        return 0;
+    }
+
+    if(!cryptoCreate(mgt->ticketctx, 2) || !cryptoCreate(&mgt->resumectx, 1)) {
+        debug("failed to create ticket crypto engine");
+        return 0;
+    }
+
+    if(!mapCreate(&mgt->groupmap, (peer_slots + 1), 4, sizeof(int))) {
+        debug("failed to create group key index");
+        return 0;
+    }
+
+    if(!mapCreate(&mgt->bcastdedup, peermgt_BCAST_DEDUP_SIZE, (nodeid_SIZE + seq_SIZE), 1)) {
+        debug("failed to create broadcast duplicate filter");
+        return 0;
+    }
+
+    groupctx_mem = malloc(sizeof(struct s_crypto) * (peer_slots + 1));
+    if(groupctx_mem == NULL) {
+        debug("failed to allocate memory for group key contexts");
+        return 0;
+    }
+
+    if(!cryptoCreate(groupctx_mem, (peer_slots + 1)) || !cryptoCreate(&mgt->localgroupctx, 1)) {
+        debug("failed to create group key crypto engine");
+        return 0;
+    }
+
+    relayq_mem = malloc(sizeof(struct s_peermgt_relaymsg) * peermgt_RELAYQ_SIZE);
+    if(relayq_mem == NULL) {
+        debug("failed to allocate memory for relay queue");
+        return 0;
+    }
+
+    txflow_mem = malloc(sizeof(int) * (peer_slots + 1));
+    if(txflow_mem == NULL) {
+        debug("failed to allocate memory for transmit scheduler");
+        return 0;
+    }
+
 
     mgt->nodekey = local_nodekey;
     mgt->data = data_mem;
     mgt->ctx = ctx_mem;
-    mgt->rrmsg.msg = mgt->rrmsgbuf;
+    mgt->groupctx = groupctx_mem;
+    mgt->relayq = relayq_mem;
+    mgt->txflow = txflow_mem;
+    mgt->txflowsize = (peer_slots + 1);
+    mgt->connectrate = peermgt_CONNECT_RATE_DEFAULT;
+    mgt->probeinterval = 0;
+    mgt->bcasttree = 0;
+    mgt->cryptthreads = 0;
+    mgt->cryptqueued = 0;
+    mgt->ctxgen = 0;
 
 
     return peermgtInit(mgt);
@@ -1238,12 +3474,27 @@ int peermgtCreate(struct s_peermgt *mgt, const int peer_slots, const int auth_sl
 // Destroy peer manager object.
 void peermgtDestroy(struct s_peermgt *mgt) {
 	int size = mapGetMapSize(&mgt->map);
+	if(mgt->cryptthreads > 0) {
+		cryptpoolDestroy(&mgt->cryptpool);
+		mgt->cryptthreads = 0;
+	}
 	mapDestroy(&mgt->map);
+	mapDestroy(&mgt->ticketdb);
+	mapDestroy(&mgt->resumereplay);
+	mapDestroy(&mgt->groupmap);
+	mapDestroy(&mgt->bcastdedup);
+	cryptoDestroy(&mgt->localgroupctx, 1);
+	cryptoDestroy(mgt->groupctx, size);
+	free(mgt->groupctx);
+	cryptoDestroy(&mgt->resumectx, 1);
+	cryptoDestroy(mgt->ticketctx, 2);
 	nodedbDestroy(&mgt->nodedb);
 	nodedbDestroy(&mgt->relaydb);
 	authmgtDestroy(&mgt->authmgt);
 	dfragDestroy(&mgt->dfrag);
 	cryptoDestroy(mgt->ctx, size);
+	free(mgt->txflow);
+	free(mgt->relayq);
 	free(mgt->ctx);
 	free(mgt->data);
 }
@@ -22,6 +22,10 @@
 #ifndef F_IO_C
 #define F_IO_C
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "io.h"
 
 #include <stdlib.h>
@@ -43,6 +47,36 @@
 
 #if defined(IO_LINUX)
 #include <linux/if_tun.h>
+#include <netinet/udp.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+#define IO_UDPOFFLOAD
+#endif
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <sys/mman.h>
+#if defined(TPACKET3_HDRLEN)
+#define IO_PACKETRING
+#endif
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <sys/syscall.h>
+#if defined(XDP_COPY) && defined(BPF_F_XDP_HAS_FRAGS) && defined(__NR_bpf)
+#define IO_XDP
+#endif
+#include <errno.h>
+#include <linux/errqueue.h>
+#if defined(IP_RECVERR) && defined(IPV6_RECVERR)
+#define IO_RECVERR
+#endif
+#endif
+
+#if defined(IO_LINUX) && defined(HAVE_LIBURING) && defined(HAVE_LIBURING_H)
+#define IO_URING
+#include <errno.h>
+#include <liburing.h>
 #endif
 
 #if defined(IO_WINDOWS)
@@ -129,6 +163,99 @@ int ioResolveName(struct s_io_addrinfo *iai, const char *hostname, const char *p
 }
 
 
+#if defined(IO_LINUX)
+// Writes a control message that sets the IPv4 TOS or IPv6 traffic class of a packet sent to destination_sockaddr. Returns the length of the control message.
+static int ioHelperSetTOS(struct cmsghdr *cmsg, const struct sockaddr *destination_sockaddr, const int tos) {
+	if(destination_sockaddr->sa_family == AF_INET6) {
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_TCLASS;
+	}
+	else {
+		cmsg->cmsg_level = IPPROTO_IP;
+		cmsg->cmsg_type = IP_TOS;
+	}
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &tos, sizeof(int));
+	return CMSG_SPACE(sizeof(int));
+}
+#endif
+
+
+// Converts a socket address received on a handle of the specified type to an IO addr.
+static void ioHelperSockaddrToAddr(struct s_io_state *iostate, const int type, const struct sockaddr_storage *source_sockaddr, struct s_io_addr *ioaddr) {
+	const struct sockaddr_in6 *source_sockaddr_v6;
+	const struct sockaddr_in *source_sockaddr_v4;
+
+	switch(type) {
+		case IO_TYPE_SOCKET_V6: // copy v6 address
+			source_sockaddr_v6 = (const struct sockaddr_in6 *)source_sockaddr;
+			if((iostate->nat64clat > 0) && (memcmp(source_sockaddr_v6->sin6_addr.s6_addr, iostate->nat64_prefix, 12) == 0)) {
+				memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP4, 4); // set address type
+				memcpy(&ioaddr->addr[4], &source_sockaddr_v6->sin6_addr.s6_addr[12], 4); // copy source IPv4 address, extracted from NAT64 address
+				memcpy(&ioaddr->addr[8], &source_sockaddr_v6->sin6_port, 2); // copy source port
+				memcpy(&ioaddr->addr[10], "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 14); // empty bytes
+			}
+			else {
+				memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP6, 4); // set address type
+				memcpy(&ioaddr->addr[4], source_sockaddr_v6->sin6_addr.s6_addr, 16); // copy source IPv6 address
+				memcpy(&ioaddr->addr[20], &source_sockaddr_v6->sin6_port, 2); // copy source port
+				memcpy(&ioaddr->addr[22], "\x00\x00", 2); // empty bytes
+			}
+			break;
+		case IO_TYPE_SOCKET_V4: // copy v4 address
+			source_sockaddr_v4 = (const struct sockaddr_in *)source_sockaddr;
+			memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP4, 4); // set address type
+			memcpy(&ioaddr->addr[4], &source_sockaddr_v4->sin_addr.s_addr, 4); // copy source IPv4 address
+			memcpy(&ioaddr->addr[8], &source_sockaddr_v4->sin_port, 2); // copy source port
+			memcpy(&ioaddr->addr[10], "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 14); // empty bytes
+			break;
+		default:
+			break;
+	}
+}
+
+
+#if defined(IO_RECVERR)
+// Reads the errors queued on socket handle ID and remembers the destinations that have been reported unreachable by ICMP. Returns the number of errors read.
+static int ioRecvErrors(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	union { struct cmsghdr align; unsigned char buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))]; } control;
+	struct sockaddr_storage destination_sockaddr;
+	struct sock_extended_err *ee;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	unsigned char buf[1];
+	int count;
+
+	count = 0;
+	while(count < IO_RECVERR_BATCH) {
+		iov.iov_base = buf;
+		iov.iov_len = sizeof(buf);
+		memset(&msg, 0, sizeof(struct msghdr));
+		msg.msg_name = &destination_sockaddr;
+		msg.msg_namelen = sizeof(struct sockaddr_storage);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		if(recvmsg(handle->fd, &msg, MSG_ERRQUEUE) < 0) break;
+		count++;
+		for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if(((cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_RECVERR)) || ((cmsg->cmsg_level == IPPROTO_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR))) {
+				ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
+				if(((ee->ee_origin == SO_EE_ORIGIN_ICMP) || (ee->ee_origin == SO_EE_ORIGIN_ICMP6)) && (ee->ee_errno != EMSGSIZE) && (iostate->unreachcount < IO_UNREACH_MAX)) { // path MTU messages are not errors
+					ioHelperSockaddrToAddr(iostate, handle->type, &destination_sockaddr, &iostate->unreach[iostate->unreachcount]);
+					iostate->unreachcount++;
+				}
+			}
+		}
+	}
+	return count;
+}
+#endif
+
+
 // Reset handle ID values and buffers.
 void ioResetID(struct s_io_state *iostate, const int id) {
 	iostate->handle[id].enabled = 0;
@@ -137,6 +264,24 @@ void ioResetID(struct s_io_state *iostate, const int id) {
 	iostate->handle[id].type = IO_TYPE_NULL;
 	iostate->handle[id].group_id = 0;
 	iostate->handle[id].open = 0;
+	iostate->handle[id].vnethdr = 0;
+	iostate->handle[id].content = &iostate->mem[id * iostate->bufsize];
+	iostate->handle[id].uringbuf = -1;
+	iostate->handle[id].uringarmed = 0;
+	iostate->handle[id].uringsingle = 0;
+	iostate->handle[id].udpgsobuf = NULL;
+	iostate->handle[id].udpgsolen = 0;
+	iostate->handle[id].udpgsosize = 0;
+	iostate->handle[id].udpgsocount = 0;
+	memset(&iostate->handle[id].udpgsoaddr, 0, sizeof(struct sockaddr_storage));
+	iostate->handle[id].udpgsoaddr_len = 0;
+	iostate->handle[id].udpgsotos = 0;
+	iostate->handle[id].udpgrobuf = NULL;
+	iostate->handle[id].udpgrolen = 0;
+	iostate->handle[id].udpgropos = 0;
+	iostate->handle[id].udpgrosize = 0;
+	iostate->handle[id].packetring = NULL;
+	iostate->handle[id].xdp = NULL;
 	memset(&iostate->handle[id].source_addr, 0, sizeof(struct s_io_addr));
 	memset(&iostate->handle[id].source_sockaddr, 0, sizeof(struct sockaddr_storage));
 	memset(&iostate->mem[id * iostate->bufsize], 0, iostate->bufsize);
@@ -188,14 +333,841 @@ void ioDeallocID(struct s_io_state *iostate, const int id) {
 }
 
 
+#if defined(IO_URING)
+// The io_uring write slot structure.
+struct s_io_uring_wslot {
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_storage sockaddr;
+	union { struct cmsghdr align; unsigned char buf[CMSG_SPACE(sizeof(int))]; } control;
+	int next;
+};
+
+
+// The io_uring backend structure.
+struct s_io_uring {
+	struct io_uring ring;
+	struct io_uring_buf_ring *bufring;
+	unsigned char *bufmem;
+	int bufsize;
+	int bufcount;
+	struct msghdr *recvmsg;
+	unsigned char *wmem;
+	int wsize;
+	struct s_io_uring_wslot wslot[IO_URING_WSLOTS];
+	int wfree;
+};
+
+
+// Returns a receive buffer to the kernel.
+static void ioUringRecycle(struct s_io_uring *uring, const int bid) {
+	io_uring_buf_ring_add(uring->bufring, &uring->bufmem[bid * uring->bufsize], uring->bufsize, bid, io_uring_buf_ring_mask(uring->bufcount), 0);
+	io_uring_buf_ring_advance(uring->bufring, 1);
+}
+
+
+// Returns a free submission queue entry, or NULL if the queue is full.
+static struct io_uring_sqe *ioUringGetSQE(struct s_io_uring *uring) {
+	struct io_uring_sqe *sqe;
+	if((sqe = io_uring_get_sqe(&uring->ring)) == NULL) {
+		io_uring_submit(&uring->ring);
+		sqe = io_uring_get_sqe(&uring->ring);
+	}
+	return sqe;
+}
+
+
+// Arms a receive on handle ID. Sockets and files use multishot requests with buffers selected from the buffer ring.
+static int ioUringArm(struct s_io_state *iostate, const int id) {
+	struct s_io_uring *uring = iostate->uring;
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct io_uring_sqe *sqe;
+
+	if(!((handle->type == IO_TYPE_SOCKET_V6) || (handle->type == IO_TYPE_SOCKET_V4) || (handle->type == IO_TYPE_FILE))) return 0;
+	if((sqe = ioUringGetSQE(uring)) == NULL) return 0;
+	switch(handle->type) {
+		case IO_TYPE_SOCKET_V6:
+		case IO_TYPE_SOCKET_V4:
+			memset(&uring->recvmsg[id], 0, sizeof(struct msghdr));
+			uring->recvmsg[id].msg_namelen = sizeof(struct sockaddr_storage);
+			io_uring_prep_recvmsg_multishot(sqe, handle->fd, &uring->recvmsg[id], 0);
+			break;
+		case IO_TYPE_FILE:
+#if defined(HAVE_DECL_IO_URING_PREP_READ_MULTISHOT) && HAVE_DECL_IO_URING_PREP_READ_MULTISHOT
+			if(!handle->uringsingle) {
+				io_uring_prep_read_multishot(sqe, handle->fd, 0, 0, IO_URING_BGID);
+				break;
+			}
+#endif
+		default:
+			io_uring_prep_read(sqe, handle->fd, NULL, uring->bufsize, 0);
+			break;
+	}
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = IO_URING_BGID;
+	io_uring_sqe_set_data64(sqe, (((uint64_t)IO_URING_OP_RECV << 32) | id));
+	handle->uringarmed = 1;
+	return 1;
+}
+
+
+// Cancels the receive on handle ID and returns its buffer.
+static void ioUringClose(struct s_io_state *iostate, const int id) {
+	struct s_io_uring *uring = iostate->uring;
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct io_uring_sqe *sqe;
+
+	if(uring == NULL) return;
+	if(handle->uringbuf >= 0) {
+		ioUringRecycle(uring, handle->uringbuf);
+		handle->uringbuf = -1;
+		handle->content_len = 0;
+	}
+	if(handle->uringarmed) {
+		handle->uringarmed = 0;
+		if((sqe = ioUringGetSQE(uring)) != NULL) {
+			io_uring_prep_cancel64(sqe, (((uint64_t)IO_URING_OP_RECV << 32) | id), 0);
+			io_uring_sqe_set_data64(sqe, 0);
+			io_uring_submit(&uring->ring);
+		}
+	}
+}
+
+
+// Moves completed receives to the handles. Stops at the first completion for a handle that still holds data. Returns the number of received messages.
+static int ioUringFill(struct s_io_state *iostate) {
+	struct s_io_uring *uring = iostate->uring;
+	struct s_io_handle *handle;
+	struct io_uring_cqe *cqe;
+	struct io_uring_recvmsg_out *out;
+	unsigned char *buf;
+	int count;
+	int op;
+	int id;
+	int bid;
+	int res;
+	int more;
+
+	count = 0;
+	while((count < IO_URING_BATCH) && (io_uring_peek_cqe(&uring->ring, &cqe) == 0)) {
+		op = (cqe->user_data >> 32);
+		id = (cqe->user_data & 0xFFFFFFFF);
+		res = cqe->res;
+
+		// finished write, free the slot
+		if(op == IO_URING_OP_WRITE) {
+			if(res < 0) debug("could not write!");
+			uring->wslot[id].next = uring->wfree;
+			uring->wfree = id;
+			io_uring_cqe_seen(&uring->ring, cqe);
+			continue;
+		}
+		if(!((op == IO_URING_OP_RECV) && (id >= 0) && (id < iostate->max))) {
+			io_uring_cqe_seen(&uring->ring, cqe);
+			continue;
+		}
+
+		// finished receive
+		handle = &iostate->handle[id];
+		if(handle->content_len > 0) break;
+		more = (cqe->flags & IORING_CQE_F_MORE);
+		bid = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+		if((bid >= 0) && (res > 0) && (handle->enabled) && (handle->uringarmed)) {
+			buf = &uring->bufmem[bid * uring->bufsize];
+			if(handle->type == IO_TYPE_FILE) {
+				handle->content = buf;
+				handle->content_len = res;
+			}
+			else {
+				out = io_uring_recvmsg_validate(buf, res, &uring->recvmsg[id]);
+				if((out != NULL) && (!(out->flags & MSG_TRUNC)) && (out->namelen <= sizeof(struct sockaddr_storage))) {
+					memcpy(&handle->source_sockaddr, io_uring_recvmsg_name(out), out->namelen);
+					handle->content = io_uring_recvmsg_payload(out, &uring->recvmsg[id]);
+					handle->content_len = io_uring_recvmsg_payload_length(out, res, &uring->recvmsg[id]);
+				}
+			}
+			if(handle->content_len > 0) {
+				handle->uringbuf = bid;
+				bid = -1;
+				count++;
+			}
+			else {
+				handle->content = &iostate->mem[id * iostate->bufsize];
+				handle->content_len = 0;
+			}
+		}
+		if(bid >= 0) ioUringRecycle(uring, bid);
+
+		// re-arm terminated requests, single reads complete after each message
+		if((!more) && (handle->enabled) && (handle->uringarmed) && (res != -ECANCELED) && (res != -EBADF)) {
+			if((res == -EINVAL) && (handle->type == IO_TYPE_FILE) && (!handle->uringsingle)) {
+				handle->uringsingle = 1; // multishot read is not supported by the kernel
+			}
+			if((res >= 0) || (res == -ENOBUFS) || (res == -EAGAIN) || (res == -EINTR) || (handle->uringsingle)) {
+				ioUringArm(iostate, id);
+			}
+#if defined(IO_RECVERR)
+			else if((handle->type != IO_TYPE_FILE) && (iostate->recverr) && (ioRecvErrors(iostate, id) > 0)) { // a queued ICMP error has terminated the receive
+				ioUringArm(iostate, id);
+			}
+#endif
+			else {
+				debug("receive failed, handle disabled!");
+				handle->uringarmed = 0;
+			}
+		}
+		io_uring_cqe_seen(&uring->ring, cqe);
+	}
+	return count;
+}
+
+
+// Returns the receive buffer of handle ID to the kernel and moves the next completed receive to the handles.
+static void ioUringClear(struct s_io_state *iostate, const int id) {
+	struct s_io_uring *uring = iostate->uring;
+	struct s_io_handle *handle = &iostate->handle[id];
+	if(handle->uringbuf >= 0) {
+		ioUringRecycle(uring, handle->uringbuf);
+		handle->uringbuf = -1;
+	}
+	handle->content = &iostate->mem[id * iostate->bufsize];
+	handle->content_len = 0;
+	ioUringFill(iostate);
+}
+
+
+// Submits pending requests and waits for completions if no handle holds data. Returns the amount of handles with data.
+static int ioUringReadAll(struct s_io_state *iostate) {
+	struct s_io_uring *uring = iostate->uring;
+	struct io_uring_cqe *cqe;
+	struct __kernel_timespec ts;
+	int ret;
+	int i;
+
+	ret = ioUringFill(iostate);
+	for(i=0; i<iostate->max; i++) {
+		if(iostate->handle[i].content_len > 0) ret++;
+	}
+	if(ret > 0) {
+		// data is waiting, only submit queued writes
+		if(io_uring_sq_ready(&uring->ring) > 0) io_uring_submit(&uring->ring);
+	}
+	else {
+		ts.tv_sec = (iostate->timeout / 1000);
+		ts.tv_nsec = ((iostate->timeout % 1000) * 1000000);
+		io_uring_submit_and_wait_timeout(&uring->ring, &cqe, 1, &ts, NULL);
+		ioUringFill(iostate);
+	}
+
+	ret = 0;
+	for(i=0; i<iostate->max; i++) {
+		if(iostate->handle[i].content_len > 0) ret++;
+	}
+	return ret;
+}
+
+
+// Queues a write on handle ID. destination_sockaddr is NULL for files, tos is only used for sockets. Returns amount of bytes queued, or 0 if no write slot is free.
+static int ioUringWrite(struct s_io_state *iostate, const int id, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos) {
+	struct s_io_uring *uring = iostate->uring;
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct s_io_uring_wslot *wslot;
+	struct io_uring_sqe *sqe;
+	unsigned char *buf;
+	int hdrlen;
+	int slot;
+
+	hdrlen = ((destination_sockaddr == NULL) && (handle->vnethdr)) ? IO_VNETHDR_SIZE : 0;
+	if((write_buf_size <= 0) || ((hdrlen + write_buf_size) > uring->wsize) || (uring->wfree < 0)) return 0;
+	if((sqe = ioUringGetSQE(uring)) == NULL) return 0;
+	slot = uring->wfree;
+	wslot = &uring->wslot[slot];
+	uring->wfree = wslot->next;
+
+	// the caller may reuse its buffer, copy the data to the registered write buffer
+	buf = &uring->wmem[slot * uring->wsize];
+	if(hdrlen > 0) {
+		if(vnethdr != NULL) {
+			memcpy(buf, vnethdr, IO_VNETHDR_SIZE);
+		}
+		else {
+			memset(buf, 0, IO_VNETHDR_SIZE);
+		}
+	}
+	memcpy(&buf[hdrlen], write_buf, write_buf_size);
+	if(destination_sockaddr != NULL) {
+		memcpy(&wslot->sockaddr, destination_sockaddr, destination_sockaddr_len);
+		wslot->iov.iov_base = buf;
+		wslot->iov.iov_len = write_buf_size;
+		memset(&wslot->msg, 0, sizeof(struct msghdr));
+		wslot->msg.msg_name = &wslot->sockaddr;
+		wslot->msg.msg_namelen = destination_sockaddr_len;
+		wslot->msg.msg_iov = &wslot->iov;
+		wslot->msg.msg_iovlen = 1;
+		if(tos > 0) {
+			wslot->msg.msg_control = wslot->control.buf;
+			wslot->msg.msg_controllen = sizeof(wslot->control.buf);
+			wslot->msg.msg_controllen = ioHelperSetTOS(CMSG_FIRSTHDR(&wslot->msg), destination_sockaddr, tos);
+		}
+		io_uring_prep_sendmsg(sqe, handle->fd, &wslot->msg, 0);
+	}
+	else {
+		io_uring_prep_write_fixed(sqe, handle->fd, buf, (hdrlen + write_buf_size), 0, 0);
+	}
+	io_uring_sqe_set_data64(sqe, (((uint64_t)IO_URING_OP_WRITE << 32) | slot));
+	return write_buf_size;
+}
+
+
+// Shuts down the io_uring backend.
+static void ioUringDestroy(struct s_io_state *iostate) {
+	struct s_io_uring *uring = iostate->uring;
+	int i;
+	if(uring == NULL) return;
+	io_uring_free_buf_ring(&uring->ring, uring->bufring, uring->bufcount, IO_URING_BGID);
+	io_uring_queue_exit(&uring->ring);
+	for(i=0; i<iostate->max; i++) {
+		iostate->handle[i].content = &iostate->mem[i * iostate->bufsize];
+		iostate->handle[i].content_len = 0;
+		iostate->handle[i].uringbuf = -1;
+		iostate->handle[i].uringarmed = 0;
+	}
+	free(uring->recvmsg);
+	free(uring->wmem);
+	free(uring->bufmem);
+	free(uring);
+	iostate->uring = NULL;
+}
+#endif
+
+
+#if defined(IO_PACKETRING)
+// The packet ring structure. The receive ring is followed by the transmit ring in the same mapping.
+struct s_io_packetring {
+	unsigned char *map;
+	size_t mapsize;
+	int rxblock;
+	int rxheld;
+	int rxleft;
+	unsigned char *rxframe;
+	unsigned char *txmem;
+	int txframes;
+	int txframe;
+	int txpending;
+};
+
+
+// Lets the kernel send the queued frames of the packet ring on handle ID.
+static void ioPacketRingKick(struct s_io_state *iostate, const int id) {
+	struct s_io_packetring *ring = iostate->handle[id].packetring;
+	sendto(iostate->handle[id].fd, NULL, 0, 0, NULL, 0);
+	ring->txpending = 0;
+}
+
+
+// Points the content of handle ID to the next received frame of the current block. The block is returned to the kernel when all frames have been read. Returns length of the frame, or 0 if there is none.
+static int ioPacketRingNext(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct s_io_packetring *ring = handle->packetring;
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *ph;
+	struct sockaddr_ll *sll;
+
+	while(ring->rxleft > 0) {
+		ph = (struct tpacket3_hdr *)ring->rxframe;
+		sll = (struct sockaddr_ll *)(ring->rxframe + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+		ring->rxframe = ring->rxframe + ph->tp_next_offset;
+		ring->rxleft--;
+
+		// skip frames sent by the host itself and truncated frames
+		if((sll->sll_pkttype != PACKET_OUTGOING) && (ph->tp_snaplen > 0) && (ph->tp_snaplen == ph->tp_len)) {
+			handle->content = (unsigned char *)ph + ph->tp_mac;
+			return ph->tp_snaplen;
+		}
+	}
+
+	if(ring->rxheld) {
+		bd = (struct tpacket_block_desc *)&ring->map[ring->rxblock * IO_PACKET_BLOCKSIZE];
+		__sync_synchronize();
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		ring->rxheld = 0;
+		ring->rxblock = (ring->rxblock + 1) % IO_PACKET_BLOCKNR;
+	}
+	handle->content = &iostate->mem[id * iostate->bufsize];
+	return 0;
+}
+
+
+// Takes the next block of received frames from the packet ring on handle ID. Returns length of the first frame, or 0 if there is none.
+static int ioPacketRingRead(struct s_io_state *iostate, const int id) {
+	struct s_io_packetring *ring = iostate->handle[id].packetring;
+	struct tpacket_block_desc *bd;
+
+	if(!ring->rxheld) {
+		bd = (struct tpacket_block_desc *)&ring->map[ring->rxblock * IO_PACKET_BLOCKSIZE];
+		if(bd->hdr.bh1.block_status & TP_STATUS_USER) {
+			__sync_synchronize();
+			ring->rxheld = 1;
+			ring->rxleft = bd->hdr.bh1.num_pkts;
+			ring->rxframe = (unsigned char *)bd + bd->hdr.bh1.offset_to_first_pkt;
+		}
+	}
+	return ioPacketRingNext(iostate, id);
+}
+
+
+// Queues a frame in the transmit ring on handle ID. Returns length of the queued frame, or 0 if the ring is full.
+static int ioPacketRingWrite(struct s_io_state *iostate, const int id, const unsigned char *write_buf, const int write_buf_size) {
+	struct s_io_packetring *ring = iostate->handle[id].packetring;
+	struct tpacket3_hdr *ph;
+
+	if(!((write_buf_size > 0) && (write_buf_size <= (IO_PACKET_FRAMESIZE - (int)TPACKET_ALIGN(sizeof(struct tpacket3_hdr)))))) return 0;
+	ph = (struct tpacket3_hdr *)&ring->txmem[ring->txframe * IO_PACKET_FRAMESIZE];
+	if(ph->tp_status != TP_STATUS_AVAILABLE) {
+		// ring is full, let the kernel catch up
+		ioPacketRingKick(iostate, id);
+		if(ph->tp_status != TP_STATUS_AVAILABLE) return 0;
+	}
+	memcpy((unsigned char *)ph + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)), write_buf, write_buf_size);
+	ph->tp_len = write_buf_size;
+	ph->tp_snaplen = write_buf_size;
+	ph->tp_next_offset = 0;
+	__sync_synchronize();
+	ph->tp_status = TP_STATUS_SEND_REQUEST;
+	ring->txframe = (ring->txframe + 1) % ring->txframes;
+	ring->txpending++;
+	if(ring->txpending >= IO_PACKET_TXBATCH) {
+		ioPacketRingKick(iostate, id);
+	}
+	return write_buf_size;
+}
+
+
+// Unmaps the packet ring on handle ID.
+static void ioPacketRingClose(struct s_io_state *iostate, const int id) {
+	struct s_io_packetring *ring = iostate->handle[id].packetring;
+	if(ring != NULL) {
+		if(ring->txpending > 0) {
+			ioPacketRingKick(iostate, id);
+		}
+		munmap(ring->map, ring->mapsize);
+		free(ring);
+		iostate->handle[id].packetring = NULL;
+		iostate->handle[id].content_len = 0;
+	}
+}
+#endif
+
+
+#if defined(IO_XDP)
+// The AF_XDP ring structure.
+struct s_io_xdp_ring {
+	uint32_t *producer;
+	uint32_t *consumer;
+	void *desc;
+	uint32_t mask;
+	void *map;
+	size_t mapsize;
+};
+
+
+// The AF_XDP neighbor structure. Stores the link layer and local addresses under which a remote address has been reached.
+struct s_io_xdp_neighbor {
+	unsigned char addr[20];
+	unsigned char remote_mac[6];
+	unsigned char local_mac[6];
+	unsigned char local_ip[16];
+	int valid;
+};
+
+
+// The AF_XDP state structure. The first half of the UMEM frames is used for receiving, the second half for sending.
+struct s_io_xdp {
+	unsigned char *umem;
+	size_t umemsize;
+	struct s_io_xdp_ring rx;
+	struct s_io_xdp_ring tx;
+	struct s_io_xdp_ring fill;
+	struct s_io_xdp_ring comp;
+	uint64_t txfree[IO_XDP_FRAMES / 2];
+	int txfreecount;
+	int txpending;
+	int rxheld;
+	int rxcount;
+	uint16_t port;
+	int mapfd;
+	int progfd;
+	int linkfd;
+	struct s_io_xdp_neighbor neighbor[IO_XDP_NEIGHBORS];
+};
+
+
+// Calls the bpf system call.
+static int ioXdpBpf(const int cmd, union bpf_attr *attr) {
+	return syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr));
+}
+
+
+// Adds buf to the ones' complement sum. Returns the new sum.
+static uint32_t ioXdpChecksumAdd(uint32_t sum, const unsigned char *buf, const int len) {
+	int i;
+	for(i=0; (i+1)<len; i+=2) {
+		sum = sum + ((buf[i] << 8) | buf[i+1]);
+	}
+	if(i < len) {
+		sum = sum + (buf[i] << 8);
+	}
+	return sum;
+}
+
+
+// Folds the ones' complement sum. Returns the checksum.
+static uint16_t ioXdpChecksumGet(uint32_t sum) {
+	while(sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+	return (~sum & 0xffff);
+}
+
+
+// Returns the neighbor slot of the remote address key (address type followed by the IP address, without port).
+static struct s_io_xdp_neighbor *ioXdpNeighbor(struct s_io_xdp *xdp, const unsigned char *key) {
+	unsigned int h;
+	int i;
+	h = 0;
+	for(i=0; i<20; i++) {
+		h = (h * 31) + key[i];
+	}
+	return &xdp->neighbor[h % IO_XDP_NEIGHBORS];
+}
+
+
+// Maps an AF_XDP ring. Returns 1 on success.
+static int ioXdpRingMap(struct s_io_xdp_ring *ring, const int fd, const struct xdp_ring_offset *off, const size_t entsize, const off_t pgoff) {
+	unsigned char *map;
+	ring->mapsize = off->desc + (IO_XDP_RINGSIZE * entsize);
+	map = mmap(NULL, ring->mapsize, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), fd, pgoff);
+	if(map == MAP_FAILED) {
+		ring->map = NULL;
+		return 0;
+	}
+	ring->map = map;
+	ring->producer = (uint32_t *)(map + off->producer);
+	ring->consumer = (uint32_t *)(map + off->consumer);
+	ring->desc = (map + off->desc);
+	ring->mask = (IO_XDP_RINGSIZE - 1);
+	return 1;
+}
+
+
+// Loads the XDP program that redirects UDP packets to the port of the AF_XDP state into the socket map. Returns the program file descriptor, or -1 on error.
+static int ioXdpLoadProgram(struct s_io_xdp *xdp) {
+	union bpf_attr attr;
+	struct bpf_insn insns[] = {
+		{ .code = (BPF_LDX | BPF_W | BPF_MEM), .dst_reg = 2, .src_reg = 1, .off = 0 }, // data
+		{ .code = (BPF_LDX | BPF_W | BPF_MEM), .dst_reg = 3, .src_reg = 1, .off = 4 }, // data_end
+		{ .code = (BPF_LDX | BPF_W | BPF_MEM), .dst_reg = 4, .src_reg = 1, .off = 16 }, // rx_queue_index
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_X), .dst_reg = 5, .src_reg = 2 },
+		{ .code = (BPF_ALU64 | BPF_ADD | BPF_K), .dst_reg = 5, .imm = 14 },
+		{ .code = (BPF_JMP | BPF_JGT | BPF_X), .dst_reg = 5, .src_reg = 3, .off = 30 },
+		{ .code = (BPF_LDX | BPF_H | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 12 }, // ethertype
+		{ .code = (BPF_JMP | BPF_JEQ | BPF_K), .dst_reg = 6, .off = 2, .imm = htons(0x0800) },
+		{ .code = (BPF_JMP | BPF_JEQ | BPF_K), .dst_reg = 6, .off = 14, .imm = htons(0x86dd) },
+		{ .code = (BPF_JMP | BPF_JA), .off = 26 },
+		// IPv4 without options, not fragmented
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_X), .dst_reg = 5, .src_reg = 2 },
+		{ .code = (BPF_ALU64 | BPF_ADD | BPF_K), .dst_reg = 5, .imm = 42 },
+		{ .code = (BPF_JMP | BPF_JGT | BPF_X), .dst_reg = 5, .src_reg = 3, .off = 23 },
+		{ .code = (BPF_LDX | BPF_B | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 14 },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 21, .imm = 0x45 },
+		{ .code = (BPF_LDX | BPF_B | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 23 },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 19, .imm = 17 },
+		{ .code = (BPF_LDX | BPF_H | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 20 },
+		{ .code = (BPF_ALU64 | BPF_AND | BPF_K), .dst_reg = 6, .imm = htons(0x3fff) },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 16, .imm = 0 },
+		{ .code = (BPF_LDX | BPF_H | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 36 },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 14, .imm = xdp->port },
+		{ .code = (BPF_JMP | BPF_JA), .off = 7 },
+		// IPv6 without extension headers
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_X), .dst_reg = 5, .src_reg = 2 },
+		{ .code = (BPF_ALU64 | BPF_ADD | BPF_K), .dst_reg = 5, .imm = 62 },
+		{ .code = (BPF_JMP | BPF_JGT | BPF_X), .dst_reg = 5, .src_reg = 3, .off = 10 },
+		{ .code = (BPF_LDX | BPF_B | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 20 },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 8, .imm = 17 },
+		{ .code = (BPF_LDX | BPF_H | BPF_MEM), .dst_reg = 6, .src_reg = 2, .off = 56 },
+		{ .code = (BPF_JMP | BPF_JNE | BPF_K), .dst_reg = 6, .off = 6, .imm = xdp->port },
+		// redirect to the socket of the receiving queue, pass to the kernel if there is none
+		{ .code = (BPF_LD | BPF_DW | BPF_IMM), .dst_reg = 1, .src_reg = BPF_PSEUDO_MAP_FD, .imm = xdp->mapfd },
+		{ .code = 0 },
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_X), .dst_reg = 2, .src_reg = 4 },
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_K), .dst_reg = 3, .imm = XDP_PASS },
+		{ .code = (BPF_JMP | BPF_CALL), .imm = BPF_FUNC_redirect_map },
+		{ .code = (BPF_JMP | BPF_EXIT) },
+		{ .code = (BPF_ALU64 | BPF_MOV | BPF_K), .dst_reg = 0, .imm = XDP_PASS },
+		{ .code = (BPF_JMP | BPF_EXIT) },
+	};
+	const char *license = "GPL";
+
+	memset(&attr, 0, sizeof(union bpf_attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insn_cnt = (sizeof(insns) / sizeof(struct bpf_insn));
+	attr.insns = (uint64_t)(unsigned long)insns;
+	attr.license = (uint64_t)(unsigned long)license;
+	return ioXdpBpf(BPF_PROG_LOAD, &attr);
+}
+
+
+// Lets the kernel send the queued packets of the AF_XDP socket on handle ID and reclaims the sent frames.
+static void ioXdpKick(struct s_io_state *iostate, const int id) {
+	struct s_io_xdp *xdp = iostate->handle[id].xdp;
+	uint32_t cons;
+	uint32_t prod;
+
+	if(xdp->txpending > 0) {
+		sendto(iostate->handle[id].fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+		xdp->txpending = 0;
+	}
+	cons = *xdp->comp.consumer;
+	prod = __atomic_load_n(xdp->comp.producer, __ATOMIC_ACQUIRE);
+	while((cons != prod) && (xdp->txfreecount < (IO_XDP_FRAMES / 2))) {
+		xdp->txfree[xdp->txfreecount] = ((uint64_t *)xdp->comp.desc)[cons & xdp->comp.mask];
+		xdp->txfreecount++;
+		cons++;
+	}
+	__atomic_store_n(xdp->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+
+// Decapsulates the UDP packet in frame and points the content of handle ID to the payload. Returns length of the payload, or 0 if the frame is not valid.
+static int ioXdpDecap(struct s_io_state *iostate, const int id, unsigned char *frame, const int len) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct s_io_xdp *xdp = handle->xdp;
+	struct s_io_xdp_neighbor *neighbor;
+	struct s_io_addr *addr = &handle->source_addr;
+	unsigned char key[20];
+	int udplen;
+
+	memset(addr, 0, sizeof(struct s_io_addr));
+	memset(key, 0, 20);
+	if((len >= 42) && (frame[12] == 0x08) && (frame[13] == 0x00) && (frame[14] == 0x45)) {
+		udplen = ((frame[38] << 8) | frame[39]);
+		if(!((udplen >= 8) && ((34 + udplen) <= len))) return 0;
+		memcpy(&addr->addr[0], IO_ADDRTYPE_UDP4, 4);
+		memcpy(&addr->addr[4], &frame[26], 4);
+		memcpy(&addr->addr[8], &frame[34], 2);
+		memcpy(key, addr->addr, 8);
+		neighbor = ioXdpNeighbor(xdp, key);
+		memcpy(neighbor->local_ip, &frame[30], 4);
+		handle->content = &frame[42];
+	}
+	else if((len >= 62) && (frame[12] == 0x86) && (frame[13] == 0xdd)) {
+		udplen = ((frame[58] << 8) | frame[59]);
+		if(!((udplen >= 8) && ((54 + udplen) <= len))) return 0;
+		memcpy(&addr->addr[0], IO_ADDRTYPE_UDP6, 4);
+		memcpy(&addr->addr[4], &frame[22], 16);
+		memcpy(&addr->addr[20], &frame[54], 2);
+		memcpy(key, addr->addr, 20);
+		neighbor = ioXdpNeighbor(xdp, key);
+		memcpy(neighbor->local_ip, &frame[38], 16);
+		handle->content = &frame[62];
+	}
+	else {
+		return 0;
+	}
+
+	// answer through the same link layer neighbor
+	memcpy(neighbor->addr, key, 20);
+	memcpy(neighbor->remote_mac, &frame[6], 6);
+	memcpy(neighbor->local_mac, &frame[0], 6);
+	neighbor->valid = 1;
+	return (udplen - 8);
+}
+
+
+// Returns the current frame of the AF_XDP socket on handle ID to the kernel and points the content to the payload of the next received packet. Returns length of the payload, or 0 if there is none.
+static int ioXdpNext(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	struct s_io_xdp *xdp = handle->xdp;
+	struct xdp_desc *desc;
+	uint32_t cons;
+	uint32_t fprod;
+	int len;
+
+	while(1) {
+		cons = *xdp->rx.consumer;
+		if(xdp->rxheld) {
+			desc = &((struct xdp_desc *)xdp->rx.desc)[cons & xdp->rx.mask];
+			fprod = *xdp->fill.producer;
+			((uint64_t *)xdp->fill.desc)[fprod & xdp->fill.mask] = (desc->addr & ~((uint64_t)IO_XDP_FRAMESIZE - 1));
+			__atomic_store_n(xdp->fill.producer, (fprod + 1), __ATOMIC_RELEASE);
+			cons++;
+			__atomic_store_n(xdp->rx.consumer, cons, __ATOMIC_RELEASE);
+			xdp->rxheld = 0;
+		}
+		if((xdp->rxcount >= IO_XDP_RXBATCH) || (cons == __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE))) {
+			handle->content = &iostate->mem[id * iostate->bufsize];
+			return 0;
+		}
+		desc = &((struct xdp_desc *)xdp->rx.desc)[cons & xdp->rx.mask];
+		xdp->rxheld = 1;
+		xdp->rxcount++;
+		if((len = ioXdpDecap(iostate, id, &xdp->umem[desc->addr], desc->len)) > 0) {
+			return len;
+		}
+	}
+}
+
+
+// Reads received packets from the AF_XDP socket on handle ID. Returns length of the first payload, or 0 if there is none.
+static int ioXdpRead(struct s_io_state *iostate, const int id) {
+	struct s_io_xdp *xdp = iostate->handle[id].xdp;
+	xdp->rxcount = 0;
+	return ioXdpNext(iostate, id);
+}
+
+
+// Encapsulates the UDP packet and queues it on the AF_XDP socket on handle ID. Only remote addresses that have been received from can be reached. Returns length of the queued packet, or 0 on error.
+static int ioXdpWrite(struct s_io_state *iostate, const int id, const unsigned char *write_buf, const int write_buf_size, const struct s_io_addr *destination_addr) {
+	struct s_io_xdp *xdp = iostate->handle[id].xdp;
+	struct s_io_xdp_neighbor *neighbor;
+	struct xdp_desc *desc;
+	unsigned char key[20];
+	unsigned char *frame;
+	uint64_t addr;
+	uint32_t prod;
+	uint32_t sum;
+	uint16_t csum;
+	int udplen;
+	int hdrlen;
+	int v6;
+
+	if(destination_addr == NULL) return 0;
+	memset(key, 0, 20);
+	if(memcmp(destination_addr->addr, IO_ADDRTYPE_UDP4, 4) == 0) {
+		memcpy(key, destination_addr->addr, 8);
+		hdrlen = 42;
+		v6 = 0;
+	}
+	else if(memcmp(destination_addr->addr, IO_ADDRTYPE_UDP6, 4) == 0) {
+		memcpy(key, destination_addr->addr, 20);
+		hdrlen = 62;
+		v6 = 1;
+	}
+	else {
+		return 0;
+	}
+	neighbor = ioXdpNeighbor(xdp, key);
+	if(!((neighbor->valid) && (memcmp(neighbor->addr, key, 20) == 0))) return 0;
+	if(!((write_buf_size > 0) && ((write_buf_size + hdrlen) <= IO_XDP_FRAMESIZE))) return 0;
+
+	// get a free frame and a free slot in the transmit ring
+	if(xdp->txfreecount < 1) {
+		ioXdpKick(iostate, id);
+		if(xdp->txfreecount < 1) return 0;
+	}
+	prod = *xdp->tx.producer;
+	if((prod - __atomic_load_n(xdp->tx.consumer, __ATOMIC_ACQUIRE)) >= IO_XDP_RINGSIZE) return 0;
+	xdp->txfreecount--;
+	addr = xdp->txfree[xdp->txfreecount];
+	frame = &xdp->umem[addr];
+
+	// ethernet, IP and UDP headers
+	udplen = write_buf_size + 8;
+	memcpy(&frame[0], neighbor->remote_mac, 6);
+	memcpy(&frame[6], neighbor->local_mac, 6);
+	if(v6) {
+		memcpy(&frame[12], "\x86\xdd\x60\x00\x00\x00", 6);
+		frame[14] = (0x60 | (iostate->tos >> 4));
+		frame[15] = ((iostate->tos & 0x0f) << 4);
+		frame[18] = (udplen >> 8);
+		frame[19] = (udplen & 0xff);
+		frame[20] = 17;
+		frame[21] = 64;
+		memcpy(&frame[22], neighbor->local_ip, 16);
+		memcpy(&frame[38], &destination_addr->addr[4], 16);
+		memcpy(&frame[56], &destination_addr->addr[20], 2);
+	}
+	else {
+		memcpy(&frame[12], "\x08\x00\x45\x00", 4);
+		frame[15] = iostate->tos;
+		frame[16] = ((udplen + 20) >> 8);
+		frame[17] = ((udplen + 20) & 0xff);
+		memcpy(&frame[18], "\x00\x00\x40\x00\x40\x11\x00\x00", 8);
+		memcpy(&frame[26], neighbor->local_ip, 4);
+		memcpy(&frame[30], &destination_addr->addr[4], 4);
+		csum = ioXdpChecksumGet(ioXdpChecksumAdd(0, &frame[14], 20));
+		frame[24] = (csum >> 8);
+		frame[25] = (csum & 0xff);
+		memcpy(&frame[36], &destination_addr->addr[8], 2);
+	}
+	memcpy(&frame[hdrlen - 8], &xdp->port, 2);
+	frame[hdrlen - 4] = (udplen >> 8);
+	frame[hdrlen - 3] = (udplen & 0xff);
+	frame[hdrlen - 2] = 0;
+	frame[hdrlen - 1] = 0;
+	memcpy(&frame[hdrlen], write_buf, write_buf_size);
+
+	// UDP checksum over the pseudo header, the addresses are followed by the UDP header
+	sum = ioXdpChecksumAdd((17 + udplen), &frame[(v6) ? 22 : 26], (v6) ? 32 : 8);
+	csum = ioXdpChecksumGet(ioXdpChecksumAdd(sum, &frame[hdrlen - 8], udplen));
+	if(csum == 0) {
+		csum = 0xffff;
+	}
+	frame[hdrlen - 2] = (csum >> 8);
+	frame[hdrlen - 1] = (csum & 0xff);
+
+	desc = &((struct xdp_desc *)xdp->tx.desc)[prod & xdp->tx.mask];
+	desc->addr = addr;
+	desc->len = (write_buf_size + hdrlen);
+	desc->options = 0;
+	__atomic_store_n(xdp->tx.producer, (prod + 1), __ATOMIC_RELEASE);
+	xdp->txpending++;
+	if(xdp->txpending >= IO_XDP_TXBATCH) {
+		ioXdpKick(iostate, id);
+	}
+	return write_buf_size;
+}
+
+
+// Detaches the XDP program and unmaps the AF_XDP rings on handle ID.
+static void ioXdpClose(struct s_io_state *iostate, const int id) {
+	struct s_io_xdp *xdp = iostate->handle[id].xdp;
+	if(xdp != NULL) {
+		if(xdp->linkfd >= 0) close(xdp->linkfd);
+		if(xdp->progfd >= 0) close(xdp->progfd);
+		if(xdp->mapfd >= 0) close(xdp->mapfd);
+		if(xdp->rx.map != NULL) munmap(xdp->rx.map, xdp->rx.mapsize);
+		if(xdp->tx.map != NULL) munmap(xdp->tx.map, xdp->tx.mapsize);
+		if(xdp->fill.map != NULL) munmap(xdp->fill.map, xdp->fill.mapsize);
+		if(xdp->comp.map != NULL) munmap(xdp->comp.map, xdp->comp.mapsize);
+		if(xdp->umem != NULL) munmap(xdp->umem, xdp->umemsize);
+		free(xdp);
+		iostate->handle[id].xdp = NULL;
+		iostate->handle[id].content_len = 0;
+	}
+}
+#endif
+
+
 // Closes a handle ID.
 void ioClose(struct s_io_state *iostate, const int id) {
 	if(id >= 0 && id < iostate->max) {
 		if(iostate->handle[id].enabled) {
+#if defined(IO_URING)
+			ioUringClose(iostate, id);
+#endif
+#if defined(IO_PACKETRING)
+			ioPacketRingClose(iostate, id);
+#endif
+#if defined(IO_XDP)
+			ioXdpClose(iostate, id);
+#endif
 			if(iostate->handle[id].open) {
 				close(iostate->handle[id].fd);
 				iostate->handle[id].open = 0;
 			}
+			free(iostate->handle[id].udpgsobuf);
+			free(iostate->handle[id].udpgrobuf);
 #if defined(IO_WINDOWS)
 			if(iostate->handle[id].open_h) {
 				CloseHandle(iostate->handle[id].fd_h);
@@ -208,6 +1180,29 @@ void ioClose(struct s_io_state *iostate, const int id) {
 }
 
 
+#if defined(IO_UDPOFFLOAD)
+// Enables UDP segmentation and receive coalescing on socket handle ID, each one only if the kernel supports it.
+static void ioUdpOffloadOpen(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	socklen_t so_len;
+	int so;
+
+	so = 0;
+	so_len = sizeof(int);
+	if(getsockopt(handle->fd, SOL_UDP, UDP_SEGMENT, (void *)&so, &so_len) == 0) {
+		handle->udpgsobuf = malloc(IO_UDPGSO_BUFSIZE);
+	}
+	so = 1;
+	if(setsockopt(handle->fd, SOL_UDP, UDP_GRO, (void *)&so, sizeof(int)) == 0) {
+		if((handle->udpgrobuf = malloc(IO_UDPGRO_BUFSIZE)) == NULL) {
+			so = 0;
+			setsockopt(handle->fd, SOL_UDP, UDP_GRO, (void *)&so, sizeof(int));
+		}
+	}
+}
+#endif
+
+
 // Opens a socket. Returns handle ID if successful, or -1 on error.
 int ioOpenSocket(struct s_io_state *iostate, const int iotype, const char *bindaddress, const char *bindport, const int domain, const int type, const int protocol) {
 	int id;
@@ -237,6 +1232,17 @@ int ioOpenSocket(struct s_io_state *iostate, const int iotype, const char *binda
 	if(domain == AF_INET6) {
 		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (void *)&so, sizeof(int));
 	}
+#endif
+#if defined(IO_RECVERR)
+	so = 1;
+	if(iostate->recverr > 0) {
+		if(domain == AF_INET6) {
+			setsockopt(fd, IPPROTO_IPV6, IPV6_RECVERR, (void *)&so, sizeof(int));
+		}
+		else {
+			setsockopt(fd, IPPROTO_IP, IP_RECVERR, (void *)&so, sizeof(int));
+		}
+	}
 #endif
 	so = iostate->sockmark;
 	if(so > 0) {
@@ -319,6 +1325,12 @@ int ioOpenSocket(struct s_io_state *iostate, const int iotype, const char *binda
 	iostate->handle[id].type = iotype;
 	iostate->handle[id].open = 1;
 
+#if defined(IO_UDPOFFLOAD)
+	if(iostate->udpoffload > 0) {
+		ioUdpOffloadOpen(iostate, id);
+	}
+#endif
+
 	return id;
 }
 
@@ -520,8 +1532,8 @@ HANDLE ioOpenTAPWINHandle(char *tapname, const char *reqname, const int reqname_
 #endif
 
 
-// Opens a TAP device. Returns handle ID if succesful, or -1 on error.
-int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
+// Opens a TAP device, or a TUN device if tun is set. Returns handle ID if succesful, or -1 on error.
+int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname, const int tun) {
 	int id;
 	int tapfd;
 	char filename[512];
@@ -536,6 +1548,7 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 #if defined(IO_LINUX)
 
 	struct ifreq ifr;
+	int vnethdr_size;
 
 	memcpy(filename, "/dev/net/tun", 12);
 	tapfd = open(filename,(O_RDWR | O_NONBLOCK));
@@ -545,7 +1558,10 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 	}
 
 	memset(&ifr,0,sizeof(struct ifreq));
-	ifr.ifr_flags = (IFF_TAP | IFF_NO_PI);
+	ifr.ifr_flags = (((tun) ? IFF_TUN : IFF_TAP) | IFF_NO_PI);
+	if(iostate->offload) {
+		ifr.ifr_flags |= IFF_VNET_HDR;
+	}
 	if(req_len > 0) {
 		if(req_len < IFNAMSIZ) {
 			memcpy(ifr.ifr_name, reqname, req_len);
@@ -566,6 +1582,20 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 		return -1;
 	}
 
+	if(iostate->offload) {
+		// let the kernel pass TSO superframes and partial checksums, segmentation is done before encryption
+		vnethdr_size = IO_VNETHDR_SIZE;
+		if(ioctl(tapfd, TUNSETVNETHDRSZ, &vnethdr_size) < 0) {
+			close(tapfd);
+			ioDeallocID(iostate, id);
+			return -1;
+		}
+		if(ioctl(tapfd, TUNSETOFFLOAD, (TUN_F_CSUM | TUN_F_TSO4 | TUN_F_TSO6 | TUN_F_TSO_ECN)) < 0) {
+			ioctl(tapfd, TUNSETOFFLOAD, 0);
+		}
+		iostate->handle[id].vnethdr = 1;
+	}
+
 	if(tapname != NULL) {
 		name_len = ioStrlen(ifr.ifr_name, (IFNAMSIZ-1));
 		tapname[0] = '\0';
@@ -595,7 +1625,7 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 		}
 	}
 	else {
-		memcpy(&filename[5], "tap", 3);
+		memcpy(&filename[5], ((tun) ? "tun" : "tap"), 3);
 		i = 0;
 		while((i < 10) && (tapfd < 0)) {
 			filename[8] = (i + 48);
@@ -635,6 +1665,11 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 	char tmpname[256];
 	HANDLE handle;
 
+	if(tun) {
+		// TUN mode of the TAP-Windows driver requires the interface addresses in advance
+		return -1;
+	}
+
 	memset(tmpname, 0, 256);
 	handle = ioOpenTAPWINHandle(tmpname, reqname, req_len);
 	if(handle == INVALID_HANDLE_VALUE) {
@@ -645,29 +1680,265 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 		CloseHandle(handle);
 		return -1;
 	}
-
-	if(tapname != NULL) {
-		name_len = ioStrlen(tmpname, 255);
-		tapname[0] = '\0';
-		if(name_len > 0 && name_len < 255) {
-			memcpy(tapname, tmpname, name_len);
-			tapname[name_len] = '\0';
+
+	if(tapname != NULL) {
+		name_len = ioStrlen(tmpname, 255);
+		tapname[0] = '\0';
+		if(name_len > 0 && name_len < 255) {
+			memcpy(tapname, tmpname, name_len);
+			tapname[name_len] = '\0';
+		}
+	}
+
+	iostate->handle[id].fd_h = handle;
+	iostate->handle[id].open_h = 1;
+
+#else
+
+	#error not implemented
+	return -1;
+
+#endif
+
+	iostate->handle[id].fd = tapfd;
+	iostate->handle[id].type = IO_TYPE_FILE;
+	return id;
+}
+
+
+// Attaches to the existing network interface reqname with memory-mapped AF_PACKET rings, frames are read and written like on a TAP device. Returns handle ID if succesful, or -1 on error.
+int ioOpenPacketRing(struct s_io_state *iostate, char *ifname, const char *reqname) {
+#if defined(IO_PACKETRING)
+	struct s_io_packetring *ring;
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	struct packet_mreq mreq;
+	unsigned char *map;
+	size_t rxsize;
+	size_t txsize;
+	int ifindex;
+	int version;
+	int req_len;
+	int fd;
+	int id;
+
+	req_len = ioStrlen(reqname, 255);
+	if(!((req_len > 0) && (req_len < IFNAMSIZ))) {
+		return -1;
+	}
+	if((ifindex = if_nametoindex(reqname)) == 0) {
+		return -1;
+	}
+	if((fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
+		return -1;
+	}
+
+	// block mode receive ring, frame mode transmit ring
+	version = TPACKET_V3;
+	rxsize = (size_t)IO_PACKET_BLOCKSIZE * IO_PACKET_BLOCKNR;
+	txsize = (size_t)IO_PACKET_BLOCKSIZE * IO_PACKET_TXBLOCKNR;
+	map = MAP_FAILED;
+	if(setsockopt(fd, SOL_PACKET, PACKET_VERSION, (void *)&version, sizeof(int)) == 0) {
+		memset(&req, 0, sizeof(struct tpacket_req3));
+		req.tp_block_size = IO_PACKET_BLOCKSIZE;
+		req.tp_block_nr = IO_PACKET_BLOCKNR;
+		req.tp_frame_size = IO_PACKET_FRAMESIZE;
+		req.tp_frame_nr = (IO_PACKET_BLOCKSIZE / IO_PACKET_FRAMESIZE) * IO_PACKET_BLOCKNR;
+		req.tp_retire_blk_tov = IO_PACKET_TIMEOUT;
+		if(setsockopt(fd, SOL_PACKET, PACKET_RX_RING, (void *)&req, sizeof(struct tpacket_req3)) == 0) {
+			memset(&req, 0, sizeof(struct tpacket_req3));
+			req.tp_block_size = IO_PACKET_BLOCKSIZE;
+			req.tp_block_nr = IO_PACKET_TXBLOCKNR;
+			req.tp_frame_size = IO_PACKET_FRAMESIZE;
+			req.tp_frame_nr = (IO_PACKET_BLOCKSIZE / IO_PACKET_FRAMESIZE) * IO_PACKET_TXBLOCKNR;
+			if(setsockopt(fd, SOL_PACKET, PACKET_TX_RING, (void *)&req, sizeof(struct tpacket_req3)) == 0) {
+				map = mmap(NULL, (rxsize + txsize), (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+			}
+		}
+	}
+	if(map == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	// bind to the interface and receive frames for all addresses
+	memset(&sll, 0, sizeof(struct sockaddr_ll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+	memset(&mreq, 0, sizeof(struct packet_mreq));
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_PROMISC;
+	if((bind(fd, (struct sockaddr *)&sll, sizeof(struct sockaddr_ll)) < 0) || (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, (void *)&mreq, sizeof(struct packet_mreq)) < 0) || (fcntl(fd, F_SETFL, O_NONBLOCK) < 0)) {
+		munmap(map, (rxsize + txsize));
+		close(fd);
+		return -1;
+	}
+
+	if((ring = malloc(sizeof(struct s_io_packetring))) == NULL) {
+		munmap(map, (rxsize + txsize));
+		close(fd);
+		return -1;
+	}
+	if((id = ioAllocID(iostate)) < 0) {
+		free(ring);
+		munmap(map, (rxsize + txsize));
+		close(fd);
+		return -1;
+	}
+
+	memset(ring, 0, sizeof(struct s_io_packetring));
+	ring->map = map;
+	ring->mapsize = (rxsize + txsize);
+	ring->txmem = &map[rxsize];
+	ring->txframes = (IO_PACKET_BLOCKSIZE / IO_PACKET_FRAMESIZE) * IO_PACKET_TXBLOCKNR;
+	iostate->handle[id].fd = fd;
+	iostate->handle[id].type = IO_TYPE_PACKET;
+	iostate->handle[id].open = 1;
+	iostate->handle[id].packetring = ring;
+
+	if(ifname != NULL) {
+		memcpy(ifname, reqname, req_len);
+		ifname[req_len] = '\0';
+	}
+
+	return id;
+#else
+	return -1;
+#endif
+}
+
+
+// Attaches an AF_XDP socket in copy mode to queue of network interface ifname and steers UDP packets to port into it. Returns handle ID if succesful, or -1 on error.
+int ioOpenXDP(struct s_io_state *iostate, const char *ifname, const int queue, const char *port) {
+#if defined(IO_XDP)
+	struct s_io_xdp *xdp;
+	struct xdp_umem_reg umemreg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp sxdp;
+	union bpf_attr attr;
+	socklen_t optlen;
+	unsigned int ifindex;
+	int ringsize;
+	int portnum;
+	int ok;
+	int fd;
+	int id;
+	int i;
+
+	if(!((ioStrlen(ifname, 255) > 0) && (ioStrlen(ifname, 255) < IFNAMSIZ))) return -1;
+	if((ifindex = if_nametoindex(ifname)) == 0) return -1;
+	if(!((queue >= 0) && (queue < IO_XDP_MAXQUEUE))) return -1;
+	portnum = atoi(port);
+	if(!((portnum > 0) && (portnum < 65536))) return -1;
+	if((fd = socket(AF_XDP, SOCK_RAW, 0)) < 0) return -1;
+	if((xdp = malloc(sizeof(struct s_io_xdp))) == NULL) {
+		close(fd);
+		return -1;
+	}
+	memset(xdp, 0, sizeof(struct s_io_xdp));
+	xdp->mapfd = -1;
+	xdp->progfd = -1;
+	xdp->linkfd = -1;
+	xdp->port = htons(portnum);
+
+	// register the UMEM and map the rings
+	ok = 0;
+	xdp->umemsize = ((size_t)IO_XDP_FRAMES * IO_XDP_FRAMESIZE);
+	xdp->umem = mmap(NULL, xdp->umemsize, (PROT_READ | PROT_WRITE), (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
+	if(xdp->umem != MAP_FAILED) {
+		memset(&umemreg, 0, sizeof(struct xdp_umem_reg));
+		umemreg.addr = (uint64_t)(unsigned long)xdp->umem;
+		umemreg.len = xdp->umemsize;
+		umemreg.chunk_size = IO_XDP_FRAMESIZE;
+		ringsize = IO_XDP_RINGSIZE;
+		optlen = sizeof(struct xdp_mmap_offsets);
+		if((setsockopt(fd, SOL_XDP, XDP_UMEM_REG, (void *)&umemreg, sizeof(struct xdp_umem_reg)) == 0)
+		&& (setsockopt(fd, SOL_XDP, XDP_UMEM_FILL_RING, (void *)&ringsize, sizeof(int)) == 0)
+		&& (setsockopt(fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, (void *)&ringsize, sizeof(int)) == 0)
+		&& (setsockopt(fd, SOL_XDP, XDP_RX_RING, (void *)&ringsize, sizeof(int)) == 0)
+		&& (setsockopt(fd, SOL_XDP, XDP_TX_RING, (void *)&ringsize, sizeof(int)) == 0)
+		&& (getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, (void *)&off, &optlen) == 0)) {
+			ok = (ioXdpRingMap(&xdp->rx, fd, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING)
+			&& ioXdpRingMap(&xdp->tx, fd, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING)
+			&& ioXdpRingMap(&xdp->fill, fd, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING)
+			&& ioXdpRingMap(&xdp->comp, fd, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING));
 		}
 	}
+	else {
+		xdp->umem = NULL;
+	}
 
-	iostate->handle[id].fd_h = handle;
-	iostate->handle[id].open_h = 1;
-
-#else
+	// hand the receive frames to the kernel, keep the transmit frames
+	if(ok) {
+		for(i=0; i<(IO_XDP_FRAMES / 2); i++) {
+			((uint64_t *)xdp->fill.desc)[i & xdp->fill.mask] = ((uint64_t)i * IO_XDP_FRAMESIZE);
+			xdp->txfree[i] = ((uint64_t)(i + (IO_XDP_FRAMES / 2)) * IO_XDP_FRAMESIZE);
+		}
+		__atomic_store_n(xdp->fill.producer, (IO_XDP_FRAMES / 2), __ATOMIC_RELEASE);
+		xdp->txfreecount = (IO_XDP_FRAMES / 2);
+
+		// copy mode works with every driver
+		memset(&sxdp, 0, sizeof(struct sockaddr_xdp));
+		sxdp.sxdp_family = AF_XDP;
+		sxdp.sxdp_ifindex = ifindex;
+		sxdp.sxdp_queue_id = queue;
+		sxdp.sxdp_flags = XDP_COPY;
+		ok = (bind(fd, (struct sockaddr *)&sxdp, sizeof(struct sockaddr_xdp)) == 0);
+	}
+
+	// create the socket map, load the program and attach it, native mode is tried first
+	if(ok) {
+		memset(&attr, 0, sizeof(union bpf_attr));
+		attr.map_type = BPF_MAP_TYPE_XSKMAP;
+		attr.key_size = sizeof(int);
+		attr.value_size = sizeof(int);
+		attr.max_entries = IO_XDP_MAXQUEUE;
+		ok = ((xdp->mapfd = ioXdpBpf(BPF_MAP_CREATE, &attr)) >= 0);
+	}
+	if(ok) {
+		i = queue;
+		memset(&attr, 0, sizeof(union bpf_attr));
+		attr.map_fd = xdp->mapfd;
+		attr.key = (uint64_t)(unsigned long)&i;
+		attr.value = (uint64_t)(unsigned long)&fd;
+		ok = ((ioXdpBpf(BPF_MAP_UPDATE_ELEM, &attr) == 0) && ((xdp->progfd = ioXdpLoadProgram(xdp)) >= 0));
+	}
+	if(ok) {
+		memset(&attr, 0, sizeof(union bpf_attr));
+		attr.link_create.prog_fd = xdp->progfd;
+		attr.link_create.target_ifindex = ifindex;
+		attr.link_create.attach_type = BPF_XDP;
+		attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+		if((xdp->linkfd = ioXdpBpf(BPF_LINK_CREATE, &attr)) < 0) {
+			attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+			xdp->linkfd = ioXdpBpf(BPF_LINK_CREATE, &attr);
+		}
+		ok = (xdp->linkfd >= 0);
+	}
 
-	#error not implemented
-	return -1;
+	if(ok) {
+		if((id = ioAllocID(iostate)) >= 0) {
+			iostate->handle[id].fd = fd;
+			iostate->handle[id].type = IO_TYPE_XDP;
+			iostate->handle[id].open = 1;
+			iostate->handle[id].xdp = xdp;
+			return id;
+		}
+	}
 
+	if(xdp->linkfd >= 0) close(xdp->linkfd);
+	if(xdp->progfd >= 0) close(xdp->progfd);
+	if(xdp->mapfd >= 0) close(xdp->mapfd);
+	if(xdp->rx.map != NULL) munmap(xdp->rx.map, xdp->rx.mapsize);
+	if(xdp->tx.map != NULL) munmap(xdp->tx.map, xdp->tx.mapsize);
+	if(xdp->fill.map != NULL) munmap(xdp->fill.map, xdp->fill.mapsize);
+	if(xdp->comp.map != NULL) munmap(xdp->comp.map, xdp->comp.mapsize);
+	if(xdp->umem != NULL) munmap(xdp->umem, xdp->umemsize);
+	free(xdp);
+	close(fd);
 #endif
-
-	iostate->handle[id].fd = tapfd;
-	iostate->handle[id].type = IO_TYPE_FILE;
-	return id;
+	return -1;
 }
 
 
@@ -781,11 +2052,35 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 #endif
 
 
-// Sends an UDP packet. Returns length of sent message.
- int ioHelperSendTo(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len) {
+// Sends an UDP packet. If tos is set, it is used as IPv4 TOS or IPv6 traffic class of the packet. Returns length of sent message.
+ int ioHelperSendTo(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos) {
 	int len;
 
-#if defined(IO_LINUX) || defined(IO_BSD)
+#if defined(IO_LINUX)
+
+	union { struct cmsghdr align; unsigned char buf[CMSG_SPACE(sizeof(int))]; } control;
+	struct msghdr msg;
+	struct iovec iov;
+
+	if(tos > 0) {
+		iov.iov_base = (void *)send_buf;
+		iov.iov_len = send_buf_size;
+		memset(&msg, 0, sizeof(struct msghdr));
+		memset(&control, 0, sizeof(control));
+		msg.msg_name = (void *)destination_sockaddr;
+		msg.msg_namelen = destination_sockaddr_len;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		msg.msg_controllen = ioHelperSetTOS(CMSG_FIRSTHDR(&msg), destination_sockaddr, tos);
+		len = sendmsg(handle->fd, &msg, 0);
+	}
+	else {
+		len = sendto(handle->fd, send_buf, send_buf_size, 0, destination_sockaddr, destination_sockaddr_len);
+	}
+
+#elif defined(IO_BSD)
 
 	len = sendto(handle->fd, send_buf, send_buf_size, 0, destination_sockaddr, destination_sockaddr_len);
 
@@ -832,6 +2127,107 @@ int ioOpenTAP(struct s_io_state *iostate, char *tapname, const char *reqname) {
 }
 
 
+#if defined(IO_LINUX)
+// Receives UDP packets that the kernel may have coalesced, the size of the coalesced packets is stored in segment_size. Returns length of received data.
+int ioHelperRecvFromGRO(struct s_io_handle *handle, unsigned char *recv_buf, const int recv_buf_size, struct sockaddr *source_sockaddr, socklen_t *source_sockaddr_len, int *segment_size) {
+	union { struct cmsghdr align; unsigned char buf[CMSG_SPACE(sizeof(int))]; } control;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	int len;
+#if defined(IO_UDPOFFLOAD)
+	int gso;
+#endif
+
+	iov.iov_base = recv_buf;
+	iov.iov_len = recv_buf_size;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_name = source_sockaddr;
+	msg.msg_namelen = *source_sockaddr_len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	len = recvmsg(handle->fd, &msg, 0);
+	if((len > 0) && !(msg.msg_flags & MSG_TRUNC)) {
+		*source_sockaddr_len = msg.msg_namelen;
+		*segment_size = len;
+		for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+#if defined(IO_UDPOFFLOAD)
+			if((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO) && (cmsg->cmsg_len >= CMSG_LEN(sizeof(int)))) {
+				memcpy(&gso, CMSG_DATA(cmsg), sizeof(int));
+				if((gso > 0) && (gso < len)) {
+					*segment_size = gso;
+				}
+			}
+#endif
+		}
+		return len;
+	}
+	else {
+		return 0;
+	}
+}
+
+
+// Sends UDP packets of segment_size bytes each (the last one may be shorter) with a single system call. If tos is set, it is used for all packets. Returns length of sent data.
+int ioHelperSendSegments(struct s_io_handle *handle, const unsigned char *send_buf, const int send_buf_size, const int segment_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos) {
+	int len;
+	int pos;
+	int seg;
+
+#if defined(IO_UDPOFFLOAD)
+	union { struct cmsghdr align; unsigned char buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(int))]; } control;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	uint16_t gso;
+
+	if(send_buf_size > segment_size) {
+		iov.iov_base = (void *)send_buf;
+		iov.iov_len = send_buf_size;
+		memset(&msg, 0, sizeof(struct msghdr));
+		memset(&control, 0, sizeof(control));
+		msg.msg_name = (void *)destination_sockaddr;
+		msg.msg_namelen = destination_sockaddr_len;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		gso = segment_size;
+		memcpy(CMSG_DATA(cmsg), &gso, sizeof(uint16_t));
+		msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+		if(tos > 0) {
+			msg.msg_controllen = sizeof(control.buf);
+			msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t)) + ioHelperSetTOS(CMSG_NXTHDR(&msg, cmsg), destination_sockaddr, tos);
+		}
+		if((len = sendmsg(handle->fd, &msg, 0)) > 0) {
+			return len;
+		}
+	}
+#endif
+
+	// the kernel refused the segmentation (e.g. segment_size exceeds the path MTU), send the packets one by one
+	len = 0;
+	pos = 0;
+	while(pos < send_buf_size) {
+		seg = send_buf_size - pos;
+		if(seg > segment_size) {
+			seg = segment_size;
+		}
+		len = len + ioHelperSendTo(handle, &send_buf[pos], seg, destination_sockaddr, destination_sockaddr_len, tos);
+		pos = pos + seg;
+	}
+	return len;
+}
+#endif
+
+
 // Reads from file. Returns amount of bytes read, or 0 if nothing is read.
 int ioHelperReadFile(struct s_io_handle *handle, unsigned char *read_buf, const int read_buf_size) {
 	int len;
@@ -902,11 +2298,31 @@ int ioHelperFinishReadFile(struct s_io_handle *handle) {
 #endif
 
 
-// Writes to file. Returns amount of bytes written.
-int ioHelperWriteFile(struct s_io_handle *handle, const unsigned char *write_buf, const int write_buf_size) {
+// Writes to file. If the handle expects a virtio-net header, vnethdr is prepended, or an empty header if vnethdr is NULL. Returns amount of bytes written.
+int ioHelperWriteFile(struct s_io_handle *handle, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size) {
 	int len;
 
-#if defined(IO_LINUX) || defined(IO_BSD)
+#if defined(IO_LINUX)
+
+	unsigned char emptyhdr[IO_VNETHDR_SIZE];
+	struct iovec iov[2];
+
+	if(handle->vnethdr) {
+		if(vnethdr == NULL) {
+			memset(emptyhdr, 0, IO_VNETHDR_SIZE);
+			vnethdr = emptyhdr;
+		}
+		iov[0].iov_base = (void *)vnethdr;
+		iov[0].iov_len = IO_VNETHDR_SIZE;
+		iov[1].iov_base = (void *)write_buf;
+		iov[1].iov_len = write_buf_size;
+		len = writev(handle->fd, iov, 2) - IO_VNETHDR_SIZE;
+	}
+	else {
+		len = write(handle->fd, write_buf, write_buf_size);
+	}
+
+#elif defined(IO_BSD)
 
 	len = write(handle->fd, write_buf, write_buf_size);
 
@@ -948,6 +2364,40 @@ int ioHelperWriteFile(struct s_io_handle *handle, const unsigned char *write_buf
 }
 
 
+#if defined(IO_UDPOFFLOAD)
+// Points the content of socket handle ID to the next of the coalesced UDP packets. Returns its length, or 0 if all packets have been read.
+static int ioNextGRO(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	int len;
+
+	len = handle->udpgrolen - handle->udpgropos;
+	if(len > 0) {
+		if(len > handle->udpgrosize) {
+			len = handle->udpgrosize;
+		}
+		handle->content = &handle->udpgrobuf[handle->udpgropos];
+		handle->udpgropos = handle->udpgropos + len;
+		return len;
+	}
+	else {
+		handle->content = &iostate->mem[id * iostate->bufsize];
+		handle->udpgrolen = 0;
+		handle->udpgropos = 0;
+		return 0;
+	}
+}
+
+
+// Receives coalesced UDP packets on socket handle ID. Returns length of the first packet.
+static int ioPreReadGRO(struct s_io_state *iostate, const int id, socklen_t sockaddr_len) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	handle->udpgrolen = ioHelperRecvFromGRO(handle, handle->udpgrobuf, IO_UDPGRO_BUFSIZE, (struct sockaddr *)&handle->source_sockaddr, &sockaddr_len, &handle->udpgrosize);
+	handle->udpgropos = 0;
+	return ioNextGRO(iostate, id);
+}
+#endif
+
+
 // Prepares read operation on specified handle ID.
 void ioPreRead(struct s_io_state *iostate, const int id) {
 	int ret;
@@ -955,19 +2405,46 @@ void ioPreRead(struct s_io_state *iostate, const int id) {
 	switch(iostate->handle[id].type) {
 		case IO_TYPE_SOCKET_V6:
 			sockaddr_len = sizeof(struct sockaddr_in6);
+#if defined(IO_UDPOFFLOAD)
+			if(iostate->handle[id].udpgrobuf != NULL) {
+				ret = ioPreReadGRO(iostate, id, sockaddr_len);
+				break;
+			}
+#endif
 			ret = ioHelperRecvFrom(&iostate->handle[id], &iostate->mem[id * iostate->bufsize], iostate->bufsize, (struct sockaddr *)&iostate->handle[id].source_sockaddr, &sockaddr_len);
 			break;
 		case IO_TYPE_SOCKET_V4:
 			sockaddr_len = sizeof(struct sockaddr_in);
+#if defined(IO_UDPOFFLOAD)
+			if(iostate->handle[id].udpgrobuf != NULL) {
+				ret = ioPreReadGRO(iostate, id, sockaddr_len);
+				break;
+			}
+#endif
 			ret = ioHelperRecvFrom(&iostate->handle[id], &iostate->mem[id * iostate->bufsize], iostate->bufsize, (struct sockaddr *)&iostate->handle[id].source_sockaddr, &sockaddr_len);
 			break;
 		case IO_TYPE_FILE:
 			ret = ioHelperReadFile(&iostate->handle[id], &iostate->mem[id * iostate->bufsize], iostate->bufsize);
 			break;
+#if defined(IO_PACKETRING)
+		case IO_TYPE_PACKET:
+			ret = ioPacketRingRead(iostate, id);
+			break;
+#endif
+#if defined(IO_XDP)
+		case IO_TYPE_XDP:
+			ret = ioXdpRead(iostate, id);
+			break;
+#endif
 		default:
 			ret = 0;
 			break;
 	}
+#if defined(IO_RECVERR)
+	if((ret <= 0) && (iostate->recverr) && ((iostate->handle[id].type == IO_TYPE_SOCKET_V6) || (iostate->handle[id].type == IO_TYPE_SOCKET_V4))) {
+		ioRecvErrors(iostate, id); // drain the error queue, it keeps the socket readable
+	}
+#endif
 	iostate->handle[id].content_len = ret;
 }
 
@@ -1013,14 +2490,22 @@ int ioReadAll(struct s_io_state *iostate) {
 	int ret;
 	int i;
 
+	ioFlush(iostate);
+
+#if defined(IO_URING)
+	if(iostate->uring != NULL) {
+		return ioUringReadAll(iostate);
+	}
+#endif
+
 #if defined(IO_LINUX) || defined(IO_BSD)
 
 	fd_set fdset;
 	struct timeval seltimeout;
 	int fd, fdh;
 
-	seltimeout.tv_sec = iostate->timeout;
-	seltimeout.tv_usec = 0;
+	seltimeout.tv_sec = (iostate->timeout / 1000);
+	seltimeout.tv_usec = ((iostate->timeout % 1000) * 1000);
 
 	fdh = 0;
 	FD_ZERO(&fdset);
@@ -1068,7 +2553,7 @@ int ioReadAll(struct s_io_state *iostate) {
 
 	ret = 0;
 	if(fdc > 0) {
-		WaitForMultipleObjects(fdc, events, FALSE, (iostate->timeout * 1000));
+		WaitForMultipleObjects(fdc, events, FALSE, iostate->timeout);
 		for(i=0; i<iostate->max; i++) {
 			if(ioRead(iostate, i) > 0) {
 				ret++;
@@ -1076,7 +2561,7 @@ int ioReadAll(struct s_io_state *iostate) {
 		}
 	}
 	else {
-		Sleep(iostate->timeout * 1000);
+		Sleep(iostate->timeout);
 	}
 
 #else
@@ -1090,6 +2575,105 @@ int ioReadAll(struct s_io_state *iostate) {
 }
 
 
+// Sends an UDP packet on handle ID, the packet is queued if the io_uring backend is enabled. Returns length of sent message.
+static int ioSubmitSendTo(struct s_io_state *iostate, const int id, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len, const int tos) {
+#if defined(IO_URING)
+	int ret;
+	if(iostate->uring != NULL) {
+		if((ret = ioUringWrite(iostate, id, NULL, send_buf, send_buf_size, destination_sockaddr, destination_sockaddr_len, tos)) > 0) return ret;
+		io_uring_submit(&((struct s_io_uring *)iostate->uring)->ring); // no free write slot, send synchronously
+	}
+#endif
+	return ioHelperSendTo(&iostate->handle[id], send_buf, send_buf_size, destination_sockaddr, destination_sockaddr_len, tos);
+}
+
+
+// Writes to file on handle ID, the write is queued if the io_uring backend is enabled. Returns amount of bytes written.
+static int ioSubmitWriteFile(struct s_io_state *iostate, const int id, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size) {
+#if defined(IO_URING)
+	int ret;
+	if(iostate->uring != NULL) {
+		if((ret = ioUringWrite(iostate, id, vnethdr, write_buf, write_buf_size, NULL, 0, 0)) > 0) return ret;
+		io_uring_submit(&((struct s_io_uring *)iostate->uring)->ring); // no free write slot, write synchronously
+	}
+#endif
+	return ioHelperWriteFile(&iostate->handle[id], vnethdr, write_buf, write_buf_size);
+}
+
+
+// Sends the queued UDP packets and packet ring frames of handle ID.
+static void ioFlushID(struct s_io_state *iostate, const int id) {
+	struct s_io_handle *handle = &iostate->handle[id];
+	int ret;
+
+#if defined(IO_PACKETRING)
+	if((handle->packetring != NULL) && (((struct s_io_packetring *)handle->packetring)->txpending > 0)) {
+		ioPacketRingKick(iostate, id);
+	}
+#endif
+#if defined(IO_XDP)
+	if((handle->xdp != NULL) && (((struct s_io_xdp *)handle->xdp)->txpending > 0)) {
+		ioXdpKick(iostate, id);
+	}
+#endif
+	if(handle->udpgsolen > 0) {
+#if defined(IO_LINUX)
+		if(handle->udpgsocount > 1) {
+			ret = ioHelperSendSegments(handle, handle->udpgsobuf, handle->udpgsolen, handle->udpgsosize, (struct sockaddr *)&handle->udpgsoaddr, handle->udpgsoaddr_len, handle->udpgsotos);
+		}
+		else
+#endif
+		{
+			ret = ioSubmitSendTo(iostate, id, handle->udpgsobuf, handle->udpgsolen, (struct sockaddr *)&handle->udpgsoaddr, handle->udpgsoaddr_len, handle->udpgsotos);
+		}
+		if(!(ret > 0)) {
+			debug("could not send packet!");
+		}
+		handle->udpgsolen = 0;
+		handle->udpgsocount = 0;
+	}
+}
+
+
+// Sends the queued UDP packets and packet ring frames of all handles.
+void ioFlush(struct s_io_state *iostate) {
+	int i;
+	for(i=0; i<iostate->max; i++) {
+		if(iostate->handle[i].enabled) {
+			ioFlushID(iostate, i);
+		}
+	}
+}
+
+
+// Sends an UDP packet on handle ID. If UDP segmentation is enabled, packets of the same size and traffic class to the same destination are queued and sent with a single system call by the next ioFlush. Returns length of the queued or sent message.
+static int ioQueueSendTo(struct s_io_state *iostate, const int id, const unsigned char *send_buf, const int send_buf_size, const struct sockaddr *destination_sockaddr, const socklen_t destination_sockaddr_len) {
+	struct s_io_handle *handle = &iostate->handle[id];
+
+	if((handle->udpgsobuf == NULL) || !(send_buf_size > 0) || (send_buf_size > IO_UDPGSO_BUFSIZE) || (destination_sockaddr_len > sizeof(struct sockaddr_storage))) {
+		return ioSubmitSendTo(iostate, id, send_buf, send_buf_size, destination_sockaddr, destination_sockaddr_len, iostate->tos);
+	}
+
+	// only the last packet of a queue may be shorter than the others
+	if(handle->udpgsolen > 0) {
+		if(!((handle->udpgsoaddr_len == destination_sockaddr_len) && (memcmp(&handle->udpgsoaddr, destination_sockaddr, destination_sockaddr_len) == 0) && (handle->udpgsotos == iostate->tos) && (send_buf_size <= handle->udpgsosize) && ((handle->udpgsolen % handle->udpgsosize) == 0) && (handle->udpgsocount < IO_UDPGSO_MAXSEGS) && ((handle->udpgsolen + send_buf_size) <= IO_UDPGSO_BUFSIZE))) {
+			ioFlushID(iostate, id);
+		}
+	}
+	if(handle->udpgsolen == 0) {
+		memcpy(&handle->udpgsoaddr, destination_sockaddr, destination_sockaddr_len);
+		handle->udpgsoaddr_len = destination_sockaddr_len;
+		handle->udpgsotos = iostate->tos;
+		handle->udpgsosize = send_buf_size;
+		handle->udpgsocount = 0;
+	}
+	memcpy(&handle->udpgsobuf[handle->udpgsolen], send_buf, send_buf_size);
+	handle->udpgsolen = handle->udpgsolen + send_buf_size;
+	handle->udpgsocount++;
+	return send_buf_size;
+}
+
+
 // Writes data on specified handle ID. Returns amount of bytes written.
 int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write_buf, const int write_buf_size, const struct s_io_addr *destination_addr) {
 	int ret;
@@ -1106,7 +2690,7 @@ int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write
 					destination_sockaddr_v6->sin6_family = AF_INET6;
 					memcpy(destination_sockaddr_v6->sin6_addr.s6_addr, &destination_addr->addr[4], 16);
 					memcpy(&destination_sockaddr_v6->sin6_port, &destination_addr->addr[20], 2);
-					ret = ioHelperSendTo(&iostate->handle[id], write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v6, sizeof(struct sockaddr_in6));
+					ret = ioQueueSendTo(iostate, id, write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v6, sizeof(struct sockaddr_in6));
 				}
 				else if((iostate->nat64clat > 0) && (memcmp(destination_addr->addr, IO_ADDRTYPE_UDP4, 4) == 0)) {
 					destination_sockaddr_v6 = (struct sockaddr_in6 *)&destination_sockaddr;
@@ -1115,7 +2699,7 @@ int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write
 					memcpy(destination_sockaddr_v6->sin6_addr.s6_addr, iostate->nat64_prefix, 12);
 					memcpy(&destination_sockaddr_v6->sin6_addr.s6_addr[12], &destination_addr->addr[4], 4);
 					memcpy(&destination_sockaddr_v6->sin6_port, &destination_addr->addr[8], 2);
-					ret = ioHelperSendTo(&iostate->handle[id], write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v6, sizeof(struct sockaddr_in6));
+					ret = ioQueueSendTo(iostate, id, write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v6, sizeof(struct sockaddr_in6));
 				}
 				else {
 					ret = 0;
@@ -1133,7 +2717,7 @@ int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write
 					destination_sockaddr_v4->sin_family = AF_INET;
 					memcpy(&destination_sockaddr_v4->sin_addr.s_addr, &destination_addr->addr[4], 4);
 					memcpy(&destination_sockaddr_v4->sin_port, &destination_addr->addr[8], 2);
-					ret = ioHelperSendTo(&iostate->handle[id], write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v4, sizeof(struct sockaddr_in));
+					ret = ioQueueSendTo(iostate, id, write_buf, write_buf_size, (struct sockaddr *)destination_sockaddr_v4, sizeof(struct sockaddr_in));
 				}
 				else {
 					ret = 0;
@@ -1144,8 +2728,18 @@ int ioWrite(struct s_io_state *iostate, const int id, const unsigned char *write
 			}
 			break;
 		case IO_TYPE_FILE:
-			ret = ioHelperWriteFile(&iostate->handle[id], write_buf, write_buf_size);
+			ret = ioSubmitWriteFile(iostate, id, NULL, write_buf, write_buf_size);
 			break;
+#if defined(IO_PACKETRING)
+		case IO_TYPE_PACKET:
+			ret = ioPacketRingWrite(iostate, id, write_buf, write_buf_size);
+			break;
+#endif
+#if defined(IO_XDP)
+		case IO_TYPE_XDP:
+			ret = ioXdpWrite(iostate, id, write_buf, write_buf_size, destination_addr);
+			break;
+#endif
 		default:
 			ret = 0;
 			break;
@@ -1171,6 +2765,22 @@ int ioWriteGroup(struct s_io_state *iostate, const int group, const unsigned cha
 }
 
 
+// Writes an offloaded frame with the specified virtio-net header on one handle ID of the specified group. Only handles that expect a virtio-net header are used. Returns amount of bytes written.
+int ioWriteVnetHdrGroup(struct s_io_state *iostate, const int group, const unsigned char *vnethdr, const unsigned char *write_buf, const int write_buf_size) {
+	int i;
+	int ret;
+	for(i=0; i<iostate->max; i++) {
+		if((iostate->handle[i].group_id == group) && (iostate->handle[i].enabled) && (iostate->handle[i].type == IO_TYPE_FILE) && (iostate->handle[i].vnethdr)) {
+			ret = ioSubmitWriteFile(iostate, i, vnethdr, write_buf, write_buf_size);
+			if(ret > 0) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+
 // Returns the first handle of the specified group that has data, or -1 if there is none.
 int ioGetGroup(struct s_io_state *iostate, const int group) {
 	int i;
@@ -1185,7 +2795,7 @@ int ioGetGroup(struct s_io_state *iostate, const int group) {
 
 // Returns a pointer to the data buffer of the specified handle ID.
 unsigned char * ioGetData(struct s_io_state *iostate, const int id) {
-	return &iostate->mem[id * iostate->bufsize];
+	return iostate->handle[id].content;
 }
 
 
@@ -1197,47 +2807,46 @@ int ioGetDataLen(struct s_io_state *iostate, const int id) {
 
 // Returns a pointer to the current source address of the specified handle ID.
 struct s_io_addr * ioGetAddr(struct s_io_state *iostate, const int id) {
-	struct s_io_addr *ioaddr;
-	struct sockaddr_storage *source_sockaddr;
-	struct sockaddr_in6 *source_sockaddr_v6;
-	struct sockaddr_in *source_sockaddr_v4;
-
-	ioaddr = &iostate->handle[id].source_addr;
+	ioHelperSockaddrToAddr(iostate, iostate->handle[id].type, &iostate->handle[id].source_sockaddr, &iostate->handle[id].source_addr);
+	return &iostate->handle[id].source_addr;
+}
 
-	source_sockaddr = &iostate->handle[id].source_sockaddr;
-	switch(iostate->handle[id].type) {
-		case IO_TYPE_SOCKET_V6: // copy v6 address
-			source_sockaddr_v6 = (struct sockaddr_in6 *)source_sockaddr;
-			if((iostate->nat64clat > 0) && (memcmp(source_sockaddr_v6->sin6_addr.s6_addr, iostate->nat64_prefix, 12) == 0)) {
-				memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP4, 4); // set address type
-				memcpy(&ioaddr->addr[4], &source_sockaddr_v6->sin6_addr.s6_addr[12], 4); // copy source IPv4 address, extracted from NAT64 address
-				memcpy(&ioaddr->addr[8], &source_sockaddr_v6->sin6_port, 2); // copy source port
-				memcpy(&ioaddr->addr[10], "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 14); // empty bytes
-			}
-			else {
-				memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP6, 4); // set address type
-				memcpy(&ioaddr->addr[4], source_sockaddr_v6->sin6_addr.s6_addr, 16); // copy source IPv6 address
-				memcpy(&ioaddr->addr[20], &source_sockaddr_v6->sin6_port, 2); // copy source port
-				memcpy(&ioaddr->addr[22], "\x00\x00", 2); // empty bytes
-			}
-			break;
-		case IO_TYPE_SOCKET_V4: // copy v4 address
-			source_sockaddr_v4 = (struct sockaddr_in *)source_sockaddr;
-			memcpy(&ioaddr->addr[0], IO_ADDRTYPE_UDP4, 4); // set address type
-			memcpy(&ioaddr->addr[4], &source_sockaddr_v4->sin_addr.s_addr, 4); // copy source IPv4 address
-			memcpy(&ioaddr->addr[8], &source_sockaddr_v4->sin_port, 2); // copy source port
-			memcpy(&ioaddr->addr[10], "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 14); // empty bytes
-			break;
-		default:
-			break;
-	}
 
-	return ioaddr;
+// Pops a destination address that has been reported unreachable by ICMP. Returns 1 if an address has been returned.
+int ioGetUnreachable(struct s_io_state *iostate, struct s_io_addr *addr) {
+	if(!(iostate->unreachcount > 0)) return 0;
+	iostate->unreachcount--;
+	*addr = iostate->unreach[iostate->unreachcount];
+	return 1;
 }
 
 
 // Clear data of the specified handle ID.
 void ioGetClear(struct s_io_state *iostate, const int id) {
+#if defined(IO_URING)
+	if(iostate->uring != NULL) {
+		ioUringClear(iostate, id);
+		return;
+	}
+#endif
+#if defined(IO_UDPOFFLOAD)
+	if(iostate->handle[id].udpgrobuf != NULL) {
+		iostate->handle[id].content_len = ioNextGRO(iostate, id);
+		return;
+	}
+#endif
+#if defined(IO_PACKETRING)
+	if(iostate->handle[id].packetring != NULL) {
+		iostate->handle[id].content_len = ioPacketRingNext(iostate, id);
+		return;
+	}
+#endif
+#if defined(IO_XDP)
+	if(iostate->handle[id].xdp != NULL) {
+		iostate->handle[id].content_len = ioXdpNext(iostate, id);
+		return;
+	}
+#endif
 	iostate->handle[id].content_len = 0;
 }
 
@@ -1272,7 +2881,64 @@ void ioSetNat64Clat(struct s_io_state *iostate, const int enable) {
 }
 
 
-// Set IO read timeout (in seconds).
+// Enable/Disable segmentation and checksum offload for new TAP devices.
+void ioSetOffload(struct s_io_state *iostate, const int enable) {
+#if defined(IO_LINUX)
+	if(enable > 0) {
+		iostate->offload = 1;
+	}
+	else {
+		iostate->offload = 0;
+	}
+#else
+	iostate->offload = 0;
+#endif
+}
+
+
+// Enable/Disable UDP segmentation and receive coalescing for new sockets.
+void ioSetUdpOffload(struct s_io_state *iostate, const int enable) {
+#if defined(IO_UDPOFFLOAD)
+	if(enable > 0) {
+		iostate->udpoffload = 1;
+	}
+	else {
+		iostate->udpoffload = 0;
+	}
+#else
+	iostate->udpoffload = 0;
+#endif
+}
+
+
+// Set the IPv4 TOS or IPv6 traffic class of the UDP packets that are written next.
+void ioSetTOS(struct s_io_state *iostate, const int tos) {
+	iostate->tos = (tos & 0xff);
+}
+
+
+// Enable/Disable the reception of ICMP errors on new sockets.
+void ioSetRecvErr(struct s_io_state *iostate, const int enable) {
+#if defined(IO_RECVERR)
+	if(enable > 0) {
+		iostate->recverr = 1;
+	}
+	else {
+		iostate->recverr = 0;
+	}
+#else
+	iostate->recverr = 0;
+#endif
+}
+
+
+// Returns 1 if data of handle ID is prefixed with a virtio-net header.
+int ioGetVnetHdr(struct s_io_state *iostate, const int id) {
+	return iostate->handle[id].vnethdr;
+}
+
+
+// Set IO read timeout (in milliseconds).
 void ioSetTimeout(struct s_io_state *iostate, const int io_timeout) {
 	if(io_timeout > 0) {
 		iostate->timeout = io_timeout;
@@ -1283,16 +2949,103 @@ void ioSetTimeout(struct s_io_state *iostate, const int io_timeout) {
 }
 
 
+// Switch to the io_uring backend. Has to be called after all handles have been opened. Returns 1 on success.
+int ioEnableUring(struct s_io_state *iostate) {
+#if defined(IO_URING)
+	struct s_io_uring *uring;
+	struct iovec iov;
+	int err;
+	int so;
+	int i;
+
+	if(iostate->uring != NULL) return 1;
+	for(i=0; i<iostate->max; i++) {
+		if((iostate->handle[i].enabled) && ((iostate->handle[i].type == IO_TYPE_PACKET) || (iostate->handle[i].type == IO_TYPE_XDP))) return 0; // the packet ring and AF_XDP sockets are not driven by io_uring
+	}
+	if((uring = (malloc(sizeof(struct s_io_uring)))) == NULL) return 0;
+	memset(uring, 0, sizeof(struct s_io_uring));
+	uring->bufsize = iostate->bufsize + IO_URING_BUFHDR;
+	uring->bufcount = IO_URING_BUFCOUNT;
+	while((uring->bufcount > 16) && ((uring->bufcount * uring->bufsize) > IO_URING_BUFMEM)) {
+		uring->bufcount = uring->bufcount / 2;
+	}
+	uring->wsize = iostate->bufsize + IO_VNETHDR_SIZE;
+	uring->bufmem = malloc(uring->bufcount * uring->bufsize);
+	uring->wmem = malloc(IO_URING_WSLOTS * uring->wsize);
+	uring->recvmsg = malloc(iostate->max * sizeof(struct msghdr));
+	if((uring->bufmem != NULL) && (uring->wmem != NULL) && (uring->recvmsg != NULL)) {
+		if(io_uring_queue_init(IO_URING_ENTRIES, &uring->ring, 0) == 0) {
+			if((uring->bufring = (io_uring_setup_buf_ring(&uring->ring, uring->bufcount, IO_URING_BGID, 0, &err))) != NULL) {
+				iov.iov_base = uring->wmem;
+				iov.iov_len = (IO_URING_WSLOTS * uring->wsize);
+				if(io_uring_register_buffers(&uring->ring, &iov, 1) == 0) {
+					// hand all receive buffers to the kernel
+					for(i=0; i<uring->bufcount; i++) {
+						io_uring_buf_ring_add(uring->bufring, &uring->bufmem[i * uring->bufsize], uring->bufsize, i, io_uring_buf_ring_mask(uring->bufcount), i);
+					}
+					io_uring_buf_ring_advance(uring->bufring, uring->bufcount);
+					uring->wfree = -1;
+					for(i=(IO_URING_WSLOTS - 1); i>=0; i--) {
+						uring->wslot[i].next = uring->wfree;
+						uring->wfree = i;
+					}
+
+#if defined(IO_UDPOFFLOAD)
+					// coalesced UDP packets do not fit into the ring buffers
+					for(i=0; i<iostate->max; i++) {
+						if((iostate->handle[i].enabled) && (iostate->handle[i].udpgrobuf != NULL)) {
+							so = 0;
+							setsockopt(iostate->handle[i].fd, SOL_UDP, UDP_GRO, (void *)&so, sizeof(int));
+							free(iostate->handle[i].udpgrobuf);
+							iostate->handle[i].udpgrobuf = NULL;
+						}
+					}
+#endif
+
+					// arm receives on all open handles
+					iostate->uring = uring;
+					for(i=0; i<iostate->max; i++) {
+						if((iostate->handle[i].enabled) && (iostate->handle[i].content_len == 0)) {
+							ioUringArm(iostate, i);
+						}
+					}
+					io_uring_submit(&uring->ring);
+					return 1;
+				}
+				io_uring_free_buf_ring(&uring->ring, uring->bufring, uring->bufcount, IO_URING_BGID);
+			}
+			io_uring_queue_exit(&uring->ring);
+		}
+	}
+	free(uring->recvmsg);
+	free(uring->wmem);
+	free(uring->bufmem);
+	free(uring);
+#else
+	(void)iostate;
+#endif
+	return 0;
+}
+
+
 // Closes all handles and resets defaults.
 void ioReset(struct s_io_state *iostate) {
 	int i;
+#if defined(IO_URING)
+	ioUringDestroy(iostate);
+#endif
 	for(i=0; i<iostate->max; i++) {
 		ioClose(iostate, i);
 		ioResetID(iostate, i);
 	}
-	iostate->timeout = 1;
+	iostate->timeout = 1000;
 	iostate->sockmark = 0;
 	iostate->nat64clat = 0;
+	iostate->offload = 0;
+	iostate->udpoffload = 0;
+	iostate->tos = 0;
+	iostate->recverr = 0;
+	iostate->unreachcount = 0;
 	memcpy(iostate->nat64_prefix, "\x00\x64\xff\x9b\x00\x00\x00\x00\x00\x00\x00\x00", 12);
 	iostate->debug = 0;
 }
@@ -1311,6 +3064,7 @@ int ioCreate(struct s_io_state *iostate, const int io_bufsize, const int io_max)
 				iostate->bufsize = io_bufsize;
 				iostate->max = io_max;
 				iostate->count = 0;
+				iostate->uring = NULL;
 				memset(iostate->mem, 0, (io_bufsize * io_max));
 				memset(iostate->handle, 0, (sizeof(struct s_io_handle) * io_max));
 				ioReset(iostate);
@@ -22,6 +22,10 @@
 #ifndef F_SECCOMP_C
 #define F_SECCOMP_C
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "logging.h"
 
 #ifdef HAVE_LIBSECCOMP
@@ -32,6 +36,7 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
 
 // Defines and loads seccomp filter. Returns 1 on success.
@@ -43,13 +48,37 @@ static int seccompEnableDo(scmp_filter_ctx ctx) {
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(write), 0) != 0) { return 0; }
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(recvfrom), 0) != 0) { return 0; }
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(sendto), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(writev), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(recvmsg), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(sendmsg), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(setsockopt), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getsockopt), 0) != 0) { return 0; }
+
+#ifdef __NR_io_uring_enter
+	// the io_uring backend submits and reaps all I/O with io_uring_enter, setup is done before the filter is loaded
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(io_uring_enter), 0) != 0) { return 0; }
+#endif
 
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(time), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_gettime), 0) != 0) { return 0; }
+#ifdef __NR_clock_gettime64
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_gettime64), 0) != 0) { return 0; }
+#endif
+#ifdef __NR_gettimeofday
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(gettimeofday), 0) != 0) { return 0; }
+#endif
+
+	// OpenSSL draws session keys and nonces from getrandom and checks the PID to detect forks
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getrandom), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getpid), 0) != 0) { return 0; }
 
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(select), 0) != 0) { return 0; }
 #ifdef __NR__newselect
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(_newselect), 0) != 0) { return 0; }
 #endif
+#ifdef __NR_pselect6
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(pselect6), 0) != 0) { return 0; }
+#endif
 
 #ifdef __NR_sigreturn
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(sigreturn), 0) != 0) { return 0; }
@@ -61,8 +90,23 @@ static int seccompEnableDo(scmp_filter_ctx ctx) {
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(exit), 0) != 0) { return 0; }
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(exit_group), 0) != 0) { return 0; }
 
+	// malloc serves large blocks and the heaps of the worker thread arenas with mmap, executable mappings stay forbidden
 	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(brk), 0) != 0) { return 0; }
-	if(seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(munmap), 0) != 0) { return 0; }
+#ifdef __NR_mmap
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(mmap), 1, SCMP_A2(SCMP_CMP_MASKED_EQ, PROT_EXEC, 0)) != 0) { return 0; }
+#endif
+#ifdef __NR_mmap2
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(mmap2), 1, SCMP_A2(SCMP_CMP_MASKED_EQ, PROT_EXEC, 0)) != 0) { return 0; }
+#endif
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(mprotect), 1, SCMP_A2(SCMP_CMP_MASKED_EQ, PROT_EXEC, 0)) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(mremap), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(munmap), 0) != 0) { return 0; }
+
+	// the crypto worker threads are started before the filter is loaded, it applies to all of them
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(futex), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(sched_yield), 0) != 0) { return 0; }
+	if(seccomp_rule_add(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(madvise), 0) != 0) { return 0; }
+	if(seccomp_attr_set(ctx, SCMP_FLTATR_CTL_TSYNC, 1) != 0) { return 0; }
 
 	if(seccomp_load(ctx) != 0) { return 0; }
 	return 1;
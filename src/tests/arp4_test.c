@@ -0,0 +1,146 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_ARP4_TEST_C
+#define F_ARP4_TEST_C
+
+
+#include "arp4.c"
+#include <stdio.h>
+
+
+#define arp4Testsuite_MAC_A "\x02\x00\x00\x00\x00\x0a"
+#define arp4Testsuite_MAC_B "\x02\x00\x00\x00\x00\x0b"
+#define arp4Testsuite_MAC_C "\x02\x00\x00\x00\x00\x0c"
+#define arp4Testsuite_IP_A "\x0a\x00\x00\x01"
+#define arp4Testsuite_IP_B "\x0a\x00\x00\x02"
+#define arp4Testsuite_IP_C "\x0a\x00\x00\x03"
+
+
+// Generate an ARP frame. Requests are sent to the broadcast MAC.
+static int arp4TestsuiteARP(unsigned char *frame, const int opcode, const char *sender_mac, const char *sender_addr, const char *target_addr) {
+	memcpy(&frame[0], (opcode == 1) ? "\xff\xff\xff\xff\xff\xff" : arp4Testsuite_MAC_A, arp4_MAC_SIZE);
+	memcpy(&frame[6], sender_mac, arp4_MAC_SIZE);
+	memcpy(&frame[12], "\x08\x06\x00\x01\x08\x00\x06\x04\x00", 9);
+	frame[21] = opcode;
+	memcpy(&frame[22], sender_mac, arp4_MAC_SIZE);
+	memcpy(&frame[28], sender_addr, arp4_ADDR_SIZE);
+	memset(&frame[32], 0, arp4_MAC_SIZE);
+	memcpy(&frame[38], target_addr, arp4_ADDR_SIZE);
+	return 42;
+}
+
+
+// Generate an IPv4 frame.
+static int arp4TestsuiteIPv4(unsigned char *frame, const char *source_mac, const char *source_addr) {
+	memset(frame, 0, 60);
+	memcpy(&frame[0], arp4Testsuite_MAC_A, arp4_MAC_SIZE);
+	memcpy(&frame[6], source_mac, arp4_MAC_SIZE);
+	frame[12] = 0x08;
+	frame[14] = 0x45;
+	memcpy(&frame[26], source_addr, arp4_ADDR_SIZE);
+	memcpy(&frame[30], arp4Testsuite_IP_A, arp4_ADDR_SIZE);
+	return 60;
+}
+
+
+// Send an ARP request and check the answer. A portid of -1 means no answer is expected.
+static int arp4TestsuiteExpect(struct s_arp4_state *arpstate, const char *sender_mac, const char *sender_addr, const char *target_addr, const char *target_mac, const int portid) {
+	unsigned char frame[60];
+	unsigned char reply[128];
+	int len;
+	int replyportid = -1;
+	int replyportts = -1;
+	len = arp4TestsuiteARP(frame, 1, sender_mac, sender_addr, target_addr);
+	len = arp4GenReply(arpstate, frame, len, reply, 128, &replyportid, &replyportts);
+	printf("arp4Testsuite: request %d.%d.%d.%d -> %d (expected %d)\n", target_addr[0], target_addr[1], target_addr[2], target_addr[3], (len > 0) ? replyportid : -1, portid);
+	if(portid < 0) return (len == 0);
+	return (
+	(len == 42) &&
+	(replyportid == portid) &&
+	(memcmp(&reply[0], sender_mac, arp4_MAC_SIZE) == 0) &&
+	(memcmp(&reply[6], target_mac, arp4_MAC_SIZE) == 0) &&
+	(reply[20] == 0x00) && (reply[21] == 0x02) &&
+	(memcmp(&reply[22], target_mac, arp4_MAC_SIZE) == 0) &&
+	(memcmp(&reply[28], target_addr, arp4_ADDR_SIZE) == 0) &&
+	(memcmp(&reply[32], sender_mac, arp4_MAC_SIZE) == 0) &&
+	(memcmp(&reply[38], sender_addr, arp4_ADDR_SIZE) == 0)
+	);
+}
+
+
+// Test learning from ARP and IPv4 frames and answering requests from the table.
+static int arp4TestsuiteCache() {
+	struct s_arp4_state arpstate;
+	struct s_arp4_arptable_entry *entry;
+	unsigned char frame[60];
+	int len;
+
+	if(!arp4Create(&arpstate)) return 0;
+
+	// learn B from its ARP reply, C is unknown
+	len = arp4TestsuiteARP(frame, 2, arp4Testsuite_MAC_B, arp4Testsuite_IP_B, arp4Testsuite_IP_A);
+	arp4PacketIn(&arpstate, frame, len, 5, 1);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, 5)) return 0;
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_C, arp4Testsuite_MAC_C, -1)) return 0;
+
+	// probes and gratuitous ARP are not answered and not learned
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, "\x00\x00\x00\x00", arp4Testsuite_IP_B, arp4Testsuite_MAC_B, -1)) return 0;
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_B, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, -1)) return 0;
+	len = arp4TestsuiteARP(frame, 1, arp4Testsuite_MAC_C, "\x00\x00\x00\x00", arp4Testsuite_IP_C);
+	arp4PacketIn(&arpstate, frame, len, 6, 1);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_C, arp4Testsuite_MAC_C, -1)) return 0;
+
+	// IPv4 traffic only refreshes entries of the same MAC
+	len = arp4TestsuiteIPv4(frame, arp4Testsuite_MAC_B, arp4Testsuite_IP_B);
+	arp4PacketIn(&arpstate, frame, len, 7, 1);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, 7)) return 0;
+	len = arp4TestsuiteIPv4(frame, arp4Testsuite_MAC_C, arp4Testsuite_IP_B);
+	arp4PacketIn(&arpstate, frame, len, 8, 1);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, 7)) return 0;
+	len = arp4TestsuiteIPv4(frame, arp4Testsuite_MAC_C, arp4Testsuite_IP_C);
+	arp4PacketIn(&arpstate, frame, len, 8, 1);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_C, arp4Testsuite_MAC_C, -1)) return 0;
+
+	// the owner of an address does not get an answer for it, expired entries are not used
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_B, arp4Testsuite_IP_C, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, -1)) return 0;
+	entry = mapGet(&arpstate.arptable, arp4Testsuite_IP_B);
+	if(entry == NULL) return 0;
+	entry->ents = (utilGetClock() - arp4_TIMEOUT);
+	if(!arp4TestsuiteExpect(&arpstate, arp4Testsuite_MAC_A, arp4Testsuite_IP_A, arp4Testsuite_IP_B, arp4Testsuite_MAC_B, -1)) return 0;
+
+	arp4Destroy(&arpstate);
+	return 1;
+}
+
+
+static int arp4Testsuite() {
+	printf("arp4Testsuite started\n");
+	if(!arp4TestsuiteCache()) {
+		printf("arp4Testsuite failed!\n");
+		return 0;
+	}
+	printf("arp4Testsuite ok\n");
+	return 1;
+}
+
+
+#endif // F_ARP4_TEST_C
@@ -30,6 +30,11 @@
 #include "authmgt_test.c"
 #include "mapstr_test.c"
 #include "packet_test.c"
+#include "route_test.c"
+#include "gso_test.c"
+#include "qos_test.c"
+#include "arp4_test.c"
+#include "switch_test.c"
 #include <stdio.h>
 #include <unistd.h>
 
@@ -856,6 +861,31 @@ void consoleTestsuiteDfragTestsuite(struct s_console_args *args) {
 }
 
 
+void consoleTestsuiteRouteTestsuite(struct s_console_args *args) {
+	routeTestsuite();
+}
+
+
+void consoleTestsuiteGsoTestsuite(struct s_console_args *args) {
+	gsoTestsuite();
+}
+
+
+void consoleTestsuiteQosTestsuite(struct s_console_args *args) {
+	qosTestsuite();
+}
+
+
+void consoleTestsuiteArp4Testsuite(struct s_console_args *args) {
+	arp4Testsuite();
+}
+
+
+void consoleTestsuiteSwitchTestsuite(struct s_console_args *args) {
+	switchTestsuite();
+}
+
+
 void consoleTestsuiteEndian(struct s_console_args *args) {
 	struct s_console *console = args->arg[0];
 	if(utilIsLittleEndian()) {
@@ -936,6 +966,11 @@ int consoleTestsuite() {
 	consoleRegisterCommand(&console, "authtestsuite", &consoleTestsuiteAuthTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "peermgttest", &consoleTestsuitePeerTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "dfragtest", &consoleTestsuiteDfragTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "routetest", &consoleTestsuiteRouteTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "gsotest", &consoleTestsuiteGsoTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "qostest", &consoleTestsuiteQosTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "arptest", &consoleTestsuiteArp4Testsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "switchtest", &consoleTestsuiteSwitchTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "textgen", &consoleTestsuiteTextgen, consoleArgs3(&console, NULL, NULL));
 	consoleRegisterCommand(&console, "endian", &consoleTestsuiteEndian, consoleArgs1(&console));
 	consoleRegisterCommand(&console, "ctrinc", &consoleTestsuiteCtrInc, consoleArgs2(&console, &testctr));
@@ -0,0 +1,241 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_GSO_TEST_C
+#define F_GSO_TEST_C
+
+
+#include "checksum.c"
+#include "gso.c"
+#include "gro.c"
+#include <stdio.h>
+
+#define gsoTestsuite_PAYLOAD_SIZE 3500
+#define gsoTestsuite_MSS 1000
+
+
+// Add the TCP pseudo header to the checksum.
+static void gsoTestsuiteAddPseudo(struct s_checksum *checksum, const unsigned char *l3, const int v6, const int l4len) {
+	unsigned char pseudo[8];
+	if(v6) {
+		checksumAddBuf(checksum, &l3[8], 32);
+		utilWriteInt32(&pseudo[0], l4len);
+		memcpy(&pseudo[4], "\x00\x00\x00\x06", 4);
+		checksumAddBuf(checksum, pseudo, 8);
+	}
+	else {
+		checksumAddBuf(checksum, &l3[12], 8);
+		pseudo[0] = 0;
+		pseudo[1] = 6;
+		utilWriteInt16(&pseudo[2], l4len);
+		checksumAddBuf(checksum, pseudo, 4);
+	}
+}
+
+
+// Build a TCP superframe with virtio-net header as read from the TAP device. Returns length of the buffer.
+static int gsoTestsuiteBuild(unsigned char *buf, const int v6, const int gsotype, const int mss, const int payload_len) {
+	struct s_checksum checksum;
+	unsigned char *frame = &buf[gso_VNETHDR_SIZE];
+	unsigned char *l3 = &frame[14];
+	unsigned char *l4;
+	uint16_t u;
+	int l4off;
+	int i;
+
+	memset(buf, 0, gso_VNETHDR_SIZE + 14 + 40 + 20);
+	memcpy(frame, "\x02\x00\x00\x00\x00\x02\x02\x00\x00\x00\x00\x01", 12);
+	if(v6) {
+		frame[12] = 0x86;
+		frame[13] = 0xdd;
+		l3[0] = 0x60;
+		utilWriteInt16(&l3[4], (20 + payload_len));
+		l3[6] = 6;
+		l3[7] = 64;
+		memcpy(&l3[8], "\x20\x01\x0d\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01", 16);
+		memcpy(&l3[24], "\x20\x01\x0d\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x02", 16);
+		l4off = 14 + 40;
+	}
+	else {
+		frame[12] = 0x08;
+		frame[13] = 0x00;
+		l3[0] = 0x45;
+		utilWriteInt16(&l3[2], (20 + 20 + payload_len));
+		utilWriteInt16(&l3[4], 0x1234);
+		l3[6] = 0x40;
+		l3[8] = 64;
+		l3[9] = 6;
+		memcpy(&l3[12], "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+		checksumZero(&checksum);
+		checksumAddBuf(&checksum, l3, 20);
+		u = checksumGet(&checksum);
+		memcpy(&l3[10], &u, 2);
+		l4off = 14 + 20;
+	}
+	l4 = &frame[l4off];
+	utilWriteInt16(&l4[0], 40000);
+	utilWriteInt16(&l4[2], 5001);
+	utilWriteInt32(&l4[4], 0xfffff000); // sequence number wraps around during segmentation
+	utilWriteInt32(&l4[8], 0x00000020);
+	l4[12] = 0x50;
+	l4[13] = 0x18;
+	utilWriteInt16(&l4[14], 0xffff);
+	for(i=0; i<payload_len; i++) l4[20 + i] = (i * 7);
+
+	// the checksum field contains the pseudo header sum, like the kernel leaves it for partial checksums
+	checksumZero(&checksum);
+	gsoTestsuiteAddPseudo(&checksum, l3, v6, (20 + payload_len));
+	u = ~checksumGet(&checksum);
+	memcpy(&l4[16], &u, 2);
+
+	// native byte order virtio-net header
+	buf[0] = gso_FLAG_NEEDS_CSUM;
+	buf[1] = gsotype;
+	u = l4off + 20;
+	memcpy(&buf[2], &u, 2);
+	u = mss;
+	memcpy(&buf[4], &u, 2);
+	u = l4off;
+	memcpy(&buf[6], &u, 2);
+	u = 16;
+	memcpy(&buf[8], &u, 2);
+
+	return (gso_VNETHDR_SIZE + l4off + 20 + payload_len);
+}
+
+
+// Check IPv4 header checksum. Returns 1 if it is valid.
+static int gsoTestsuiteCheckIPv4(const unsigned char *frame) {
+	struct s_checksum checksum;
+	checksumZero(&checksum);
+	checksumAddBuf(&checksum, &frame[14], 20);
+	return (checksumGet(&checksum) == 0);
+}
+
+
+// Check the TCP checksum of a segment. Returns 1 if it is valid.
+static int gsoTestsuiteCheckTCP(const unsigned char *frame, const int frame_len, const int v6) {
+	struct s_checksum checksum;
+	int l4off = (v6) ? (14 + 40) : (14 + 20);
+	checksumZero(&checksum);
+	gsoTestsuiteAddPseudo(&checksum, &frame[14], v6, (frame_len - l4off));
+	checksumAddBuf(&checksum, &frame[l4off], (frame_len - l4off));
+	return (checksumGet(&checksum) == 0);
+}
+
+
+// Segment a superframe, verify the headers, checksums and payload of all segments and coalesce them again.
+static int gsoTestsuiteRun(const int v6) {
+	struct s_gso_state gso;
+	struct s_gro_state gro;
+	unsigned char first[2048];
+	unsigned char *buf;
+	unsigned char *segbuf;
+	unsigned char *segment;
+	unsigned char *vnethdr;
+	unsigned char *frame;
+	const unsigned char *l4;
+	int l4off = (v6) ? (14 + 40) : (14 + 20);
+	int buf_len;
+	int seglen;
+	int segcount;
+	int payload;
+	int paylen;
+	int len;
+
+	buf = malloc(gso_VNETHDR_SIZE + 14 + 40 + 20 + gsoTestsuite_PAYLOAD_SIZE);
+	segbuf = malloc(gso_SEGBUF_SIZE);
+	if((buf == NULL) || (segbuf == NULL)) return 0;
+	if(!groCreate(&gro)) return 0;
+
+	// frame without segmentation, only the checksum has to be completed
+	buf_len = gsoTestsuiteBuild(buf, v6, gso_TYPE_NONE, 0, 100);
+	if(!gsoInit(&gso, buf, buf_len, 1, 1)) return 0;
+	seglen = gsoNext(&gso, segbuf, gso_SEGBUF_SIZE, &segment);
+	if(seglen != (buf_len - gso_VNETHDR_SIZE)) return 0;
+	if(!gsoTestsuiteCheckTCP(segment, seglen, v6)) return 0;
+	if(gsoNext(&gso, segbuf, gso_SEGBUF_SIZE, &segment) != 0) return 0;
+	printf("gsoTestsuite: ipv%d checksum completed\n", (v6) ? 6 : 4);
+
+	// segmentation
+	buf_len = gsoTestsuiteBuild(buf, v6, ((v6) ? gso_TYPE_TCPV6 : gso_TYPE_TCPV4), gsoTestsuite_MSS, gsoTestsuite_PAYLOAD_SIZE);
+	if(!gsoInit(&gso, buf, buf_len, 1, 1)) return 0;
+	segcount = 0;
+	payload = 0;
+	while((seglen = gsoNext(&gso, segbuf, gso_SEGBUF_SIZE, &segment)) > 0) {
+		l4 = &segment[l4off];
+		paylen = seglen - (l4off + 20);
+		if((paylen <= 0) || (paylen > gsoTestsuite_MSS)) return 0;
+		if((!v6) && ((!gsoTestsuiteCheckIPv4(segment)) || ((utilReadInt16(&segment[16]) & 0xffff) != (seglen - 14)))) return 0;
+		if((v6) && ((utilReadInt16(&segment[18]) & 0xffff) != (seglen - l4off))) return 0;
+		if(!gsoTestsuiteCheckTCP(segment, seglen, v6)) return 0;
+		if(utilReadInt32(&l4[4]) != (int32_t)(0xfffff000 + payload)) return 0; // sequence number wraps around
+		if(((l4[13] & 0x08) != 0) != ((payload + paylen) == gsoTestsuite_PAYLOAD_SIZE)) return 0; // PSH only on the last segment
+		if(memcmp(&l4[20], &buf[gso_VNETHDR_SIZE + l4off + 20 + payload], paylen) != 0) return 0;
+		if(segcount == 0) {
+			if((seglen > 2048) || (!groStart(&gro, segment, seglen, 1, 1, 1))) return 0;
+			memcpy(first, segment, seglen);
+		}
+		else {
+			// segments of other peers, repeated segments and segments with a bad checksum are not merged
+			if(groAppend(&gro, segment, seglen, 2, 1, 1)) return 0;
+			if(groAppend(&gro, first, (l4off + 20 + gsoTestsuite_MSS), 1, 1, 1)) return 0;
+			segment[seglen - 1] ^= 0x01;
+			if(groAppend(&gro, segment, seglen, 1, 1, 1)) return 0;
+			segment[seglen - 1] ^= 0x01;
+			if(!groAppend(&gro, segment, seglen, 1, 1, 1)) return 0;
+		}
+		printf("gsoTestsuite: ipv%d segment %d, %d bytes\n", (v6) ? 6 : 4, segcount, seglen);
+		payload = payload + paylen;
+		segcount++;
+	}
+	if(segcount != ((gsoTestsuite_PAYLOAD_SIZE + gsoTestsuite_MSS - 1) / gsoTestsuite_MSS)) return 0;
+	if(payload != gsoTestsuite_PAYLOAD_SIZE) return 0;
+
+	// the coalesced frame has to match the original superframe
+	len = groGet(&gro, &vnethdr, &frame);
+	if(len != (buf_len - gso_VNETHDR_SIZE)) return 0;
+	if(vnethdr[1] != buf[1]) return 0;
+	if(memcmp(&vnethdr[2], &buf[2], 8) != 0) return 0;
+	if((!v6) && (!gsoTestsuiteCheckIPv4(frame))) return 0;
+	if(memcmp(frame, &buf[gso_VNETHDR_SIZE], len) != 0) return 0;
+	if(groPending(&gro)) return 0;
+	printf("gsoTestsuite: ipv%d coalesced %d bytes\n", (v6) ? 6 : 4, len);
+
+	groDestroy(&gro);
+	free(segbuf);
+	free(buf);
+	return 1;
+}
+
+
+static int gsoTestsuite() {
+	printf("gsoTestsuite started\n");
+	if(!(gsoTestsuiteRun(0) && gsoTestsuiteRun(1))) {
+		printf("gsoTestsuite failed!\n");
+		return 0;
+	}
+	printf("gsoTestsuite ok\n");
+	return 1;
+}
+
+
+#endif // F_GSO_TEST_C
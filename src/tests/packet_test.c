@@ -86,10 +86,91 @@ static int packetTestsuiteMsg(const int random_msg) {
 }
 
 
+// Encode and decode packets of two sessions in batches that span more than one crypto batch.
+static int packetTestsuiteBatch() {
+	const int count = (crypto_BATCHMAX + 6);
+	unsigned char plbuf[count][packetTestsuite_PLBUF_SIZE];
+	unsigned char plbufdec[count][packetTestsuite_PLBUF_SIZE];
+	struct s_packet_data testdata[count];
+	struct s_packet_data testdatadec[count];
+	struct s_packet_batch batch[count];
+	unsigned char *pkbuf;
+	struct s_crypto ctx[4];
+	unsigned char secret[64];
+	unsigned char nonce[16];
+	struct s_seq_state seqstate[2];
+	int i;
+
+	pkbuf = malloc(count * packetTestsuite_PKBUF_SIZE);
+	if(pkbuf == NULL) return 0;
+	cryptoCreate(ctx, 4);
+	memset(nonce, 5, 16);
+	for(i=0; i<2; i++) {
+		memset(secret, (23 + i), 64);
+		if(!cryptoSetKeys(&ctx[i], 1, secret, 64, nonce, 16)) return 0;
+		if(!cryptoSetKeys(&ctx[2 + i], 1, secret, 64, nonce, 16)) return 0;
+		seqInit(&seqstate[i], 0);
+	}
+
+	// encode, the items alternate between the sessions
+	for(i=0; i<count; i++) {
+		RAND_pseudo_bytes(plbuf[i], packetTestsuite_PLBUF_SIZE);
+		testdata[i].pl_buf = plbuf[i];
+		testdata[i].pl_buf_size = packetTestsuite_PLBUF_SIZE;
+		testdata[i].pl_length = 1 + (i % packetTestsuite_PLBUF_SIZE);
+		testdata[i].pl_type = 0;
+		testdata[i].pl_options = 0;
+		testdata[i].peerid = i;
+		testdata[i].seq = (i / 2) + 1;
+		batch[i].pbuf = &pkbuf[i * packetTestsuite_PKBUF_SIZE];
+		batch[i].pbuf_size = packetTestsuite_PKBUF_SIZE;
+		batch[i].data = &testdata[i];
+		batch[i].ctx = &ctx[i % 2];
+		batch[i].seqstate = NULL;
+	}
+	testdata[3].pl_length = packetTestsuite_PLBUF_SIZE + 1;
+	if(packetEncodeBatch(batch, count) != (count - 1)) return 0;
+	if(batch[3].result != 0) return 0;
+	testdata[3].pl_length = 1;
+	if(packetEncodeBatch(&batch[3], 1) != 1) return 0;
+
+	// decode with the other context of each session, a modified packet is rejected without affecting the others
+	for(i=0; i<count; i++) {
+		if(!(batch[i].result > 0)) return 0;
+		testdatadec[i].pl_buf = plbufdec[i];
+		testdatadec[i].pl_buf_size = packetTestsuite_PLBUF_SIZE;
+		batch[i].pbuf_size = batch[i].result;
+		batch[i].data = &testdatadec[i];
+		batch[i].ctx = &ctx[2 + (i % 2)];
+		batch[i].seqstate = &seqstate[i % 2];
+	}
+	batch[count - 2].pbuf[batch[count - 2].pbuf_size - 1] ^= 0x01;
+	if(packetDecodeBatch(batch, count) != (count - 1)) return 0;
+	for(i=0; i<count; i++) {
+		if(i == (count - 2)) {
+			if(batch[i].result != 0) return 0;
+			continue;
+		}
+		if((batch[i].result != testdata[i].pl_length) || (testdatadec[i].pl_length != testdata[i].pl_length)) return 0;
+		if((testdatadec[i].peerid != i) || (testdatadec[i].seq != testdata[i].seq)) return 0;
+		if(memcmp(plbufdec[i], plbuf[i], testdata[i].pl_length) != 0) return 0;
+	}
+
+	// replayed packets are rejected
+	if(packetDecodeBatch(batch, count) != 0) return 0;
+	printf("packet batch of %d items ok\n", count);
+
+	cryptoDestroy(ctx, 4);
+	free(pkbuf);
+	return 1;
+}
+
+
 static int packetTestsuite() {
 	int i;
 	for(i=0; i<100; i++) if(!packetTestsuiteMsg(1)) return 0;
 	for(i=0; i<100; i++) if(!packetTestsuiteMsg(0)) return 0;
+	if(!packetTestsuiteBatch()) return 0;
 	return 1;
 }
 
@@ -34,6 +34,8 @@
 #define peermgtTestsuite_NODECOUNT authmgtTestsuite_NODECOUNT
 #define peermgtTestsuite_PEERSLOTS (peermgtTestsuite_NODECOUNT * 4)
 #define peermgtTestsuite_AUTHSLOTS (peermgtTestsuite_NODECOUNT / 4)
+#define peermgtTestsuite_FLAGS (peermgt_FLAG_USERDATA | peermgt_FLAG_RELAY | peermgt_FLAG_TICKET | peermgt_FLAG_DELTA | peermgt_FLAG_GROUPKEY | peermgt_FLAG_BCAST | peermgt_FLAG_MACADV | peermgt_FLAG_ROUTEADV | peermgt_FLAG_BUNDLE | peermgt_FLAG_PINGTYPE)
+#define peermgtTestsuite_ROUNDS 64
 
 #if peermgtTestsuite_NODECOUNT < 4
 #error not enough nodes!
@@ -43,6 +45,11 @@
 struct s_peermgt_test {
 	struct s_authmgt_test authtest;
 	struct s_peermgt peermgts[peermgtTestsuite_NODECOUNT];
+	int linkdown[peermgtTestsuite_NODECOUNT][peermgtTestsuite_NODECOUNT];
+	int recvcount[peermgtTestsuite_NODECOUNT];
+	int recvfrom[peermgtTestsuite_NODECOUNT];
+	int recvlen[peermgtTestsuite_NODECOUNT];
+	unsigned char recvmsg[peermgtTestsuite_NODECOUNT][peermgt_MSGSIZE_MAX];
 };
 
 
@@ -72,7 +79,1065 @@ static int peermgtTestsuiteGetAddr(struct s_peeraddr *addr, const int id) {
 }
 
 
-static int peermgtTestsuiteRun(struct s_peermgt_test *teststate) {
+// Reset a node to a fresh peer manager with all features enabled.
+static void peermgtTestsuiteReset(struct s_peermgt_test *teststate, const int id) {
+	struct s_peermgt *mgt = &teststate->peermgts[id];
+	int i;
+	if(mgt->cryptthreads > 0) {
+		cryptpoolDestroy(&mgt->cryptpool);
+		mgt->cryptthreads = 0;
+	}
+	peermgtInit(mgt);
+	peermgtSetFastauth(mgt, 1);
+	peermgtSetLoopback(mgt, 0);
+	peermgtSetFragmentation(mgt, 1);
+	peermgtSetBroadcastTree(mgt, 0);
+	peermgtSetConnectRate(mgt, peermgt_CONNECT_RATE_DEFAULT);
+	peermgtSetProbeInterval(mgt, 0);
+	peermgtSetNetID(mgt, "testnet", 7);
+	peermgtSetFlags(mgt, peermgtTestsuite_FLAGS);
+	for(i=0; i<peermgtTestsuite_NODECOUNT; i++) {
+		teststate->linkdown[id][i] = 0;
+		teststate->linkdown[i][id] = 0;
+	}
+	teststate->recvcount[id] = 0;
+	teststate->recvfrom[id] = -1;
+	teststate->recvlen[id] = 0;
+}
+
+
+// Reset all nodes.
+static void peermgtTestsuiteResetAll(struct s_peermgt_test *teststate) {
+	int i;
+	for(i=0; i<peermgtTestsuite_NODECOUNT; i++) {
+		peermgtTestsuiteReset(teststate, i);
+	}
+}
+
+
+// Returns the PeerID node a uses for node b.
+static int peermgtTestsuitePeerID(struct s_peermgt_test *teststate, const int a, const int b) {
+	return peermgtGetID(&teststate->peermgts[a], &teststate->authtest.nk[b].nodeid);
+}
+
+
+// Check if node a and node b have an active session with each other.
+static int peermgtTestsuiteIsConnected(struct s_peermgt_test *teststate, const int a, const int b) {
+	return (peermgtIsActiveRemoteID(&teststate->peermgts[a], peermgtTestsuitePeerID(teststate, a, b)) && peermgtIsActiveRemoteID(&teststate->peermgts[b], peermgtTestsuitePeerID(teststate, b, a)));
+}
+
+
+// Record the user data node j has received.
+static void peermgtTestsuiteCollect(struct s_peermgt_test *teststate, const int j) {
+	struct s_msg msgr;
+	int l;
+	while(peermgtRecvUserdata(&teststate->peermgts[j], &msgr, NULL, &l, NULL)) {
+		teststate->recvcount[j]++;
+		teststate->recvfrom[j] = l;
+		teststate->recvlen[j] = msgr.len;
+		if(msgr.len <= peermgt_MSGSIZE_MAX) memcpy(teststate->recvmsg[j], msgr.msg, msgr.len);
+	}
+}
+
+
+// Deliver a packet from node i to node j. Returns 1 if node j accepted it.
+static int peermgtTestsuiteDeliver(struct s_peermgt_test *teststate, const int i, const int j, const unsigned char *pbuf, const int len) {
+	struct s_peeraddr sourceaddr;
+	int ret;
+	peermgtTestsuiteGetAddr(&sourceaddr, i);
+	ret = peermgtDecodePacket(&teststate->peermgts[j], pbuf, len, &sourceaddr);
+	peermgtTestsuiteCollect(teststate, j);
+	return ret;
+}
+
+
+// Route the packets between the nodes for the specified number of rounds. Packets over links that are down get lost.
+static int peermgtTestsuiteRoute(struct s_peermgt_test *teststate, const int rounds) {
+	unsigned char pbuf[4096];
+	struct s_peeraddr addr;
+	int len;
+	int r;
+	int i;
+	int j;
+
+	for(r=0; r<rounds; r++) {
+		for(i=0; i<peermgtTestsuite_NODECOUNT; i++) {
+			while(peermgtDecodePending(&teststate->peermgts[i])) peermgtTestsuiteCollect(teststate, i);
+			while((len = (peermgtGetNextPacket(&teststate->peermgts[i], pbuf, 4096, &addr))) > 0) {
+				j = peermgtTestsuiteGetID(&addr);
+				if(j < 0) return 0;
+				if(!teststate->linkdown[i][j]) peermgtTestsuiteDeliver(teststate, i, j, pbuf, len);
+			}
+		}
+	}
+	return 1;
+}
+
+
+// Connect node a to node b. Returns 1 if the session has been established.
+static int peermgtTestsuiteConnect(struct s_peermgt_test *teststate, const int a, const int b) {
+	struct s_peeraddr addr;
+	int r;
+	peermgtTestsuiteGetAddr(&addr, b);
+	if(!peermgtConnect(&teststate->peermgts[a], &addr)) return 0;
+	for(r=0; r<peermgtTestsuite_ROUNDS; r++) {
+		if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+		if(peermgtTestsuiteIsConnected(teststate, a, b)) return 1;
+	}
+	printf("node %d failed to connect to node %d\n", a, b);
+	return 0;
+}
+
+
+// Send a message from node a to node b and check that it arrives.
+static int peermgtTestsuiteSend(struct s_peermgt_test *teststate, const int a, const int b, const char *text) {
+	struct s_msg msg = { .msg = (unsigned char *)text, .len = strlen(text) };
+	int peerid = peermgtTestsuitePeerID(teststate, a, b);
+	int count = teststate->recvcount[b];
+	if(!peermgtSendUserdata(&teststate->peermgts[a], &msg, NULL, peerid, teststate->peermgts[a].data[peerid].conntime)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 2)) return 0;
+	return ((teststate->recvcount[b] == (count + 1)) && (teststate->recvfrom[b] == peermgtTestsuitePeerID(teststate, b, a)) && (teststate->recvlen[b] == msg.len) && (memcmp(teststate->recvmsg[b], text, msg.len) == 0));
+}
+
+
+// Check session resumption and the replay protection of resume requests.
+static int peermgtTestsuiteResume(struct s_peermgt_test *teststate) {
+	unsigned char reqbuf[4096];
+	unsigned char nonce[peermgt_TICKET_NONCESIZE];
+	struct s_peermgt *mgt = &teststate->peermgts[1];
+	struct s_peeraddr addr;
+	int reqlen;
+	int tnow;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 0, 1)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if(mapGet(&teststate->peermgts[0].ticketdb, teststate->authtest.nk[1].nodeid.id) == NULL) return 0;
+
+	// both sides lose the session, node 0 resumes it with the ticket of node 1
+	peermgtDelete(&teststate->peermgts[0], &teststate->authtest.nk[1].nodeid);
+	peermgtDelete(mgt, &teststate->authtest.nk[0].nodeid);
+	peermgtTestsuiteGetAddr(&addr, 1);
+	if(!peermgtResume(&teststate->peermgts[0], &teststate->authtest.nk[1].nodeid, &addr)) return 0;
+	do {
+		reqlen = peermgtGetNextPacket(&teststate->peermgts[0], reqbuf, 4096, &addr);
+	}
+	while((reqlen > 0) && ((peermgtTestsuiteGetID(&addr) != 1) || (packetGetPeerID(reqbuf) != 0)));
+	if(!(reqlen > 0)) return 0;
+	if(!peermgtTestsuiteDeliver(teststate, 0, 1, reqbuf, reqlen)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if(!peermgtTestsuiteIsConnected(teststate, 0, 1)) return 0;
+	if(!peermgtTestsuiteSend(teststate, 0, 1, "resumed")) return 0;
+	if(!peermgtTestsuiteSend(teststate, 1, 0, "resumed too")) return 0;
+
+	// a replayed request is dropped
+	if(peermgtTestsuiteDeliver(teststate, 0, 1, reqbuf, reqlen)) return 0;
+
+	// a full replay cache refuses new requests until old nonces expire
+	tnow = utilGetClock();
+	memset(nonce, 0, peermgt_TICKET_NONCESIZE);
+	nonce[4] = 1;
+	for(i=0; i<peermgt_RESUME_REPLAY_SIZE; i++) {
+		utilWriteInt32(nonce, i);
+		if(!peermgtCheckResumeReplay(mgt, nonce, tnow)) break;
+	}
+	if(!(mapGetKeyCount(&mgt->resumereplay) == mapGetMapSize(&mgt->resumereplay))) return 0;
+	utilWriteInt32(nonce, 0);
+	if(peermgtCheckResumeReplay(mgt, nonce, tnow)) return 0;
+	utilWriteInt32(nonce, peermgt_RESUME_REPLAY_SIZE);
+	if(peermgtCheckResumeReplay(mgt, nonce, tnow)) return 0;
+	if(!peermgtCheckResumeReplay(mgt, nonce, (tnow + peermgt_TICKET_LIFETIME))) return 0;
+	if(peermgtCheckResumeReplay(mgt, nonce, (tnow + peermgt_TICKET_LIFETIME))) return 0;
+
+	printf("resume test ok\n");
+	return 1;
+}
+
+
+// Check that every session request under load gets its own cookie challenge and that auth sessions are found by address.
+static int peermgtTestsuiteCookies(struct s_peermgt_test *teststate) {
+	unsigned char pbuf[4096];
+	struct s_authmgt *authmgt = &teststate->peermgts[0].authmgt;
+	struct s_peeraddr addr;
+	struct s_peeraddr target;
+	int authid;
+	int count;
+	int len;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+
+	// node 0 fills most of its auth slots with sessions to unreachable nodes
+	for(i=13; i<16; i++) {
+		teststate->linkdown[0][i] = 1;
+		teststate->linkdown[i][0] = 1;
+		peermgtTestsuiteGetAddr(&addr, i);
+		if(!peermgtConnect(&teststate->peermgts[0], &addr)) return 0;
+		if(authmgtFindAddr(authmgt, &addr) < 0) return 0;
+	}
+	if(!authmgtIsUnderLoad(authmgt, utilGetClock())) return 0;
+
+	// requests that arrive at the same time are all challenged
+	peermgtTestsuiteGetAddr(&addr, 0);
+	for(i=1; i<5; i++) {
+		if(!peermgtConnect(&teststate->peermgts[i], &addr)) return 0;
+		if(!((len = peermgtGetNextPacket(&teststate->peermgts[i], pbuf, 4096, &target)) > 0)) return 0;
+		if(peermgtTestsuiteGetID(&target) != 0) return 0;
+		if(peermgtTestsuiteDeliver(teststate, i, 0, pbuf, len)) return 0;
+		peermgtTestsuiteGetAddr(&target, i);
+		if(authmgtFindAddr(authmgt, &target) >= 0) return 0;
+	}
+	if(authmgt->cookieqcount != 4) return 0;
+
+	// each node gets its challenge
+	count = 0;
+	while((len = peermgtGetNextPacket(&teststate->peermgts[0], pbuf, 4096, &target)) > 0) {
+		i = peermgtTestsuiteGetID(&target);
+		if((i < 1) || (i > 4)) continue;
+		if(!peermgtTestsuiteDeliver(teststate, 0, i, pbuf, len)) return 0;
+		authid = authmgtFindAddr(&teststate->peermgts[i].authmgt, &addr);
+		if(authid < 0) return 0;
+		if(teststate->peermgts[i].authmgt.authstate[authid].cookie_size != auth_COOKIESIZE) return 0;
+		count++;
+	}
+	if((count != 4) || (authmgt->cookieqcount != 0)) return 0;
+
+	// the echoed cookies get auth slots, first the free one, then the ones of sessions that made no progress
+	for(i=1; i<3; i++) {
+		do {
+			len = peermgtGetNextPacket(&teststate->peermgts[i], pbuf, 4096, &target);
+		}
+		while((len > 0) && (peermgtTestsuiteGetID(&target) != 0));
+		if(!(len > 0)) return 0;
+		if(!peermgtTestsuiteDeliver(teststate, i, 0, pbuf, len)) return 0;
+		peermgtTestsuiteGetAddr(&target, i);
+		if(authmgtFindAddr(authmgt, &target) < 0) return 0;
+	}
+	peermgtTestsuiteGetAddr(&target, 13);
+	if(authmgtFindAddr(authmgt, &target) >= 0) return 0;
+	for(i=14; i<16; i++) {
+		peermgtTestsuiteGetAddr(&target, i);
+		if(authmgtFindAddr(authmgt, &target) < 0) return 0;
+	}
+	if(!peermgtTestsuiteRoute(teststate, 16)) return 0;
+	if(!peermgtTestsuiteIsConnected(teststate, 0, 1)) return 0;
+
+	printf("cookie test ok\n");
+	return 1;
+}
+
+
+// Check the address index and the free list of the auth sessions.
+static int peermgtTestsuiteAuthIndex(struct s_peermgt_test *teststate) {
+	struct s_authmgt *authmgt = &teststate->peermgts[0].authmgt;
+	struct s_peeraddr addr;
+	int ids[3];
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	for(i=0; i<3; i++) {
+		teststate->linkdown[0][(13 + i)] = 1;
+		peermgtTestsuiteGetAddr(&addr, (13 + i));
+		if(!authmgtStart(authmgt, &addr)) return 0;
+		ids[i] = authmgtFindAddr(authmgt, &addr);
+		if(ids[i] < 0) return 0;
+	}
+	if((ids[0] == ids[1]) || (ids[0] == ids[2]) || (ids[1] == ids[2])) return 0;
+	if(authmgt->freecount != 3) return 0;
+
+	// address changes move the index entry
+	peermgtTestsuiteGetAddr(&addr, 12);
+	authmgtSetAddr(authmgt, ids[0], &addr);
+	if(authmgtFindAddr(authmgt, &addr) != ids[0]) return 0;
+	peermgtTestsuiteGetAddr(&addr, 13);
+	if(authmgtFindAddr(authmgt, &addr) >= 0) return 0;
+
+	// deleted sessions leave the index and the free list
+	authmgtDelete(authmgt, ids[1]);
+	peermgtTestsuiteGetAddr(&addr, 14);
+	if(authmgtFindAddr(authmgt, &addr) >= 0) return 0;
+	if(authmgt->freecount != 2) return 0;
+	for(i=0; i<authmgt->freecount; i++) {
+		if(authmgt->freepos[authmgt->freelist[i]] != i) return 0;
+		if(authmgt->freelist[i] == ids[1]) return 0;
+	}
+
+	// sessions that passed preauth are not replaceable until the peer completed
+	if(!peermgtTestsuiteConnect(teststate, 1, 0)) return 0;
+	peermgtTestsuiteGetAddr(&addr, 1);
+	i = authmgtFindAddr(authmgt, &addr);
+	if(i < 0) return 0;
+	if(!authIsPeerCompleted(&authmgt->authstate[i])) return 0;
+	if(authmgt->freepos[i] < 0) return 0;
+
+	printf("auth index test ok\n");
+	return 1;
+}
+
+
+// Check the connection budget, parallel connection attempts and the retry backoff.
+static int peermgtTestsuiteConnectBudget(struct s_peermgt_test *teststate) {
+	unsigned char pbuf[4096];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_nodedb_addrdata *addrdata;
+	struct s_peeraddr addr;
+	int len;
+	int r;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+
+	// the budget scales with the free auth slots and never drops below one attempt while a slot is free
+	if(peermgtConnectBudget(mgt) != peermgt_CONNECT_RATE_DEFAULT) return 0;
+	for(i=14; i<16; i++) {
+		teststate->linkdown[0][i] = 1;
+		peermgtTestsuiteGetAddr(&addr, i);
+		if(!peermgtConnect(mgt, &addr)) return 0;
+	}
+	if(peermgtConnectBudget(mgt) != (peermgt_CONNECT_RATE_DEFAULT / 2)) return 0;
+	peermgtSetConnectRate(mgt, 1);
+	if(peermgtConnectBudget(mgt) != 1) return 0;
+	peermgtSetConnectRate(mgt, peermgt_CONNECT_RATE_DEFAULT);
+	authmgtReset(&mgt->authmgt);
+	peermgtSetFastauth(mgt, 1);
+
+	// known nodes are all tried in the same second
+	for(i=1; i<3; i++) {
+		peermgtTestsuiteGetAddr(&addr, i);
+		nodedbUpdate(&mgt->nodedb, &teststate->authtest.nk[i].nodeid, &addr, 1, 0, 0);
+	}
+	mgt->lastconntry = 0;
+	if(!((len = peermgtGetNextPacket(mgt, pbuf, 4096, &addr)) > 0)) return 0;
+	if(authmgtUsedSlotCount(&mgt->authmgt) != 2) return 0;
+	peermgtTestsuiteDeliver(teststate, 0, peermgtTestsuiteGetID(&addr), pbuf, len);
+	for(r=0; r<peermgtTestsuite_ROUNDS; r++) {
+		if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+		if(peermgtTestsuiteIsConnected(teststate, 0, 1) && peermgtTestsuiteIsConnected(teststate, 0, 2)) break;
+	}
+	if(!(peermgtTestsuiteIsConnected(teststate, 0, 1) && peermgtTestsuiteIsConnected(teststate, 0, 2))) return 0;
+
+	// attempts that fail back off exponentially, a connection resets the backoff
+	peermgtTestsuiteGetAddr(&addr, 15);
+	for(i=0; i<3; i++) {
+		nodedbUpdate(&mgt->nodedb, &teststate->authtest.nk[15].nodeid, &addr, 1, 0, 1);
+	}
+	if(!(nodedbGetDBID(&mgt->nodedb, &teststate->authtest.nk[15].nodeid, -1, -1, -1) < 0)) return 0;
+	addrdata = mapGet(mapGet(mgt->nodedb.addrdb, teststate->authtest.nk[15].nodeid.id), addr.addr);
+	if(addrdata == NULL) return 0;
+	if(nodedbBackoff(addrdata) != (nodedb_BACKOFF_MIN << 2)) return 0;
+	nodedbUpdate(&mgt->nodedb, &teststate->authtest.nk[15].nodeid, &addr, 0, 1, 0);
+	if(nodedbBackoff(addrdata) != nodedb_BACKOFF_MIN) return 0;
+	addrdata->failcount = nodedb_BACKOFF_MAXSHIFT;
+	if(nodedbBackoff(addrdata) != nodedb_BACKOFF_MAX) return 0;
+
+	printf("connect budget test ok\n");
+	return 1;
+}
+
+
+// Check that connection attempts to all addresses of a node race and the losers are cancelled.
+static int peermgtTestsuiteRace(struct s_peermgt_test *teststate) {
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_peeraddr addr;
+	struct s_peeraddr deadaddr;
+	int authid;
+	int r;
+
+	peermgtTestsuiteResetAll(teststate);
+
+	// node 0 knows node 1 by its real address and by one that does not answer
+	teststate->linkdown[0][15] = 1;
+	peermgtTestsuiteGetAddr(&addr, 1);
+	peermgtTestsuiteGetAddr(&deadaddr, 15);
+	nodedbUpdate(&mgt->nodedb, &teststate->authtest.nk[1].nodeid, &deadaddr, 1, 0, 0);
+	nodedbUpdate(&mgt->nodedb, &teststate->authtest.nk[1].nodeid, &addr, 1, 0, 1);
+	if(peermgtConnectNode(mgt, &teststate->authtest.nk[1].nodeid, &addr) != 2) return 0;
+	authid = authmgtFindAddr(&mgt->authmgt, &deadaddr);
+	if(authid < 0) return 0;
+	if(mgt->authmgt.raceid[authid] == 0) return 0;
+	if(mgt->authmgt.raceid[authid] != mgt->authmgt.raceid[authmgtFindAddr(&mgt->authmgt, &addr)]) return 0;
+
+	// the first session that completes cancels the other one
+	for(r=0; r<peermgtTestsuite_ROUNDS; r++) {
+		if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+		if(peermgtTestsuiteIsConnected(teststate, 0, 1)) break;
+	}
+	if(!peermgtTestsuiteIsConnected(teststate, 0, 1)) return 0;
+	if(!(authmgtFindAddr(&mgt->authmgt, &deadaddr) < 0)) return 0;
+	authid = authmgtFindAddr(&mgt->authmgt, &addr);
+	if(!(authid < 0) && ((mgt->authmgt.raceid[authid] != 0) || (mgt->authmgt.racenext[authid] != authid))) return 0;
+
+	printf("race test ok\n");
+	return 1;
+}
+
+
+// Check that peerinfo changes reach other peers as acknowledged deltas.
+static int peermgtTestsuiteDelta(struct s_peermgt_test *teststate) {
+	unsigned char plbuf[4096];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_packet_data data;
+	int peerid;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 1, 0)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 2, 0)) return 0;
+	peerid = peermgtTestsuitePeerID(teststate, 0, 1);
+
+	// node 1 learns about node 2 and acknowledges the version
+	mgt->data[peerid].lastinfodelta = 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if(mapGet(teststate->peermgts[1].nodedb.addrdb, teststate->authtest.nk[2].nodeid.id) == NULL) return 0;
+	if(mgt->data[peerid].infoacked != mgt->infoversion) return 0;
+	if(teststate->peermgts[1].data[peermgtTestsuitePeerID(teststate, 1, 0)].remoteinfoversion != mgt->infoversion) return 0;
+
+	// acknowledged entries are not sent again
+	data.pl_buf = plbuf;
+	data.pl_buf_size = 4096;
+	peermgtGenPacketPeerinfoDelta(&data, mgt, peerid);
+	if((data.pl_length != peermgt_PEERINFO_DELTA_HDRSIZE) || (utilReadInt32(plbuf) != 0) || (utilReadInt32(&plbuf[4]) != mgt->infoversion)) return 0;
+
+	// a new peer only sends the changed entry
+	if(!peermgtTestsuiteConnect(teststate, 3, 0)) return 0;
+	if(!(mgt->data[peerid].infoacked < mgt->infoversion)) return 0;
+	peermgtGenPacketPeerinfoDelta(&data, mgt, peerid);
+	if(utilReadInt32(plbuf) != 1) return 0;
+	if(memcmp(&plbuf[(peermgt_PEERINFO_DELTA_HDRSIZE + packet_PEERID_SIZE)], teststate->authtest.nk[3].nodeid.id, nodeid_SIZE) != 0) return 0;
+	mgt->data[peerid].lastinfodelta = 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if(mapGet(teststate->peermgts[1].nodedb.addrdb, teststate->authtest.nk[3].nodeid.id) == NULL) return 0;
+	if(mgt->data[peerid].infoacked != mgt->infoversion) return 0;
+
+	// keepalives carry the acknowledgement only
+	peermgtGenPacketKeepalive(&data, mgt, peerid);
+	if((data.pl_length != peermgt_KEEPALIVE_SIZE) || (data.pl_type != packet_PLTYPE_KEEPALIVE)) return 0;
+
+	printf("delta test ok\n");
+	return 1;
+}
+
+
+// Send a broadcast from node a and check that node b receives it encrypted with the group key of node a.
+static int peermgtTestsuiteGroupBroadcast(struct s_peermgt_test *teststate, const int a, const int b, const char *text) {
+	unsigned char pbuf[4096];
+	struct s_msg msg = { .msg = (unsigned char *)text, .len = strlen(text) };
+	struct s_peeraddr addr;
+	int count = teststate->recvcount[b];
+	int len;
+	if(!peermgtSendBroadcastUserdata(&teststate->peermgts[a], &msg)) return 0;
+	do {
+		len = peermgtGetNextPacket(&teststate->peermgts[a], pbuf, 4096, &addr);
+	}
+	while((len > 0) && ((peermgtTestsuiteGetID(&addr) != b) || (!(packetGetPeerID(pbuf) < 0))));
+	if(!(len > 0)) return 0;
+	peermgtTestsuiteDeliver(teststate, a, b, pbuf, len);
+	return ((teststate->recvcount[b] == (count + 1)) && (teststate->recvfrom[b] == peermgtTestsuitePeerID(teststate, b, a)) && (memcmp(teststate->recvmsg[b], text, msg.len) == 0));
+}
+
+
+// Check the group key exchange and that a peer can't take over the key ID of another peer.
+static int peermgtTestsuiteGroupKey(struct s_peermgt_test *teststate) {
+	unsigned char plbuf[peermgt_GROUPKEY_MSGSIZE];
+	unsigned char keyid[4];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_packet_data data;
+	int *indexed;
+	int peerid1;
+	int peerid2;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 1, 0)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 2, 0)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	peerid1 = peermgtTestsuitePeerID(teststate, 0, 1);
+	peerid2 = peermgtTestsuitePeerID(teststate, 0, 2);
+	if(mgt->data[peerid1].groupkeyid != teststate->peermgts[1].groupkeyid) return 0;
+	if(mgt->data[peerid2].groupkeyid != teststate->peermgts[2].groupkeyid) return 0;
+	if(!peermgtIsGroupKeyReady(&teststate->peermgts[1], peermgtTestsuitePeerID(teststate, 1, 0))) return 0;
+	if(!peermgtTestsuiteGroupBroadcast(teststate, 1, 0, "group")) return 0;
+
+	// node 2 announces the key ID of node 1 with a different secret
+	utilWriteInt32(keyid, teststate->peermgts[1].groupkeyid);
+	memcpy(plbuf, keyid, 4);
+	utilWriteInt64(&plbuf[4], 1);
+	cryptoRand(&plbuf[(4 + seq_SIZE)], peermgt_GROUPKEY_SECRETSIZE);
+	data.pl_buf = plbuf;
+	data.pl_buf_size = peermgt_GROUPKEY_MSGSIZE;
+	data.pl_length = peermgt_GROUPKEY_MSGSIZE;
+	data.pl_type = packet_PLTYPE_GROUPKEY;
+	data.pl_options = peermgt_GROUPKEY_KEY;
+	data.peerid = peerid2;
+	if(peermgtDecodePacketGroupKey(mgt, &data)) return 0;
+	indexed = mapGet(&mgt->groupmap, keyid);
+	if((indexed == NULL) || (*indexed != peerid1)) return 0;
+	if(mgt->data[peerid2].groupkeyid != teststate->peermgts[2].groupkeyid) return 0;
+	if(!peermgtTestsuiteGroupBroadcast(teststate, 1, 0, "still group")) return 0;
+
+	printf("group key test ok\n");
+	return 1;
+}
+
+
+// Set the link between node a and node b up or down.
+static void peermgtTestsuiteSetLink(struct s_peermgt_test *teststate, const int a, const int b, const int up) {
+	teststate->linkdown[a][b] = (up) ? 0 : 1;
+	teststate->linkdown[b][a] = (up) ? 0 : 1;
+}
+
+
+// Send a broadcast from node 0 and check that each of the nodes 1 to 4 receives it exactly once.
+static int peermgtTestsuiteBroadcastOnce(struct s_peermgt_test *teststate, const char *text) {
+	struct s_msg msg = { .msg = (unsigned char *)text, .len = strlen(text) };
+	int count[5];
+	int i;
+	for(i=1; i<5; i++) count[i] = teststate->recvcount[i];
+	if(!peermgtSendBroadcastUserdata(&teststate->peermgts[0], &msg)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	for(i=1; i<5; i++) {
+		if(teststate->recvcount[i] != (count[i] + 1)) return 0;
+		if(teststate->recvfrom[i] != peermgtTestsuitePeerID(teststate, i, 0)) return 0;
+		if(memcmp(teststate->recvmsg[i], text, msg.len) != 0) return 0;
+	}
+	return 1;
+}
+
+
+// Check that the broadcast tree only leaves peers to a forwarding peer that has a session to them.
+static int peermgtTestsuiteBroadcastTree(struct s_peermgt_test *teststate) {
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	int peerid;
+	int part;
+	int fwd;
+	int i;
+	int j;
+
+	// nodes 1 and 2 forward, nodes 3 and 4 only have a session to node 0
+	peermgtTestsuiteResetAll(teststate);
+	for(i=3; i<5; i++) {
+		peermgtSetFlags(&teststate->peermgts[i], (peermgtTestsuite_FLAGS & (~peermgt_FLAG_RELAY)));
+	}
+	for(i=1; i<5; i++) {
+		for(j=(i + 1); j<5; j++) {
+			peermgtTestsuiteSetLink(teststate, i, j, 0);
+		}
+		if(!peermgtTestsuiteConnect(teststate, i, 0)) return 0;
+	}
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	peermgtSetBroadcastTree(mgt, 1);
+	if(!peermgtTestsuiteBroadcastOnce(teststate, "tree")) return 0;
+	if(mgt->bcastparts != 2) return 0;
+	for(i=3; i<5; i++) {
+		if(peermgtGetBroadcastRole(mgt, peermgtTestsuitePeerID(teststate, 0, i)) != peermgt_BCAST_DIRECT) return 0;
+	}
+
+	// node 3 is left to its forwarding peer once that peer has announced a session to it
+	peerid = peermgtTestsuitePeerID(teststate, 0, 3);
+	part = peermgtGetBroadcastPart(mgt, peerid, mgt->bcastparts);
+	fwd = (mgt->bcastfwdpeer[part] == peermgtTestsuitePeerID(teststate, 0, 1)) ? 1 : 2;
+	peermgtTestsuiteSetLink(teststate, fwd, 3, 1);
+	if(!peermgtTestsuiteConnect(teststate, fwd, 3)) return 0;
+	teststate->peermgts[fwd].data[peermgtTestsuitePeerID(teststate, fwd, 0)].lastinfodelta = 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if(!peermgtIsAnnouncedBy(mgt, mgt->bcastfwdpeer[part], peerid)) return 0;
+	if(!peermgtTestsuiteBroadcastOnce(teststate, "tree again")) return 0;
+	if(peermgtGetBroadcastRole(mgt, peerid) != peermgt_BCAST_COVERED) return 0;
+	if(peermgtGetBroadcastRole(mgt, peermgtTestsuitePeerID(teststate, 0, 4)) != peermgt_BCAST_DIRECT) return 0;
+
+	printf("broadcast tree test ok\n");
+	return 1;
+}
+
+
+// Deliver the packets node a sends until node b receives a MAC advertisement. Returns the length of the advertisement.
+static int peermgtTestsuiteRecvMacAdvert(struct s_peermgt_test *teststate, const int a, const int b, unsigned char *advert) {
+	unsigned char pbuf[4096];
+	struct s_peeraddr addr;
+	struct s_msg msg;
+	int peerid;
+	int len;
+	int r;
+	int j;
+	for(r=0; r<peermgtTestsuite_ROUNDS; r++) {
+		while((len = (peermgtGetNextPacket(&teststate->peermgts[a], pbuf, 4096, &addr))) > 0) {
+			j = peermgtTestsuiteGetID(&addr);
+			if(j < 0) return -1;
+			peermgtTestsuiteDeliver(teststate, a, j, pbuf, len);
+			if((j == b) && (peermgtRecvMacAdvert(&teststate->peermgts[b], &msg, &peerid, NULL))) {
+				if((peerid != peermgtTestsuitePeerID(teststate, b, a)) || (msg.len > peermgt_MACADV_SIZE)) return -1;
+				memcpy(advert, msg.msg, msg.len);
+				return msg.len;
+			}
+		}
+		if(!peermgtTestsuiteRoute(teststate, 1)) return -1;
+	}
+	return -1;
+}
+
+
+// Check that MAC advertisements reach the peers and that an emptied list is sent too.
+static int peermgtTestsuiteMacAdvert(struct s_peermgt_test *teststate) {
+	unsigned char advert[peermgt_MACADV_SIZE];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	int peerid;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 0, 1)) return 0;
+	peerid = peermgtTestsuitePeerID(teststate, 0, 1);
+
+	// the list is sent when it is set
+	peermgtSetMacAdvert(mgt, (const unsigned char *)"\x02\x00\x00\x00\x00\x0a\x02\x00\x00\x00\x00\x0b", 12);
+	if(peermgtTestsuiteRecvMacAdvert(teststate, 0, 1, advert) != 12) return 0;
+	if(memcmp(advert, "\x02\x00\x00\x00\x00\x0a\x02\x00\x00\x00\x00\x0b", 12) != 0) return 0;
+	if(mgt->data[peerid].macadvsent != mgt->macadvversion) return 0;
+
+	// an emptied list is sent as a single padding byte
+	peermgtSetMacAdvert(mgt, advert, 0);
+	mgt->data[peerid].lastmacadv = 0;
+	if(peermgtTestsuiteRecvMacAdvert(teststate, 0, 1, advert) != 1) return 0;
+	if(mgt->data[peerid].macadvsent != mgt->macadvversion) return 0;
+
+	printf("MAC advert test ok\n");
+	return 1;
+}
+
+
+// Add a frame from node a to the bundle for node b. Returns 1 if it has been bundled.
+static int peermgtTestsuiteBundle(struct s_peermgt_test *teststate, const int a, const int b, const char *text) {
+	struct s_msg msg = { .msg = (unsigned char *)text, .len = strlen(text) };
+	int peerid = peermgtTestsuitePeerID(teststate, a, b);
+	return peermgtBundleUserdata(&teststate->peermgts[a], &msg, peerid, teststate->peermgts[a].data[peerid].conntime);
+}
+
+
+// Check that small frames are bundled and that bundles keep the frame order.
+static int peermgtTestsuiteBundling(struct s_peermgt_test *teststate) {
+	unsigned char plbuf[8];
+	unsigned char large[(peermgt_BUNDLE_FRAMEMAX + 2)];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_packet_data data;
+	struct s_msg msg = { .msg = (unsigned char *)"regular", .len = 7 };
+	int peerid;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 0, 1)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 0, 2)) return 0;
+	peerid = peermgtTestsuitePeerID(teststate, 0, 1);
+
+	// bundled frames wait for the flush and arrive as separate frames
+	if(!(peermgtTestsuiteBundle(teststate, 0, 1, "one") && peermgtTestsuiteBundle(teststate, 0, 1, "two") && peermgtTestsuiteBundle(teststate, 0, 1, "three"))) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 2)) return 0;
+	if((teststate->recvcount[1] != 0) || (!peermgtIsBundlePending(mgt))) return 0;
+	peermgtFlushBundle(mgt);
+	if(!peermgtTestsuiteRoute(teststate, 2)) return 0;
+	if((teststate->recvcount[1] != 3) || (teststate->recvlen[1] != 5) || (memcmp(teststate->recvmsg[1], "three", 5) != 0)) return 0;
+	if(peermgtIsBundlePending(mgt)) return 0;
+
+	// frames for another peer and large frames are not added to a pending bundle
+	if(!peermgtTestsuiteBundle(teststate, 0, 1, "four")) return 0;
+	if(peermgtTestsuiteBundle(teststate, 0, 2, "other peer")) return 0;
+	memset(large, 'x', (peermgt_BUNDLE_FRAMEMAX + 1));
+	large[peermgt_BUNDLE_FRAMEMAX + 1] = 0;
+	if(peermgtTestsuiteBundle(teststate, 0, 1, (const char *)large)) return 0;
+
+	// regular user data sends the pending bundle first and no frame may be bundled behind it
+	if(!peermgtSendUserdata(mgt, &msg, NULL, peerid, mgt->data[peerid].conntime)) return 0;
+	if(peermgtTestsuiteBundle(teststate, 0, 1, "five")) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 2)) return 0;
+	if((teststate->recvcount[1] != 5) || (teststate->recvlen[1] != 7) || (memcmp(teststate->recvmsg[1], "regular", 7) != 0)) return 0;
+
+	// malformed bundles are rejected
+	data.pl_buf = plbuf;
+	data.pl_buf_size = 8;
+	data.peerid = peerid;
+	memcpy(plbuf, "\x00\x05ab", 4);
+	data.pl_length = 4;
+	if(peermgtDecodeUserdataBundle(mgt, &data)) return 0;
+	memcpy(plbuf, "\x00\x00", 2);
+	data.pl_length = 2;
+	if(peermgtDecodeUserdataBundle(mgt, &data)) return 0;
+
+	printf("bundle test ok\n");
+	return 1;
+}
+
+
+// Check that the crypto workers encode and decode a burst of user data in order and still reject replayed packets.
+static int peermgtTestsuiteCryptPool(struct s_peermgt_test *teststate) {
+	unsigned char pbuf[4096];
+	unsigned char replay[4096];
+	char text[peermgtTestsuite_ROUNDS][16];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_peeraddr addr;
+	struct s_msg msg;
+	int replaylen;
+	int peerid;
+	int queued;
+	int count;
+	int len;
+	int r;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtEnableCryptPool(mgt, 2)) return 0;
+	if(!peermgtEnableCryptPool(&teststate->peermgts[1], 2)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 0, 1)) return 0;
+	peerid = peermgtTestsuitePeerID(teststate, 0, 1);
+
+	// queue a burst on both sides without waiting for the workers
+	queued = 0;
+	replaylen = 0;
+	for(i=0; i<peermgtTestsuite_ROUNDS; i++) {
+		snprintf(text[i], 16, "burst %d", i);
+		msg.msg = (unsigned char *)text[i];
+		msg.len = strlen(text[i]);
+		if(!peermgtSendUserdata(mgt, &msg, NULL, peerid, mgt->data[peerid].conntime)) return 0;
+		while((len = (peermgtGetNextPacket(mgt, pbuf, 4096, &addr))) > 0) {
+			if(peermgtTestsuiteGetID(&addr) != 1) return 0;
+			if((replaylen == 0) && (len <= 4096)) {
+				memcpy(replay, pbuf, len);
+				replaylen = len;
+			}
+			peermgtTestsuiteDeliver(teststate, 0, 1, pbuf, len);
+		}
+		if(peermgtCryptPending(mgt) > 0) queued |= 1;
+		if(peermgtCryptPending(&teststate->peermgts[1]) > 0) queued |= 2;
+	}
+	if(queued != 3) return 0;
+
+	// the frames arrive complete and in order
+	count = 0;
+	for(r=0; (r < (peermgtTestsuite_ROUNDS * 1000)) && (teststate->recvcount[1] < peermgtTestsuite_ROUNDS); r++) {
+		if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+		if(teststate->recvcount[1] != count) {
+			count = teststate->recvcount[1];
+			if((teststate->recvlen[1] != (int)strlen(text[count - 1])) || (memcmp(teststate->recvmsg[1], text[count - 1], teststate->recvlen[1]) != 0)) return 0;
+		}
+	}
+	printf("crypto pool delivered %d of %d frames\n", teststate->recvcount[1], peermgtTestsuite_ROUNDS);
+	if(teststate->recvcount[1] != peermgtTestsuite_ROUNDS) return 0;
+
+	// a replayed packet is dropped after the workers have decrypted it
+	if(replaylen == 0) return 0;
+	peermgtTestsuiteDeliver(teststate, 0, 1, replay, replaylen);
+	for(r=0; (r < 1000) && (peermgtCryptPending(&teststate->peermgts[1]) > 0); r++) {
+		if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+	}
+	if(!peermgtTestsuiteRoute(teststate, 1)) return 0;
+	if(teststate->recvcount[1] != peermgtTestsuite_ROUNDS) return 0;
+
+	printf("crypto pool test ok\n");
+	return 1;
+}
+
+
+// Returns the number of free relay queue entries.
+static int peermgtTestsuiteRelayFree(struct s_peermgt *mgt) {
+	int count = 0;
+	int entry = mgt->relayqfree;
+	while((entry >= 0) && (count <= peermgt_RELAYQ_SIZE)) {
+		entry = mgt->relayq[entry].next;
+		count++;
+	}
+	return count;
+}
+
+
+// Check that the relay queues and local user data share the link by deficit round robin, and that the relay queue of a deleted peer is returned.
+static int peermgtTestsuiteScheduler(struct s_peermgt_test *teststate) {
+	unsigned char pbuf[4096];
+	unsigned char relaybuf[400];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_peeraddr target;
+	struct s_msg msg = { .msg = (unsigned char *)"local", .len = 5 };
+	int p1;
+	int p2;
+	int p3;
+	int tnow;
+	int sent2;
+	int sentlocal;
+	int len1;
+	int len2;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	for(i=1; i<4; i++) {
+		if(!peermgtTestsuiteConnect(teststate, i, 0)) return 0;
+	}
+	p1 = peermgtTestsuitePeerID(teststate, 0, 1);
+	p2 = peermgtTestsuitePeerID(teststate, 0, 2);
+	p3 = peermgtTestsuitePeerID(teststate, 0, 3);
+	memset(relaybuf, 0x55, 400);
+	tnow = utilGetClock();
+
+	// node 1 fills its relay queue before node 2 and the local user data get queued
+	for(i=0; i<peermgt_RELAYQ_PEERMAX; i++) {
+		if(!peermgtQueueRelay(mgt, p1, p3, relaybuf, 400)) return 0;
+	}
+	if(peermgtQueueRelay(mgt, p1, p3, relaybuf, 400)) return 0;
+	if(!(peermgtQueueRelay(mgt, p2, p3, relaybuf, 400) && peermgtQueueRelay(mgt, p2, p3, relaybuf, 400))) return 0;
+	if(!peermgtSendUserdata(mgt, &msg, NULL, p3, mgt->data[p3].conntime)) return 0;
+
+	// the later flows are served before node 1 has used up its queue
+	sent2 = -1;
+	sentlocal = -1;
+	for(i=0; i<(peermgt_RELAYQ_PEERMAX + 3); i++) {
+		len1 = mgt->data[p1].relayqlen;
+		len2 = mgt->data[p2].relayqlen;
+		if(!(peermgtGetNextPacketData(mgt, pbuf, 4096, tnow, &target) > 0)) return 0;
+		if(peermgtTestsuiteGetID(&target) != 3) return 0;
+		if((len2 > 0) && (mgt->data[p2].relayqlen == 0)) sent2 = i;
+		if((sentlocal < 0) && (mgt->outmsg.len == 0) && (mgt->data[p1].relayqlen == len1) && (mgt->data[p2].relayqlen == len2)) sentlocal = i;
+	}
+	printf("scheduler: node 2 done after %d packets, local data sent as packet %d\n", (sent2 + 1), (sentlocal + 1));
+	if((sent2 < 0) || (sent2 >= (peermgt_RELAYQ_PEERMAX - 1)) || (sentlocal < 0) || (sentlocal >= (peermgt_RELAYQ_PEERMAX - 1))) return 0;
+	if(peermgtGetNextPacketData(mgt, pbuf, 4096, tnow, &target) > 0) return 0;
+	if((mgt->txflowcount != 0) || (peermgtTestsuiteRelayFree(mgt) != peermgt_RELAYQ_SIZE)) return 0;
+
+	// the queue of a deleted peer is returned and not sent for the next peer with the same PeerID
+	for(i=0; i<3; i++) {
+		if(!peermgtQueueRelay(mgt, p1, p3, relaybuf, 400)) return 0;
+	}
+	peermgtDeleteID(mgt, p1);
+	if((mgt->data[p1].relayqlen != 0) || (mgt->data[p1].relayqhead >= 0) || (peermgtTestsuiteRelayFree(mgt) != peermgt_RELAYQ_SIZE)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 4, 0)) return 0;
+	if(peermgtTestsuitePeerID(teststate, 0, 4) != p1) return 0;
+	if(peermgtGetNextPacketData(mgt, pbuf, 4096, tnow, &target) > 0) return 0;
+	if(mgt->txflowcount != 0) return 0;
+	if(!peermgtQueueRelay(mgt, p1, p3, relaybuf, 400)) return 0;
+	if(!(peermgtGetNextPacketData(mgt, pbuf, 4096, tnow, &target) > 0)) return 0;
+	if((mgt->data[p1].relayqlen != 0) || (peermgtTestsuiteRelayFree(mgt) != peermgt_RELAYQ_SIZE)) return 0;
+
+	printf("scheduler test ok\n");
+	return 1;
+}
+
+
+// Generate packets of node 0 until the local user data or the relay queue of a peer has been served. Returns the served flow and its TOS.
+static int peermgtTestsuiteNextFlow(struct s_peermgt *mgt, const int relaypeerid, int *tos) {
+	unsigned char pbuf[4096];
+	struct s_peeraddr target;
+	int relayqlen;
+	int outlen;
+	int r;
+	for(r=0; r<peermgtTestsuite_ROUNDS; r++) {
+		relayqlen = mgt->data[relaypeerid].relayqlen;
+		outlen = mgt->outmsg.len;
+		if(!(peermgtGetNextPacketGen(mgt, pbuf, 4096, utilGetClock(), &target) > 0)) return -1;
+		*tos = peermgtGetOutputTOS(mgt);
+		if(mgt->data[relaypeerid].relayqlen != relayqlen) return relaypeerid;
+		if((outlen > 0) && (mgt->outmsg.len == 0)) return 0;
+	}
+	return -1;
+}
+
+
+// Check that user data keeps its traffic class and that latency sensitive user data bypasses the round robin.
+static int peermgtTestsuiteDSCP(struct s_peermgt_test *teststate) {
+	unsigned char relaybuf[400];
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_msg msg = { .msg = (unsigned char *)"dscp", .len = 4 };
+	int p1;
+	int p3;
+	int tos;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	for(i=1; i<4; i++) {
+		if(!peermgtTestsuiteConnect(teststate, i, 0)) return 0;
+	}
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	p1 = peermgtTestsuitePeerID(teststate, 0, 1);
+	p3 = peermgtTestsuitePeerID(teststate, 0, 3);
+	memset(relaybuf, 0x55, 400);
+	for(i=0; i<peermgt_RELAYQ_PEERMAX; i++) {
+		if(!peermgtQueueRelay(mgt, p1, p3, relaybuf, 400)) return 0;
+	}
+
+	// AF11 user data waits for its turn behind the relayed packets, which carry no traffic class
+	peermgtSetUserdataTOS(mgt, 0x28);
+	if(!peermgtSendUserdata(mgt, &msg, NULL, p3, mgt->data[p3].conntime)) return 0;
+	if((peermgtTestsuiteNextFlow(mgt, p1, &tos) != p1) || (tos != 0)) return 0;
+	while((i = peermgtTestsuiteNextFlow(mgt, p1, &tos)) == p1) {
+		if(tos != 0) return 0;
+	}
+	if((i != 0) || (tos != 0x28)) return 0;
+
+	// EF user data is not bundled and goes out before the remaining relayed packets
+	peermgtSetUserdataTOS(mgt, 0xb8);
+	if(peermgtTestsuiteBundle(teststate, 0, 3, "ef bundle")) return 0;
+	if(!(mgt->data[p1].relayqlen > 0)) return 0;
+	if(!peermgtSendUserdata(mgt, &msg, NULL, p3, mgt->data[p3].conntime)) return 0;
+	if((peermgtTestsuiteNextFlow(mgt, p1, &tos) != 0) || (tos != 0xb8)) return 0;
+
+	// frames of another traffic class are not added to a pending bundle
+	peermgtSetUserdataTOS(mgt, 0x00);
+	if(!peermgtTestsuiteBundle(teststate, 0, 3, "be")) return 0;
+	peermgtSetUserdataTOS(mgt, 0x28);
+	if(peermgtTestsuiteBundle(teststate, 0, 3, "af11")) return 0;
+	peermgtSetUserdataTOS(mgt, 0x00);
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	peermgtFlushBundle(mgt);
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if((teststate->recvlen[3] != 2) || (memcmp(teststate->recvmsg[3], "be", 2) != 0)) return 0;
+
+	printf("DSCP test ok\n");
+	return 1;
+}
+
+
+// Run the path probes of a peer manager and return the number of queued pings.
+static int peermgtTestsuiteProbe(struct s_peermgt *mgt) {
+	int count = mgt->ctrlqcount;
+	mgt->probetime = 0;
+	peermgtProbePeers(mgt);
+	return (mgt->ctrlqcount - count);
+}
+
+
+// Check that idle peers are only probed at the keepalive interval and that a peer with user data fails over to a relay and back.
+static int peermgtTestsuiteFailover(struct s_peermgt_test *teststate) {
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr;
+	int64_t tnowms;
+	int interval;
+	int p1;
+	int p2;
+
+	peermgtTestsuiteResetAll(teststate);
+	if(!peermgtTestsuiteConnect(teststate, 1, 0)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 2, 0)) return 0;
+	if(!peermgtTestsuiteConnect(teststate, 2, 1)) return 0;
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	peermgtSetProbeInterval(mgt, 100);
+	interval = mgt->probeinterval;
+	p1 = peermgtTestsuitePeerID(teststate, 0, 1);
+	p2 = peermgtTestsuitePeerID(teststate, 0, 2);
+
+	// node 1 is reachable through node 2
+	if(!peermgtGetNodeID(mgt, &nodeid, p1)) return 0;
+	addr = mgt->data[p2].remoteaddr;
+	peeraddrSetIndirect(&addr, p2, mgt->data[p2].conntime, peermgtTestsuitePeerID(teststate, 2, 1));
+	nodedbUpdate(&mgt->relaydb, &nodeid, &addr, 1, 0, 0);
+
+	// an idle peer is not probed at the probe interval, only at the keepalive interval
+	tnowms = utilGetClockMs();
+	mgt->data[p1].lastrecvms = (tnowms - (2 * interval));
+	mgt->data[p2].lastrecvms = (tnowms - (2 * interval));
+	if(peermgtTestsuiteProbe(mgt) != 0) return 0;
+	mgt->data[p2].lastrecvms = (tnowms - peermgt_PROBE_IDLE_INTERVAL);
+	if(peermgtTestsuiteProbe(mgt) != 1) return 0;
+	if((mgt->data[p2].failover) || (peeraddrIsInternal(&mgt->data[p2].remoteaddr))) return 0;
+
+	// a peer with user data gets a full detection time, then it is probed and switched to the relay
+	peermgtTestsuiteSetLink(teststate, 0, 1, 0);
+	if(peermgtTestsuiteSend(teststate, 0, 1, "lost")) return 0;
+	if(peermgtTestsuiteProbe(mgt) != 0) return 0;
+	tnowms = utilGetClockMs();
+	mgt->data[p1].activems = (tnowms - (2 * interval));
+	mgt->data[p1].lastrecvms = (tnowms - (2 * interval));
+	if(peermgtTestsuiteProbe(mgt) != 1) return 0;
+	mgt->data[p1].activems = (tnowms - (3 * interval));
+	mgt->data[p1].lastrecvms = (tnowms - (3 * interval));
+	peermgtTestsuiteProbe(mgt);
+	if((!mgt->data[p1].failover) || (!peeraddrIsInternal(&mgt->data[p1].remoteaddr))) return 0;
+	if(!peermgtTestsuiteSend(teststate, 0, 1, "relayed")) return 0;
+
+	// the direct path is used again as soon as it answers
+	peermgtTestsuiteSetLink(teststate, 0, 1, 1);
+	mgt->data[p1].lastrecover = 0;
+	peermgtTestsuiteProbe(mgt);
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	if((mgt->data[p1].failover) || (peeraddrIsInternal(&mgt->data[p1].remoteaddr))) return 0;
+	if(!peermgtTestsuiteSend(teststate, 0, 1, "direct")) return 0;
+
+	printf("failover test ok\n");
+	return 1;
+}
+
+
+// Check the RTT and jitter estimate and that relays are compared by SRTT plus jitter.
+static int peermgtTestsuiteRTT(struct s_peermgt_test *teststate) {
+	struct s_peermgt *mgt = &teststate->peermgts[0];
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr2;
+	struct s_peeraddr addr3;
+	char report[4096];
+	char hex[9];
+	char *line;
+	int best;
+	int p1;
+	int p2;
+	int p3;
+	int i;
+
+	peermgtTestsuiteResetAll(teststate);
+	for(i=1; i<4; i++) {
+		if(!peermgtTestsuiteConnect(teststate, i, 0)) return 0;
+	}
+	if(!peermgtTestsuiteRoute(teststate, 4)) return 0;
+	p1 = peermgtTestsuitePeerID(teststate, 0, 1);
+	p2 = peermgtTestsuitePeerID(teststate, 0, 2);
+	p3 = peermgtTestsuitePeerID(teststate, 0, 3);
+
+	// node 1 is reachable through node 2 and node 3
+	if(!peermgtGetNodeID(mgt, &nodeid, p1)) return 0;
+	addr2 = mgt->data[p2].remoteaddr;
+	peeraddrSetIndirect(&addr2, p2, mgt->data[p2].conntime, 1);
+	nodedbUpdate(&mgt->relaydb, &nodeid, &addr2, 1, 0, 0);
+	addr3 = mgt->data[p3].remoteaddr;
+	peeraddrSetIndirect(&addr3, p3, mgt->data[p3].conntime, 1);
+	nodedbUpdate(&mgt->relaydb, &nodeid, &addr3, 1, 0, 0);
+
+	// the first sample sets the jitter to half the RTT, later samples are smoothed
+	peermgtSetRemoteAddr(mgt, p1, &addr2);
+	peermgtUpdateRTT(mgt, p1, 40);
+	if((mgt->data[p1].srtt != 40) || (mgt->data[p1].jitter != 20)) return 0;
+	peermgtUpdateRTT(mgt, p1, 56);
+	if((mgt->data[p1].srtt != 42) || (mgt->data[p1].jitter != 19)) return 0;
+
+	// the relay through node 2 has the lower SRTT but varies a lot, the relay through node 3 is stable
+	for(i=0; i<32; i++) {
+		peermgtUpdateRTT(mgt, p1, ((i % 2) ? 70 : 10));
+		nodedbUpdateRTT(&mgt->relaydb, &nodeid, &addr3, 50);
+	}
+	if(!(mgt->data[p1].srtt < 50)) return 0;
+	if(!((mgt->data[p1].srtt + mgt->data[p1].jitter) > 65)) return 0;
+	best = peermgtGetBestRelay(mgt, &nodeid, p1, -1, NULL);
+	if((best < 0) || (memcmp(nodedbGetNodeAddress(&mgt->relaydb, best)->addr, addr3.addr, peeraddr_SIZE) != 0)) return 0;
+
+	// the jitter is reported next to the SRTT
+	peermgtStatus(mgt, report, 4096);
+	if(memcmp(&report[170], "Jitter\n", 7) != 0) return 0;
+	sprintf(hex, "%08X", p1);
+	line = report;
+	while((line = strchr(line, '\n')) != NULL) {
+		line++;
+		if(memcmp(line, hex, 8) == 0) break;
+	}
+	if(line == NULL) return 0;
+	sprintf(hex, "%08X", mgt->data[p1].jitter);
+	if((memcmp(&line[170], hex, 8) != 0) || (line[178] != '\n')) return 0;
+
+	// the measurement switches node 1 to the stable relay and does not switch back
+	mgt->data[p1].lastrtt = 0;
+	mgt->rtttime = 0;
+	peermgtMeasurePeers(mgt, utilGetClock());
+	if(memcmp(mgt->data[p1].remoteaddr.addr, addr3.addr, peeraddr_SIZE) != 0) return 0;
+	for(i=0; i<4; i++) peermgtUpdateRTT(mgt, p1, 50);
+	mgt->data[p1].lastrtt = 0;
+	mgt->rtttime = 0;
+	peermgtMeasurePeers(mgt, utilGetClock());
+	if(memcmp(mgt->data[p1].remoteaddr.addr, addr3.addr, peeraddr_SIZE) != 0) return 0;
+
+	printf("RTT test ok\n");
+	return 1;
+}
+
+
+// Let all nodes connect to node 0 and print the state of the mesh.
+static int peermgtTestsuiteMesh(struct s_peermgt_test *teststate) {
 	unsigned char pbuf[4096];
 	char text[4096];
 	int len;
@@ -148,11 +1213,7 @@ static int peermgtTestsuiteRun(struct s_peermgt_test *teststate) {
 			*/
 			case 100:
 				// reset node 3
-				peermgtInit(&teststate->peermgts[3]);
-				peermgtSetFastauth(&teststate->peermgts[3], 1);
-				peermgtSetLoopback(&teststate->peermgts[3], 0);
-				peermgtSetFragmentation(&teststate->peermgts[3], 1);
-				peermgtSetNetID(&teststate->peermgts[3], "testnet", 7);
+				peermgtTestsuiteReset(teststate, 3);
 				break;
 			case 103:
 				// reconnect node 3
@@ -206,6 +1267,27 @@ static int peermgtTestsuiteRun(struct s_peermgt_test *teststate) {
 }
 
 
+static int peermgtTestsuiteRun(struct s_peermgt_test *teststate) {
+	if(!peermgtTestsuiteResume(teststate)) return 0;
+	if(!peermgtTestsuiteCookies(teststate)) return 0;
+	if(!peermgtTestsuiteAuthIndex(teststate)) return 0;
+	if(!peermgtTestsuiteConnectBudget(teststate)) return 0;
+	if(!peermgtTestsuiteRace(teststate)) return 0;
+	if(!peermgtTestsuiteDelta(teststate)) return 0;
+	if(!peermgtTestsuiteGroupKey(teststate)) return 0;
+	if(!peermgtTestsuiteBroadcastTree(teststate)) return 0;
+	if(!peermgtTestsuiteMacAdvert(teststate)) return 0;
+	if(!peermgtTestsuiteBundling(teststate)) return 0;
+	if(!peermgtTestsuiteCryptPool(teststate)) return 0;
+	if(!peermgtTestsuiteScheduler(teststate)) return 0;
+	if(!peermgtTestsuiteDSCP(teststate)) return 0;
+	if(!peermgtTestsuiteFailover(teststate)) return 0;
+	if(!peermgtTestsuiteRTT(teststate)) return 0;
+	peermgtTestsuiteResetAll(teststate);
+	return peermgtTestsuiteMesh(teststate);
+}
+
+
 static int peermgtTestsuitePrepare(struct s_peermgt_test *teststate) {
 	int count;
 	int ret = 0;
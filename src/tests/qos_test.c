@@ -0,0 +1,95 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_QOS_TEST_C
+#define F_QOS_TEST_C
+
+
+#include "qos.c"
+#include <stdio.h>
+
+
+// Get TOS of frame and compare the result.
+static int qosTestsuiteCheck(const char *name, const unsigned char *frame, const int frame_len, const int l2, const int tos) {
+	int ret = qosGetTOS(frame, frame_len, l2);
+	printf("qosTestsuite: %s -> 0x%02x (expected 0x%02x)\n", name, ret, tos);
+	return (ret == tos);
+}
+
+
+static int qosTestsuite() {
+	unsigned char frame[64];
+
+	printf("qosTestsuite started\n");
+	memset(frame, 0, 64);
+
+	// IPv4 packet with DSCP EF and ECN bits set
+	frame[0] = 0x45;
+	frame[1] = 0xbb;
+	if(!qosTestsuiteCheck("ipv4", frame, 20, 0, 0xb8)) return 0;
+
+	// IPv6 packet with DSCP AF41 and ECN bits set
+	frame[0] = 0x68;
+	frame[1] = 0xb3;
+	if(!qosTestsuiteCheck("ipv6", frame, 40, 0, 0x88)) return 0;
+
+	// not an IP packet
+	frame[0] = 0x00;
+	if(!qosTestsuiteCheck("no ip", frame, 40, 0, 0)) return 0;
+	if(!qosTestsuiteCheck("short", frame, 1, 0, 0)) return 0;
+
+	// ethernet frame with IPv4 packet
+	memset(frame, 0, 64);
+	frame[12] = 0x08;
+	frame[13] = 0x00;
+	frame[14] = 0x45;
+	frame[15] = 0x28;
+	if(!qosTestsuiteCheck("eth ipv4", frame, 34, 1, 0x28)) return 0;
+
+	// QinQ tagged ethernet frame with IPv6 packet
+	memset(frame, 0, 64);
+	frame[12] = 0x88;
+	frame[13] = 0xa8;
+	frame[16] = 0x81;
+	frame[17] = 0x00;
+	frame[20] = 0x86;
+	frame[21] = 0xdd;
+	frame[22] = 0x6b;
+	frame[23] = 0x80;
+	if(!qosTestsuiteCheck("eth qinq ipv6", frame, 62, 1, 0xb8)) return 0;
+
+	// ARP frame
+	memset(frame, 0, 64);
+	frame[12] = 0x08;
+	frame[13] = 0x06;
+	frame[14] = 0x45;
+	frame[15] = 0x28;
+	if(!qosTestsuiteCheck("eth arp", frame, 42, 1, 0)) return 0;
+
+	// truncated ethernet frame
+	if(!qosTestsuiteCheck("eth short", frame, 10, 1, 0)) return 0;
+
+	printf("qosTestsuite ok\n");
+	return 1;
+}
+
+
+#endif // F_QOS_TEST_C
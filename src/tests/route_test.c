@@ -0,0 +1,175 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_ROUTE_TEST_C
+#define F_ROUTE_TEST_C
+
+
+#include "route.c"
+#include <stdio.h>
+
+
+// Parse prefix and compare the result. A negative plen means the string has to be rejected.
+static int routeTestsuiteParse(const char *str, const int host, const int plen) {
+	unsigned char prefix[route_ADDR_SIZE];
+	int len = -1;
+	int ret;
+	ret = routeParsePrefix(prefix, &len, str, strlen(str), host);
+	printf("routeTestsuite: parse \"%s\" (host=%d) -> ", str, host);
+	if(ret) printf("/%d\n", len); else printf("rejected\n");
+	if(plen < 0) return (!ret);
+	return (ret && (len == plen));
+}
+
+
+// Append prefix to an advertisement. Returns the new length of the advertisement.
+static int routeTestsuiteAdvertAdd(unsigned char *advert, const int advert_len, const char *str) {
+	int plen;
+	if(!routeParsePrefix(&advert[advert_len + 1], &plen, str, strlen(str), 0)) return advert_len;
+	advert[advert_len] = plen;
+	return (advert_len + route_ADVERT_ENTRYSIZE);
+}
+
+
+// Look up the route of an IPv4 or IPv6 destination address. Returns the PortID, or -1 if there is no route.
+static int routeTestsuiteLookup(struct s_route_state *routestate, const char *addr) {
+	unsigned char packet[40];
+	int portid;
+	int portts;
+	memset(packet, 0, 40);
+	if(inet_pton(AF_INET, addr, &packet[16]) == 1) {
+		packet[0] = 0x45;
+	}
+	else if(inet_pton(AF_INET6, addr, &packet[24]) == 1) {
+		packet[0] = 0x60;
+	}
+	else {
+		return -1;
+	}
+	if(!routePacketOut(routestate, packet, 40, &portid, &portts)) return -1;
+	return portid;
+}
+
+
+// Check the route of a destination address.
+static int routeTestsuiteExpect(struct s_route_state *routestate, const char *addr, const int portid) {
+	int ret = routeTestsuiteLookup(routestate, addr);
+	printf("routeTestsuite: route %s -> %d (expected %d)\n", addr, ret, portid);
+	return (ret == portid);
+}
+
+
+// Test the prefix parser.
+static int routeTestsuiteParser() {
+	if(!routeTestsuiteParse("10.1.2.3/8", 0, (8 + route_IPV4_OFFSET))) return 0;
+	if(!routeTestsuiteParse("10.1.2.3", 0, (32 + route_IPV4_OFFSET))) return 0;
+	if(!routeTestsuiteParse("10.1.2.3/8", 1, (32 + route_IPV4_OFFSET))) return 0;
+	if(!routeTestsuiteParse("0.0.0.0/0", 0, route_IPV4_OFFSET)) return 0;
+	if(!routeTestsuiteParse("2001:db8::/32", 0, 32)) return 0;
+	if(!routeTestsuiteParse("2001:db8::1", 0, 128)) return 0;
+	if(!routeTestsuiteParse("::/0", 0, 0)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/33", 0, -1)) return 0;
+	if(!routeTestsuiteParse("2001:db8::/129", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/abc", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/24x", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/-8", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0.0/99999999999", 0, -1)) return 0;
+	if(!routeTestsuiteParse("10.0.0/8", 0, -1)) return 0;
+	if(!routeTestsuiteParse("", 0, -1)) return 0;
+	return 1;
+}
+
+
+// Test longest prefix match, withdrawal and compaction of the trie.
+static int routeTestsuiteTrie() {
+	struct s_route_state routestate;
+	unsigned char advert[peermgt_ROUTEADV_SIZE];
+	char addr[32];
+	int len;
+	int i;
+
+	if(!routeCreate(&routestate)) return 0;
+
+	len = 0;
+	len = routeTestsuiteAdvertAdd(advert, len, "10.0.0.0/8");
+	routeAdvertIn(&routestate, advert, len, 1, 1);
+	len = 0;
+	len = routeTestsuiteAdvertAdd(advert, len, "10.1.0.0/16");
+	len = routeTestsuiteAdvertAdd(advert, len, "2001:db8::/32");
+	routeAdvertIn(&routestate, advert, len, 2, 1);
+	len = 0;
+	len = routeTestsuiteAdvertAdd(advert, len, "0.0.0.0/0");
+	routeAdvertIn(&routestate, advert, len, 3, 1);
+
+	// longest prefix wins
+	if(!routeTestsuiteExpect(&routestate, "10.1.2.3", 2)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "10.2.0.1", 1)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "192.168.0.1", 3)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "2001:db8::1", 2)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "2001:db9::1", -1)) return 0;
+
+	// a new advertisement replaces the routes of the peer
+	len = 0;
+	len = routeTestsuiteAdvertAdd(advert, len, "2001:db8::/32");
+	routeAdvertIn(&routestate, advert, len, 2, 1);
+	if(!routeTestsuiteExpect(&routestate, "10.1.2.3", 1)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "2001:db8::1", 2)) return 0;
+
+	// an advertisement without complete entries withdraws all routes of the peer
+	advert[0] = 0;
+	routeAdvertIn(&routestate, advert, 1, 2, 1);
+	if(!routeTestsuiteExpect(&routestate, "2001:db8::1", -1)) return 0;
+
+	// withdrawn nodes are freed when the node pool runs out
+	for(i=0; i<(route_NODE_MAX * 2); i++) {
+		snprintf(addr, 32, "172.16.%d.%d/32", ((i >> 8) & 0xff), (i & 0xff));
+		len = 0;
+		len = routeTestsuiteAdvertAdd(advert, len, addr);
+		routeAdvertIn(&routestate, advert, len, 4, 1);
+	}
+	if(!(routestate.nodecount < route_NODE_MAX)) return 0;
+	snprintf(addr, 32, "172.16.%d.%d", (((i - 1) >> 8) & 0xff), ((i - 1) & 0xff));
+	if(!routeTestsuiteExpect(&routestate, addr, 4)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "172.16.0.0", 3)) return 0;
+	if(!routeTestsuiteExpect(&routestate, "10.2.0.1", 1)) return 0;
+
+	routeDestroy(&routestate);
+	return 1;
+}
+
+
+static int routeTestsuite() {
+	printf("routeTestsuite started\n");
+	if(!routeTestsuiteParser()) {
+		printf("routeTestsuite failed!\n");
+		return 0;
+	}
+	if(!routeTestsuiteTrie()) {
+		printf("routeTestsuite failed!\n");
+		return 0;
+	}
+	printf("routeTestsuite ok\n");
+	return 1;
+}
+
+
+#endif // F_ROUTE_TEST_C
@@ -0,0 +1,245 @@
+/*
+ * MeshVPN - A open source peer-to-peer VPN (forked from PeerVPN)
+ *
+ * Copyright (C) 2012-2016  Tobias Volk <mail@tobiasvolk.de>
+ * Copyright (C) 2016       Hideman Developer <company@hideman.net>
+ * Copyright (C) 2017       Benjamin Kübler <b.kuebler@kuebler-it.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef F_SWITCH_TEST_C
+#define F_SWITCH_TEST_C
+
+
+#include "switch.c"
+#include <stdio.h>
+
+
+// Generate a frame header with a unicast source MAC derived from the PortID.
+static void switchTestsuiteHeader(unsigned char *frame, const unsigned char *dstmac, const int portid, const int ethertype) {
+	memset(frame, 0, 128);
+	memcpy(&frame[0], dstmac, switch_MACADDR_SIZE);
+	memcpy(&frame[6], "\x02\x00\x00\x00\x00", 5);
+	frame[11] = portid;
+	frame[12] = (ethertype >> 8);
+	frame[13] = (ethertype & 0xff);
+}
+
+
+// Generate an IPv4 frame. Protocol 2 makes it an IGMP message, its type and group are written at offset 34.
+static int switchTestsuiteIPv4(unsigned char *frame, const int portid, const int proto, const int igmptype, const unsigned char *group) {
+	unsigned char dstmac[switch_MACADDR_SIZE];
+	switchMcastIPv4ToMac(dstmac, group);
+	switchTestsuiteHeader(frame, dstmac, portid, 0x0800);
+	frame[14] = 0x45;
+	frame[23] = proto;
+	memcpy(&frame[30], group, 4);
+	frame[34] = igmptype;
+	memcpy(&frame[38], group, 4);
+	return 60;
+}
+
+
+// Generate an IGMPv3 report with one group record.
+static int switchTestsuiteIGMPv3(unsigned char *frame, const int portid, const int rtype, const int sources, const unsigned char *group) {
+	switchTestsuiteIPv4(frame, portid, 2, 0x22, (const unsigned char *)"\xe0\x00\x00\x16");
+	memset(&frame[38], 0, 4);
+	frame[41] = 1;
+	frame[42] = rtype;
+	frame[45] = sources;
+	memcpy(&frame[46], group, 4);
+	return (50 + (sources * 4));
+}
+
+
+// Generate an MLDv2 report with one group record, carried behind a hop-by-hop options header.
+static int switchTestsuiteMLDv2(unsigned char *frame, const int portid, const int rtype, const unsigned char *group) {
+	switchTestsuiteHeader(frame, (const unsigned char *)"\x33\x33\x00\x00\x00\x16", portid, 0x86dd);
+	frame[14] = 0x60;
+	frame[20] = 0;
+	frame[54] = 0x3a;
+	frame[62] = 143;
+	frame[69] = 1;
+	frame[70] = rtype;
+	memcpy(&frame[74], group, 16);
+	return 90;
+}
+
+
+// Check type of outgoing frame and the ports returned for it.
+static int switchTestsuiteExpect(struct s_switch_state *switchstate, const char *name, const unsigned char *frame, const int frame_len, const int type, const int *ports, const int count) {
+	int portid[switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS];
+	int portts[switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS];
+	int outtype;
+	int n;
+	int i;
+	int j;
+	outtype = switchFrameOut(switchstate, frame, frame_len, &portid[0], &portts[0]);
+	n = (outtype == switch_FRAME_TYPE_MULTICAST) ? switchMcastMembers(switchstate, frame, frame_len, portid, portts, (switch_MCAST_MAXMEMBERS + switch_MCAST_MAXROUTERS)) : 0;
+	printf("switchTestsuite: %s: type %d (expected %d), %d ports (expected %d)\n", name, outtype, type, n, count);
+	if((outtype != type) || (n != count)) return 0;
+	for(i=0; i<count; i++) {
+		for(j=0; j<n; j++) {
+			if((portid[j] == ports[i]) && (portts[j] == (ports[i] * 10))) break;
+		}
+		if(j == n) return 0;
+	}
+	return 1;
+}
+
+
+// Test IGMP and MLD snooping.
+static int switchTestsuiteSnoop() {
+	struct s_switch_state switchstate;
+	struct s_switch_mcast_entry *mcastentry;
+	unsigned char frame[128];
+	unsigned char macaddr[switch_MACADDR_SIZE];
+	const unsigned char *group = (const unsigned char *)"\xef\x01\x02\x03";
+	const unsigned char *group6 = (const unsigned char *)"\xff\x05\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01\x00\x03";
+	int ports[4];
+	int len;
+	int i;
+
+	if(!switchCreate(&switchstate)) return 0;
+
+	// snooping is off by default, reports are not learned
+	len = switchTestsuiteIPv4(frame, 3, 2, 0x16, group);
+	switchFrameIn(&switchstate, frame, len, 3, 30);
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, group);
+	if(!switchTestsuiteExpect(&switchstate, "snooping off", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+	switchSetMcastSnooping(&switchstate, 1);
+	if(!switchTestsuiteExpect(&switchstate, "unknown group", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+
+	// IGMPv2 and IGMPv3 reports add members, the reports themselves are flooded
+	len = switchTestsuiteIPv4(frame, 3, 2, 0x16, group);
+	if(!switchTestsuiteExpect(&switchstate, "IGMPv2 report", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+	switchFrameIn(&switchstate, frame, len, 3, 30);
+	len = switchTestsuiteIGMPv3(frame, 4, 1, 1, group);
+	switchFrameIn(&switchstate, frame, len, 4, 40);
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, group);
+	ports[0] = 3; ports[1] = 4;
+	if(!switchTestsuiteExpect(&switchstate, "two members", frame, len, switch_FRAME_TYPE_MULTICAST, ports, 2)) return 0;
+
+	// queries make router ports that receive all snooped groups
+	len = switchTestsuiteIPv4(frame, 9, 2, 0x11, (const unsigned char *)"\xe0\x00\x00\x01");
+	memset(&frame[38], 0, 4);
+	switchFrameIn(&switchstate, frame, len, 9, 90);
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, group);
+	ports[2] = 9;
+	if(!switchTestsuiteExpect(&switchstate, "members and router", frame, len, switch_FRAME_TYPE_MULTICAST, ports, 3)) return 0;
+
+	// link-local groups are always flooded
+	len = switchTestsuiteIPv4(frame, 5, 2, 0x16, (const unsigned char *)"\xe0\x00\x00\xfb");
+	switchFrameIn(&switchstate, frame, len, 5, 50);
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, (const unsigned char *)"\xe0\x00\x00\xfb");
+	if(!switchTestsuiteExpect(&switchstate, "link-local group", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+
+	// a leave only shortens the membership
+	len = switchTestsuiteIGMPv3(frame, 4, 3, 0, group);
+	switchFrameIn(&switchstate, frame, len, 4, 40);
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, group);
+	if(!switchTestsuiteExpect(&switchstate, "after leave", frame, len, switch_FRAME_TYPE_MULTICAST, ports, 3)) return 0;
+	switchMcastIPv4ToMac(macaddr, group);
+	mcastentry = mapGet(&switchstate.mcasttable, macaddr);
+	if(mcastentry == NULL) return 0;
+	for(i=0; i<mcastentry->count; i++) {
+		if(mcastentry->member[i].portid == 4) mcastentry->member[i].ents = mcastentry->member[i].ents - switch_MCAST_LEAVETIMEOUT;
+	}
+	ports[1] = 9;
+	if(!switchTestsuiteExpect(&switchstate, "leave expired", frame, len, switch_FRAME_TYPE_MULTICAST, ports, 2)) return 0;
+
+	// too many members make the group flood
+	for(i=0; i<switch_MCAST_MAXMEMBERS; i++) {
+		len = switchTestsuiteIPv4(frame, (20 + i), 2, 0x16, group);
+		switchFrameIn(&switchstate, frame, len, (20 + i), ((20 + i) * 10));
+	}
+	len = switchTestsuiteIPv4(frame, 1, 17, 0, group);
+	if(!switchTestsuiteExpect(&switchstate, "member overflow", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+
+	// MLDv2 reports add members, solicited-node groups are always flooded
+	len = switchTestsuiteMLDv2(frame, 6, 4, group6);
+	if(!switchTestsuiteExpect(&switchstate, "MLDv2 report", frame, len, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+	switchFrameIn(&switchstate, frame, len, 6, 60);
+	switchTestsuiteHeader(frame, (const unsigned char *)"\x33\x33\x00\x01\x00\x03", 1, 0x86dd);
+	ports[0] = 6; ports[1] = 9;
+	if(!switchTestsuiteExpect(&switchstate, "MLD member and router", frame, 60, switch_FRAME_TYPE_MULTICAST, ports, 2)) return 0;
+	len = switchTestsuiteMLDv2(frame, 6, 4, (const unsigned char *)"\xff\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01\xff\x00\x00\x01");
+	switchFrameIn(&switchstate, frame, len, 6, 60);
+	switchTestsuiteHeader(frame, (const unsigned char *)"\x33\x33\xff\x00\x00\x01", 1, 0x86dd);
+	if(!switchTestsuiteExpect(&switchstate, "solicited-node group", frame, 60, switch_FRAME_TYPE_BROADCAST, ports, 0)) return 0;
+
+	// remote IGMPv2 reports are only written to the TAP device if a local querier exists
+	len = switchTestsuiteIPv4(frame, 3, 2, 0x16, group);
+	if(switchMcastDeliverIn(&switchstate, frame, len)) return 0;
+	len = switchTestsuiteIPv4(frame, 1, 2, 0x11, (const unsigned char *)"\xe0\x00\x00\x01");
+	memset(&frame[38], 0, 4);
+	switchLocalFrameIn(&switchstate, frame, len);
+	len = switchTestsuiteIPv4(frame, 3, 2, 0x16, group);
+	if(!switchMcastDeliverIn(&switchstate, frame, len)) return 0;
+
+	switchDestroy(&switchstate);
+	return 1;
+}
+
+
+// Test learning from MAC advertisements.
+static int switchTestsuiteMacAdvert() {
+	struct s_switch_state switchstate;
+	unsigned char frame[128];
+	int portid;
+	int portts;
+
+	if(!switchCreate(&switchstate)) return 0;
+	switchTestsuiteHeader(frame, (const unsigned char *)"\x02\x00\x00\x00\x00\x0a", 1, 0x0800);
+
+	// the padding byte of an empty advertisement contains no entry
+	switchMacAdvertIn(&switchstate, (const unsigned char *)"\x00", 1, 3, 30);
+	if(mapGetKeyCount(&switchstate.mactable) != 0) return 0;
+
+	// advertised addresses are learned, multicast and local addresses are skipped
+	switchMacAdvertIn(&switchstate, (const unsigned char *)"\x02\x00\x00\x00\x00\x0a\x01\x00\x5e\x00\x00\x01", 12, 3, 30);
+	if(switchFrameOut(&switchstate, frame, 60, &portid, &portts) != switch_FRAME_TYPE_UNICAST) return 0;
+	if((portid != 3) || (portts != 30)) return 0;
+	if(mapGetKeyCount(&switchstate.mactable) != 1) return 0;
+	switchTestsuiteHeader(frame, (const unsigned char *)"\xff\xff\xff\xff\xff\xff", 11, 0x0800);
+	switchLocalFrameIn(&switchstate, frame, 60);
+	switchMacAdvertIn(&switchstate, (const unsigned char *)"\x02\x00\x00\x00\x00\x0b", 6, 3, 30);
+	if(mapGetKeyCount(&switchstate.mactable) != 1) return 0;
+
+	// frames seen from the new location take precedence over the advertisement of the old location
+	switchTestsuiteHeader(frame, (const unsigned char *)"\xff\xff\xff\xff\xff\xff", 10, 0x0800);
+	switchFrameIn(&switchstate, frame, 60, 4, 40);
+	switchMacAdvertIn(&switchstate, (const unsigned char *)"\x02\x00\x00\x00\x00\x0a", 6, 3, 30);
+	switchTestsuiteHeader(frame, (const unsigned char *)"\x02\x00\x00\x00\x00\x0a", 1, 0x0800);
+	if(switchFrameOut(&switchstate, frame, 60, &portid, &portts) != switch_FRAME_TYPE_UNICAST) return 0;
+	if((portid != 4) || (portts != 40)) return 0;
+
+	switchDestroy(&switchstate);
+	return 1;
+}
+
+
+static int switchTestsuite() {
+	printf("switchTestsuite started\n");
+	if((!switchTestsuiteSnoop()) || (!switchTestsuiteMacAdvert())) {
+		printf("switchTestsuite failed!\n");
+		return 0;
+	}
+	printf("switchTestsuite ok\n");
+	return 1;
+}
+
+
+#endif // F_SWITCH_TEST_C